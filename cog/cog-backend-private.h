@@ -0,0 +1,49 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include <aws/cognito-idp/CognitoIdentityProviderClient.h>
+#include <aws/core/client/ClientConfiguration.h>
+#include <aws/core/http/HttpClient.h>
+#include <aws/core/utils/memory/stl/AWSString.h>
+#include <aws/core/utils/threading/Executor.h>
+
+#include "cog/cog-retry-strategy-private.h"
+
+/* The AWS SDK service client behind a #CogClient, together with what it owns:
+ * its HTTP client and connection pool, its executor, and its retry strategy.
+ * Several #CogClients with the same configuration can share one backend, so
+ * that they reuse each other's connections; the backend lives as long as any
+ * of them does.
+ *
+ * Construct it with Aws::New() inside a #CogTransportScope, so that the
+ * service client gets the right HTTP client, and then set @network_client to
+ * the scope's network client, through which connections to @endpoint can be
+ * opened ahead of the service client's requests.
+ *
+ * An @anonymous backend has no AWS credentials, which also means that the
+ * SDK does not sign its requests. */
+struct CogBackend {
+  CogBackend (const Aws::Client::ClientConfiguration& config,
+              std::shared_ptr<CogRetryStrategy> retry_strategy,
+              bool anonymous);
+
+  Aws::CognitoIdentityProvider::CognitoIdentityProviderClient internal;
+  std::shared_ptr<Aws::Http::HttpClient> network_client;
+  Aws::String endpoint;
+  std::shared_ptr<Aws::Utils::Threading::Executor> executor;
+  std::shared_ptr<CogRetryStrategy> retry_strategy;
+};
+
+typedef std::shared_ptr<CogBackend> CogBackendRef;
+
+/* Returns the shared backend registered under @key, or if there is none, calls
+ * @make to create one and registers it until it is no longer used. Backends
+ * not created this way should be owned with Aws::MakeShared(). @key must
+ * describe everything that went into the backend's configuration.
+ * @make is called without any lock held, so threads that race to create the
+ * same backend may each call it; all of them get the one that is registered
+ * first, and the others are deleted. */
+CogBackendRef _cog_backend_get_shared (const Aws::String& key,
+                                       const std::function<CogBackend *(void)>& make);
@@ -0,0 +1,105 @@
+#include <string>
+#include <unordered_map>
+
+#include <aws/cognito-idp/CognitoIdentityProviderEndpoint.h>
+#include <aws/core/auth/AWSCredentialsProvider.h>
+#include <aws/core/auth/AWSCredentialsProviderChain.h>
+#include <aws/core/http/Scheme.h>
+#include <glib.h>
+
+#include "cog/cog-backend-private.h"
+#include "cog/cog-utils-private.h"
+
+/* Deliberately not allocated through the AWS SDK, which may not be initialized
+ * when static objects are constructed */
+static std::unordered_map<std::string, std::weak_ptr<CogBackend>> shared_backends;
+static GMutex shared_backends_lock;
+
+static std::shared_ptr<Aws::Auth::AWSCredentialsProvider>
+credentials_provider (bool anonymous)
+{
+  /* The default chain looks in the environment, in profile files, and at the
+   * EC2 instance metadata endpoint, which takes seconds without a network */
+  if (anonymous)
+    return Aws::MakeShared<Aws::Auth::AnonymousAWSCredentialsProvider> (_COG_ALLOCATION_TAG);
+  return Aws::MakeShared<Aws::Auth::DefaultAWSCredentialsProviderChain> (_COG_ALLOCATION_TAG);
+}
+
+/* The URL that the service client sends its requests to, worked out the same
+ * way as the service client does, so that it has the right domain outside
+ * the standard AWS partition, such as amazonaws.com.cn in China */
+static Aws::String
+service_endpoint (const Aws::Client::ClientConfiguration& config)
+{
+  Aws::String scheme = Aws::Http::SchemeMapper::ToString (config.scheme);
+  if (!config.endpointOverride.empty ())
+    {
+      if (config.endpointOverride.find ("://") != Aws::String::npos)
+        return config.endpointOverride;
+      return scheme + "://" + config.endpointOverride;
+    }
+
+  using Aws::CognitoIdentityProvider::CognitoIdentityProviderEndpoint::ForRegion;
+  return scheme + "://" + ForRegion (config.region, config.useDualStack) + "/";
+}
+
+CogBackend::CogBackend (const Aws::Client::ClientConfiguration& config,
+                        std::shared_ptr<CogRetryStrategy> retry_strategy,
+                        bool anonymous)
+  : internal (credentials_provider (anonymous), config),
+    endpoint (service_endpoint (config)),
+    executor (config.executor),
+    retry_strategy (std::move (retry_strategy))
+{
+}
+
+static CogBackendRef
+lookup_shared (const std::string& map_key)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&shared_backends_lock);
+  auto iter = shared_backends.find (map_key);
+  if (iter == shared_backends.end ())
+    return nullptr;
+  return iter->second.lock ();
+}
+
+CogBackendRef
+_cog_backend_get_shared (const Aws::String& key,
+                         const std::function<CogBackend *(void)>& make)
+{
+  std::string map_key (key.c_str (), key.size ());
+
+  CogBackendRef backend = lookup_shared (map_key);
+  if (backend)
+    return backend;
+
+  /* Creating the service client and its HTTP client is slow, so do it without
+   * holding up clients that want other backends */
+  CogBackendRef created (make (), [map_key] (CogBackend *unused)
+    {
+      g_mutex_lock (&shared_backends_lock);
+      /* A new backend may have been registered under the same key since the
+       * last reference to this one was dropped */
+      auto iter = shared_backends.find (map_key);
+      if (iter != shared_backends.end () && iter->second.expired ())
+        shared_backends.erase (iter);
+      g_mutex_unlock (&shared_backends_lock);
+
+      Aws::Delete (unused);
+    });
+
+  g_mutex_lock (&shared_backends_lock);
+  std::weak_ptr<CogBackend>& entry = shared_backends[map_key];
+  /* Another thread may have registered one while this one was being created;
+   * if so, use that one, and drop this one once the lock is released, since
+   * its deleter takes the lock */
+  backend = entry.lock ();
+  if (!backend)
+    {
+      entry = created;
+      backend = created;
+    }
+  g_mutex_unlock (&shared_backends_lock);
+
+  return backend;
+}
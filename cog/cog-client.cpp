@@ -7,38 +7,109 @@
  * directories and users.
  * You can authenticate a user to obtain tokens related to user identity and
  * access policies.
+ *
+ * Each API call comes in three versions.
+ * The plain version blocks until the request is complete.
+ * The `_async()` version calls its #GAsyncReadyCallback in the thread-default
+ * main context of the thread that started it, so that thread must be running
+ * a main loop.
+ * The `_direct()` version is for programs that have no main loop, such as
+ * servers using their own thread pools.
+ * It calls a plain C callback on whichever of the client's worker threads
+ * received the response; see #CogClient:executor for how many of those there
+ * are.
+ * If the request fails before it is sent, for example because too many are
+ * already queued, the callback is instead called on the calling thread before
+ * the `_direct()` function returns.
+ * The callback must not block for long, since the worker thread cannot send
+ * other requests while it runs.
+ *
+ * Cancelling the #GCancellable passed to any version aborts the request, even
+ * if it is already being sent, and frees its connection and worker thread.
+ * A request that is still waiting for a worker thread is dropped without being
+ * sent.
+ *
+ * To stay under the request-rate quotas of your user pool, you can limit the
+ * rate at which the client sends each category of request with
+ * cog_client_set_rate_limit().
+ * Requests over the limit then wait their turn on the client, or fail right
+ * away with %G_IO_ERROR_WOULD_BLOCK, instead of being throttled by the server.
  */
 
+#include <string.h>
+
 #include <aws/cognito-idp/CognitoIdentityProviderClient.h>
+#include <aws/cognito-idp/CognitoIdentityProviderErrors.h>
 #include <aws/cognito-idp/model/GetUserRequest.h>
 #include <aws/cognito-idp/model/InitiateAuthRequest.h>
+#include <aws/cognito-idp/model/RespondToAuthChallengeRequest.h>
 #include <aws/cognito-idp/model/SignUpRequest.h>
 #include <aws/cognito-idp/model/UpdateUserAttributesRequest.h>
+#include <aws/core/AmazonWebServiceRequest.h>
+#include <aws/core/http/HttpRequest.h>
 #include <aws/core/utils/Outcome.h>
+#include <aws/core/utils/memory/stl/AWSMap.h>
 #include <gio/gio.h>
 
 #include "cog/cog-analytics-metadata.h"
 #include "cog/cog-authentication-result.h"
+#include "cog/cog-backend-private.h"
 #include "cog/cog-boxed-private.h"
 #include "cog/cog-client.h"
+#include "cog/cog-completion-source-private.h"
 #include "cog/cog-enums.h"
+#include "cog/cog-executor.h"
+#include "cog/cog-executor-private.h"
+#include "cog/cog-login-private.h"
+#include "cog/cog-operation-stats-private.h"
+#include "cog/cog-prewarm-private.h"
+#include "cog/cog-rate-limiter-private.h"
+#include "cog/cog-request-monitor-private.h"
+#include "cog/cog-retry-strategy-private.h"
+#include "cog/cog-transport.h"
+#include "cog/cog-transport-private.h"
+#include "cog/cog-user-cache-private.h"
 #include "cog/cog-user-context-data.h"
+#include "cog/cog-user-private.h"
 #include "cog/cog-utils-private.h"
 #include "cog/cog-utils.h"
 
 #define GET_PRIVATE(o) (static_cast<CogClientPrivate *> (cog_client_get_instance_private (COG_CLIENT (o))))
 
+/* These are the AWS SDK's own defaults */
+#define DEFAULT_MAX_CONNECTIONS 25
+#define DEFAULT_CONNECT_TIMEOUT_MS 1000
+#define DEFAULT_REQUEST_TIMEOUT_MS 3000
+#define DEFAULT_TCP_KEEP_ALIVE_INTERVAL_MS 30000
+#define MIN_TCP_KEEP_ALIVE_INTERVAL_MS 15000
+#define DEFAULT_LOW_SPEED_LIMIT 1
+
+#define DEFAULT_USER_CACHE_MAX_SIZE (1024 * 1024)
+
+#define DEFAULT_COMPLETION_MAX_BATCH 64
+
+#define DEFAULT_MAX_ATTEMPTS 3
+#define DEFAULT_RETRY_BASE_DELAY_MS 50
+#define DEFAULT_RETRY_MAX_DELAY_MS 20000
+#define DEFAULT_RETRY_BUDGET 0.1
+
+#define N_QUOTA_CATEGORIES (COG_QUOTA_CATEGORY_USER_ACCOUNT_UPDATE + 1)
+
 using Aws::Client::AsyncCallerContext;
 using Aws::Client::ClientConfiguration;
 using Aws::CognitoIdentityProvider::CognitoIdentityProviderClient;
+using Aws::CognitoIdentityProvider::CognitoIdentityProviderErrors;
 using Aws::CognitoIdentityProvider::Model::AuthFlowType;
 using Aws::CognitoIdentityProvider::Model::AttributeType;
+using Aws::CognitoIdentityProvider::Model::ChallengeNameType;
 using Aws::CognitoIdentityProvider::Model::GetUserOutcome;
 using Aws::CognitoIdentityProvider::Model::GetUserRequest;
 using Aws::CognitoIdentityProvider::Model::GetUserResult;
 using Aws::CognitoIdentityProvider::Model::InitiateAuthOutcome;
 using Aws::CognitoIdentityProvider::Model::InitiateAuthRequest;
 using Aws::CognitoIdentityProvider::Model::InitiateAuthResult;
+using Aws::CognitoIdentityProvider::Model::RespondToAuthChallengeOutcome;
+using Aws::CognitoIdentityProvider::Model::RespondToAuthChallengeRequest;
 using Aws::CognitoIdentityProvider::Model::SignUpOutcome;
 using Aws::CognitoIdentityProvider::Model::SignUpRequest;
 using Aws::CognitoIdentityProvider::Model::SignUpResult;
@@ -54,10 +125,67 @@ public:
   GTask *task (void) const { return m_task; }
 };
 
+typedef Aws::UnorderedMap<Aws::String, GPtrArray *> GetUserFlights;
+
+typedef enum {
+  OPERATION_GET_USER,
+  OPERATION_INITIATE_AUTH,
+  OPERATION_RESPOND_TO_AUTH_CHALLENGE,
+  OPERATION_SIGN_UP,
+  OPERATION_UPDATE_USER_ATTRIBUTES,
+  N_OPERATIONS
+} ClientOperation;
+
+/* Keys of cog_client_get_statistics(), by ClientOperation */
+static const char * const operation_names[N_OPERATIONS] = {
+  "GetUser",
+  "InitiateAuth",
+  "RespondToAuthChallenge",
+  "SignUp",
+  "UpdateUserAttributes",
+};
+static GQuark operation_quarks[N_OPERATIONS];
+
 typedef struct
 {
-  CognitoIdentityProviderClient internal;
+  CogBackendRef backend;
+  /* Token buckets by CogQuotaCategory, or null if not limited */
+  std::shared_ptr<CogRateLimiter> rate_limiters[N_QUOTA_CATEGORIES];
+  GMutex rate_limiters_lock;
+  CogOperationStats operation_stats[N_OPERATIONS];
   CogRegion region;
+  CogExecutor *executor;
+  CogTransport *transport;
+  CogUserCache *user_cache;
+  /* Tasks waiting on each in-flight GetUser request, by access token */
+  GetUserFlights get_user_flights;
+  GMutex get_user_flights_lock;
+  /* Completion sources by GMainContext */
+  GHashTable *completion_sources;
+  GMutex completion_sources_lock;
+  CogCompletionCounters completion_counters;
+  unsigned completion_max_batch;
+  unsigned max_connections;
+  unsigned connect_timeout;
+  unsigned request_timeout;
+  unsigned tcp_keep_alive_interval;
+  unsigned low_speed_limit;
+  unsigned user_cache_ttl;
+  unsigned user_cache_stale_time;
+  unsigned user_cache_max_size;
+  unsigned max_attempts;
+  unsigned retry_base_delay;
+  unsigned retry_max_delay;
+  double retry_budget;
+  /* Of the last call to cog_client_prewarm_async() */
+  unsigned n_prewarm_connections;
+  unsigned long network_changed_id;
+  /* Keyed with the client secret, copied for each SECRET_HASH */
+  GHmac *secret_hmac;
+  bool tcp_keep_alive : 1;
+  bool shared_backend : 1;
+  bool anonymous : 1;
+  bool rewarming : 1;
 } CogClientPrivate;
 
 struct _CogClient {
@@ -66,11 +194,70 @@ struct _CogClient {
 
 G_DEFINE_TYPE_WITH_PRIVATE (CogClient, cog_client, G_TYPE_OBJECT)
 
+G_DEFINE_BOXED_TYPE (CogRequestMetrics, cog_request_metrics,
+                     cog_request_metrics_copy, cog_request_metrics_free)
+
+/**
+ * cog_request_metrics_copy:
+ * @self: a #CogRequestMetrics
+ *
+ * Returns: (transfer full): a copy of @self
+ */
+CogRequestMetrics *
+cog_request_metrics_copy (CogRequestMetrics *self)
+{
+  g_return_val_if_fail (self, NULL);
+  return g_slice_dup (CogRequestMetrics, self);
+}
+
+/**
+ * cog_request_metrics_free:
+ * @self: (transfer full): a #CogRequestMetrics
+ *
+ * Frees a #CogRequestMetrics returned by cog_request_metrics_copy().
+ */
+void
+cog_request_metrics_free (CogRequestMetrics *self)
+{
+  g_return_if_fail (self);
+  g_slice_free (CogRequestMetrics, self);
+}
+
 enum {
   PROP_REGION = 1,
+  PROP_EXECUTOR,
+  PROP_MAX_CONNECTIONS,
+  PROP_CONNECT_TIMEOUT,
+  PROP_REQUEST_TIMEOUT,
+  PROP_TCP_KEEP_ALIVE,
+  PROP_TCP_KEEP_ALIVE_INTERVAL,
+  PROP_LOW_SPEED_LIMIT,
+  PROP_TRANSPORT,
+  PROP_USER_CACHE_TTL,
+  PROP_USER_CACHE_STALE_TIME,
+  PROP_USER_CACHE_MAX_SIZE,
+  PROP_COMPLETION_MAX_BATCH,
+  PROP_MAX_ATTEMPTS,
+  PROP_RETRY_BASE_DELAY,
+  PROP_RETRY_MAX_DELAY,
+  PROP_RETRY_BUDGET,
+  PROP_SHARED_BACKEND,
+  PROP_ANONYMOUS,
+  PROP_REWARM_ON_NETWORK_CHANGE,
+  PROP_CLIENT_SECRET,
   N_PROPERTIES
 };
 
+enum {
+  REQUEST_COMPLETED,
+  N_SIGNALS
+};
+
+static unsigned signals[N_SIGNALS];
+
+static void client_set_rewarm_on_network_change (CogClient *self,
+                                                 bool rewarm);
+
 static void
 cog_client_set_property (GObject *object,
                          unsigned property_id,
@@ -84,6 +271,72 @@ cog_client_set_property (GObject *object,
     case PROP_REGION:
       priv->region = (CogRegion) g_value_get_enum (value);
       break;
+    case PROP_EXECUTOR:
+      priv->executor = COG_EXECUTOR (g_value_dup_object (value));
+      break;
+    case PROP_MAX_CONNECTIONS:
+      priv->max_connections = g_value_get_uint (value);
+      break;
+    case PROP_CONNECT_TIMEOUT:
+      priv->connect_timeout = g_value_get_uint (value);
+      break;
+    case PROP_REQUEST_TIMEOUT:
+      priv->request_timeout = g_value_get_uint (value);
+      break;
+    case PROP_TCP_KEEP_ALIVE:
+      priv->tcp_keep_alive = g_value_get_boolean (value);
+      break;
+    case PROP_TCP_KEEP_ALIVE_INTERVAL:
+      priv->tcp_keep_alive_interval = g_value_get_uint (value);
+      break;
+    case PROP_LOW_SPEED_LIMIT:
+      priv->low_speed_limit = g_value_get_uint (value);
+      break;
+    case PROP_TRANSPORT:
+      priv->transport = COG_TRANSPORT (g_value_dup_object (value));
+      break;
+    case PROP_USER_CACHE_TTL:
+      priv->user_cache_ttl = g_value_get_uint (value);
+      break;
+    case PROP_USER_CACHE_STALE_TIME:
+      priv->user_cache_stale_time = g_value_get_uint (value);
+      break;
+    case PROP_USER_CACHE_MAX_SIZE:
+      priv->user_cache_max_size = g_value_get_uint (value);
+      break;
+    case PROP_COMPLETION_MAX_BATCH:
+      priv->completion_max_batch = g_value_get_uint (value);
+      break;
+    case PROP_MAX_ATTEMPTS:
+      priv->max_attempts = g_value_get_uint (value);
+      break;
+    case PROP_RETRY_BASE_DELAY:
+      priv->retry_base_delay = g_value_get_uint (value);
+      break;
+    case PROP_RETRY_MAX_DELAY:
+      priv->retry_max_delay = g_value_get_uint (value);
+      break;
+    case PROP_RETRY_BUDGET:
+      priv->retry_budget = g_value_get_double (value);
+      break;
+    case PROP_SHARED_BACKEND:
+      priv->shared_backend = g_value_get_boolean (value);
+      break;
+    case PROP_ANONYMOUS:
+      priv->anonymous = g_value_get_boolean (value);
+      break;
+    case PROP_REWARM_ON_NETWORK_CHANGE:
+      client_set_rewarm_on_network_change (self, g_value_get_boolean (value));
+      break;
+    case PROP_CLIENT_SECRET:
+      {
+        const char *secret = g_value_get_string (value);
+        if (secret)
+          priv->secret_hmac = g_hmac_new (G_CHECKSUM_SHA256,
+                                          (const guchar *) secret,
+                                          strlen (secret));
+        break;
+      }
     default:
       /* We don't have any other property... */
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -104,6 +357,63 @@ cog_client_get_property (GObject *object,
     case PROP_REGION:
       g_value_set_enum (value, priv->region);
       break;
+    case PROP_EXECUTOR:
+      g_value_set_object (value, priv->executor);
+      break;
+    case PROP_MAX_CONNECTIONS:
+      g_value_set_uint (value, priv->max_connections);
+      break;
+    case PROP_CONNECT_TIMEOUT:
+      g_value_set_uint (value, priv->connect_timeout);
+      break;
+    case PROP_REQUEST_TIMEOUT:
+      g_value_set_uint (value, priv->request_timeout);
+      break;
+    case PROP_TCP_KEEP_ALIVE:
+      g_value_set_boolean (value, priv->tcp_keep_alive);
+      break;
+    case PROP_TCP_KEEP_ALIVE_INTERVAL:
+      g_value_set_uint (value, priv->tcp_keep_alive_interval);
+      break;
+    case PROP_LOW_SPEED_LIMIT:
+      g_value_set_uint (value, priv->low_speed_limit);
+      break;
+    case PROP_TRANSPORT:
+      g_value_set_object (value, priv->transport);
+      break;
+    case PROP_USER_CACHE_TTL:
+      g_value_set_uint (value, priv->user_cache_ttl);
+      break;
+    case PROP_USER_CACHE_STALE_TIME:
+      g_value_set_uint (value, priv->user_cache_stale_time);
+      break;
+    case PROP_USER_CACHE_MAX_SIZE:
+      g_value_set_uint (value, priv->user_cache_max_size);
+      break;
+    case PROP_COMPLETION_MAX_BATCH:
+      g_value_set_uint (value, priv->completion_max_batch);
+      break;
+    case PROP_MAX_ATTEMPTS:
+      g_value_set_uint (value, priv->max_attempts);
+      break;
+    case PROP_RETRY_BASE_DELAY:
+      g_value_set_uint (value, priv->retry_base_delay);
+      break;
+    case PROP_RETRY_MAX_DELAY:
+      g_value_set_uint (value, priv->retry_max_delay);
+      break;
+    case PROP_RETRY_BUDGET:
+      g_value_set_double (value, priv->retry_budget);
+      break;
+    case PROP_SHARED_BACKEND:
+      g_value_set_boolean (value, priv->shared_backend);
+      break;
+    case PROP_ANONYMOUS:
+      g_value_set_boolean (value, priv->anonymous);
+      break;
+    case PROP_REWARM_ON_NETWORK_CHANGE:
+      g_value_set_boolean (value, priv->network_changed_id != 0);
+      break;
     default:
       /* We don't have any other property... */
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -191,7 +501,61 @@ cog_client_constructed (GObject *object)
       break;
   }
 
-  new (&priv->internal) CognitoIdentityProviderClient(config);
+  config.maxConnections = priv->max_connections;
+  config.connectTimeoutMs = priv->connect_timeout;
+  config.requestTimeoutMs = priv->request_timeout;
+  config.enableTcpKeepAlive = priv->tcp_keep_alive;
+  config.tcpKeepAliveIntervalMs = priv->tcp_keep_alive_interval;
+  config.lowSpeedLimit = priv->low_speed_limit;
+
+  if (priv->executor)
+    config.executor = _cog_executor_to_internal (priv->executor);
+
+  auto make_backend = [priv, &config]
+    {
+      auto retry_strategy =
+        Aws::MakeShared<CogRetryStrategy> (_COG_ALLOCATION_TAG,
+                                           priv->max_attempts,
+                                           priv->retry_base_delay,
+                                           priv->retry_max_delay,
+                                           priv->retry_budget);
+      config.retryStrategy = retry_strategy;
+
+      CogTransportScope scope (priv->transport);
+      auto *backend = Aws::New<CogBackend> (_COG_ALLOCATION_TAG, config,
+                                            retry_strategy, priv->anonymous);
+      backend->network_client = scope.network_client ();
+      return backend;
+    };
+
+  if (priv->shared_backend)
+    {
+      /* Everything that goes into the configuration; the executor and
+       * transport are kept alive by the backend, so their addresses cannot be
+       * reused while it is registered */
+      g_autofree char *key =
+        g_strdup_printf ("%d/%u/%u/%u/%d/%u/%u/%p/%p/%u/%u/%u/%g/%d",
+                         priv->region, priv->max_connections,
+                         priv->connect_timeout, priv->request_timeout,
+                         priv->tcp_keep_alive, priv->tcp_keep_alive_interval,
+                         priv->low_speed_limit, priv->executor,
+                         priv->transport, priv->max_attempts,
+                         priv->retry_base_delay, priv->retry_max_delay,
+                         priv->retry_budget, priv->anonymous);
+      new (&priv->backend) CogBackendRef (_cog_backend_get_shared (key,
+                                                                   make_backend));
+    }
+  else
+    {
+      new (&priv->backend) CogBackendRef (make_backend (),
+                                          Aws::Deleter<CogBackend> ());
+    }
+  new (&priv->get_user_flights) GetUserFlights ();
+
+  if (priv->user_cache_ttl > 0)
+    priv->user_cache = new CogUserCache (priv->user_cache_ttl,
+                                         priv->user_cache_stale_time,
+                                         priv->user_cache_max_size);
 }
 
 static void
@@ -200,7 +564,22 @@ cog_client_finalize (GObject *object)
   CogClient *self = COG_CLIENT (object);
   CogClientPrivate *priv = GET_PRIVATE (self);
 
-  priv->internal.~CognitoIdentityProviderClient();
+  client_set_rewarm_on_network_change (self, false);
+  priv->backend.~shared_ptr ();
+  priv->get_user_flights.~GetUserFlights ();
+  g_mutex_clear (&priv->get_user_flights_lock);
+  g_hash_table_unref (priv->completion_sources);
+  g_mutex_clear (&priv->completion_sources_lock);
+  priv->completion_counters.~CogCompletionCounters ();
+  for (auto& limiter : priv->rate_limiters)
+    limiter.~shared_ptr ();
+  g_mutex_clear (&priv->rate_limiters_lock);
+  for (auto& stats : priv->operation_stats)
+    stats.~CogOperationStats ();
+  g_clear_object (&priv->executor);
+  g_clear_object (&priv->transport);
+  g_clear_pointer (&priv->secret_hmac, g_hmac_unref);
+  delete priv->user_cache;
 
   G_OBJECT_CLASS (cog_client_parent_class)->finalize (object);
 }
@@ -226,257 +605,2195 @@ cog_client_class_init (CogClientClass *klass)
                                                       (GParamFlags)
                                                       (G_PARAM_CONSTRUCT_ONLY |
                                                        G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:executor:
+   *
+   * The #CogExecutor on which asynchronous requests are run.
+   * If %NULL, the default, each asynchronous request is run on a new thread.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_EXECUTOR,
+                                   g_param_spec_object ("executor",
+                                                        "Executor",
+                                                        "Worker pool for asynchronous requests",
+                                                        COG_TYPE_EXECUTOR,
+                                                        (GParamFlags)
+                                                        (G_PARAM_CONSTRUCT_ONLY |
+                                                         G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:max-connections:
+   *
+   * Maximum number of HTTP connections that the client keeps open to the
+   * Cognito endpoint.
+   * This limits the number of requests in progress at once; size it to match
+   * the concurrency of your application, for example #CogExecutor:max-threads.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_MAX_CONNECTIONS,
+                                   g_param_spec_uint ("max-connections",
+                                                      "Max connections",
+                                                      "Maximum number of pooled HTTP connections",
+                                                      1, G_MAXINT,
+                                                      DEFAULT_MAX_CONNECTIONS,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:connect-timeout:
+   *
+   * Time in milliseconds to wait for a TCP connection to be established.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_CONNECT_TIMEOUT,
+                                   g_param_spec_uint ("connect-timeout",
+                                                      "Connect timeout",
+                                                      "Connection timeout in milliseconds",
+                                                      1, G_MAXINT,
+                                                      DEFAULT_CONNECT_TIMEOUT_MS,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:request-timeout:
+   *
+   * Time in milliseconds that a request may go without transferring any data
+   * before it is aborted.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_REQUEST_TIMEOUT,
+                                   g_param_spec_uint ("request-timeout",
+                                                      "Request timeout",
+                                                      "Request timeout in milliseconds",
+                                                      1, G_MAXINT,
+                                                      DEFAULT_REQUEST_TIMEOUT_MS,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:tcp-keep-alive:
+   *
+   * Whether to send TCP keep-alive probes on idle pooled connections, so that
+   * connections dropped by the network are detected before they are reused.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_TCP_KEEP_ALIVE,
+                                   g_param_spec_boolean ("tcp-keep-alive",
+                                                         "TCP keep-alive",
+                                                         "Whether to enable TCP keep-alive",
+                                                         TRUE,
+                                                         (GParamFlags)
+                                                         (G_PARAM_CONSTRUCT_ONLY |
+                                                          G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:tcp-keep-alive-interval:
+   *
+   * Interval in milliseconds between TCP keep-alive probes, if
+   * #CogClient:tcp-keep-alive is enabled.
+   * Values smaller than 15 seconds are not accepted by the underlying HTTP
+   * client.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_TCP_KEEP_ALIVE_INTERVAL,
+                                   g_param_spec_uint ("tcp-keep-alive-interval",
+                                                      "TCP keep-alive interval",
+                                                      "TCP keep-alive interval in milliseconds",
+                                                      MIN_TCP_KEEP_ALIVE_INTERVAL_MS,
+                                                      G_MAXINT,
+                                                      DEFAULT_TCP_KEEP_ALIVE_INTERVAL_MS,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:low-speed-limit:
+   *
+   * Transfer rate in bytes per second below which a connection is considered
+   * stalled.
+   * A connection that stays below this rate for #CogClient:request-timeout is
+   * closed rather than kept in the pool.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_LOW_SPEED_LIMIT,
+                                   g_param_spec_uint ("low-speed-limit",
+                                                      "Low speed limit",
+                                                      "Minimum transfer rate in bytes per second",
+                                                      0, G_MAXUINT,
+                                                      DEFAULT_LOW_SPEED_LIMIT,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:transport:
+   *
+   * A #CogTransport through which to record requests to Cognito, or from
+   * which to replay them.
+   * If %NULL, the default, requests go over the network unrecorded.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_TRANSPORT,
+                                   g_param_spec_object ("transport",
+                                                        "Transport",
+                                                        "Record or replay transport",
+                                                        COG_TYPE_TRANSPORT,
+                                                        (GParamFlags)
+                                                        (G_PARAM_CONSTRUCT_ONLY |
+                                                         G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:user-cache-ttl:
+   *
+   * Time in seconds for which the results of cog_client_get_user() are cached
+   * and reused for the same access token.
+   * Results are never kept past the expiry of the access token.
+   * A successful cog_client_update_user_attributes() updates the cached
+   * attributes, but attributes that the server changes as a side effect, such
+   * as `email_verified`, are only updated when the result is fetched again.
+   * If the update sends a verification code, the server does not change the
+   * attribute until it is verified, so the cached result is dropped instead.
+   * If 0, the default, results are not cached.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_USER_CACHE_TTL,
+                                   g_param_spec_uint ("user-cache-ttl",
+                                                      "User cache TTL",
+                                                      "Time in seconds to cache user attributes",
+                                                      0, G_MAXINT, 0,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:user-cache-stale-time:
+   *
+   * Time in seconds after #CogClient:user-cache-ttl has elapsed for which a
+   * cached result of cog_client_get_user() is still returned, while it is
+   * fetched again in the background.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_USER_CACHE_STALE_TIME,
+                                   g_param_spec_uint ("user-cache-stale-time",
+                                                      "User cache stale time",
+                                                      "Time in seconds to serve stale user attributes",
+                                                      0, G_MAXINT, 0,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:user-cache-max-size:
+   *
+   * Approximate maximum memory in bytes taken up by cached results of
+   * cog_client_get_user().
+   * When it is exceeded, the least recently used results are discarded.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_USER_CACHE_MAX_SIZE,
+                                   g_param_spec_uint ("user-cache-max-size",
+                                                      "User cache max size",
+                                                      "Maximum size in bytes of cached user attributes",
+                                                      0, G_MAXUINT,
+                                                      DEFAULT_USER_CACHE_MAX_SIZE,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:completion-max-batch:
+   *
+   * Maximum number of asynchronous operations completed in one dispatch of the
+   * main context.
+   * Results arriving from the AWS SDK's worker threads are queued, and a burst
+   * of them costs only one wakeup of the main context; they are then
+   * delivered this many at a time, so that other sources attached to the
+   * context are not starved.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_COMPLETION_MAX_BATCH,
+                                   g_param_spec_uint ("completion-max-batch",
+                                                      "Completion max batch",
+                                                      "Maximum number of operations completed per dispatch",
+                                                      1, G_MAXUINT,
+                                                      DEFAULT_COMPLETION_MAX_BATCH,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:max-attempts:
+   *
+   * Maximum number of times to try a request, including the first attempt,
+   * when it fails with an error that may go away by itself, such as
+   * %COG_IDENTITY_PROVIDER_ERROR_THROTTLING,
+   * %COG_IDENTITY_PROVIDER_ERROR_TOO_MANY_REQUESTS,
+   * %COG_IDENTITY_PROVIDER_ERROR_SERVICE_UNAVAILABLE, or a network error.
+   * Set to 1 to never retry.
+   *
+   * If a request still fails after being retried, the message of the
+   * returned #GError ends with the number of attempts that were made.
+   * cog_identity_provider_error_get_attempts() returns that number for any
+   * error from the server.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_MAX_ATTEMPTS,
+                                   g_param_spec_uint ("max-attempts",
+                                                      "Max attempts",
+                                                      "Maximum number of times to try a request",
+                                                      1, G_MAXUINT,
+                                                      DEFAULT_MAX_ATTEMPTS,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:retry-base-delay:
+   *
+   * Base time in milliseconds to wait before retrying a request.
+   * The wait before the Nth retry is a random time between zero and this
+   * delay times 2^(N - 1), but no more than #CogClient:retry-max-delay.
+   * Picking the time at random keeps clients that were throttled at the same
+   * moment from retrying in lockstep.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_RETRY_BASE_DELAY,
+                                   g_param_spec_uint ("retry-base-delay",
+                                                      "Retry base delay",
+                                                      "Base time in ms to wait before retrying a request",
+                                                      0, G_MAXUINT,
+                                                      DEFAULT_RETRY_BASE_DELAY_MS,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:retry-max-delay:
+   *
+   * Maximum time in milliseconds to wait before retrying a request.
+   * See #CogClient:retry-base-delay.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_RETRY_MAX_DELAY,
+                                   g_param_spec_uint ("retry-max-delay",
+                                                      "Retry max delay",
+                                                      "Maximum time in ms to wait before retrying a request",
+                                                      0, G_MAXUINT,
+                                                      DEFAULT_RETRY_MAX_DELAY_MS,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:retry-budget:
+   *
+   * Maximum share of the client's requests that may be retries.
+   * Each request made adds this much to a budget, and each retry takes one
+   * from it; when the budget is used up, failed requests are not retried.
+   * The budget starts with enough for a few retries.
+   * This keeps retries from multiplying the load on a service that is
+   * already overloaded.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_RETRY_BUDGET,
+                                   g_param_spec_double ("retry-budget",
+                                                        "Retry budget",
+                                                        "Maximum share of requests that may be retries",
+                                                        0.0, 1.0,
+                                                        DEFAULT_RETRY_BUDGET,
+                                                        (GParamFlags)
+                                                        (G_PARAM_CONSTRUCT_ONLY |
+                                                         G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:shared-backend:
+   *
+   * Whether to share the underlying AWS SDK client with other clients that
+   * have this property set and the same configuration: the same region,
+   * executor, transport, and HTTP and retry settings.
+   * Shared clients reuse each other's pooled connections, so a program that
+   * creates a short-lived #CogClient for each request still gets warm
+   * connections, as long as at least one such client is alive at a time.
+   *
+   * Shared clients also share their retry budget, but each has its own user
+   * cache, rate limits and statistics.
+   * The underlying client is freed along with the last #CogClient using it.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_SHARED_BACKEND,
+                                   g_param_spec_boolean ("shared-backend",
+                                                         "Shared backend",
+                                                         "Whether to share the AWS SDK client with similar clients",
+                                                         FALSE,
+                                                         (GParamFlags)
+                                                         (G_PARAM_CONSTRUCT_ONLY |
+                                                          G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:anonymous:
+   *
+   * Whether to send requests without AWS credentials.
+   * None of the API calls in #CogClient need credentials, since they are
+   * authorized by the app client ID or by the user's access token.
+   *
+   * An anonymous client does not look for credentials, which otherwise can
+   * take seconds on a machine without a network while the AWS SDK tries the
+   * EC2 instance metadata endpoint; and it does not spend time signing each
+   * request.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_ANONYMOUS,
+                                   g_param_spec_boolean ("anonymous",
+                                                         "Anonymous",
+                                                         "Whether to send unsigned requests without credentials",
+                                                         FALSE,
+                                                         (GParamFlags)
+                                                         (G_PARAM_CONSTRUCT_ONLY |
+                                                          G_PARAM_READWRITE)));
+
+  /**
+   * CogClient:rewarm-on-network-change:
+   *
+   * Whether to open new connections when the network changes, as many as the
+   * last call to cog_client_prewarm_async() asked for.
+   * After a change, such as switching from Wi-Fi to a mobile network, the
+   * pooled connections are dead, and the next request would have to notice
+   * that and connect again.
+   *
+   * Changes are reported by the default #GNetworkMonitor, in the main context
+   * that was the thread-default one when it was first used.
+   * Nothing happens before the first call to cog_client_prewarm_async(), or
+   * while the network is unavailable.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_REWARM_ON_NETWORK_CHANGE,
+                                   g_param_spec_boolean ("rewarm-on-network-change",
+                                                         "Rewarm on network change",
+                                                         "Whether to open new connections when the network changes",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE));
+
+  /**
+   * CogClient:client-secret:
+   *
+   * Secret of the app client, if it has one.
+   * If set, the client computes %COG_PARAMETER_SECRET_HASH from it for each
+   * request that needs one and was not given one, with the username and the
+   * app client ID of the request.
+   *
+   * The secret is only used to key the hash once, when the client is
+   * constructed, and cannot be read back.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_CLIENT_SECRET,
+                                   g_param_spec_string ("client-secret",
+                                                        "Client secret",
+                                                        "Secret of the app client",
+                                                        NULL,
+                                                        (GParamFlags)
+                                                        (G_PARAM_CONSTRUCT_ONLY |
+                                                         G_PARAM_WRITABLE)));
+
+  /**
+   * CogClient::request-completed:
+   * @self: the #CogClient
+   * @operation: name of the Cognito operation, such as `InitiateAuth`
+   * @metrics: where the time went in the request
+   *
+   * Emitted after each request that the client sends, once its response has
+   * been unpacked, with the time taken by each phase of the request and the
+   * amount of data transferred.
+   * The detail is the name of the operation, so you can connect to
+   * `request-completed::InitiateAuth` to only hear about those requests.
+   *
+   * Requests are only measured while a handler is connected for them, so the
+   * signal costs nothing otherwise.
+   *
+   * For the plain version of an API call, the signal is emitted on the
+   * calling thread before the call returns.
+   * For the other versions, it is emitted from the thread-default main
+   * context of the thread that made the call, like the callback of the
+   * `_async()` version, so handlers need not be thread-safe; for the
+   * `_direct()` versions, that context must be running for the signal to be
+   * delivered.
+   * @metrics is only valid during the emission; use
+   * cog_request_metrics_copy() to keep it.
+   */
+  signals[REQUEST_COMPLETED] =
+    g_signal_new ("request-completed", G_TYPE_FROM_CLASS (klass),
+                  (GSignalFlags)(G_SIGNAL_RUN_LAST | G_SIGNAL_DETAILED), 0,
+                  NULL, NULL, NULL, G_TYPE_NONE, 2,
+                  G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
+                  COG_TYPE_REQUEST_METRICS | G_SIGNAL_TYPE_STATIC_SCOPE);
+
+  for (unsigned ix = 0; ix < N_OPERATIONS; ix++)
+    operation_quarks[ix] = g_quark_from_static_string (operation_names[ix]);
 }
 
 static void
-cog_client_init (CogClient *self G_GNUC_UNUSED)
+completion_source_destroy (void *data)
 {
+  auto *source = static_cast<GSource *> (data);
+  g_source_destroy (source);
+  g_source_unref (source);
 }
 
-/* METHODS */
-
-static gboolean
-get_user_validate_in_parameters (const char *access_token)
+static void
+cog_client_init (CogClient *self)
 {
-  g_return_val_if_fail(access_token, FALSE);
-  g_return_val_if_fail (_cog_is_valid_access_token (access_token), FALSE);
-  return TRUE;
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  g_mutex_init (&priv->get_user_flights_lock);
+  priv->completion_sources = g_hash_table_new_full (NULL, NULL, NULL,
+                                                    completion_source_destroy);
+  g_mutex_init (&priv->completion_sources_lock);
+  new (&priv->completion_counters) CogCompletionCounters ();
+  for (auto& limiter : priv->rate_limiters)
+    new (&limiter) std::shared_ptr<CogRateLimiter> ();
+  g_mutex_init (&priv->rate_limiters_lock);
+  for (auto& stats : priv->operation_stats)
+    new (&stats) CogOperationStats ();
 }
 
-static gboolean
-get_user_validate_out_parameters (char **username,
-                                  GHashTable **user_attributes,
-                                  GList **mfa_options,
-                                  char **preferred_mfa_setting,
-                                  char ***user_mfa_settings_list)
+struct CompletionSourceEntry
 {
-  g_return_val_if_fail (username, FALSE);
-  g_return_val_if_fail (user_attributes, FALSE);
-  g_return_val_if_fail (mfa_options, FALSE);
-  g_return_val_if_fail (preferred_mfa_setting, FALSE);
-  g_return_val_if_fail (user_mfa_settings_list, FALSE);
-  return TRUE;
+  GWeakRef client;
+  GMainContext *context;  /* (unowned), only used as a key */
+  GSource *source;  /* (unowned) */
+};
+
+/* Called when a completion source is destroyed, normally because its context
+ * was freed. Drops the client's entry for it, together with any completions
+ * still queued in it, which can no longer be delivered. */
+static void
+completion_source_entry_free (void *data)
+{
+  auto *entry = static_cast<CompletionSourceEntry *> (data);
+  GSource *source = NULL;
+
+  /* NULL if the client is being finalized; it drops all its sources then */
+  auto *self = static_cast<CogClient *> (g_weak_ref_get (&entry->client));
+  if (self)
+    {
+      CogClientPrivate *priv = GET_PRIVATE (self);
+      g_mutex_lock (&priv->completion_sources_lock);
+      if (g_hash_table_lookup (priv->completion_sources, entry->context) ==
+          entry->source)
+        {
+          g_hash_table_steal (priv->completion_sources, entry->context);
+          source = entry->source;
+        }
+      g_mutex_unlock (&priv->completion_sources_lock);
+      g_object_unref (self);
+    }
+
+  if (source)
+    g_source_unref (source);
+  g_weak_ref_clear (&entry->client);
+  g_free (entry);
 }
 
-static GetUserRequest
-get_user_build_request (const char *access_token)
+/* Returns the completion source attached to @context, creating it if needed.
+ * The source stays alive as long as @context does. */
+static GSource *
+client_get_completion_source (CogClient *self,
+                              GMainContext *context)
 {
-  return GetUserRequest ().WithAccessToken (access_token);
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  g_autoptr(GMutexLocker) locker =
+    g_mutex_locker_new (&priv->completion_sources_lock);
+
+  auto *source =
+    static_cast<GSource *> (g_hash_table_lookup (priv->completion_sources,
+                                                 context));
+  if (source)
+    return source;
+
+  source = _cog_completion_source_new (priv->completion_max_batch,
+                                      &priv->completion_counters);
+  CompletionSourceEntry *entry = g_new0 (CompletionSourceEntry, 1);
+  g_weak_ref_init (&entry->client, self);
+  entry->context = context;
+  entry->source = source;
+  _cog_completion_source_set_destroy_notify (source, entry,
+                                             completion_source_entry_free);
+  g_source_attach (source, context);
+  g_hash_table_insert (priv->completion_sources, context, source);
+  return source;
 }
 
+/* Completes @task with @result from any thread. The task's callback is run
+ * from the client's completion source for the task's main context, together
+ * with any other completions that arrived at around the same time. */
 static void
-get_user_unpack_result (GetUserResult& result,
-                        char **username,
-                        GHashTable **user_attributes,
-                        GList **mfa_options,
-                        char **preferred_mfa_setting,
-                        char ***user_mfa_settings_list)
+client_return_pointer (GTask *task,
+                       void *result,
+                       GDestroyNotify result_destroy)
 {
-  *username = g_strdup (result.GetUsername ().c_str ());
-  *preferred_mfa_setting = g_strdup (result.GetPreferredMfaSetting ().c_str ());
+  CogClient *self = COG_CLIENT (g_task_get_source_object (task));
+  GSource *source = client_get_completion_source (self,
+                                                  g_task_get_context (task));
+  _cog_completion_source_return_pointer (source, task, result, result_destroy);
+}
 
-  *user_attributes = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                            g_free, g_free);
-  _cog_vector_to_hash_table (result.GetUserAttributes (), *user_attributes);
+/* Like client_return_pointer(), but completes @task with @error */
+static void
+client_return_error (GTask *task,
+                     GError *error)
+{
+  CogClient *self = COG_CLIENT (g_task_get_source_object (task));
+  GSource *source = client_get_completion_source (self,
+                                                  g_task_get_context (task));
+  _cog_completion_source_return_error (source, task, error);
+}
 
-  *mfa_options = NULL;
-  for (auto& option : result.GetMFAOptions ())
-    *mfa_options = g_list_prepend (*mfa_options,
-                                   _cog_mfa_option_from_internal (option));
-  *mfa_options = g_list_reverse (*mfa_options);
+static std::shared_ptr<CogRateLimiter>
+client_get_rate_limiter (CogClient *self,
+                         CogQuotaCategory category)
+{
+  CogClientPrivate *priv = GET_PRIVATE (self);
 
-  *user_mfa_settings_list = _cog_vector_to_strv (result.GetUserMFASettingList ());
+  g_mutex_lock (&priv->rate_limiters_lock);
+  std::shared_ptr<CogRateLimiter> limiter = priv->rate_limiters[category];
+  g_mutex_unlock (&priv->rate_limiters_lock);
+  return limiter;
 }
 
-/* Work around the lack of a copy or move constructor for GetUserResult. Returns
- * a GetUserResult allocated on the heap, suitable for returning as a pointer
- * with g_task_return_pointer() */
-static GetUserResult *
-get_user_move_result (const GetUserResult&& result)
+/* Call on the thread that is about to send a synchronous request of
+ * @category. Waits until the category's rate limit allows another request, if
+ * one is set. Returns %FALSE if the request must not be sent, because too many
+ * others are already waiting or because @cancellable was cancelled while
+ * waiting. */
+static bool
+client_admit (CogClient *self,
+              CogQuotaCategory category,
+              GCancellable *cancellable,
+              GError **error)
 {
-  auto *retval = new GetUserResult ();
-  retval->SetUsername (std::move (result.GetUsername ()));
-  retval->SetUserAttributes (std::move (result.GetUserAttributes ()));
-  retval->SetMFAOptions (std::move (result.GetMFAOptions ()));
-  retval->SetPreferredMfaSetting (std::move (result.GetPreferredMfaSetting ()));
-  retval->SetUserMFASettingList (std::move (result.GetUserMFASettingList ()));
-  return retval;
+  std::shared_ptr<CogRateLimiter> limiter =
+    client_get_rate_limiter (self, category);
+  return !limiter || limiter->acquire (cancellable, error);
 }
 
+/* Runs @job on the client's executor once the rate limit for @category allows
+ * it: right away if a token is available, or else only once the token that it
+ * reserves is due, so that requests waiting their turn do not hold on to
+ * worker threads that other categories could use.
+ * On a worker thread, @job is called with %NULL. If the request must not be
+ * sent, @job is called with the error instead, which it takes ownership of,
+ * on whichever thread finds out: because too many requests of @category are
+ * already waiting, because the executor's queue is full, or because
+ * @cancellable was cancelled. */
+template <typename Job>
 static void
-get_user_handle_request (const CognitoIdentityProviderClient *client G_GNUC_UNUSED,
-                         const GetUserRequest& request G_GNUC_UNUSED,
-                         const GetUserOutcome& outcome,
-                         const std::shared_ptr<const AsyncCallerContext>& cx)
+client_schedule (CogClient *self,
+                 CogQuotaCategory category,
+                 GCancellable *cancellable,
+                 Job&& job)
 {
-  GTask *task = std::static_pointer_cast<const GTaskAsyncContext> (cx)->task();
+  GError *error = NULL;
+  if (g_cancellable_set_error_if_cancelled (cancellable, &error))
+    {
+      job (error);
+      return;
+    }
 
-  if (!outcome.IsSuccess ())
+  std::shared_ptr<CogRateLimiter> limiter =
+    client_get_rate_limiter (self, category);
+  gint64 ready_time = 0;
+  if (limiter && !limiter->reserve (&ready_time, &error))
     {
-      auto& aws_error = outcome.GetError ();
-      GError *new_error = g_error_new_literal (COG_IDENTITY_PROVIDER_ERROR,
-                                               int(aws_error.GetErrorType ()),
-                                               aws_error.GetMessage ().c_str ());
-      g_task_return_error (task, new_error);
+      job (error);
       return;
     }
 
-  GetUserResult *result_ref = get_user_move_result (std::move (outcome.GetResult ()));
-  g_task_return_pointer (task, result_ref, [](void *data)
+  std::shared_ptr<GCancellable> ref;
+  if (cancellable)
+    ref.reset (G_CANCELLABLE (g_object_ref (cancellable)), g_object_unref);
+  std::shared_ptr<Aws::Utils::Threading::Executor> executor =
+    GET_PRIVATE (self)->backend->executor;
+
+  auto submit = [executor, ref, job] (GError *error)
+    {
+      if (error)
+        {
+          job (error);
+          return;
+        }
+
+      bool submitted = executor->Submit ([ref, job]
+        {
+          GError *error = NULL;
+          g_cancellable_set_error_if_cancelled (ref.get (), &error);
+          job (error);
+        });
+      if (!submitted)
+        job (g_error_new_literal (G_IO_ERROR, G_IO_ERROR_BUSY,
+                                  "Too many requests waiting to be sent"));
+    };
+
+  if (limiter)
+    limiter->wait_async (ready_time, cancellable, std::move (submit));
+  else
+    submit (NULL);
+}
+
+/* Runs @fn on the client's executor, once the rate limit for @category allows
+ * it. If @task is cancelled before @fn would run, or client_schedule() cannot
+ * run it, @task is completed with the error instead. */
+template <typename Fn>
+static void
+client_submit (CogClient *self,
+               CogQuotaCategory category,
+               GTask *task,
+               Fn&& fn)
+{
+  g_object_ref (task);
+  client_schedule (self, category, g_task_get_cancellable (task),
+                   [task, fn] (GError *error)
     {
-      delete static_cast<GetUserResult *> (data);
+      if (error)
+        client_return_error (task, error);
+      else
+        fn ();
+      g_object_unref (task);
     });
 }
 
-/**
- * cog_client_get_user:
- * @self: the #CogClient
- * @access_token: the access token returned by the server response
- * @cancellable: (nullable): optional #GCancellable object
- * @username: (out): the username of the user retrieved
- * @user_attributes: (out) (element-type utf8 utf8): a dictionary of user
- *   attributes
- * @mfa_options: (out) (element-type CogMFAOption): the options for MFA (e.g.,
- *   email or phone number)
- * @preferred_mfa_setting: (out): the user's preferred MFA setting
- * @user_mfa_settings_list: (out): list of the user's MFA settings
- * @error: error location
- *
- * Gets the user attributes and metadata for a user.
- *
- * For custom attributes, `custom:` will be prepended to the attribute keys in
- * @user_attributes.
- *
- * Returns: %TRUE if the request completed successfully, %FALSE on error
- */
-gboolean
-cog_client_get_user (CogClient *self,
-                     const char *access_token,
-                     GCancellable *cancellable,
-                     char **username,
-                     GHashTable **user_attributes,
-                     GList **mfa_options,
-                     char **preferred_mfa_setting,
-                     char ***user_mfa_settings_list,
-                     GError **error)
+/* Call for each request about to be made. Counts it towards the retry budget,
+ * lets #CogClient::request-completed count the data it transfers, and makes
+ * the AWS SDK abort it as soon as @cancellable is cancelled, even if it is
+ * already being sent, so that its connection and worker thread are freed right
+ * away. */
+static void
+client_prepare_request (CogClient *self,
+                        Aws::AmazonWebServiceRequest& request,
+                        GCancellable *cancellable)
 {
-  g_return_val_if_fail(COG_IS_CLIENT (self), FALSE);
-  g_return_val_if_fail(!cancellable || G_IS_CANCELLABLE (cancellable), FALSE);
+  GET_PRIVATE (self)->backend->retry_strategy->record_request ();
+  _cog_request_monitor_install (request);
+
+  if (!cancellable)
+    return;
+
+  std::shared_ptr<GCancellable> ref (G_CANCELLABLE (g_object_ref (cancellable)),
+                                     g_object_unref);
+  request.SetContinueRequestHandler ([ref] (const Aws::Http::HttpRequest *)
+    {
+      return !g_cancellable_is_cancelled (ref.get ());
+    });
+}
+
+/* Returns the base64-encoded HMAC of @username and @client_id keyed with
+ * #CogClient:client-secret, or %NULL if there is no secret or no username.
+ * The keyed state is copied rather than built again, so only the message is
+ * hashed. */
+static char *
+client_secret_hash (CogClient *self,
+                    const char *username,
+                    const char *client_id)
+{
+  CogClientPrivate *priv = GET_PRIVATE (self);
+
+  if (!priv->secret_hmac || !username)
+    return NULL;
+
+  guint8 digest[32];
+  gsize length = sizeof digest;
+  GHmac *hmac = g_hmac_copy (priv->secret_hmac);
+  g_hmac_update (hmac, (const guchar *) username, -1);
+  g_hmac_update (hmac, (const guchar *) client_id, -1);
+  g_hmac_get_digest (hmac, digest, &length);
+  g_hmac_unref (hmac);
+
+  return g_base64_encode (digest, length);
+}
+
+/* Runs @fn on the client's executor for one of the _direct() functions, once
+ * the rate limit for @category allows it, unless @cancellable is cancelled by
+ * the time it would start. If the job cannot run, @fail is called with the
+ * error instead, on whichever thread finds out. Both must call the caller's
+ * callback. Keeps @self and @cancellable alive until then. */
+template <typename Fn, typename Fail>
+static void
+client_submit_direct (CogClient *self,
+                      CogQuotaCategory category,
+                      GCancellable *cancellable,
+                      Fn&& fn,
+                      Fail&& fail)
+{
+  g_object_ref (self);
+  if (cancellable)
+    g_object_ref (cancellable);
+
+  client_schedule (self, category, cancellable,
+                   [self, cancellable, fn, fail] (GError *error)
+    {
+      if (error)
+        {
+          fail (error);
+          g_error_free (error);
+        }
+      else
+        {
+          fn ();
+        }
+      if (cancellable)
+        g_object_unref (cancellable);
+      g_object_unref (self);
+    });
+}
+
+/* Returns a new #GError for a request that failed, or for one that was
+ * aborted because @cancellable was cancelled. Must be called on the thread
+ * that made the request, so that the error can say how many attempts were
+ * made; see cog_identity_provider_error_get_attempts(). */
+static GError *
+client_error_from_internal (const Aws::Client::AWSError<CognitoIdentityProviderErrors>& aws_error,
+                            GCancellable *cancellable)
+{
+  unsigned attempts = CogRetryStrategy::take_attempts ();
+
+  GError *error = NULL;
+  if (g_cancellable_set_error_if_cancelled (cancellable, &error))
+    return error;
+
+  if (attempts > 1)
+    error = g_error_new (COG_IDENTITY_PROVIDER_ERROR,
+                         int(aws_error.GetErrorType ()), "%s (%u attempts)",
+                         aws_error.GetMessage ().c_str (), attempts);
+  else
+    error = g_error_new_literal (COG_IDENTITY_PROVIDER_ERROR,
+                                 int(aws_error.GetErrorType ()),
+                                 aws_error.GetMessage ().c_str ());
+  _cog_identity_provider_error_set_attempts (error, attempts);
+  return error;
+}
+
+/* A #CogClient::request-completed emission queued for another thread */
+typedef struct
+{
+  CogClient *client;
+  ClientOperation operation;
+  CogRequestMetrics metrics;
+} RequestCompletion;
+
+static void
+request_completion_emit (void *data)
+{
+  auto *completion = static_cast<RequestCompletion *> (data);
+  g_signal_emit (completion->client, signals[REQUEST_COMPLETED],
+                 operation_quarks[completion->operation],
+                 operation_names[completion->operation],
+                 &completion->metrics);
+}
+
+static void
+request_completion_free (void *data)
+{
+  auto *completion = static_cast<RequestCompletion *> (data);
+  g_object_unref (completion->client);
+  g_free (completion);
+}
+
+/* Measures one request for #CogClient::request-completed: the time to build
+ * it from the call's parameters, to send it, and to unpack the response into
+ * the call's return values. Create it before building the request, and call
+ * built() and unpacked() at the end of those phases; client_send() measures
+ * the rest. Unless a handler is connected for @operation when it is created,
+ * it measures nothing and unpacked() does not emit the signal.
+ *
+ * If unpacked() is called on another thread than the one that created it, as
+ * for asynchronous requests, the signal is emitted from the client's
+ * completion source for the thread-default main context of the creating
+ * thread, the same one that completes the request's #GTask. */
+class RequestTiming {
+public:
+  RequestTiming (CogClient *client,
+                 ClientOperation operation)
+    : m_client (client),
+      m_operation (operation),
+      m_active (g_signal_has_handler_pending (client,
+                                              signals[REQUEST_COMPLETED],
+                                              operation_quarks[operation],
+                                              TRUE)),
+      m_mark (m_active ? g_get_monotonic_time () : 0),
+      m_metrics (),
+      m_thread (g_thread_self ())
+  {
+    if (m_active)
+      m_context.reset (g_main_context_ref_thread_default (),
+                       g_main_context_unref);
+  }
+
+  ClientOperation operation (void) const { return m_operation; }
+  bool active (void) const { return m_active; }
+
+  void
+  built (void)
+  {
+    if (!m_active)
+      return;
+    gint64 now = g_get_monotonic_time ();
+    m_metrics.build = now - m_mark;
+    m_mark = now;
+  }
+
+  void
+  sent (CogRequestMonitor& monitor)
+  {
+    monitor.finish (&m_metrics);
+    m_mark = g_get_monotonic_time ();
+  }
+
+  void
+  unpacked (void)
+  {
+    if (!m_active)
+      return;
+    m_metrics.unpack = g_get_monotonic_time () - m_mark;
+
+    if (g_thread_self () == m_thread)
+      {
+        g_signal_emit (m_client, signals[REQUEST_COMPLETED],
+                       operation_quarks[m_operation],
+                       operation_names[m_operation], &m_metrics);
+        return;
+      }
+
+    RequestCompletion *completion = g_new (RequestCompletion, 1);
+    completion->client = COG_CLIENT (g_object_ref (m_client));
+    completion->operation = m_operation;
+    completion->metrics = m_metrics;
+    GSource *source = client_get_completion_source (m_client, m_context.get ());
+    _cog_completion_source_call (source, request_completion_emit, completion,
+                                 request_completion_free);
+  }
+
+private:
+  CogClient *m_client;
+  ClientOperation m_operation;
+  bool m_active;
+  gint64 m_mark;
+  CogRequestMetrics m_metrics;
+  GThread *m_thread;
+  std::shared_ptr<GMainContext> m_context;  /* only if active */
+};
+
+/* Sends a request by calling @send, and records it in the client's
+ * statistics. If @timing is active, also measures the request. */
+template <typename Send>
+static auto
+client_send (CogClient *self,
+             RequestTiming& timing,
+             Send&& send) -> decltype (send ())
+{
+  /* Asynchronous requests are prepared on the calling thread, but the count
+   * is kept on the thread that sends them */
+  CogRetryStrategy::reset_attempts ();
+
+  CogOperationStats& stats =
+    GET_PRIVATE (self)->operation_stats[timing.operation ()];
+  if (!timing.active ())
+    return stats.record (send);
+
+  CogRequestMonitor monitor;
+  auto outcome = stats.record (send);
+  timing.sent (monitor);
+  return outcome;
+}
+
+static GetUserOutcome
+client_send_get_user (CogClient *self,
+                      RequestTiming& timing,
+                      const GetUserRequest& request)
+{
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  return client_send (self, timing, [priv, &request]
+    {
+      return priv->backend->internal.GetUser (request);
+    });
+}
+
+static InitiateAuthOutcome
+client_send_initiate_auth (CogClient *self,
+                           RequestTiming& timing,
+                           const InitiateAuthRequest& request)
+{
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  return client_send (self, timing, [priv, &request]
+    {
+      return priv->backend->internal.InitiateAuth (request);
+    });
+}
+
+static RespondToAuthChallengeOutcome
+client_send_respond_to_auth_challenge (CogClient *self,
+                                      RequestTiming& timing,
+                                      const RespondToAuthChallengeRequest& request)
+{
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  return client_send (self, timing, [priv, &request]
+    {
+      return priv->backend->internal.RespondToAuthChallenge (request);
+    });
+}
+
+static SignUpOutcome
+client_send_sign_up (CogClient *self,
+                     RequestTiming& timing,
+                     const SignUpRequest& request)
+{
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  return client_send (self, timing, [priv, &request]
+    {
+      return priv->backend->internal.SignUp (request);
+    });
+}
+
+static UpdateUserAttributesOutcome
+client_send_update_user_attributes (CogClient *self,
+                                    RequestTiming& timing,
+                                    const UpdateUserAttributesRequest& request)
+{
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  return client_send (self, timing, [priv, &request]
+    {
+      return priv->backend->internal.UpdateUserAttributes (request);
+    });
+}
+
+/* METHODS */
+
+static gboolean
+get_user_validate_in_parameters (const char *access_token)
+{
+  g_return_val_if_fail(access_token, FALSE);
+  g_return_val_if_fail (_cog_is_valid_access_token (access_token, NULL), FALSE);
+  return TRUE;
+}
+
+static gboolean
+get_user_validate_out_parameters (char **username,
+                                  GHashTable **user_attributes,
+                                  GList **mfa_options,
+                                  char **preferred_mfa_setting,
+                                  char ***user_mfa_settings_list)
+{
+  g_return_val_if_fail (username, FALSE);
+  g_return_val_if_fail (user_attributes, FALSE);
+  g_return_val_if_fail (mfa_options, FALSE);
+  g_return_val_if_fail (preferred_mfa_setting, FALSE);
+  g_return_val_if_fail (user_mfa_settings_list, FALSE);
+  return TRUE;
+}
+
+static GetUserRequest
+get_user_build_request (const char *access_token)
+{
+  return GetUserRequest ().WithAccessToken (access_token);
+}
+
+static void
+get_user_unpack_result (const GetUserResult& result,
+                        char **username,
+                        GHashTable **user_attributes,
+                        GList **mfa_options,
+                        char **preferred_mfa_setting,
+                        char ***user_mfa_settings_list)
+{
+  *username = g_strdup (result.GetUsername ().c_str ());
+  *preferred_mfa_setting = g_strdup (result.GetPreferredMfaSetting ().c_str ());
+
+  *user_attributes = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            g_free, g_free);
+  _cog_vector_to_hash_table (result.GetUserAttributes (), *user_attributes);
+
+  *mfa_options = NULL;
+  for (auto& option : result.GetMFAOptions ())
+    *mfa_options = g_list_prepend (*mfa_options,
+                                   _cog_mfa_option_from_internal (option));
+  *mfa_options = g_list_reverse (*mfa_options);
+
+  *user_mfa_settings_list = _cog_vector_to_strv (result.GetUserMFASettingList ());
+}
+
+/* Returns a copy of @result allocated on the heap, to be kept in the user
+ * cache; the outcome that it comes from can only be read, not moved from */
+static GetUserResult *
+get_user_copy_result (const GetUserResult& result)
+{
+  auto *retval = new GetUserResult ();
+  retval->SetUsername (result.GetUsername ());
+  retval->SetUserAttributes (result.GetUserAttributes ());
+  retval->SetMFAOptions (result.GetMFAOptions ());
+  retval->SetPreferredMfaSetting (result.GetPreferredMfaSetting ());
+  retval->SetUserMFASettingList (result.GetUserMFASettingList ());
+  return retval;
+}
+
+/* The return values of cog_client_get_user_finish(). Asynchronous requests
+ * unpack their result into this on the worker thread, so that finishing the
+ * request only hands the values over. */
+typedef struct
+{
+  char *username;
+  GHashTable *user_attributes;
+  GList *mfa_options;
+  char *preferred_mfa_setting;
+  char **user_mfa_settings_list;
+} GetUserReturn;
+
+static GetUserReturn *
+get_user_return_new (const GetUserResult& result)
+{
+  auto *retval = g_new (GetUserReturn, 1);
+  get_user_unpack_result (result, &retval->username, &retval->user_attributes,
+                          &retval->mfa_options, &retval->preferred_mfa_setting,
+                          &retval->user_mfa_settings_list);
+  return retval;
+}
+
+static void
+get_user_return_free (void *data)
+{
+  auto *ret = static_cast<GetUserReturn *> (data);
+  g_free (ret->username);
+  g_hash_table_unref (ret->user_attributes);
+  g_list_free_full (ret->mfa_options, (GDestroyNotify) cog_mfa_option_unref);
+  g_free (ret->preferred_mfa_setting);
+  g_strfreev (ret->user_mfa_settings_list);
+  g_free (ret);
+}
+
+/* Hands over the return values in @ret to the caller, and frees @ret */
+static void
+get_user_return_steal (GetUserReturn *ret,
+                       char **username,
+                       GHashTable **user_attributes,
+                       GList **mfa_options,
+                       char **preferred_mfa_setting,
+                       char ***user_mfa_settings_list)
+{
+  *username = ret->username;
+  *user_attributes = ret->user_attributes;
+  *mfa_options = ret->mfa_options;
+  *preferred_mfa_setting = ret->preferred_mfa_setting;
+  *user_mfa_settings_list = ret->user_mfa_settings_list;
+  g_free (ret);
+}
+
+/* Completes @task, from either cog_client_get_user_async() or
+ * cog_client_fetch_user_async(), with @result in the form that its _finish()
+ * function hands over. *@user keeps the #CogUser created for the first task,
+ * so that all tasks waiting on the same request share it. */
+static void
+get_user_return_result (GTask *task,
+                        const GetUserResult& result,
+                        CogUser **user)
+{
+  if (g_task_get_source_tag (task) == (void *) cog_client_fetch_user_async)
+    {
+      if (!*user)
+        *user = _cog_user_new_from_internal (result);
+      client_return_pointer (task, cog_user_ref (*user),
+                             (GDestroyNotify) cog_user_unref);
+      return;
+    }
+
+  client_return_pointer (task, get_user_return_new (result),
+                         get_user_return_free);
+}
+
+/* Takes ownership of @result, and stores it in the user cache if that is
+ * enabled and the user was not written since client_lookup_user() returned
+ * @generation */
+static CogGetUserResultRef
+client_store_user (CogClient *self,
+                   const char *access_token,
+                   GetUserResult *result,
+                   guint64 generation)
+{
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  CogGetUserResultRef retval (result);
+
+  if (priv->user_cache)
+    priv->user_cache->insert (access_token, retval, generation);
+  return retval;
+}
+
+/* Fetches the user for @access_token again in the background, and updates the
+ * user cache with the result */
+static void
+client_revalidate_user (CogClient *self,
+                        const char *access_token,
+                        guint64 generation)
+{
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  RequestTiming timing (self, OPERATION_GET_USER);
+  GetUserRequest request = get_user_build_request (access_token);
+  client_prepare_request (self, request, NULL);
+  timing.built ();
+
+  g_object_ref (self);
+  client_schedule (self, COG_QUOTA_CATEGORY_USER_ACCOUNT_READ, NULL,
+                   [self, priv, request, timing, generation] (GError *error)
+    {
+      const char *token = request.GetAccessToken ().c_str ();
+
+      /* If the rate limit or the executor refuses the request, treat it like
+       * a transient error and keep serving the stale result */
+      if (error)
+        {
+          g_error_free (error);
+          priv->user_cache->revalidation_failed (token, false);
+          g_object_unref (self);
+          return;
+        }
+
+      RequestTiming sending (timing);
+      auto outcome = client_send_get_user (self, sending, request);
+
+      if (outcome.IsSuccess ())
+        {
+          client_store_user (self, token,
+                             get_user_copy_result (outcome.GetResult ()),
+                             generation);
+        }
+      else
+        {
+          CogRetryStrategy::take_attempts ();
+
+          /* Drop the cached result if the token is no longer accepted, but
+           * keep serving it through transient errors */
+          auto error_type = outcome.GetError ().GetErrorType ();
+          bool rejected =
+            error_type == CognitoIdentityProviderErrors::NOT_AUTHORIZED ||
+            error_type == CognitoIdentityProviderErrors::USER_NOT_FOUND;
+          priv->user_cache->revalidation_failed (token, rejected);
+        }
+      sending.unpacked ();
+
+      g_object_unref (self);
+    });
+}
+
+/* Returns the cached result for @access_token if the user cache is enabled and
+ * has one, and starts fetching it again if it is stale. Sets @generation to
+ * what client_store_user() needs for a result fetched after this. */
+static CogGetUserResultRef
+client_lookup_user (CogClient *self,
+                    const char *access_token,
+                    guint64 *generation)
+{
+  CogClientPrivate *priv = GET_PRIVATE (self);
+
+  *generation = 0;
+  if (!priv->user_cache)
+    return nullptr;
+
+  bool revalidate;
+  CogGetUserResultRef retval = priv->user_cache->lookup (access_token,
+                                                         &revalidate,
+                                                         generation);
+  if (revalidate)
+    client_revalidate_user (self, access_token, *generation);
+  return retval;
+}
+
+/* Adds @task to the waiters on the in-flight GetUser request for
+ * @access_token. Returns %TRUE if there was already such a request, or %FALSE
+ * if @task is the first waiter and the caller must send the request. */
+static bool
+client_join_get_user_flight (CogClient *self,
+                             const char *access_token,
+                             GTask *task)
+{
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  g_autoptr(GMutexLocker) locker =
+    g_mutex_locker_new (&priv->get_user_flights_lock);
+
+  auto iter = priv->get_user_flights.find (access_token);
+  if (iter != priv->get_user_flights.end ())
+    {
+      g_ptr_array_add (iter->second, g_object_ref (task));
+      return true;
+    }
+
+  GPtrArray *waiters = g_ptr_array_new_with_free_func (g_object_unref);
+  g_ptr_array_add (waiters, g_object_ref (task));
+  priv->get_user_flights.emplace (access_token, waiters);
+  return false;
+}
+
+/* Ends the in-flight GetUser request for @access_token, and returns the tasks
+ * that were waiting on it */
+static GPtrArray *
+client_leave_get_user_flight (CogClient *self,
+                              const char *access_token)
+{
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  g_autoptr(GMutexLocker) locker =
+    g_mutex_locker_new (&priv->get_user_flights_lock);
+
+  auto iter = priv->get_user_flights.find (access_token);
+  g_assert (iter != priv->get_user_flights.end ());
+  GPtrArray *waiters = iter->second;
+  priv->get_user_flights.erase (iter);
+  return waiters;
+}
+
+static bool
+get_user_flight_cancelled (GPtrArray *waiters)
+{
+  for (unsigned ix = 0; ix < waiters->len; ix++)
+    {
+      GTask *task = G_TASK (waiters->pdata[ix]);
+      if (!g_cancellable_is_cancelled (g_task_get_cancellable (task)))
+        return false;
+    }
+  return true;
+}
+
+/* Whether every task waiting on the GetUser request for @access_token has been
+ * cancelled, in which case the request can be aborted */
+static bool
+client_get_user_flight_cancelled (CogClient *self,
+                                  const char *access_token)
+{
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  g_autoptr(GMutexLocker) locker =
+    g_mutex_locker_new (&priv->get_user_flights_lock);
+
+  auto iter = priv->get_user_flights.find (access_token);
+  return iter != priv->get_user_flights.end () &&
+    get_user_flight_cancelled (iter->second);
+}
+
+/* Like client_leave_get_user_flight(), but only if every waiting task has
+ * been cancelled; otherwise returns NULL */
+static GPtrArray *
+client_leave_cancelled_get_user_flight (CogClient *self,
+                                        const char *access_token)
+{
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  g_autoptr(GMutexLocker) locker =
+    g_mutex_locker_new (&priv->get_user_flights_lock);
+
+  auto iter = priv->get_user_flights.find (access_token);
+  g_assert (iter != priv->get_user_flights.end ());
+  GPtrArray *waiters = iter->second;
+  if (!get_user_flight_cancelled (waiters))
+    return NULL;
+  priv->get_user_flights.erase (iter);
+  return waiters;
+}
+
+static void
+get_user_handle_request (const CognitoIdentityProviderClient *client G_GNUC_UNUSED,
+                         const GetUserRequest& request,
+                         const GetUserOutcome& outcome,
+                         RequestTiming& timing,
+                         guint64 generation,
+                         const std::shared_ptr<const AsyncCallerContext>& cx)
+{
+  GTask *task = std::static_pointer_cast<const GTaskAsyncContext> (cx)->task();
+  CogClient *self = COG_CLIENT (g_task_get_source_object (task));
+  const char *access_token = request.GetAccessToken ().c_str ();
+  g_autoptr(GPtrArray) waiters = client_leave_get_user_flight (self,
+                                                               access_token);
+
+  if (!outcome.IsSuccess ())
+    {
+      g_autoptr(GError) error = client_error_from_internal (outcome.GetError (),
+                                                            NULL);
+      for (unsigned ix = 0; ix < waiters->len; ix++)
+        client_return_error (G_TASK (waiters->pdata[ix]), g_error_copy (error));
+      timing.unpacked ();
+      return;
+    }
+
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  if (priv->user_cache)
+    client_store_user (self, access_token,
+                       get_user_copy_result (outcome.GetResult ()),
+                       generation);
+
+  g_autoptr(CogUser) user = NULL;
+  for (unsigned ix = 0; ix < waiters->len; ix++)
+    get_user_return_result (G_TASK (waiters->pdata[ix]), outcome.GetResult (),
+                            &user);
+  timing.unpacked ();
+}
+
+/**
+ * cog_client_get_user:
+ * @self: the #CogClient
+ * @access_token: the access token returned by the server response
+ * @cancellable: (nullable): optional #GCancellable object
+ * @username: (out): the username of the user retrieved
+ * @user_attributes: (out) (element-type utf8 utf8): a dictionary of user
+ *   attributes
+ * @mfa_options: (out) (element-type CogMFAOption): the options for MFA (e.g.,
+ *   email or phone number)
+ * @preferred_mfa_setting: (out): the user's preferred MFA setting
+ * @user_mfa_settings_list: (out): list of the user's MFA settings
+ * @error: error location
+ *
+ * Gets the user attributes and metadata for a user.
+ *
+ * For custom attributes, `custom:` will be prepended to the attribute keys in
+ * @user_attributes.
+ *
+ * Returns: %TRUE if the request completed successfully, %FALSE on error
+ */
+gboolean
+cog_client_get_user (CogClient *self,
+                     const char *access_token,
+                     GCancellable *cancellable,
+                     char **username,
+                     GHashTable **user_attributes,
+                     GList **mfa_options,
+                     char **preferred_mfa_setting,
+                     char ***user_mfa_settings_list,
+                     GError **error)
+{
+  g_return_val_if_fail(COG_IS_CLIENT (self), FALSE);
+  g_return_val_if_fail(!cancellable || G_IS_CANCELLABLE (cancellable), FALSE);
+  g_return_val_if_fail(!error || !*error, FALSE);
+  g_return_val_if_fail(get_user_validate_in_parameters (access_token), FALSE);
+  g_return_val_if_fail(
+    get_user_validate_out_parameters (username, user_attributes, mfa_options,
+                                      preferred_mfa_setting,
+                                      user_mfa_settings_list), FALSE);
+
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    return FALSE;
+
+  guint64 generation;
+  CogGetUserResultRef cached = client_lookup_user (self, access_token,
+                                                   &generation);
+  if (cached)
+    {
+      get_user_unpack_result (*cached, username, user_attributes, mfa_options,
+                              preferred_mfa_setting, user_mfa_settings_list);
+      return TRUE;
+    }
+
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  RequestTiming timing (self, OPERATION_GET_USER);
+  GetUserRequest request = get_user_build_request (access_token);
+  timing.built ();
+  if (!client_admit (self, COG_QUOTA_CATEGORY_USER_ACCOUNT_READ, cancellable,
+                     error))
+    return FALSE;
+  client_prepare_request (self, request, cancellable);
+  auto outcome = client_send_get_user (self, timing, request);
+
+  /* An aborted request fails, so check this first */
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    {
+      timing.unpacked ();
+      return FALSE;
+    }
+
+  if (!outcome.IsSuccess ())
+    {
+      g_propagate_error (error, client_error_from_internal (outcome.GetError (),
+                                                           NULL));
+      timing.unpacked ();
+      return FALSE;
+    }
+
+  if (priv->user_cache)
+    {
+      CogGetUserResultRef result =
+        client_store_user (self, access_token,
+                           get_user_copy_result (outcome.GetResult ()),
+                           generation);
+      get_user_unpack_result (*result, username, user_attributes, mfa_options,
+                              preferred_mfa_setting, user_mfa_settings_list);
+      timing.unpacked ();
+      return TRUE;
+    }
+
+  get_user_unpack_result(outcome.GetResult (), username, user_attributes,
+                         mfa_options, preferred_mfa_setting,
+                         user_mfa_settings_list);
+  timing.unpacked ();
+
+  return TRUE;
+}
+
+/* Completes @task from the user cache, or from a new or in-flight GetUser
+ * request */
+static void
+client_start_get_user (CogClient *self,
+                       const char *access_token,
+                       GTask *task)
+{
+  guint64 generation;
+  CogGetUserResultRef cached = client_lookup_user (self, access_token,
+                                                   &generation);
+  if (cached)
+    {
+      g_autoptr(CogUser) user = NULL;
+      get_user_return_result (task, *cached, &user);
+      return;
+    }
+
+  if (client_join_get_user_flight (self, access_token, task))
+    return;
+
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  RequestTiming timing (self, OPERATION_GET_USER);
+  GetUserRequest request = get_user_build_request (access_token);
+  auto cx = Aws::MakeShared<GTaskAsyncContext> (_COG_ALLOCATION_TAG, task);
+
+  /* The request is shared, so only abort it if all the tasks waiting on it
+   * have been cancelled */
+  client_prepare_request (self, request, NULL);
+  Aws::String token (access_token);
+  request.SetContinueRequestHandler ([self, token] (const Aws::Http::HttpRequest *)
+    {
+      return !client_get_user_flight_cancelled (self, token.c_str ());
+    });
+  timing.built ();
+
+  /* The request is shared, so no single task's cancellable may cut short the
+   * wait for the rate limit */
+  client_schedule (self, COG_QUOTA_CATEGORY_USER_ACCOUNT_READ, NULL,
+                   [self, priv, request, cx, timing, generation] (GError *error)
+    {
+      const char *token = request.GetAccessToken ().c_str ();
+      if (error)
+        {
+          g_autoptr(GPtrArray) waiters =
+            client_leave_get_user_flight (self, token);
+          for (unsigned ix = 0; ix < waiters->len; ix++)
+            client_return_error (G_TASK (waiters->pdata[ix]),
+                                 g_error_copy (error));
+          g_error_free (error);
+          return;
+        }
+
+      g_autoptr(GPtrArray) cancelled =
+        client_leave_cancelled_get_user_flight (self, token);
+      if (cancelled)
+        {
+          for (unsigned ix = 0; ix < cancelled->len; ix++)
+            {
+              GTask *waiter = G_TASK (cancelled->pdata[ix]);
+              GError *cancel_error = NULL;
+              g_cancellable_set_error_if_cancelled (g_task_get_cancellable (waiter),
+                                                    &cancel_error);
+              client_return_error (waiter, cancel_error);
+            }
+          return;
+        }
+
+      RequestTiming sending (timing);
+      auto outcome = client_send_get_user (self, sending, request);
+      get_user_handle_request (&priv->backend->internal, request, outcome,
+                               sending, generation, cx);
+    });
+}
+
+/**
+ * cog_client_get_user_async:
+ * @self: the #CogClient
+ * @access_token: the access token returned by the server response
+ * @cancellable: (nullable): optional #GCancellable object
+ * @callback: (nullable): a callback to call when the operation is complete
+ * @user_data: (nullable): the data to pass to @callback
+ *
+ * See cog_client_get_user() for documentation.
+ * This version completes the request without blocking and calls @callback when
+ * finished.
+ * In your @callback, you must call cog_client_get_user_finish() to get the
+ * results of the request.
+ *
+ * If a request for the same @access_token is already in progress, no new
+ * request is sent; @callback is called with the outcome of the request in
+ * progress.
+ */
+void
+cog_client_get_user_async (CogClient *self,
+                           const char *access_token,
+                           GCancellable *cancellable,
+                           GAsyncReadyCallback callback,
+                           gpointer user_data)
+{
+  g_return_if_fail(COG_IS_CLIENT (self));
+  g_return_if_fail(!cancellable || G_IS_CANCELLABLE (cancellable));
+  g_return_if_fail(get_user_validate_in_parameters (access_token));
+
+  GTask *task = g_task_new (self, cancellable, callback, user_data);
+  client_start_get_user (self, access_token, task);
+  g_object_unref (task);
+}
+
+/**
+ * cog_client_get_user_finish:
+ * @self: the #CogClient
+ * @res: the #GAsyncResult passed to your callback
+ * @username: (out): the username of the user retrieved
+ * @user_attributes: (out) (element-type utf8 utf8): a dictionary of user
+ *   attributes
+ * @mfa_options: (out) (element-type CogMFAOption): the options for MFA (e.g.,
+ *   email or phone number)
+ * @preferred_mfa_setting: (out): the user's preferred MFA setting
+ * @user_mfa_settings_list: (out): list of the user's MFA settings
+ * @error: error location
+ *
+ * See cog_client_get_user() for documentation.
+ * After starting an asynchronous request with cog_client_get_user_async(), you
+ * must call this in your callback to finish the request and receive the return
+ * values or handle the errors.
+ *
+ * Returns: %TRUE if the request completed successfully, %FALSE on error
+ */
+gboolean
+cog_client_get_user_finish (CogClient *self,
+                            GAsyncResult *res,
+                            char **username,
+                            GHashTable **user_attributes,
+                            GList **mfa_options,
+                            char **preferred_mfa_setting,
+                            char ***user_mfa_settings_list,
+                            GError **error)
+{
+  g_return_val_if_fail (COG_IS_CLIENT (self), FALSE);
+  g_return_val_if_fail (G_IS_TASK (res), FALSE);
   g_return_val_if_fail(!error || !*error, FALSE);
-  g_return_val_if_fail(get_user_validate_in_parameters (access_token), FALSE);
-  g_return_val_if_fail(
+  g_return_val_if_fail (
     get_user_validate_out_parameters (username, user_attributes, mfa_options,
                                       preferred_mfa_setting,
                                       user_mfa_settings_list), FALSE);
 
-  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+  auto *ret =
+    static_cast<GetUserReturn *> (g_task_propagate_pointer (G_TASK (res), error));
+  if (!ret)
     return FALSE;
 
-  CogClientPrivate *priv = GET_PRIVATE (self);
-  GetUserRequest request = get_user_build_request (access_token);
-  auto outcome = priv->internal.GetUser (request);
+  get_user_return_steal (ret, username, user_attributes, mfa_options,
+                         preferred_mfa_setting, user_mfa_settings_list);
+  return TRUE;
+}
+
+/**
+ * cog_client_fetch_user:
+ * @self: the #CogClient
+ * @access_token: the access token returned by the server response
+ * @cancellable: (nullable): optional #GCancellable object
+ * @error: error location
+ *
+ * Gets the user attributes and metadata for a user, like
+ * cog_client_get_user(), but as a #CogUser.
+ * This avoids copying every attribute into a dictionary when you only need a
+ * few of them.
+ *
+ * Returns: (transfer full): a #CogUser, or %NULL on error
+ */
+CogUser *
+cog_client_fetch_user (CogClient *self,
+                       const char *access_token,
+                       GCancellable *cancellable,
+                       GError **error)
+{
+  g_return_val_if_fail (COG_IS_CLIENT (self), NULL);
+  g_return_val_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable), NULL);
+  g_return_val_if_fail (!error || !*error, NULL);
+  g_return_val_if_fail (get_user_validate_in_parameters (access_token), NULL);
+
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    return NULL;
+
+  guint64 generation;
+  CogGetUserResultRef cached = client_lookup_user (self, access_token,
+                                                   &generation);
+  if (cached)
+    return _cog_user_new_from_internal (*cached);
+
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  RequestTiming timing (self, OPERATION_GET_USER);
+  GetUserRequest request = get_user_build_request (access_token);
+  timing.built ();
+  if (!client_admit (self, COG_QUOTA_CATEGORY_USER_ACCOUNT_READ, cancellable,
+                     error))
+    return NULL;
+  client_prepare_request (self, request, cancellable);
+  auto outcome = client_send_get_user (self, timing, request);
+
+  /* An aborted request fails, so check this first */
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    {
+      timing.unpacked ();
+      return NULL;
+    }
+
+  if (!outcome.IsSuccess ())
+    {
+      g_propagate_error (error, client_error_from_internal (outcome.GetError (),
+                                                           NULL));
+      timing.unpacked ();
+      return NULL;
+    }
+
+  if (priv->user_cache)
+    client_store_user (self, access_token,
+                       get_user_copy_result (outcome.GetResult ()),
+                       generation);
+
+  CogUser *user = _cog_user_new_from_internal (outcome.GetResult ());
+  timing.unpacked ();
+  return user;
+}
+
+/**
+ * cog_client_fetch_user_async:
+ * @self: the #CogClient
+ * @access_token: the access token returned by the server response
+ * @cancellable: (nullable): optional #GCancellable object
+ * @callback: (nullable): a callback to call when the operation is complete
+ * @user_data: (nullable): the data to pass to @callback
+ *
+ * See cog_client_fetch_user() for documentation.
+ * This version completes the request without blocking and calls @callback when
+ * finished.
+ * In your @callback, you must call cog_client_fetch_user_finish() to get the
+ * results of the request.
+ *
+ * Requests for the same @access_token are coalesced with each other and with
+ * those from cog_client_get_user_async(); all callers of this function that
+ * are waiting on the same request receive the same #CogUser.
+ */
+void
+cog_client_fetch_user_async (CogClient *self,
+                             const char *access_token,
+                             GCancellable *cancellable,
+                             GAsyncReadyCallback callback,
+                             gpointer user_data)
+{
+  g_return_if_fail (COG_IS_CLIENT (self));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+  g_return_if_fail (get_user_validate_in_parameters (access_token));
+
+  GTask *task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, (void *) cog_client_fetch_user_async);
+  client_start_get_user (self, access_token, task);
+  g_object_unref (task);
+}
+
+/**
+ * cog_client_fetch_user_finish:
+ * @self: the #CogClient
+ * @res: the #GAsyncResult passed to your callback
+ * @error: error location
+ *
+ * See cog_client_fetch_user() for documentation.
+ * After starting an asynchronous request with cog_client_fetch_user_async(),
+ * you must call this in your callback to finish the request and receive the
+ * return value or handle the errors.
+ *
+ * Returns: (transfer full): a #CogUser, or %NULL on error
+ */
+CogUser *
+cog_client_fetch_user_finish (CogClient *self,
+                              GAsyncResult *res,
+                              GError **error)
+{
+  g_return_val_if_fail (COG_IS_CLIENT (self), NULL);
+  g_return_val_if_fail (G_IS_TASK (res), NULL);
+  g_return_val_if_fail (!error || !*error, NULL);
+
+  return static_cast<CogUser *> (g_task_propagate_pointer (G_TASK (res),
+                                                           error));
+}
+
+/**
+ * cog_client_fetch_user_direct: (skip)
+ * @self: the #CogClient
+ * @access_token: the access token returned by the server response
+ * @cancellable: (nullable): optional #GCancellable object
+ * @callback: a callback to call when the operation is complete
+ * @user_data: (nullable): the data to pass to @callback
+ *
+ * See cog_client_fetch_user() for documentation.
+ * This version completes the request without blocking and without a main
+ * loop; @callback is called on one of the client's worker threads, or on the
+ * calling thread if the user is in the cache or the request cannot be queued.
+ * See the introduction to #CogClient.
+ *
+ * Unlike cog_client_fetch_user_async(), requests for the same @access_token
+ * are not coalesced.
+ */
+void
+cog_client_fetch_user_direct (CogClient *self,
+                              const char *access_token,
+                              GCancellable *cancellable,
+                              CogFetchUserDirectCallback callback,
+                              gpointer user_data)
+{
+  g_return_if_fail (COG_IS_CLIENT (self));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+  g_return_if_fail (callback);
+  g_return_if_fail (get_user_validate_in_parameters (access_token));
+
+  guint64 generation;
+  CogGetUserResultRef cached = client_lookup_user (self, access_token,
+                                                   &generation);
+  if (cached)
+    {
+      g_autoptr(CogUser) user = _cog_user_new_from_internal (*cached);
+      callback (self, user, NULL, user_data);
+      return;
+    }
+
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  RequestTiming timing (self, OPERATION_GET_USER);
+  GetUserRequest request = get_user_build_request (access_token);
+  client_prepare_request (self, request, cancellable);
+  timing.built ();
+
+  client_submit_direct (self, COG_QUOTA_CATEGORY_USER_ACCOUNT_READ,
+                        cancellable,
+                        [self, priv, request, timing, generation, cancellable,
+                         callback, user_data]
+    {
+      RequestTiming sending (timing);
+      auto outcome = client_send_get_user (self, sending, request);
+      if (!outcome.IsSuccess ())
+        {
+          GError *error = client_error_from_internal (outcome.GetError (),
+                                                      cancellable);
+          sending.unpacked ();
+          callback (self, NULL, error, user_data);
+          g_error_free (error);
+          return;
+        }
+
+      if (priv->user_cache)
+        client_store_user (self, request.GetAccessToken ().c_str (),
+                           get_user_copy_result (outcome.GetResult ()),
+                           generation);
+
+      g_autoptr(CogUser) user = _cog_user_new_from_internal (outcome.GetResult ());
+      sending.unpacked ();
+      callback (self, user, NULL, user_data);
+    },
+                        [self, callback, user_data] (const GError *error)
+    {
+      callback (self, NULL, error, user_data);
+    });
+}
+
+/**
+ * CogUserBatchItem:
+ *
+ * The outcome of looking up one access token in a batch started with
+ * cog_client_get_user_batch_async().
+ * Use cog_user_batch_item_get_user() to get the user or the error.
+ */
+struct _CogUserBatchItem
+{
+  unsigned ref_count;
+  unsigned index;
+  char *access_token;
+  CogUser *user;
+  GError *error;
+};
+
+G_DEFINE_BOXED_TYPE (CogUserBatchItem, cog_user_batch_item,
+                     cog_user_batch_item_ref, cog_user_batch_item_unref)
+
+/* Takes ownership of @user and @error */
+static CogUserBatchItem *
+user_batch_item_new (unsigned index,
+                     const char *access_token,
+                     CogUser *user,
+                     GError *error)
+{
+  CogUserBatchItem *self = g_slice_new0 (CogUserBatchItem);
+  self->ref_count = 1;
+  self->index = index;
+  self->access_token = g_strdup (access_token);
+  self->user = user;
+  self->error = error;
+  return self;
+}
+
+/**
+ * cog_user_batch_item_ref:
+ * @self: a #CogUserBatchItem
+ *
+ * Increments the reference count of @self by one.
+ *
+ * Returns: (transfer none): @self
+ */
+CogUserBatchItem *
+cog_user_batch_item_ref (CogUserBatchItem *self)
+{
+  g_return_val_if_fail (self, NULL);
+  g_return_val_if_fail (self->ref_count, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+/**
+ * cog_user_batch_item_unref:
+ * @self: (transfer none): a #CogUserBatchItem
+ *
+ * Decrements the reference count of @self by one, freeing the structure when
+ * the reference count reaches zero.
+ */
+void
+cog_user_batch_item_unref (CogUserBatchItem *self)
+{
+  g_return_if_fail (self);
+  g_return_if_fail (self->ref_count);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+    {
+      g_free (self->access_token);
+      g_clear_pointer (&self->user, cog_user_unref);
+      g_clear_error (&self->error);
+      g_slice_free (CogUserBatchItem, self);
+    }
+}
+
+/**
+ * cog_user_batch_item_get_index:
+ * @self: a #CogUserBatchItem
+ *
+ * Returns: the position in the batch of the access token that this item is
+ *   the outcome for
+ */
+unsigned
+cog_user_batch_item_get_index (CogUserBatchItem *self)
+{
+  g_return_val_if_fail (self, 0);
+  return self->index;
+}
+
+/**
+ * cog_user_batch_item_get_access_token:
+ * @self: a #CogUserBatchItem
+ *
+ * Returns: the access token that this item is the outcome for
+ */
+const char *
+cog_user_batch_item_get_access_token (CogUserBatchItem *self)
+{
+  g_return_val_if_fail (self, NULL);
+  return self->access_token;
+}
+
+/**
+ * cog_user_batch_item_get_user:
+ * @self: a #CogUserBatchItem
+ * @username: (out): the username of the user retrieved
+ * @user_attributes: (out) (element-type utf8 utf8): a dictionary of user
+ *   attributes
+ * @mfa_options: (out) (element-type CogMFAOption): the options for MFA (e.g.,
+ *   email or phone number)
+ * @preferred_mfa_setting: (out): the user's preferred MFA setting
+ * @user_mfa_settings_list: (out): list of the user's MFA settings
+ * @error: error location
+ *
+ * Gets the outcome of the lookup, with the same return values as
+ * cog_client_get_user_finish().
+ * May be called any number of times.
+ *
+ * Returns: %TRUE if the lookup completed successfully, %FALSE on error
+ */
+gboolean
+cog_user_batch_item_get_user (CogUserBatchItem *self,
+                              char **username,
+                              GHashTable **user_attributes,
+                              GList **mfa_options,
+                              char **preferred_mfa_setting,
+                              char ***user_mfa_settings_list,
+                              GError **error)
+{
+  g_return_val_if_fail (self, FALSE);
+  g_return_val_if_fail (!error || !*error, FALSE);
+  g_return_val_if_fail (
+    get_user_validate_out_parameters (username, user_attributes, mfa_options,
+                                      preferred_mfa_setting,
+                                      user_mfa_settings_list), FALSE);
+
+  if (self->error)
+    {
+      g_propagate_error (error, g_error_copy (self->error));
+      return FALSE;
+    }
+
+  *username = g_strdup (cog_user_get_username (self->user));
+  *user_attributes = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            g_free, g_free);
+  GHashTableIter iter;
+  void *key, *value;
+  g_hash_table_iter_init (&iter, cog_user_get_attributes (self->user));
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    g_hash_table_insert (*user_attributes, g_strdup ((char *) key),
+                         g_strdup ((char *) value));
+  *mfa_options = cog_user_dup_mfa_options (self->user);
+  const char *preferred = cog_user_get_preferred_mfa_setting (self->user);
+  *preferred_mfa_setting = g_strdup (preferred ? preferred : "");
+  *user_mfa_settings_list =
+    g_strdupv ((char **) cog_user_get_mfa_settings (self->user));
+  return TRUE;
+}
+
+/**
+ * cog_user_batch_item_get_user_object:
+ * @self: a #CogUserBatchItem
+ * @error: error location
+ *
+ * Gets the outcome of the lookup as a #CogUser, like
+ * cog_client_fetch_user_finish().
+ *
+ * Returns: (transfer none): the #CogUser, owned by @self, or %NULL on error
+ */
+CogUser *
+cog_user_batch_item_get_user_object (CogUserBatchItem *self,
+                                     GError **error)
+{
+  g_return_val_if_fail (self, NULL);
+  g_return_val_if_fail (!error || !*error, NULL);
+
+  if (self->error)
+    {
+      g_propagate_error (error, g_error_copy (self->error));
+      return NULL;
+    }
+  return self->user;
+}
+
+typedef struct
+{
+  char **access_tokens;
+  unsigned n_tokens;
+  unsigned next;
+  unsigned n_in_flight;
+  unsigned n_done;
+  unsigned max_concurrent;
+  GPtrArray *items;
+  CogUserBatchItemCallback item_callback;
+  void *item_user_data;
+  GDestroyNotify item_destroy;
+} GetUserBatchData;
+
+static void
+get_user_batch_data_free (void *data)
+{
+  auto *batch = static_cast<GetUserBatchData *> (data);
+  g_strfreev (batch->access_tokens);
+  g_ptr_array_unref (batch->items);
+  if (batch->item_destroy)
+    batch->item_destroy (batch->item_user_data);
+  g_free (batch);
+}
+
+typedef struct
+{
+  GTask *task;
+  unsigned index;
+} GetUserBatchLookup;
+
+static void get_user_batch_lookup_done (GObject *source,
+                                        GAsyncResult *res,
+                                        void *data);
+
+/* Records the outcome for the access token at @index, and completes the batch
+ * if it was the last one. Takes ownership of @user and @error. */
+static void
+get_user_batch_complete_item (GTask *task,
+                              unsigned index,
+                              CogUser *user,
+                              GError *error)
+{
+  auto *batch = static_cast<GetUserBatchData *> (g_task_get_task_data (task));
+  CogClient *self = COG_CLIENT (g_task_get_source_object (task));
+
+  CogUserBatchItem *item =
+    user_batch_item_new (index, batch->access_tokens[index], user, error);
+  batch->items->pdata[index] = item;
+  batch->n_done++;
+
+  if (batch->item_callback)
+    batch->item_callback (self, item, batch->item_user_data);
+
+  if (batch->n_done == batch->n_tokens)
+    g_task_return_pointer (task, g_ptr_array_ref (batch->items),
+                           (GDestroyNotify) g_ptr_array_unref);
+}
+
+/* Starts lookups until there are @max_concurrent in flight or none are left
+ * to start. Once the batch is cancelled, the lookups not yet started are
+ * completed with the cancellation error instead. */
+static void
+get_user_batch_start_lookups (GTask *task)
+{
+  auto *batch = static_cast<GetUserBatchData *> (g_task_get_task_data (task));
+  CogClient *self = COG_CLIENT (g_task_get_source_object (task));
+  GCancellable *cancellable = g_task_get_cancellable (task);
+
+  while (batch->next < batch->n_tokens &&
+         batch->n_in_flight < batch->max_concurrent)
+    {
+      unsigned index = batch->next++;
+      const char *access_token = batch->access_tokens[index];
+      GError *error = NULL;
+
+      if (g_cancellable_set_error_if_cancelled (cancellable, &error))
+        {
+          get_user_batch_complete_item (task, index, NULL, error);
+          continue;
+        }
+
+      if (!_cog_is_valid_access_token (access_token, NULL))
+        {
+          error = g_error_new_literal (COG_IDENTITY_PROVIDER_ERROR,
+                                       COG_IDENTITY_PROVIDER_ERROR_INVALID_PARAMETER,
+                                       "Malformed access token");
+          get_user_batch_complete_item (task, index, NULL, error);
+          continue;
+        }
 
-  if (!outcome.IsSuccess ())
-    {
-      auto& aws_error = outcome.GetError ();
-      GError *new_error = g_error_new_literal (COG_IDENTITY_PROVIDER_ERROR,
-                                               int (aws_error.GetErrorType ()),
-                                               aws_error.GetMessage ().c_str ());
-      g_propagate_error (error, new_error);
-      return FALSE;
+      auto *lookup = g_new0 (GetUserBatchLookup, 1);
+      lookup->task = G_TASK (g_object_ref (task));
+      lookup->index = index;
+      batch->n_in_flight++;
+      cog_client_fetch_user_async (self, access_token, cancellable,
+                                   get_user_batch_lookup_done, lookup);
     }
+}
 
-  if (g_cancellable_set_error_if_cancelled (cancellable, error))
-    return FALSE;
+static void
+get_user_batch_lookup_done (GObject *source,
+                            GAsyncResult *res,
+                            void *data)
+{
+  auto *lookup = static_cast<GetUserBatchLookup *> (data);
+  g_autoptr(GTask) task = lookup->task;
+  unsigned index = lookup->index;
+  g_free (lookup);
 
-  get_user_unpack_result(outcome.GetResult (), username, user_attributes,
-                         mfa_options, preferred_mfa_setting,
-                         user_mfa_settings_list);
+  auto *batch = static_cast<GetUserBatchData *> (g_task_get_task_data (task));
+  batch->n_in_flight--;
 
-  return TRUE;
+  GError *error = NULL;
+  CogUser *user = cog_client_fetch_user_finish (COG_CLIENT (source), res,
+                                                &error);
+  get_user_batch_complete_item (task, index, user, error);
+
+  get_user_batch_start_lookups (task);
 }
 
 /**
- * cog_client_get_user_async:
+ * cog_client_get_user_batch_async:
  * @self: the #CogClient
- * @access_token: the access token returned by the server response
+ * @access_tokens: (array zero-terminated=1): the access tokens to look up
+ * @max_concurrent: maximum number of lookups to have in progress at once, or
+ *   0 to use #CogClient:max-connections
  * @cancellable: (nullable): optional #GCancellable object
- * @callback: (nullable): a callback to call when the operation is complete
+ * @item_callback: (nullable) (scope notified) (closure item_user_data)
+ *   (destroy item_destroy): a callback to call as each lookup completes
+ * @item_user_data: (nullable): the data to pass to @item_callback
+ * @item_destroy: (nullable): a function to free @item_user_data when
+ *   @item_callback will not be called anymore
+ * @callback: (nullable): a callback to call when the whole batch is complete
  * @user_data: (nullable): the data to pass to @callback
  *
- * See cog_client_get_user() for documentation.
- * This version completes the request without blocking and calls @callback when
- * finished.
- * In your @callback, you must call cog_client_get_user_finish() to get the
- * results of the request.
+ * Does the equivalent of cog_client_fetch_user_async() for each of
+ * @access_tokens, with no more than @max_concurrent of them in progress at
+ * once.
+ * Lookups go through the user cache and are coalesced with other requests for
+ * the same access token, just like single requests.
+ *
+ * Each lookup succeeds or fails on its own.
+ * As each one completes, @item_callback is called with its outcome, so that
+ * results can be used without waiting for the slowest lookup.
+ * If @cancellable is cancelled, lookups that have not started yet fail with
+ * %G_IO_ERROR_CANCELLED.
+ *
+ * In your @callback, you must call cog_client_get_user_batch_finish() to get
+ * the outcomes of all the lookups.
  */
 void
-cog_client_get_user_async (CogClient *self,
-                           const char *access_token,
-                           GCancellable *cancellable,
-                           GAsyncReadyCallback callback,
-                           gpointer user_data)
+cog_client_get_user_batch_async (CogClient *self,
+                                 const char * const *access_tokens,
+                                 unsigned max_concurrent,
+                                 GCancellable *cancellable,
+                                 CogUserBatchItemCallback item_callback,
+                                 gpointer item_user_data,
+                                 GDestroyNotify item_destroy,
+                                 GAsyncReadyCallback callback,
+                                 gpointer user_data)
 {
-  g_return_if_fail(COG_IS_CLIENT (self));
-  g_return_if_fail(!cancellable || G_IS_CANCELLABLE (cancellable));
-  g_return_if_fail(get_user_validate_in_parameters (access_token));
-
-  GTask *task = g_task_new (self, cancellable, callback, user_data);
+  g_return_if_fail (COG_IS_CLIENT (self));
+  g_return_if_fail (access_tokens);
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
 
   CogClientPrivate *priv = GET_PRIVATE (self);
-  GetUserRequest request = get_user_build_request (access_token);
+  auto *batch = g_new0 (GetUserBatchData, 1);
+  batch->access_tokens = g_strdupv ((char **) access_tokens);
+  batch->n_tokens = g_strv_length (batch->access_tokens);
+  batch->max_concurrent = max_concurrent ? max_concurrent :
+    priv->max_connections;
+  batch->items = g_ptr_array_new_full (batch->n_tokens,
+                                       (GDestroyNotify) cog_user_batch_item_unref);
+  g_ptr_array_set_size (batch->items, batch->n_tokens);
+  batch->item_callback = item_callback;
+  batch->item_user_data = item_user_data;
+  batch->item_destroy = item_destroy;
 
-  priv->internal.GetUserAsync (request, get_user_handle_request,
-    Aws::MakeShared<GTaskAsyncContext> (_COG_ALLOCATION_TAG, task));
+  GTask *task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, (void *) cog_client_get_user_batch_async);
+  /* Cancellation is reported per item */
+  g_task_set_check_cancellable (task, FALSE);
+  g_task_set_task_data (task, batch, get_user_batch_data_free);
+
+  if (batch->n_tokens == 0)
+    g_task_return_pointer (task, g_ptr_array_ref (batch->items),
+                           (GDestroyNotify) g_ptr_array_unref);
+  else
+    get_user_batch_start_lookups (task);
+
+  g_object_unref (task);
 }
 
 /**
- * cog_client_get_user_finish:
+ * cog_client_get_user_batch_finish:
  * @self: the #CogClient
  * @res: the #GAsyncResult passed to your callback
- * @username: (out): the username of the user retrieved
- * @user_attributes: (out) (element-type utf8 utf8): a dictionary of user
- *   attributes
- * @mfa_options: (out) (element-type CogMFAOption): the options for MFA (e.g.,
- *   email or phone number)
- * @preferred_mfa_setting: (out): the user's preferred MFA setting
- * @user_mfa_settings_list: (out): list of the user's MFA settings
  * @error: error location
  *
- * See cog_client_get_user() for documentation.
- * After starting an asynchronous request with cog_client_get_user_async(), you
- * must call this in your callback to finish the request and receive the return
- * values or handle the errors.
+ * After starting a batch with cog_client_get_user_batch_async(), you must call
+ * this in your callback to receive the outcomes of the lookups.
+ * Failed lookups are reported in their items, not in @error.
  *
- * Returns: %TRUE if the request completed successfully, %FALSE on error
+ * Returns: (transfer full) (element-type CogUserBatchItem): a
+ *   #CogUserBatchItem for each access token, in the order they were given
  */
-gboolean
-cog_client_get_user_finish (CogClient *self,
-                            GAsyncResult *res,
-                            char **username,
-                            GHashTable **user_attributes,
-                            GList **mfa_options,
-                            char **preferred_mfa_setting,
-                            char ***user_mfa_settings_list,
-                            GError **error)
+GPtrArray *
+cog_client_get_user_batch_finish (CogClient *self,
+                                  GAsyncResult *res,
+                                  GError **error)
 {
-  g_return_val_if_fail (COG_IS_CLIENT (self), FALSE);
-  g_return_val_if_fail (G_IS_TASK (res), FALSE);
-  g_return_val_if_fail(!error || !*error, FALSE);
-  g_return_val_if_fail (
-    get_user_validate_out_parameters (username, user_attributes, mfa_options,
-                                      preferred_mfa_setting,
-                                      user_mfa_settings_list), FALSE);
-
-  auto *result =
-    static_cast<GetUserResult *> (g_task_propagate_pointer (G_TASK (res), error));
-  if (!result)
-    return FALSE;
+  g_return_val_if_fail (COG_IS_CLIENT (self), NULL);
+  g_return_val_if_fail (G_IS_TASK (res), NULL);
+  g_return_val_if_fail (!error || !*error, NULL);
 
-  get_user_unpack_result (*result, username, user_attributes, mfa_options,
-                          preferred_mfa_setting, user_mfa_settings_list);
-  delete result;
-  return TRUE;
+  return static_cast<GPtrArray *> (g_task_propagate_pointer (G_TASK (res),
+                                                             error));
 }
 
 static gboolean
@@ -487,14 +2804,15 @@ initiate_auth_validate_in_parameters (CogAuthFlow auth_flow,
                                       CogAnalyticsMetadata *analytics_metadata G_GNUC_UNUSED,
                                       CogUserContextData *user_context_data G_GNUC_UNUSED)
 {
+  size_t length;
+
   g_return_val_if_fail(auth_flow != COG_AUTH_FLOW_NOT_SET &&
                        auth_flow != COG_AUTH_FLOW_ADMIN_NO_SRP_AUTH,
                        FALSE);
   g_return_val_if_fail(auth_parameters, FALSE);
   g_return_val_if_fail(client_id, FALSE);
-  g_return_val_if_fail (*client_id, FALSE);
-  g_return_val_if_fail (strlen (client_id) <= 128, FALSE);
-  g_return_val_if_fail (_cog_is_valid_client_id (client_id), FALSE);
+  g_return_val_if_fail (_cog_is_valid_client_id (client_id, &length), FALSE);
+  g_return_val_if_fail (length <= 128, FALSE);
 
   switch (auth_flow)
     {
@@ -536,7 +2854,8 @@ initiate_auth_validate_out_parameters (CogAuthenticationResult **auth_result,
 }
 
 static InitiateAuthRequest
-initiate_auth_build_request (CogAuthFlow auth_flow,
+initiate_auth_build_request (CogClient *self,
+                             CogAuthFlow auth_flow,
                              GHashTable *auth_parameters,
                              const char *client_id,
                              GHashTable *client_metadata,
@@ -555,6 +2874,17 @@ initiate_auth_build_request (CogAuthFlow auth_flow,
     },
     &request);
 
+  if (!g_hash_table_contains (auth_parameters, COG_PARAMETER_SECRET_HASH))
+    {
+      auto *username =
+        static_cast<const char *> (g_hash_table_lookup (auth_parameters,
+                                                        COG_PARAMETER_USERNAME));
+      g_autofree char *secret_hash = client_secret_hash (self, username,
+                                                         client_id);
+      if (secret_hash)
+        request.AddAuthParameters (COG_PARAMETER_SECRET_HASH, secret_hash);
+    }
+
   if (client_metadata)
     {
       g_hash_table_foreach (client_metadata, [](void *key, void *value, void *data)
@@ -575,8 +2905,11 @@ initiate_auth_build_request (CogAuthFlow auth_flow,
   return request;
 }
 
+/* Also used for the RespondToAuthChallengeResult of each step of a login,
+ * which has the same fields */
+template <typename Result>
 static void
-initiate_auth_unpack_result (InitiateAuthResult& result,
+initiate_auth_unpack_result (const Result& result,
                              CogAuthenticationResult **auth_result,
                              CogChallengeName *challenge_name,
                              GHashTable **challenge_parameters,
@@ -604,41 +2937,57 @@ initiate_auth_unpack_result (InitiateAuthResult& result,
   *session = NULL;
 }
 
-/* Work around the lack of a copy or move constructor. See above */
-static InitiateAuthResult *
-initiate_auth_move_result (const InitiateAuthResult&& result)
+/* The return values of cog_client_initiate_auth_finish(). See
+ * GetUserReturn. */
+typedef struct
+{
+  CogAuthenticationResult *auth_result;
+  CogChallengeName challenge_name;
+  GHashTable *challenge_parameters;
+  char *session;
+} InitiateAuthReturn;
+
+static InitiateAuthReturn *
+initiate_auth_return_new (const InitiateAuthResult& result)
 {
-  auto *retval = new InitiateAuthResult ();
-  retval->SetAuthenticationResult (std::move (result.GetAuthenticationResult ()));
-  retval->SetChallengeName (std::move (result.GetChallengeName ()));
-  retval->SetChallengeParameters (std::move (result.GetChallengeParameters ()));
-  retval->SetSession (std::move (result.GetSession ()));
+  auto *retval = g_new (InitiateAuthReturn, 1);
+  initiate_auth_unpack_result (result, &retval->auth_result,
+                               &retval->challenge_name,
+                               &retval->challenge_parameters,
+                               &retval->session);
   return retval;
 }
 
+static void
+initiate_auth_return_free (void *data)
+{
+  auto *ret = static_cast<InitiateAuthReturn *> (data);
+  g_clear_pointer (&ret->auth_result, cog_authentication_result_unref);
+  g_clear_pointer (&ret->challenge_parameters, g_hash_table_unref);
+  g_free (ret->session);
+  g_free (ret);
+}
+
 static void
 initiate_auth_handle_request (const CognitoIdentityProviderClient *client G_GNUC_UNUSED,
                               const InitiateAuthRequest& request G_GNUC_UNUSED,
                               const InitiateAuthOutcome& outcome,
+                              RequestTiming& timing,
                               const std::shared_ptr<const AsyncCallerContext>& cx)
 {
   GTask *task = std::static_pointer_cast<const GTaskAsyncContext> (cx)->task();
 
   if (!outcome.IsSuccess ())
     {
-      auto& aws_error = outcome.GetError ();
-      GError *new_error = g_error_new_literal (COG_IDENTITY_PROVIDER_ERROR,
-                                               int(aws_error.GetErrorType ()),
-                                               aws_error.GetMessage ().c_str ());
-      g_task_return_error (task, new_error);
+      GError *error = client_error_from_internal (outcome.GetError (), NULL);
+      timing.unpacked ();
+      client_return_error (task, error);
       return;
     }
 
-  InitiateAuthResult *result_ref = initiate_auth_move_result (std::move (outcome.GetResult ()));
-  g_task_return_pointer (task, result_ref, [](void *data)
-    {
-      delete static_cast<InitiateAuthResult *> (data);
-    });
+  InitiateAuthReturn *retval = initiate_auth_return_new (outcome.GetResult ());
+  timing.unpacked ();
+  client_return_pointer (task, retval, initiate_auth_return_free);
 }
 
 /**
@@ -705,6 +3054,11 @@ initiate_auth_handle_request (const CognitoIdentityProviderClient *client G_GNUC
  * the next call (cog_client_respond_to_auth_challenge()).
  * Note that all of these challenges require %COG_PARAMETER_USERNAME and
  * %COG_PARAMETER_SECRET_HASH (if applicable) in the parameters.
+ *
+ * If #CogClient:client-secret is set and @auth_parameters has no `SECRET_HASH`,
+ * it is computed from `USERNAME`.
+ * For the refresh token flows, which do not otherwise need `USERNAME`, pass
+ * the user's `sub` attribute as `USERNAME` for that.
  * The @session should be passed both ways in challenge-response calls to the
  * service.
  * If the cog_client_initiate_auth() or cog_client_respond_to_auth_challenge()
@@ -745,28 +3099,36 @@ cog_client_initiate_auth (CogClient *self,
   if (g_cancellable_set_error_if_cancelled (cancellable, error))
     return FALSE;
 
-  CogClientPrivate *priv = GET_PRIVATE (self);
+  RequestTiming timing (self, OPERATION_INITIATE_AUTH);
   InitiateAuthRequest request =
-    initiate_auth_build_request (auth_flow, auth_parameters, client_id,
+    initiate_auth_build_request (self, auth_flow, auth_parameters, client_id,
                                  client_metadata, analytics_metadata,
                                  user_context_data);
-  auto outcome = priv->internal.InitiateAuth (request);
+  timing.built ();
+  if (!client_admit (self, COG_QUOTA_CATEGORY_USER_AUTHENTICATION, cancellable,
+                     error))
+    return FALSE;
+  client_prepare_request (self, request, cancellable);
+  auto outcome = client_send_initiate_auth (self, timing, request);
 
-  if (!outcome.IsSuccess ())
+  /* An aborted request fails, so check this first */
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
     {
-      auto& aws_error = outcome.GetError ();
-      GError *new_error = g_error_new_literal (COG_IDENTITY_PROVIDER_ERROR,
-                                               int (aws_error.GetErrorType ()),
-                                               aws_error.GetMessage ().c_str ());
-      g_propagate_error (error, new_error);
+      timing.unpacked ();
       return FALSE;
     }
 
-  if (g_cancellable_set_error_if_cancelled (cancellable, error))
-    return FALSE;
+  if (!outcome.IsSuccess ())
+    {
+      g_propagate_error (error, client_error_from_internal (outcome.GetError (),
+                                                           NULL));
+      timing.unpacked ();
+      return FALSE;
+    }
 
   initiate_auth_unpack_result(outcome.GetResult (), auth_result, challenge_name,
                               challenge_parameters, session);
+  timing.unpacked ();
 
   return TRUE;
 }
@@ -814,13 +3176,24 @@ cog_client_initiate_auth_async (CogClient *self,
   GTask *task = g_task_new (self, cancellable, callback, user_data);
 
   CogClientPrivate *priv = GET_PRIVATE (self);
+  RequestTiming timing (self, OPERATION_INITIATE_AUTH);
   InitiateAuthRequest request =
-    initiate_auth_build_request (auth_flow, auth_parameters, client_id,
+    initiate_auth_build_request (self, auth_flow, auth_parameters, client_id,
                                  client_metadata, analytics_metadata,
                                  user_context_data);
+  client_prepare_request (self, request, cancellable);
+  timing.built ();
+  auto cx = Aws::MakeShared<GTaskAsyncContext> (_COG_ALLOCATION_TAG, task);
 
-  priv->internal.InitiateAuthAsync (request, initiate_auth_handle_request,
-    Aws::MakeShared<GTaskAsyncContext> (_COG_ALLOCATION_TAG, task));
+  client_submit (self, COG_QUOTA_CATEGORY_USER_AUTHENTICATION, task,
+                 [self, priv, request, timing, cx]
+    {
+      RequestTiming sending (timing);
+      auto outcome = client_send_initiate_auth (self, sending, request);
+      initiate_auth_handle_request (&priv->backend->internal, request, outcome,
+                                    sending, cx);
+    });
+  g_object_unref (task);
 }
 
 /**
@@ -838,38 +3211,505 @@ cog_client_initiate_auth_async (CogClient *self,
  *   another challenge
  * @error: error location
  *
- * See cog_client_initiate_auth() for documentation.
- * After starting an asynchronous request with cog_client_initiate_auth_async(),
- * you must call this in your callback to finish the request and receive the
- * return values or handle the errors.
+ * See cog_client_initiate_auth() for documentation.
+ * After starting an asynchronous request with cog_client_initiate_auth_async(),
+ * you must call this in your callback to finish the request and receive the
+ * return values or handle the errors.
+ *
+ * Returns: %TRUE if the request completed successfully, %FALSE on error
+ */
+gboolean
+cog_client_initiate_auth_finish (CogClient *self,
+                                 GAsyncResult *res,
+                                 CogAuthenticationResult **auth_result,
+                                 CogChallengeName *challenge_name,
+                                 GHashTable **challenge_parameters,
+                                 char **session,
+                                 GError **error)
+{
+  g_return_val_if_fail (COG_IS_CLIENT (self), FALSE);
+  g_return_val_if_fail (G_IS_TASK (res), FALSE);
+  g_return_val_if_fail(!error || !*error, FALSE);
+  g_return_val_if_fail (
+    initiate_auth_validate_out_parameters (auth_result, challenge_name,
+                                           challenge_parameters, session),
+    FALSE);
+
+  auto *ret =
+    static_cast<InitiateAuthReturn *> (g_task_propagate_pointer (G_TASK (res), error));
+  if (!ret)
+    return FALSE;
+
+  *auth_result = ret->auth_result;
+  *challenge_name = ret->challenge_name;
+  *challenge_parameters = ret->challenge_parameters;
+  *session = ret->session;
+  g_free (ret);
+  return TRUE;
+}
+
+/**
+ * cog_client_initiate_auth_direct: (skip)
+ * @self: the #CogClient
+ * @auth_flow: the authentication flow for this call to execute
+ * @auth_parameters: (element-type utf8 utf8): the authentication parameters
+ * @client_id: the app client ID
+ * @client_metadata: (nullable) (element-type utf8 utf8): a map for custom
+ *   parameters
+ * @analytics_metadata: (nullable): Amazon Pinpoint analytics metadata for
+ *   collecting metrics
+ * @user_context_data: (nullable): contextual data for security analysis
+ * @cancellable: (nullable): optional #GCancellable object
+ * @callback: a callback to call when the operation is complete
+ * @user_data: (nullable): the data to pass to @callback
+ *
+ * See cog_client_initiate_auth() for documentation.
+ * This version completes the request without blocking and without a main
+ * loop; @callback is called on one of the client's worker threads.
+ * See the introduction to #CogClient.
+ */
+void
+cog_client_initiate_auth_direct (CogClient *self,
+                                 CogAuthFlow auth_flow,
+                                 GHashTable *auth_parameters,
+                                 const char *client_id,
+                                 GHashTable *client_metadata,
+                                 CogAnalyticsMetadata *analytics_metadata,
+                                 CogUserContextData *user_context_data,
+                                 GCancellable *cancellable,
+                                 CogInitiateAuthDirectCallback callback,
+                                 gpointer user_data)
+{
+  g_return_if_fail (COG_IS_CLIENT (self));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+  g_return_if_fail (callback);
+  g_return_if_fail (
+    initiate_auth_validate_in_parameters (auth_flow, auth_parameters, client_id,
+                                          client_metadata, analytics_metadata,
+                                          user_context_data));
+
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  RequestTiming timing (self, OPERATION_INITIATE_AUTH);
+  InitiateAuthRequest request =
+    initiate_auth_build_request (self, auth_flow, auth_parameters, client_id,
+                                 client_metadata, analytics_metadata,
+                                 user_context_data);
+  client_prepare_request (self, request, cancellable);
+  timing.built ();
+
+  client_submit_direct (self, COG_QUOTA_CATEGORY_USER_AUTHENTICATION,
+                        cancellable,
+                        [self, priv, request, timing, cancellable, callback,
+                         user_data]
+    {
+      RequestTiming sending (timing);
+      auto outcome = client_send_initiate_auth (self, sending, request);
+      if (!outcome.IsSuccess ())
+        {
+          GError *error = client_error_from_internal (outcome.GetError (),
+                                                      cancellable);
+          sending.unpacked ();
+          callback (self, NULL, COG_CHALLENGE_NAME_NOT_SET, NULL, NULL, error,
+                    user_data);
+          g_error_free (error);
+          return;
+        }
+
+      auto *ret = initiate_auth_return_new (outcome.GetResult ());
+      sending.unpacked ();
+      callback (self, ret->auth_result, ret->challenge_name,
+                ret->challenge_parameters, ret->session, NULL, user_data);
+      initiate_auth_return_free (ret);
+    },
+                        [self, callback, user_data] (const GError *error)
+    {
+      callback (self, NULL, COG_CHALLENGE_NAME_NOT_SET, NULL, NULL, error,
+                user_data);
+    });
+}
+
+/* Builds the request that answers the challenge @login is waiting on with
+ * @responses, adding the USERNAME, DEVICE_KEY and SECRET_HASH that every
+ * response needs, if they are missing */
+static RespondToAuthChallengeRequest
+log_in_build_response (CogClient *self,
+                       CogLogin *login,
+                       GHashTable *responses)
+{
+  RespondToAuthChallengeRequest request;
+  request.WithChallengeName (ChallengeNameType (login->challenge_name))
+    .WithClientId (login->client_id)
+    .SetSession (login->session);
+
+  g_hash_table_foreach (responses, [](void *key, void *value, void *data)
+    {
+      auto *request = static_cast<RespondToAuthChallengeRequest *> (data);
+      request->AddChallengeResponses (static_cast<const char *> (key),
+                                      static_cast<const char *> (value));
+    },
+    &request);
+
+  auto *username =
+    static_cast<const char *> (g_hash_table_lookup (responses,
+                                                    COG_PARAMETER_USERNAME));
+  if (!username)
+    {
+      username = login->challenge_username ? login->challenge_username :
+                                             login->username;
+      request.AddChallengeResponses (COG_PARAMETER_USERNAME, username);
+    }
+
+  if (login->device_key &&
+      !g_hash_table_contains (responses, COG_PARAMETER_DEVICE_KEY))
+    request.AddChallengeResponses (COG_PARAMETER_DEVICE_KEY, login->device_key);
+
+  if (!g_hash_table_contains (responses, COG_PARAMETER_SECRET_HASH))
+    {
+      g_autofree char *secret_hash = client_secret_hash (self, username,
+                                                         login->client_id);
+      if (secret_hash)
+        request.AddChallengeResponses (COG_PARAMETER_SECRET_HASH, secret_hash);
+    }
+
+  return request;
+}
+
+static GHashTable *
+log_in_new_responses (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+}
+
+/* Decides what comes after a step of @login that ended with @result. Returns
+ * %TRUE with the @responses to send next if the challenge needs nothing from
+ * the app; otherwise returns %FALSE with either the @ret to complete the login
+ * with, or an @error. */
+template <typename Result>
+static bool
+log_in_next_step (CogLogin *login,
+                  const Result& result,
+                  InitiateAuthReturn **ret,
+                  GHashTable **responses,
+                  GError **error)
+{
+  *responses = NULL;
+
+  auto *retval = g_new (InitiateAuthReturn, 1);
+  initiate_auth_unpack_result (result, &retval->auth_result,
+                               &retval->challenge_name,
+                               &retval->challenge_parameters,
+                               &retval->session);
+  login->challenge_name = retval->challenge_name;
+  g_free (login->session);
+  login->session = retval->session;
+  retval->session = NULL;
+
+  if (retval->challenge_name == COG_CHALLENGE_NAME_NOT_SET)
+    {
+      *ret = retval;
+      return false;
+    }
+
+  auto *username =
+    static_cast<const char *> (g_hash_table_lookup (retval->challenge_parameters,
+                                                    COG_PARAMETER_USERNAME));
+  if (username)
+    {
+      g_free (login->challenge_username);
+      login->challenge_username = g_strdup (username);
+    }
+
+  switch (retval->challenge_name)
+    {
+    case COG_CHALLENGE_NAME_PASSWORD_VERIFIER:
+      *responses =
+        cog_srp_session_respond_to_password_verifier (login->srp_session,
+                                                      login->password,
+                                                      retval->challenge_parameters,
+                                                      error);
+      break;
+
+    case COG_CHALLENGE_NAME_DEVICE_SRP_AUTH:
+      if (!login->device_key)
+        goto for_app;
+      g_clear_pointer (&login->srp_session, cog_srp_session_unref);
+      login->srp_session = cog_srp_client_start_session (login->srp_client);
+      *responses = log_in_new_responses ();
+      g_hash_table_insert (*responses, g_strdup (COG_PARAMETER_SRP_A),
+                           g_strdup (cog_srp_session_get_srp_a (login->srp_session)));
+      break;
+
+    case COG_CHALLENGE_NAME_DEVICE_PASSWORD_VERIFIER:
+      if (!login->device_key)
+        goto for_app;
+      *responses =
+        cog_srp_session_respond_to_device_password_verifier (login->srp_session,
+                                                             login->device_group_key,
+                                                             login->device_key,
+                                                             login->device_password,
+                                                             retval->challenge_parameters,
+                                                             error);
+      break;
+
+    case COG_CHALLENGE_NAME_NEW_PASSWORD_REQUIRED:
+      if (!login->new_password)
+        goto for_app;
+      *responses = log_in_new_responses ();
+      g_hash_table_insert (*responses, g_strdup (COG_PARAMETER_NEW_PASSWORD),
+                           g_strdup (login->new_password));
+      break;
+
+    default:
+      goto for_app;
+    }
+
+  initiate_auth_return_free (retval);
+  return *responses != NULL;
+
+for_app:
+  *ret = retval;
+  return false;
+}
+
+/* Completes @task unless the step that ended with @outcome leads to another
+ * one that needs nothing from the app, in which case it returns %TRUE with the
+ * @responses to send. The SRP computations for those responses count towards
+ * the time @timing reports for unpacking the step. */
+template <typename Outcome>
+static bool
+log_in_handle_outcome (CogLogin *login,
+                       GTask *task,
+                       const Outcome& outcome,
+                       RequestTiming& timing,
+                       GHashTable **responses)
+{
+  GCancellable *cancellable = g_task_get_cancellable (task);
+  InitiateAuthReturn *ret = NULL;
+  GError *error = NULL;
+
+  if (!outcome.IsSuccess ())
+    {
+      error = client_error_from_internal (outcome.GetError (), cancellable);
+      timing.unpacked ();
+      client_return_error (task, error);
+      return false;
+    }
+
+  bool next = log_in_next_step (login, outcome.GetResult (), &ret, responses,
+                                &error);
+  timing.unpacked ();
+  if (next)
+    return true;
+
+  if (error)
+    client_return_error (task, error);
+  else
+    client_return_pointer (task, ret, initiate_auth_return_free);
+  return false;
+}
+
+static void log_in_continue (CogClient *self,
+                             CogLogin *login,
+                             GTask *task,
+                             GHashTable *responses);
+
+/* Runs on a worker thread: sends @responses, and goes on answering challenges
+ * until Cognito returns tokens, an error, or a challenge for the app */
+static void
+log_in_respond (CogClient *self,
+                CogLogin *login,
+                GTask *task,
+                GHashTable *responses)
+{
+  RequestTiming timing (self, OPERATION_RESPOND_TO_AUTH_CHALLENGE);
+  RespondToAuthChallengeRequest request =
+    log_in_build_response (self, login, responses);
+  g_hash_table_unref (responses);
+  client_prepare_request (self, request, g_task_get_cancellable (task));
+  timing.built ();
+  auto outcome = client_send_respond_to_auth_challenge (self, timing, request);
+
+  if (log_in_handle_outcome (login, task, outcome, timing, &responses))
+    log_in_continue (self, login, task, responses);
+}
+
+/* Takes ownership of @responses, and sends them from a worker thread once the
+ * rate limit allows it, like any other request. Each step of a login is a
+ * job of its own, so that a step waiting for its turn does not hold on to a
+ * worker thread. */
+static void
+log_in_continue (CogClient *self,
+                 CogLogin *login,
+                 GTask *task,
+                 GHashTable *responses)
+{
+  std::shared_ptr<GHashTable> ref (responses, g_hash_table_unref);
+  client_submit (self, COG_QUOTA_CATEGORY_USER_AUTHENTICATION, task,
+                 [self, login, task, ref]
+    {
+      log_in_respond (self, login, task, g_hash_table_ref (ref.get ()));
+    });
+}
+
+/**
+ * cog_client_log_in_async:
+ * @self: the #CogClient
+ * @login: the #CogLogin to run
+ * @cancellable: (nullable): optional #GCancellable object
+ * @callback: (nullable): a callback to call when the operation is complete
+ * @user_data: (nullable): the data to pass to @callback
+ *
+ * Logs in with %COG_AUTH_FLOW_USER_SRP_AUTH, answering every challenge that
+ * @login has what it takes to answer, without going back to the thread that
+ * called this in between.
+ * cog_client_initiate_auth() and each challenge response are sent one after
+ * the other from the client's worker threads, which also do the SRP
+ * computations.
+ *
+ * %COG_CHALLENGE_NAME_PASSWORD_VERIFIER is always answered.
+ * %COG_CHALLENGE_NAME_DEVICE_SRP_AUTH and
+ * %COG_CHALLENGE_NAME_DEVICE_PASSWORD_VERIFIER are answered if a device was
+ * set with cog_login_set_device(), and
+ * %COG_CHALLENGE_NAME_NEW_PASSWORD_REQUIRED if a new password was set with
+ * cog_login_set_new_password().
+ * Other challenges, such as %COG_CHALLENGE_NAME_SMS_MFA, need input from the
+ * user; for those, cog_client_log_in_finish() returns the challenge, and the
+ * login goes on with cog_client_log_in_respond_async().
+ *
+ * %COG_PARAMETER_SECRET_HASH is added to each request if
+ * #CogClient:client-secret is set.
+ */
+void
+cog_client_log_in_async (CogClient *self,
+                         CogLogin *login,
+                         GCancellable *cancellable,
+                         GAsyncReadyCallback callback,
+                         gpointer user_data)
+{
+  g_return_if_fail (COG_IS_CLIENT (self));
+  g_return_if_fail (login);
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  GTask *task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_task_data (task, cog_login_ref (login),
+                        (GDestroyNotify) cog_login_unref);
+
+  client_submit (self, COG_QUOTA_CATEGORY_USER_AUTHENTICATION, task,
+                 [self, login, task, cancellable]
+    {
+      RequestTiming timing (self, OPERATION_INITIATE_AUTH);
+      g_clear_pointer (&login->srp_session, cog_srp_session_unref);
+      login->srp_session = cog_srp_client_start_session (login->srp_client);
+      g_clear_pointer (&login->challenge_username, g_free);
+
+      GHashTable *auth_parameters = g_hash_table_new (g_str_hash, g_str_equal);
+      g_hash_table_insert (auth_parameters, (void *) COG_PARAMETER_USERNAME,
+                           login->username);
+      g_hash_table_insert (auth_parameters, (void *) COG_PARAMETER_SRP_A,
+                           (void *) cog_srp_session_get_srp_a (login->srp_session));
+      if (login->device_key)
+        g_hash_table_insert (auth_parameters, (void *) COG_PARAMETER_DEVICE_KEY,
+                             login->device_key);
+      InitiateAuthRequest request =
+        initiate_auth_build_request (self, COG_AUTH_FLOW_USER_SRP_AUTH,
+                                     auth_parameters, login->client_id, NULL,
+                                     NULL, NULL);
+      g_hash_table_unref (auth_parameters);
+
+      client_prepare_request (self, request, cancellable);
+      timing.built ();
+      auto outcome = client_send_initiate_auth (self, timing, request);
+
+      GHashTable *responses;
+      if (log_in_handle_outcome (login, task, outcome, timing, &responses))
+        log_in_continue (self, login, task, responses);
+    });
+  g_object_unref (task);
+}
+
+/**
+ * cog_client_log_in_respond_async:
+ * @self: the #CogClient
+ * @login: a #CogLogin for which cog_client_log_in_finish() returned a
+ *   challenge
+ * @responses: (element-type utf8 utf8): the responses to that challenge, for
+ *   example %COG_PARAMETER_SMS_MFA_CODE for %COG_CHALLENGE_NAME_SMS_MFA
+ * @cancellable: (nullable): optional #GCancellable object
+ * @callback: (nullable): a callback to call when the operation is complete
+ * @user_data: (nullable): the data to pass to @callback
+ *
+ * Answers the challenge that the last step of @login returned, and goes on
+ * with the login like cog_client_log_in_async().
+ * %COG_PARAMETER_USERNAME, %COG_PARAMETER_DEVICE_KEY and
+ * %COG_PARAMETER_SECRET_HASH are added to @responses if they are needed and
+ * missing.
+ *
+ * In your @callback, call cog_client_log_in_finish() to get the results.
+ */
+void
+cog_client_log_in_respond_async (CogClient *self,
+                                 CogLogin *login,
+                                 GHashTable *responses,
+                                 GCancellable *cancellable,
+                                 GAsyncReadyCallback callback,
+                                 gpointer user_data)
+{
+  g_return_if_fail (COG_IS_CLIENT (self));
+  g_return_if_fail (login);
+  g_return_if_fail (login->challenge_name != COG_CHALLENGE_NAME_NOT_SET);
+  g_return_if_fail (responses);
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  GTask *task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_task_data (task, cog_login_ref (login),
+                        (GDestroyNotify) cog_login_unref);
+
+  log_in_continue (self, login, task, g_hash_table_ref (responses));
+  g_object_unref (task);
+}
+
+/**
+ * cog_client_log_in_finish:
+ * @self: the #CogClient
+ * @res: the #GAsyncResult passed to your callback
+ * @auth_result: (out) (nullable): the tokens of the logged-in user, or %NULL
+ *   if the app needs to answer another challenge
+ * @challenge_name: (out): the challenge for the app to answer, or
+ *   %COG_CHALLENGE_NAME_NOT_SET if the user is logged in
+ * @challenge_parameters: (out) (nullable): the parameters of the challenge, or
+ *   %NULL if the user is logged in
+ * @error: error location
+ *
+ * Finishes a step of a login started with cog_client_log_in_async() or
+ * continued with cog_client_log_in_respond_async().
+ * The session to pass back and forth with Cognito is kept in the #CogLogin.
  *
  * Returns: %TRUE if the request completed successfully, %FALSE on error
  */
 gboolean
-cog_client_initiate_auth_finish (CogClient *self,
-                                 GAsyncResult *res,
-                                 CogAuthenticationResult **auth_result,
-                                 CogChallengeName *challenge_name,
-                                 GHashTable **challenge_parameters,
-                                 char **session,
-                                 GError **error)
+cog_client_log_in_finish (CogClient *self,
+                          GAsyncResult *res,
+                          CogAuthenticationResult **auth_result,
+                          CogChallengeName *challenge_name,
+                          GHashTable **challenge_parameters,
+                          GError **error)
 {
   g_return_val_if_fail (COG_IS_CLIENT (self), FALSE);
   g_return_val_if_fail (G_IS_TASK (res), FALSE);
-  g_return_val_if_fail(!error || !*error, FALSE);
-  g_return_val_if_fail (
-    initiate_auth_validate_out_parameters (auth_result, challenge_name,
-                                           challenge_parameters, session),
-    FALSE);
+  g_return_val_if_fail (!error || !*error, FALSE);
+  g_return_val_if_fail (auth_result, FALSE);
+  g_return_val_if_fail (challenge_name, FALSE);
+  g_return_val_if_fail (challenge_parameters, FALSE);
 
-  auto *result =
-    static_cast<InitiateAuthResult *> (g_task_propagate_pointer (G_TASK (res), error));
-  if (!result)
+  auto *ret = static_cast<InitiateAuthReturn *> (g_task_propagate_pointer (G_TASK (res),
+                                                                           error));
+  if (!ret)
     return FALSE;
 
-  initiate_auth_unpack_result (*result, auth_result, challenge_name,
-                               challenge_parameters, session);
-  delete result;
+  *auth_result = ret->auth_result;
+  *challenge_name = ret->challenge_name;
+  *challenge_parameters = ret->challenge_parameters;
+  g_free (ret);
   return TRUE;
 }
 
@@ -883,24 +3723,22 @@ sign_up_validate_in_parameters (const char *client_id,
                                 CogAnalyticsMetadata *analytics_metadata G_GNUC_UNUSED,
                                 CogUserContextData *user_context_data G_GNUC_UNUSED)
 {
+  size_t length;
+
   g_return_val_if_fail (client_id, FALSE);
-  g_return_val_if_fail (*client_id, FALSE);
-  g_return_val_if_fail (strlen (client_id) <= 128, FALSE);
-  g_return_val_if_fail (_cog_is_valid_client_id (client_id), FALSE);
+  g_return_val_if_fail (_cog_is_valid_client_id (client_id, &length), FALSE);
+  g_return_val_if_fail (length <= 128, FALSE);
   g_return_val_if_fail (username, FALSE);
-  g_return_val_if_fail (*username, FALSE);
-  g_return_val_if_fail (strlen (username) <= 128, FALSE);
-  g_return_val_if_fail (_cog_is_valid_username (username), FALSE);
+  g_return_val_if_fail (_cog_is_valid_username (username, &length), FALSE);
+  g_return_val_if_fail (length <= 128, FALSE);
   g_return_val_if_fail (password, FALSE);
-  g_return_val_if_fail (*password, FALSE);
-  g_return_val_if_fail (strlen (password) >= 6 && strlen (password) <= 256,
-                        FALSE);
-  g_return_val_if_fail (_cog_is_valid_password (password), FALSE);
+  g_return_val_if_fail (_cog_is_valid_password (password, &length), FALSE);
+  g_return_val_if_fail (length >= 6 && length <= 256, FALSE);
   if (secret_hash)
     {
-      g_return_val_if_fail (*secret_hash, FALSE);
-      g_return_val_if_fail (strlen (secret_hash) > 128, FALSE);
-      g_return_val_if_fail (_cog_is_valid_secret_hash (secret_hash), FALSE);
+      g_return_val_if_fail (_cog_is_valid_secret_hash (secret_hash, &length),
+                            FALSE);
+      g_return_val_if_fail (length <= 128, FALSE);
     }
 
   return TRUE;
@@ -918,7 +3756,8 @@ sign_up_validate_out_parameters (gboolean *user_confirmed,
 }
 
 static SignUpRequest
-sign_up_build_request (const char *client_id,
+sign_up_build_request (CogClient *self,
+                       const char *client_id,
                        const char *secret_hash,
                        const char *username,
                        const char *password,
@@ -932,6 +3771,10 @@ sign_up_build_request (const char *client_id,
     .WithUsername (username)
     .SetPassword (password);
 
+  g_autofree char *computed_hash = NULL;
+  if (!secret_hash)
+    secret_hash = computed_hash = client_secret_hash (self, username,
+                                                      client_id);
   if (secret_hash)
     request.SetSecretHash (secret_hash);
 
@@ -959,7 +3802,7 @@ sign_up_build_request (const char *client_id,
 }
 
 static void
-sign_up_unpack_result (SignUpResult& result,
+sign_up_unpack_result (const SignUpResult& result,
                        gboolean *user_confirmed,
                        CogCodeDeliveryDetails **code_delivery_details,
                        const char **user_sub)
@@ -969,40 +3812,52 @@ sign_up_unpack_result (SignUpResult& result,
   *user_sub = g_strdup (result.GetUserSub ().c_str ());
 }
 
-/* Work around the lack of a copy or move constructor. See above. */
-static SignUpResult *
-sign_up_move_result (const SignUpResult&& result)
+/* The return values of cog_client_sign_up_finish(). See GetUserReturn. */
+typedef struct
+{
+  gboolean user_confirmed;
+  CogCodeDeliveryDetails *code_delivery_details;
+  const char *user_sub;
+} SignUpReturn;
+
+static SignUpReturn *
+sign_up_return_new (const SignUpResult& result)
 {
-  auto *retval = new SignUpResult ();
-  retval->SetUserConfirmed (result.GetUserConfirmed ());
-  retval->SetCodeDeliveryDetails (std::move (result.GetCodeDeliveryDetails ()));
-  retval->SetUserSub (std::move (result.GetUserSub ()));
+  auto *retval = g_new (SignUpReturn, 1);
+  sign_up_unpack_result (result, &retval->user_confirmed,
+                         &retval->code_delivery_details, &retval->user_sub);
   return retval;
 }
 
+static void
+sign_up_return_free (void *data)
+{
+  auto *ret = static_cast<SignUpReturn *> (data);
+  g_clear_pointer (&ret->code_delivery_details, cog_code_delivery_details_unref);
+  g_free ((char *) ret->user_sub);
+  g_free (ret);
+}
+
 static void
 sign_up_handle_request (const CognitoIdentityProviderClient *client G_GNUC_UNUSED,
                         const SignUpRequest& request G_GNUC_UNUSED,
                         const SignUpOutcome& outcome,
+                        RequestTiming& timing,
                         const std::shared_ptr<const AsyncCallerContext>& cx)
 {
   GTask *task = std::static_pointer_cast<const GTaskAsyncContext> (cx)->task();
 
   if (!outcome.IsSuccess ())
     {
-      auto& aws_error = outcome.GetError ();
-      GError *new_error = g_error_new_literal (COG_IDENTITY_PROVIDER_ERROR,
-                                               int(aws_error.GetErrorType ()),
-                                               aws_error.GetMessage ().c_str ());
-      g_task_return_error (task, new_error);
+      GError *error = client_error_from_internal (outcome.GetError (), NULL);
+      timing.unpacked ();
+      client_return_error (task, error);
       return;
     }
 
-  SignUpResult *result_ref = sign_up_move_result (std::move (outcome.GetResult ()));
-  g_task_return_pointer (task, result_ref, [](void *data)
-    {
-      delete static_cast<SignUpResult *> (data);
-    });
+  SignUpReturn *retval = sign_up_return_new (outcome.GetResult ());
+  timing.unpacked ();
+  client_return_pointer (task, retval, sign_up_return_free);
 }
 
 /**
@@ -1032,6 +3887,7 @@ sign_up_handle_request (const CognitoIdentityProviderClient *client G_GNUC_UNUSE
  * If given, @secret_hash must be a keyed-hash message authentication code
  * (HMAC) calculated using the secret key of a user pool client and username
  * plus the client ID in the message.
+ * If %NULL, it is computed from #CogClient:client-secret, if that is set.
  *
  * If including custom attributes in @user_attributes, you must prepend the
  * `custom:` prefix to the attribute key.
@@ -1075,28 +3931,36 @@ cog_client_sign_up (CogClient *self,
   if (g_cancellable_set_error_if_cancelled (cancellable, error))
     return FALSE;
 
-  CogClientPrivate *priv = GET_PRIVATE (self);
+  RequestTiming timing (self, OPERATION_SIGN_UP);
   SignUpRequest request =
-    sign_up_build_request (client_id, secret_hash, username, password,
+    sign_up_build_request (self, client_id, secret_hash, username, password,
                            user_attributes, validation_data, analytics_metadata,
                            user_context_data);
-  auto outcome = priv->internal.SignUp (request);
+  timing.built ();
+  if (!client_admit (self, COG_QUOTA_CATEGORY_USER_CREATION, cancellable,
+                     error))
+    return FALSE;
+  client_prepare_request (self, request, cancellable);
+  auto outcome = client_send_sign_up (self, timing, request);
 
-  if (!outcome.IsSuccess ())
+  /* An aborted request fails, so check this first */
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
     {
-      auto& aws_error = outcome.GetError ();
-      GError *new_error = g_error_new_literal (COG_IDENTITY_PROVIDER_ERROR,
-                                               int (aws_error.GetErrorType ()),
-                                               aws_error.GetMessage ().c_str ());
-      g_propagate_error (error, new_error);
+      timing.unpacked ();
       return FALSE;
     }
 
-  if (g_cancellable_set_error_if_cancelled (cancellable, error))
-    return FALSE;
+  if (!outcome.IsSuccess ())
+    {
+      g_propagate_error (error, client_error_from_internal (outcome.GetError (),
+                                                           NULL));
+      timing.unpacked ();
+      return FALSE;
+    }
 
   sign_up_unpack_result(outcome.GetResult (), user_confirmed,
                         code_delivery_details, user_sub);
+  timing.unpacked ();
 
   return TRUE;
 }
@@ -1148,13 +4012,24 @@ cog_client_sign_up_async (CogClient *self,
   GTask *task = g_task_new (self, cancellable, callback, user_data);
 
   CogClientPrivate *priv = GET_PRIVATE (self);
+  RequestTiming timing (self, OPERATION_SIGN_UP);
   SignUpRequest request =
-    sign_up_build_request (client_id, secret_hash, username, password,
+    sign_up_build_request (self, client_id, secret_hash, username, password,
                            user_attributes, validation_data, analytics_metadata,
                            user_context_data);
+  client_prepare_request (self, request, cancellable);
+  timing.built ();
+  auto cx = Aws::MakeShared<GTaskAsyncContext> (_COG_ALLOCATION_TAG, task);
 
-  priv->internal.SignUpAsync (request, sign_up_handle_request,
-    Aws::MakeShared<GTaskAsyncContext> (_COG_ALLOCATION_TAG, task));
+  client_submit (self, COG_QUOTA_CATEGORY_USER_CREATION, task,
+                 [self, priv, request, timing, cx]
+    {
+      RequestTiming sending (timing);
+      auto outcome = client_send_sign_up (self, sending, request);
+      sign_up_handle_request (&priv->backend->internal, request, outcome,
+                              sending, cx);
+    });
+  g_object_unref (task);
 }
 
 /**
@@ -1190,23 +4065,106 @@ cog_client_sign_up_finish (CogClient *self,
     sign_up_validate_out_parameters (user_confirmed, code_delivery_details,
                                      user_sub), FALSE);
 
-  auto *result =
-    static_cast<SignUpResult *> (g_task_propagate_pointer (G_TASK (res), error));
-  if (!result)
+  auto *ret =
+    static_cast<SignUpReturn *> (g_task_propagate_pointer (G_TASK (res), error));
+  if (!ret)
     return FALSE;
 
-  sign_up_unpack_result (*result, user_confirmed, code_delivery_details,
-                         user_sub);
-  delete result;
+  *user_confirmed = ret->user_confirmed;
+  *code_delivery_details = ret->code_delivery_details;
+  *user_sub = ret->user_sub;
+  g_free (ret);
   return TRUE;
 }
 
+/**
+ * cog_client_sign_up_direct: (skip)
+ * @self: the #CogClient
+ * @client_id: the ID of the client associated with the user pool
+ * @secret_hash: (nullable): hash of client secret, username, and client ID
+ * @username: the user name of the user you wish to register
+ * @password: the password of the user you wish to register
+ * @user_attributes: (nullable) (element-type utf8 utf8): a dictionary of user
+ *   attributes
+ * @validation_data: (nullable) (element-type utf8 utf8): the validation data
+ * @analytics_metadata: (nullable): Amazon Pinpoint analytics metadata for
+ *   collecting metrics
+ * @user_context_data: (nullable): contextual data for security analysis
+ * @cancellable: (nullable): optional #GCancellable object
+ * @callback: a callback to call when the operation is complete
+ * @user_data: (nullable): the data to pass to @callback
+ *
+ * See cog_client_sign_up() for documentation.
+ * This version completes the request without blocking and without a main
+ * loop; @callback is called on one of the client's worker threads.
+ * See the introduction to #CogClient.
+ */
+void
+cog_client_sign_up_direct (CogClient *self,
+                           const char *client_id,
+                           const char *secret_hash,
+                           const char *username,
+                           const char *password,
+                           GHashTable *user_attributes,
+                           GHashTable *validation_data,
+                           CogAnalyticsMetadata *analytics_metadata,
+                           CogUserContextData *user_context_data,
+                           GCancellable *cancellable,
+                           CogSignUpDirectCallback callback,
+                           gpointer user_data)
+{
+  g_return_if_fail (COG_IS_CLIENT (self));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+  g_return_if_fail (callback);
+  g_return_if_fail (
+    sign_up_validate_in_parameters (client_id, secret_hash, username, password,
+                                    user_attributes, validation_data,
+                                    analytics_metadata, user_context_data));
+
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  RequestTiming timing (self, OPERATION_SIGN_UP);
+  SignUpRequest request =
+    sign_up_build_request (self, client_id, secret_hash, username, password,
+                           user_attributes, validation_data, analytics_metadata,
+                           user_context_data);
+  client_prepare_request (self, request, cancellable);
+  timing.built ();
+
+  client_submit_direct (self, COG_QUOTA_CATEGORY_USER_CREATION,
+                        cancellable,
+                        [self, priv, request, timing, cancellable, callback,
+                         user_data]
+    {
+      RequestTiming sending (timing);
+      auto outcome = client_send_sign_up (self, sending, request);
+      if (!outcome.IsSuccess ())
+        {
+          GError *error = client_error_from_internal (outcome.GetError (),
+                                                      cancellable);
+          sending.unpacked ();
+          callback (self, FALSE, NULL, NULL, error, user_data);
+          g_error_free (error);
+          return;
+        }
+
+      auto *ret = sign_up_return_new (outcome.GetResult ());
+      sending.unpacked ();
+      callback (self, ret->user_confirmed, ret->code_delivery_details,
+                ret->user_sub, NULL, user_data);
+      sign_up_return_free (ret);
+    },
+                        [self, callback, user_data] (const GError *error)
+    {
+      callback (self, FALSE, NULL, NULL, error, user_data);
+    });
+}
+
 static gboolean
 update_user_attributes_validate_in_parameters (const char *access_token,
                                                GHashTable *user_attributes)
 {
   g_return_val_if_fail (access_token, FALSE);
-  g_return_val_if_fail (_cog_is_valid_access_token (access_token), FALSE);
+  g_return_val_if_fail (_cog_is_valid_access_token (access_token, NULL), FALSE);
   g_return_val_if_fail (user_attributes, FALSE);
   return TRUE;
 }
@@ -1233,7 +4191,7 @@ update_user_attributes_build_request (const char *access_token,
 }
 
 static void
-update_user_attributes_unpack_result (UpdateUserAttributesResult& result,
+update_user_attributes_unpack_result (const UpdateUserAttributesResult& result,
                                       GList **code_delivery_details_list)
 {
   *code_delivery_details_list = NULL;
@@ -1244,39 +4202,60 @@ update_user_attributes_unpack_result (UpdateUserAttributesResult& result,
   *code_delivery_details_list = g_list_reverse (*code_delivery_details_list);
 }
 
-/* Work around the lack of a copy or move constructor. See above. */
-static UpdateUserAttributesResult *
-update_user_attributes_move_result (const UpdateUserAttributesResult&& result)
+static void
+update_user_attributes_free_return (void *data)
+{
+  g_list_free_full (static_cast<GList *> (data),
+                    (GDestroyNotify) cog_code_delivery_details_unref);
+}
+
+/* Writes the attributes changed by @request through to the user cache, if that
+ * is enabled. If any of them must first be verified, the server does not
+ * change it yet, so the user is dropped from the cache instead. */
+static void
+client_update_cached_user (CogClient *self,
+                           const UpdateUserAttributesRequest& request,
+                           const UpdateUserAttributesResult& result)
 {
-  auto *retval = new UpdateUserAttributesResult ();
-  retval->SetCodeDeliveryDetailsList (std::move (result.GetCodeDeliveryDetailsList ()));
-  return retval;
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  if (!priv->user_cache)
+    return;
+
+  const char *access_token = request.GetAccessToken ().c_str ();
+  if (!result.GetCodeDeliveryDetailsList ().empty ())
+    priv->user_cache->invalidate (access_token);
+  else
+    priv->user_cache->update_attributes (access_token,
+                                         request.GetUserAttributes ());
 }
 
 static void
 update_user_attributes_handle_request (const CognitoIdentityProviderClient *client G_GNUC_UNUSED,
-                                       const UpdateUserAttributesRequest& request G_GNUC_UNUSED,
+                                       const UpdateUserAttributesRequest& request,
                                        const UpdateUserAttributesOutcome& outcome,
+                                       RequestTiming& timing,
                                        const std::shared_ptr<const AsyncCallerContext>& cx)
 {
   GTask *task = std::static_pointer_cast<const GTaskAsyncContext> (cx)->task();
 
   if (!outcome.IsSuccess ())
     {
-      auto& aws_error = outcome.GetError ();
-      GError *new_error = g_error_new_literal (COG_IDENTITY_PROVIDER_ERROR,
-                                               int(aws_error.GetErrorType ()),
-                                               aws_error.GetMessage ().c_str ());
-      g_task_return_error (task, new_error);
+      GError *error = client_error_from_internal (outcome.GetError (), NULL);
+      timing.unpacked ();
+      client_return_error (task, error);
       return;
     }
 
-  UpdateUserAttributesResult *result_ref =
-    update_user_attributes_move_result (std::move (outcome.GetResult ()));
-  g_task_return_pointer (task, result_ref, [](void *data)
-    {
-      delete static_cast<UpdateUserAttributesResult *> (data);
-    });
+  client_update_cached_user (COG_CLIENT (g_task_get_source_object (task)),
+                             request, outcome.GetResult ());
+
+  /* The only return value is a list, so it needs no allocation to hold it */
+  GList *code_delivery_details_list;
+  update_user_attributes_unpack_result (outcome.GetResult (),
+                                        &code_delivery_details_list);
+  timing.unpacked ();
+  client_return_pointer (task, code_delivery_details_list,
+                         update_user_attributes_free_return);
 }
 
 /**
@@ -1317,26 +4296,38 @@ cog_client_update_user_attributes (CogClient *self,
   if (g_cancellable_set_error_if_cancelled (cancellable, error))
     return FALSE;
 
-  CogClientPrivate *priv = GET_PRIVATE (self);
+  RequestTiming timing (self, OPERATION_UPDATE_USER_ATTRIBUTES);
   UpdateUserAttributesRequest request =
     update_user_attributes_build_request (access_token, user_attributes);
-  auto outcome = priv->internal.UpdateUserAttributes (request);
+  timing.built ();
+  if (!client_admit (self, COG_QUOTA_CATEGORY_USER_ACCOUNT_UPDATE, cancellable,
+                     error))
+    return FALSE;
+  client_prepare_request (self, request, cancellable);
+  auto outcome = client_send_update_user_attributes (self, timing, request);
 
   if (!outcome.IsSuccess ())
     {
-      auto& aws_error = outcome.GetError ();
-      GError *new_error = g_error_new_literal (COG_IDENTITY_PROVIDER_ERROR,
-                                               int (aws_error.GetErrorType ()),
-                                               aws_error.GetMessage ().c_str ());
-      g_propagate_error (error, new_error);
+      /* An aborted request fails, too */
+      if (!g_cancellable_set_error_if_cancelled (cancellable, error))
+        g_propagate_error (error,
+                           client_error_from_internal (outcome.GetError (),
+                                                       NULL));
+      timing.unpacked ();
       return FALSE;
     }
 
+  client_update_cached_user (self, request, outcome.GetResult ());
+
   if (g_cancellable_set_error_if_cancelled (cancellable, error))
-    return FALSE;
+    {
+      timing.unpacked ();
+      return FALSE;
+    }
 
   update_user_attributes_unpack_result(outcome.GetResult (),
                                        code_delivery_details_list);
+  timing.unpacked ();
 
   return TRUE;
 }
@@ -1373,12 +4364,23 @@ cog_client_update_user_attributes_async (CogClient *self,
   GTask *task = g_task_new (self, cancellable, callback, user_data);
 
   CogClientPrivate *priv = GET_PRIVATE (self);
+  RequestTiming timing (self, OPERATION_UPDATE_USER_ATTRIBUTES);
   UpdateUserAttributesRequest request =
     update_user_attributes_build_request (access_token, user_attributes);
+  client_prepare_request (self, request, cancellable);
+  timing.built ();
+  auto cx = Aws::MakeShared<GTaskAsyncContext> (_COG_ALLOCATION_TAG, task);
 
-  priv->internal.UpdateUserAttributesAsync (request,
-    update_user_attributes_handle_request,
-    Aws::MakeShared<GTaskAsyncContext> (_COG_ALLOCATION_TAG, task));
+  client_submit (self, COG_QUOTA_CATEGORY_USER_ACCOUNT_UPDATE, task,
+                 [self, priv, request, timing, cx]
+    {
+      RequestTiming sending (timing);
+      auto outcome = client_send_update_user_attributes (self, sending,
+                                                         request);
+      update_user_attributes_handle_request (&priv->backend->internal,
+                                             request, outcome, sending, cx);
+    });
+  g_object_unref (task);
 }
 
 /**
@@ -1410,12 +4412,383 @@ cog_client_update_user_attributes_finish (CogClient *self,
     update_user_attributes_validate_out_parameters (code_delivery_details_list),
     FALSE);
 
-  auto *result =
-    static_cast<UpdateUserAttributesResult *> (g_task_propagate_pointer (G_TASK (res), error));
-  if (!result)
-    return FALSE;
-
-  update_user_attributes_unpack_result (*result, code_delivery_details_list);
-  delete result;
+  /* An empty list is NULL, so check for an error instead */
+  GError *local_error = NULL;
+  *code_delivery_details_list =
+    static_cast<GList *> (g_task_propagate_pointer (G_TASK (res), &local_error));
+  if (local_error)
+    {
+      g_propagate_error (error, local_error);
+      return FALSE;
+    }
   return TRUE;
 }
+
+/**
+ * cog_client_update_user_attributes_direct: (skip)
+ * @self: the #CogClient
+ * @access_token: the access token returned by the server response
+ * @user_attributes: (element-type utf8 utf8): a dictionary of user attributes
+ * @cancellable: (nullable): optional #GCancellable object
+ * @callback: a callback to call when the operation is complete
+ * @user_data: (nullable): the data to pass to @callback
+ *
+ * See cog_client_update_user_attributes() for documentation.
+ * This version completes the request without blocking and without a main
+ * loop; @callback is called on one of the client's worker threads.
+ * See the introduction to #CogClient.
+ */
+void
+cog_client_update_user_attributes_direct (CogClient *self,
+                                          const char *access_token,
+                                          GHashTable *user_attributes,
+                                          GCancellable *cancellable,
+                                          CogUpdateUserAttributesDirectCallback callback,
+                                          gpointer user_data)
+{
+  g_return_if_fail (COG_IS_CLIENT (self));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+  g_return_if_fail (callback);
+  g_return_if_fail (
+    update_user_attributes_validate_in_parameters (access_token,
+                                                   user_attributes));
+
+  RequestTiming timing (self, OPERATION_UPDATE_USER_ATTRIBUTES);
+  UpdateUserAttributesRequest request =
+    update_user_attributes_build_request (access_token, user_attributes);
+  client_prepare_request (self, request, cancellable);
+  timing.built ();
+
+  client_submit_direct (self, COG_QUOTA_CATEGORY_USER_ACCOUNT_UPDATE,
+                        cancellable,
+                        [self, request, timing, cancellable, callback,
+                         user_data]
+    {
+      RequestTiming sending (timing);
+      auto outcome = client_send_update_user_attributes (self, sending,
+                                                         request);
+      if (!outcome.IsSuccess ())
+        {
+          GError *error = client_error_from_internal (outcome.GetError (),
+                                                      cancellable);
+          sending.unpacked ();
+          callback (self, NULL, error, user_data);
+          g_error_free (error);
+          return;
+        }
+
+      client_update_cached_user (self, request, outcome.GetResult ());
+
+      GList *code_delivery_details_list;
+      update_user_attributes_unpack_result (outcome.GetResult (),
+                                            &code_delivery_details_list);
+      sending.unpacked ();
+      callback (self, code_delivery_details_list, NULL, user_data);
+      update_user_attributes_free_return (code_delivery_details_list);
+    },
+                        [self, callback, user_data] (const GError *error)
+    {
+      callback (self, NULL, error, user_data);
+    });
+}
+
+/**
+ * cog_client_get_completion_dispatch_count:
+ * @self: the #CogClient
+ *
+ * Gets the number of times that the main context woke up to complete
+ * asynchronous operations.
+ * See #CogClient:completion-max-batch.
+ *
+ * Returns: the number of completion dispatches
+ */
+guint64
+cog_client_get_completion_dispatch_count (CogClient *self)
+{
+  g_return_val_if_fail (COG_IS_CLIENT (self), 0);
+  return GET_PRIVATE (self)->completion_counters.dispatches;
+}
+
+/**
+ * cog_client_get_dispatched_completion_count:
+ * @self: the #CogClient
+ *
+ * Gets the number of asynchronous operations completed by all completion
+ * dispatches.
+ * Divide this by cog_client_get_completion_dispatch_count() to get the average
+ * number of completions delivered per wakeup of the main context.
+ *
+ * Returns: the number of completions delivered
+ */
+guint64
+cog_client_get_dispatched_completion_count (CogClient *self)
+{
+  g_return_val_if_fail (COG_IS_CLIENT (self), 0);
+  return GET_PRIVATE (self)->completion_counters.completions;
+}
+
+/**
+ * cog_client_get_max_completions_per_dispatch:
+ * @self: the #CogClient
+ *
+ * Returns: the largest number of asynchronous operations that have been
+ *   completed in a single dispatch
+ */
+unsigned
+cog_client_get_max_completions_per_dispatch (CogClient *self)
+{
+  g_return_val_if_fail (COG_IS_CLIENT (self), 0);
+  return GET_PRIVATE (self)->completion_counters.max_batch_dispatched;
+}
+
+/**
+ * cog_client_set_rate_limit:
+ * @self: the #CogClient
+ * @category: the category of requests to limit
+ * @requests_per_second: the sustained rate at which to send requests of
+ *   @category, or 0 to remove the limit
+ * @burst: how many requests of @category may be sent at once after a quiet
+ *   period
+ * @max_waiting: how many requests of @category may wait for their turn before
+ *   further ones fail right away
+ *
+ * Limits the rate at which the client sends requests of @category, so as to
+ * stay under the matching request-rate quota of the user pool.
+ * Each category is limited separately, by a token bucket holding up to @burst
+ * tokens and refilled at @requests_per_second.
+ *
+ * A request over the limit waits until it may be sent, up to @max_waiting of
+ * them at a time, in the order in which they arrived.
+ * The plain version of an API call waits on the calling thread.
+ * The other versions only hand the request to the client's worker threads
+ * once it may be sent, so requests waiting their turn do not hold up requests
+ * of other categories.
+ * Cancelling the request's #GCancellable stops the wait.
+ * When @max_waiting requests are already waiting, or if @max_waiting is 0,
+ * the request fails with %G_IO_ERROR_WOULD_BLOCK without being sent.
+ *
+ * The new limit applies to requests that start waiting after this call; it
+ * starts out with a full bucket.
+ */
+void
+cog_client_set_rate_limit (CogClient *self,
+                           CogQuotaCategory category,
+                           double requests_per_second,
+                           unsigned burst,
+                           unsigned max_waiting)
+{
+  g_return_if_fail (COG_IS_CLIENT (self));
+  g_return_if_fail (category < N_QUOTA_CATEGORIES);
+  g_return_if_fail (requests_per_second >= 0.0);
+
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  std::shared_ptr<CogRateLimiter> limiter;
+  if (requests_per_second > 0.0)
+    limiter = Aws::MakeShared<CogRateLimiter> (_COG_ALLOCATION_TAG,
+                                               requests_per_second, burst,
+                                               max_waiting);
+
+  g_mutex_lock (&priv->rate_limiters_lock);
+  priv->rate_limiters[category].swap (limiter);
+  g_mutex_unlock (&priv->rate_limiters_lock);
+}
+
+/**
+ * cog_client_get_statistics:
+ * @self: the #CogClient
+ *
+ * Gets a snapshot of statistics about the requests sent by the client, for
+ * monitoring.
+ * The snapshot is cheap to take, so you can poll for it every few seconds and
+ * compare it with the previous one.
+ *
+ * The result is a dictionary with an entry for each operation, named `GetUser`,
+ * `InitiateAuth`, `SignUp` and `UpdateUserAttributes`.
+ * Each entry is itself a dictionary with these keys:
+ *
+ * - `requests` (`t`): number of requests sent, counting each retried request
+ *   once
+ * - `in-flight` (`u`): number of requests currently being sent
+ * - `retries` (`t`): number of times a request was retried
+ * - `errors` (`a{it}`): number of failed requests by #CogIdentityProviderError
+ *   code; codes that never occurred are left out
+ * - `latency-sum` (`t`): total time taken by the completed requests, including
+ *   retries, in microseconds
+ * - `latency-histogram` (`a(tt)`): number of completed requests by latency;
+ *   each element gives the lower bound of a bucket in microseconds and the
+ *   number of requests in it.
+ *   A bucket's width is at most an eighth of its lower bound, so any
+ *   percentile computed from the histogram is within 12.5% of the exact value.
+ *   Empty buckets are left out.
+ *
+ * Requests that failed before being sent, for example because they were
+ * cancelled or over a rate limit, are not counted.
+ * Results served from the user cache are not counted either.
+ * The counters are updated without locking, so while requests are in progress
+ * the entries in the snapshot may be slightly out of step with each other.
+ *
+ * Returns: (transfer full): a new #GVariant of type `a{sa{sv}}`
+ */
+GVariant *
+cog_client_get_statistics (CogClient *self)
+{
+  g_return_val_if_fail (COG_IS_CLIENT (self), NULL);
+
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  GVariantBuilder builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+  for (unsigned ix = 0; ix < N_OPERATIONS; ix++)
+    g_variant_builder_add (&builder, "{s@a{sv}}", operation_names[ix],
+                           priv->operation_stats[ix].snapshot ());
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+static void
+client_prewarm (CogClient *self,
+                unsigned n_connections,
+                GCancellable *cancellable,
+                GAsyncReadyCallback callback,
+                void *user_data)
+{
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  GTask *task = g_task_new (self, cancellable, callback, user_data);
+  CogBackendRef backend = priv->backend;
+
+  /* A replaying transport never touches the network */
+  n_connections = MIN (n_connections, priv->max_connections);
+  if (!backend->network_client || n_connections == 0)
+    {
+      client_return_pointer (task, GINT_TO_POINTER (TRUE), NULL);
+      g_object_unref (task);
+      return;
+    }
+
+  /* Succeeds if any connection was opened */
+  _cog_prewarm (backend->network_client, backend->endpoint, *backend->executor,
+                n_connections, cancellable,
+                [task] (unsigned n_opened, GError *error)
+    {
+      if (n_opened > 0)
+        client_return_pointer (task, GINT_TO_POINTER (TRUE), NULL);
+      else
+        client_return_error (task, error);
+      g_object_unref (task);
+    });
+}
+
+/**
+ * cog_client_prewarm_async:
+ * @self: the #CogClient
+ * @n_connections: number of connections to open
+ * @cancellable: (nullable): optional #GCancellable object
+ * @callback: (nullable): a callback to call when the operation is complete
+ * @user_data: (nullable): the data to pass to @callback
+ *
+ * Opens connections to the Cognito endpoint of the client's region and keeps
+ * them in the client's connection pool, so that the next requests do not have
+ * to wait for a DNS lookup, a TCP connection and a TLS handshake first.
+ * Call this when your program starts, for example, to speed up the first
+ * login.
+ *
+ * The connections are opened at once, on the client's worker threads, so at
+ * most as many are opened as the executor runs at once, and as
+ * #CogClient:max-connections allows.
+ * Opening them sends no Cognito request, so it does not count towards the
+ * statistics, rate limits or retry budget.
+ * With a replaying #CogTransport there is no network, and this completes
+ * right away.
+ *
+ * See also #CogClient:rewarm-on-network-change.
+ * In your @callback, you must call cog_client_prewarm_finish().
+ */
+void
+cog_client_prewarm_async (CogClient *self,
+                          unsigned n_connections,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback,
+                          gpointer user_data)
+{
+  g_return_if_fail (COG_IS_CLIENT (self));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  GET_PRIVATE (self)->n_prewarm_connections = n_connections;
+  client_prewarm (self, n_connections, cancellable, callback, user_data);
+}
+
+/**
+ * cog_client_prewarm_finish:
+ * @self: the #CogClient
+ * @res: the #GAsyncResult passed to your callback
+ * @error: error location
+ *
+ * After starting to open connections with cog_client_prewarm_async(), you
+ * must call this in your callback to find out whether it worked.
+ *
+ * Returns: %TRUE if at least one connection was opened, or there was no
+ *   need to, %FALSE on error
+ */
+gboolean
+cog_client_prewarm_finish (CogClient *self,
+                           GAsyncResult *res,
+                           GError **error)
+{
+  g_return_val_if_fail (COG_IS_CLIENT (self), FALSE);
+  g_return_val_if_fail (G_IS_TASK (res), FALSE);
+  g_return_val_if_fail (!error || !*error, FALSE);
+
+  return GPOINTER_TO_INT (g_task_propagate_pointer (G_TASK (res), error));
+}
+
+static void
+on_rewarmed (GObject *source,
+             GAsyncResult *res,
+             void *data G_GNUC_UNUSED)
+{
+  CogClient *self = COG_CLIENT (source);
+  GError *error = NULL;
+
+  GET_PRIVATE (self)->rewarming = false;
+  if (!cog_client_prewarm_finish (self, res, &error))
+    {
+      g_debug ("Could not open connections after a network change: %s",
+               error->message);
+      g_error_free (error);
+    }
+}
+
+static void
+on_network_changed (GNetworkMonitor *monitor G_GNUC_UNUSED,
+                    gboolean available,
+                    CogClient *self)
+{
+  CogClientPrivate *priv = GET_PRIVATE (self);
+
+  /* The monitor often reports several changes in a row */
+  if (!available || priv->n_prewarm_connections == 0 || priv->rewarming)
+    return;
+
+  priv->rewarming = true;
+  client_prewarm (self, priv->n_prewarm_connections, NULL, on_rewarmed, NULL);
+}
+
+static void
+client_set_rewarm_on_network_change (CogClient *self,
+                                     bool rewarm)
+{
+  CogClientPrivate *priv = GET_PRIVATE (self);
+  if (rewarm == (priv->network_changed_id != 0))
+    return;
+
+  GNetworkMonitor *monitor = g_network_monitor_get_default ();
+  if (rewarm)
+    {
+      priv->network_changed_id =
+        g_signal_connect (monitor, "network-changed",
+                          G_CALLBACK (on_network_changed), self);
+    }
+  else
+    {
+      g_signal_handler_disconnect (monitor, priv->network_changed_id);
+      priv->network_changed_id = 0;
+    }
+}
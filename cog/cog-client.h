@@ -10,7 +10,9 @@
 #include "cog/cog-analytics-metadata.h"
 #include "cog/cog-authentication-result.h"
 #include "cog/cog-code-delivery-details.h"
+#include "cog/cog-login.h"
 #include "cog/cog-macros.h"
+#include "cog/cog-user.h"
 #include "cog/cog-user-context-data.h"
 
 G_BEGIN_DECLS
@@ -129,6 +131,29 @@ typedef enum {
   COG_REGION_US_GOV_WEST_1
 } CogRegion;
 
+/**
+ * CogQuotaCategory:
+ * @COG_QUOTA_CATEGORY_USER_AUTHENTICATION: Requests that authenticate a user,
+ *   such as cog_client_initiate_auth() and each step of
+ *   cog_client_log_in_async().
+ * @COG_QUOTA_CATEGORY_USER_CREATION: Requests that create a user, such as
+ *   cog_client_sign_up().
+ * @COG_QUOTA_CATEGORY_USER_ACCOUNT_READ: Requests that read a user's account,
+ *   such as cog_client_get_user().
+ * @COG_QUOTA_CATEGORY_USER_ACCOUNT_UPDATE: Requests that modify a user's
+ *   account, such as cog_client_update_user_attributes().
+ *
+ * Category of request that Amazon Cognito counts towards the same request-rate
+ * quota.
+ * See cog_client_set_rate_limit().
+ */
+typedef enum {
+  COG_QUOTA_CATEGORY_USER_AUTHENTICATION,
+  COG_QUOTA_CATEGORY_USER_CREATION,
+  COG_QUOTA_CATEGORY_USER_ACCOUNT_READ,
+  COG_QUOTA_CATEGORY_USER_ACCOUNT_UPDATE,
+} CogQuotaCategory;
+
 /* Defines for hashtable keys */
 
 /**
@@ -162,6 +187,20 @@ typedef enum {
  * See `auth_parameters` in cog_client_initiate_auth().
  */
 #define COG_PARAMETER_REFRESH_TOKEN "REFRESH_TOKEN"
+/**
+ * COG_PARAMETER_SALT:
+ *
+ * Salt of the user's password verifier, as a hex string.
+ * Sent with %COG_CHALLENGE_NAME_PASSWORD_VERIFIER.
+ */
+#define COG_PARAMETER_SALT "SALT"
+/**
+ * COG_PARAMETER_SECRET_BLOCK:
+ *
+ * Opaque block sent with %COG_CHALLENGE_NAME_PASSWORD_VERIFIER, to be
+ * returned as %COG_PARAMETER_PASSWORD_CLAIM_SECRET_BLOCK.
+ */
+#define COG_PARAMETER_SECRET_BLOCK "SECRET_BLOCK"
 /**
  * COG_PARAMETER_SECRET_HASH:
  *
@@ -180,6 +219,13 @@ typedef enum {
  * a hex string.
  */
 #define COG_PARAMETER_SRP_A "SRP_A"
+/**
+ * COG_PARAMETER_SRP_B:
+ *
+ * The server's value named *B* in the Secure Remote Password protocol, as a
+ * hex string. See %COG_PARAMETER_SRP_A.
+ */
+#define COG_PARAMETER_SRP_B "SRP_B"
 /**
  * COG_PARAMETER_TIMESTAMP:
  */
@@ -190,6 +236,111 @@ typedef enum {
  * Username.
  */
 #define COG_PARAMETER_USERNAME "USERNAME"
+/**
+ * COG_PARAMETER_USER_ID_FOR_SRP:
+ *
+ * The user ID that the password verifier was computed with, which may differ
+ * from the username the user logged in with.
+ */
+#define COG_PARAMETER_USER_ID_FOR_SRP "USER_ID_FOR_SRP"
+
+#define COG_TYPE_USER_BATCH_ITEM (cog_user_batch_item_get_type ())
+
+typedef struct _CogUserBatchItem CogUserBatchItem;
+
+COG_AVAILABLE_IN_ALL
+GType cog_user_batch_item_get_type (void) G_GNUC_CONST;
+
+COG_AVAILABLE_IN_ALL
+CogUserBatchItem *cog_user_batch_item_ref (CogUserBatchItem *self);
+
+COG_AVAILABLE_IN_ALL
+void cog_user_batch_item_unref (CogUserBatchItem *self);
+
+COG_AVAILABLE_IN_ALL
+unsigned cog_user_batch_item_get_index (CogUserBatchItem *self);
+
+COG_AVAILABLE_IN_ALL
+const char *cog_user_batch_item_get_access_token (CogUserBatchItem *self);
+
+COG_AVAILABLE_IN_ALL
+gboolean cog_user_batch_item_get_user (CogUserBatchItem *self,
+                                       char **username,
+                                       GHashTable **user_attributes,
+                                       GList **mfa_options,
+                                       char **preferred_mfa_setting,
+                                       char ***user_mfa_settings_list,
+                                       GError **error);
+
+COG_AVAILABLE_IN_ALL
+CogUser *cog_user_batch_item_get_user_object (CogUserBatchItem *self,
+                                              GError **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (CogUserBatchItem, cog_user_batch_item_unref)
+
+#define COG_TYPE_REQUEST_METRICS (cog_request_metrics_get_type ())
+
+typedef struct _CogRequestMetrics CogRequestMetrics;
+
+/**
+ * CogRequestMetrics:
+ * @total: time taken by the whole request, including all attempts and the
+ *   backoff between them
+ * @overhead: part of @total not spent in the HTTP client: marshalling,
+ *   signing, unmarshalling, and backoff between attempts
+ * @acquire_connection: time waiting for a connection from the pool
+ * @dns: time resolving the server's host name
+ * @connect: time establishing the TCP connection
+ * @tls: time of the TLS handshake
+ * @time_to_first_byte: time from sending the last byte of the request to
+ *   receiving the first byte of the response
+ * @transfer: time from receiving the first byte of the response to receiving
+ *   the last
+ * @attempts: number of times the request was sent
+ * @bytes_sent: bytes of request body sent, over all attempts
+ * @bytes_received: bytes of response body received, over all attempts
+ * @connection_reused: whether the last attempt reused a connection, so that
+ *   @dns, @connect and @tls are zero
+ * @build: time taken to build the request from the parameters of the API
+ *   call, before @total
+ * @unpack: time taken to turn the response into the return values of the API
+ *   call, or into its error, after @total
+ *
+ * Where time goes in a request sent by a #CogClient; see
+ * #CogClient::request-completed.
+ * All times are in microseconds.
+ * The phases from @acquire_connection to @transfer are those of the last
+ * attempt, and are -1 when not known; the connection phases are only reported
+ * by the default HTTP client, with millisecond precision.
+ */
+struct _CogRequestMetrics
+{
+  gint64 total;
+  gint64 overhead;
+  gint64 acquire_connection;
+  gint64 dns;
+  gint64 connect;
+  gint64 tls;
+  gint64 time_to_first_byte;
+  gint64 transfer;
+  unsigned attempts;
+  guint64 bytes_sent;
+  guint64 bytes_received;
+  gboolean connection_reused;
+  gint64 build;
+  gint64 unpack;
+};
+
+COG_AVAILABLE_IN_ALL
+GType cog_request_metrics_get_type (void) G_GNUC_CONST;
+
+COG_AVAILABLE_IN_ALL
+CogRequestMetrics *cog_request_metrics_copy (CogRequestMetrics *self);
+
+COG_AVAILABLE_IN_ALL
+void cog_request_metrics_free (CogRequestMetrics *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (CogRequestMetrics, cog_request_metrics_free)
 
 #define COG_TYPE_CLIENT (cog_client_get_type())
 
@@ -201,6 +352,96 @@ struct _CogClientClass
   GObjectClass parent_class;
 };
 
+/**
+ * CogUserBatchItemCallback:
+ * @client: the #CogClient
+ * @item: the #CogUserBatchItem that has just completed
+ * @user_data: the data passed to cog_client_get_user_batch_async()
+ *
+ * Called by cog_client_get_user_batch_async() as each lookup in the batch
+ * completes, in order of completion.
+ */
+typedef void (*CogUserBatchItemCallback) (CogClient *client,
+                                          CogUserBatchItem *item,
+                                          gpointer user_data);
+
+/**
+ * CogFetchUserDirectCallback:
+ * @client: the #CogClient
+ * @user: (nullable): the user, or %NULL on error
+ * @error: (nullable): the error, or %NULL on success
+ * @user_data: the data passed to cog_client_fetch_user_direct()
+ *
+ * Called by cog_client_fetch_user_direct() when the request is complete.
+ * @user and @error belong to the caller and are only valid until the callback
+ * returns; use cog_user_ref() or g_error_copy() to keep them.
+ */
+typedef void (*CogFetchUserDirectCallback) (CogClient *client,
+                                            CogUser *user,
+                                            const GError *error,
+                                            gpointer user_data);
+
+/**
+ * CogInitiateAuthDirectCallback:
+ * @client: the #CogClient
+ * @auth_result: (nullable): the result of the authentication response, or
+ *   %NULL if you need to pass another challenge or on error
+ * @challenge_name: the name of the next challenge, or
+ *   %COG_CHALLENGE_NAME_NOT_SET
+ * @challenge_parameters: (nullable) (element-type utf8 utf8): the challenge
+ *   parameters, or %NULL
+ * @session: (nullable): a session ID, or %NULL
+ * @error: (nullable): the error, or %NULL on success
+ * @user_data: the data passed to cog_client_initiate_auth_direct()
+ *
+ * Called by cog_client_initiate_auth_direct() when the request is complete.
+ * The arguments are only valid until the callback returns.
+ */
+typedef void (*CogInitiateAuthDirectCallback) (CogClient *client,
+                                               CogAuthenticationResult *auth_result,
+                                               CogChallengeName challenge_name,
+                                               GHashTable *challenge_parameters,
+                                               const char *session,
+                                               const GError *error,
+                                               gpointer user_data);
+
+/**
+ * CogSignUpDirectCallback:
+ * @client: the #CogClient
+ * @user_confirmed: whether the user was confirmed
+ * @code_delivery_details: (nullable): where the confirmation code was sent,
+ *   or %NULL on error
+ * @user_sub: (nullable): the UUID of the new user, or %NULL on error
+ * @error: (nullable): the error, or %NULL on success
+ * @user_data: the data passed to cog_client_sign_up_direct()
+ *
+ * Called by cog_client_sign_up_direct() when the request is complete.
+ * The arguments are only valid until the callback returns.
+ */
+typedef void (*CogSignUpDirectCallback) (CogClient *client,
+                                         gboolean user_confirmed,
+                                         CogCodeDeliveryDetails *code_delivery_details,
+                                         const char *user_sub,
+                                         const GError *error,
+                                         gpointer user_data);
+
+/**
+ * CogUpdateUserAttributesDirectCallback:
+ * @client: the #CogClient
+ * @code_delivery_details_list: (element-type CogCodeDeliveryDetails): list
+ *   of code delivery details
+ * @error: (nullable): the error, or %NULL on success
+ * @user_data: the data passed to cog_client_update_user_attributes_direct()
+ *
+ * Called by cog_client_update_user_attributes_direct() when the request is
+ * complete.
+ * The arguments are only valid until the callback returns.
+ */
+typedef void (*CogUpdateUserAttributesDirectCallback) (CogClient *client,
+                                                       GList *code_delivery_details_list,
+                                                       const GError *error,
+                                                       gpointer user_data);
+
 COG_AVAILABLE_IN_ALL
 CogClient *cog_client_new (void);
 
@@ -232,6 +473,47 @@ gboolean cog_client_get_user_finish (CogClient *self,
                                      char ***user_mfa_settings_list,
                                      GError **error);
 
+COG_AVAILABLE_IN_ALL
+CogUser *cog_client_fetch_user (CogClient *self,
+                                const char *access_token,
+                                GCancellable *cancellable,
+                                GError **error);
+
+COG_AVAILABLE_IN_ALL
+void cog_client_fetch_user_async (CogClient *self,
+                                  const char *access_token,
+                                  GCancellable *cancellable,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data);
+
+COG_AVAILABLE_IN_ALL
+CogUser *cog_client_fetch_user_finish (CogClient *self,
+                                       GAsyncResult *res,
+                                       GError **error);
+
+COG_AVAILABLE_IN_ALL
+void cog_client_fetch_user_direct (CogClient *self,
+                                   const char *access_token,
+                                   GCancellable *cancellable,
+                                   CogFetchUserDirectCallback callback,
+                                   gpointer user_data);
+
+COG_AVAILABLE_IN_ALL
+void cog_client_get_user_batch_async (CogClient *self,
+                                      const char * const *access_tokens,
+                                      unsigned max_concurrent,
+                                      GCancellable *cancellable,
+                                      CogUserBatchItemCallback item_callback,
+                                      gpointer item_user_data,
+                                      GDestroyNotify item_destroy,
+                                      GAsyncReadyCallback callback,
+                                      gpointer user_data);
+
+COG_AVAILABLE_IN_ALL
+GPtrArray *cog_client_get_user_batch_finish (CogClient *self,
+                                             GAsyncResult *res,
+                                             GError **error);
+
 COG_AVAILABLE_IN_ALL
 gboolean cog_client_initiate_auth (CogClient *self,
                                    CogAuthFlow auth_flow,
@@ -268,6 +550,18 @@ gboolean cog_client_initiate_auth_finish (CogClient *self,
                                           char **session,
                                           GError **error);
 
+COG_AVAILABLE_IN_ALL
+void cog_client_initiate_auth_direct (CogClient *self,
+                                      CogAuthFlow auth_flow,
+                                      GHashTable *auth_parameters,
+                                      const char *client_id,
+                                      GHashTable *client_metadata,
+                                      CogAnalyticsMetadata *analytics_metadata,
+                                      CogUserContextData *user_context_data,
+                                      GCancellable *cancellable,
+                                      CogInitiateAuthDirectCallback callback,
+                                      gpointer user_data);
+
 COG_AVAILABLE_IN_ALL
 gboolean cog_client_sign_up (CogClient *self,
                              const char *client_id,
@@ -306,6 +600,20 @@ gboolean cog_client_sign_up_finish (CogClient *self,
                                     const char **user_sub,
                                     GError **error);
 
+COG_AVAILABLE_IN_ALL
+void cog_client_sign_up_direct (CogClient *self,
+                                const char *client_id,
+                                const char *secret_hash,
+                                const char *username,
+                                const char *password,
+                                GHashTable *user_attributes,
+                                GHashTable *validation_data,
+                                CogAnalyticsMetadata *analytics_metadata,
+                                CogUserContextData *user_context_data,
+                                GCancellable *cancellable,
+                                CogSignUpDirectCallback callback,
+                                gpointer user_data);
+
 COG_AVAILABLE_IN_ALL
 gboolean cog_client_update_user_attributes (CogClient *self,
                                             const char *access_token,
@@ -328,4 +636,66 @@ gboolean cog_client_update_user_attributes_finish (CogClient *self,
                                                    GList **code_delivery_details_list,
                                                    GError **error);
 
+COG_AVAILABLE_IN_ALL
+void cog_client_update_user_attributes_direct (CogClient *self,
+                                               const char *access_token,
+                                               GHashTable *user_attributes,
+                                               GCancellable *cancellable,
+                                               CogUpdateUserAttributesDirectCallback callback,
+                                               gpointer user_data);
+
+COG_AVAILABLE_IN_ALL
+guint64 cog_client_get_completion_dispatch_count (CogClient *self);
+
+COG_AVAILABLE_IN_ALL
+guint64 cog_client_get_dispatched_completion_count (CogClient *self);
+
+COG_AVAILABLE_IN_ALL
+unsigned cog_client_get_max_completions_per_dispatch (CogClient *self);
+
+COG_AVAILABLE_IN_ALL
+GVariant *cog_client_get_statistics (CogClient *self);
+
+COG_AVAILABLE_IN_ALL
+void cog_client_set_rate_limit (CogClient *self,
+                                CogQuotaCategory category,
+                                double requests_per_second,
+                                unsigned burst,
+                                unsigned max_waiting);
+
+COG_AVAILABLE_IN_ALL
+void cog_client_prewarm_async (CogClient *self,
+                               unsigned n_connections,
+                               GCancellable *cancellable,
+                               GAsyncReadyCallback callback,
+                               gpointer user_data);
+
+COG_AVAILABLE_IN_ALL
+gboolean cog_client_prewarm_finish (CogClient *self,
+                                    GAsyncResult *res,
+                                    GError **error);
+
+COG_AVAILABLE_IN_ALL
+void cog_client_log_in_async (CogClient *self,
+                              CogLogin *login,
+                              GCancellable *cancellable,
+                              GAsyncReadyCallback callback,
+                              gpointer user_data);
+
+COG_AVAILABLE_IN_ALL
+void cog_client_log_in_respond_async (CogClient *self,
+                                      CogLogin *login,
+                                      GHashTable *responses,
+                                      GCancellable *cancellable,
+                                      GAsyncReadyCallback callback,
+                                      gpointer user_data);
+
+COG_AVAILABLE_IN_ALL
+gboolean cog_client_log_in_finish (CogClient *self,
+                                   GAsyncResult *res,
+                                   CogAuthenticationResult **auth_result,
+                                   CogChallengeName *challenge_name,
+                                   GHashTable **challenge_parameters,
+                                   GError **error);
+
 G_END_DECLS
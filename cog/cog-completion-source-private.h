@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+
+#include <gio/gio.h>
+
+/* Counters shared by all the completion sources of one #CogClient */
+typedef struct
+{
+  std::atomic<guint64> dispatches;
+  std::atomic<guint64> completions;
+  std::atomic<unsigned> max_batch_dispatched;
+} CogCompletionCounters;
+
+/* A #GSource that completes #GTasks on behalf of other threads. Completions
+ * queued from any thread while the source is idle cost a single wakeup of its
+ * #GMainContext, and are then delivered up to @max_batch per dispatch. The
+ * source does not keep @counters alive; its owner must destroy it first. */
+GSource *_cog_completion_source_new (unsigned max_batch,
+                                     CogCompletionCounters *counters);
+
+/* Arranges for @notify to be called with @data once the source is destroyed,
+ * from whichever thread destroys it; for example, when its #GMainContext is
+ * freed. Call before attaching the source. */
+void _cog_completion_source_set_destroy_notify (GSource *source,
+                                                void *data,
+                                                GDestroyNotify notify);
+
+/* Thread-safe. Takes ownership of @result, and completes @task with it like
+ * g_task_return_pointer(), in the thread running the source's context. */
+void _cog_completion_source_return_pointer (GSource *source,
+                                            GTask *task,
+                                            void *result,
+                                            GDestroyNotify result_destroy);
+
+/* Thread-safe. Takes ownership of @error, and completes @task with it like
+ * g_task_return_error(). */
+void _cog_completion_source_return_error (GSource *source,
+                                          GTask *task,
+                                          GError *error);
+
+/* Thread-safe. Calls @func with @data in the thread running the source's
+ * context, in order with the completions, then frees @data with
+ * @data_destroy. Not counted as a completion. */
+void _cog_completion_source_call (GSource *source,
+                                  void (*func) (void *data),
+                                  void *data,
+                                  GDestroyNotify data_destroy);
@@ -0,0 +1,210 @@
+#include <gio/gio.h>
+
+#include "cog/cog-completion-source-private.h"
+
+typedef struct
+{
+  GList link;  /* data points back to the struct */
+  GTask *task;  /* NULL if @func is set */
+  void (*func) (void *data);  /* called with @result */
+  void *result;
+  GDestroyNotify result_destroy;
+  GError *error;
+} Completion;
+
+typedef struct
+{
+  GSource source;
+  GMutex lock;
+  GQueue pending;  /* (element-type Completion) */
+  unsigned max_batch;
+  CogCompletionCounters *counters;
+} CogCompletionSource;
+
+static void
+completion_free (Completion *completion)
+{
+  if (completion->result_destroy)
+    completion->result_destroy (completion->result);
+  g_clear_error (&completion->error);
+  g_clear_object (&completion->task);
+  g_free (completion);
+}
+
+static void
+completion_source_count (CogCompletionSource *self,
+                         unsigned n_delivered)
+{
+  CogCompletionCounters *counters = self->counters;
+
+  counters->dispatches++;
+  counters->completions += n_delivered;
+
+  unsigned max = counters->max_batch_dispatched;
+  while (n_delivered > max &&
+         !counters->max_batch_dispatched.compare_exchange_weak (max,
+                                                                n_delivered))
+    ;
+}
+
+static gboolean
+completion_source_dispatch (GSource *source,
+                            GSourceFunc callback G_GNUC_UNUSED,
+                            void *data G_GNUC_UNUSED)
+{
+  auto *self = reinterpret_cast<CogCompletionSource *> (source);
+  GQueue batch = G_QUEUE_INIT;
+
+  g_mutex_lock (&self->lock);
+  while (batch.length < self->max_batch && self->pending.length > 0)
+    g_queue_push_tail_link (&batch, g_queue_pop_head_link (&self->pending));
+  /* Stay ready if there are more; otherwise sleep until the next
+   * completion is queued */
+  if (self->pending.length == 0)
+    g_source_set_ready_time (source, -1);
+  g_mutex_unlock (&self->lock);
+
+  if (batch.length == 0)
+    return G_SOURCE_CONTINUE;
+
+  /* Count before delivering, since the last task may be holding the last
+   * reference to the owner of the counters */
+  unsigned n_tasks = 0;
+  for (GList *iter = batch.head; iter; iter = iter->next)
+    if (static_cast<Completion *> (iter->data)->task)
+      n_tasks++;
+  if (n_tasks > 0)
+    completion_source_count (self, n_tasks);
+
+  GList *link;
+  while ((link = g_queue_pop_head_link (&batch)))
+    {
+      auto *completion = static_cast<Completion *> (link->data);
+      if (completion->func)
+        {
+          completion->func (completion->result);
+          completion_free (completion);
+          continue;
+        }
+
+      if (completion->error)
+        g_task_return_error (completion->task,
+                             g_steal_pointer (&completion->error));
+      else
+        g_task_return_pointer (completion->task, completion->result,
+                               completion->result_destroy);
+      completion->result_destroy = NULL;
+      completion_free (completion);
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+completion_source_finalize (GSource *source)
+{
+  auto *self = reinterpret_cast<CogCompletionSource *> (source);
+
+  GList *link;
+  while ((link = g_queue_pop_head_link (&self->pending)))
+    completion_free (static_cast<Completion *> (link->data));
+  g_mutex_clear (&self->lock);
+}
+
+static GSourceFuncs completion_source_funcs = {
+  NULL,  /* prepare */
+  NULL,  /* check */
+  completion_source_dispatch,
+  completion_source_finalize,
+};
+
+GSource *
+_cog_completion_source_new (unsigned max_batch,
+                            CogCompletionCounters *counters)
+{
+  g_return_val_if_fail (max_batch > 0, NULL);
+  g_return_val_if_fail (counters, NULL);
+
+  GSource *source = g_source_new (&completion_source_funcs,
+                                  sizeof (CogCompletionSource));
+  auto *self = reinterpret_cast<CogCompletionSource *> (source);
+  g_mutex_init (&self->lock);
+  g_queue_init (&self->pending);
+  self->max_batch = max_batch;
+  self->counters = counters;
+
+  g_source_set_name (source, "CogClient completions");
+  return source;
+}
+
+static gboolean
+completion_source_unused_callback (void *data G_GNUC_UNUSED)
+{
+  g_assert_not_reached ();
+  return G_SOURCE_REMOVE;
+}
+
+void
+_cog_completion_source_set_destroy_notify (GSource *source,
+                                           void *data,
+                                           GDestroyNotify notify)
+{
+  /* The source never calls its callback, but GLib drops the callback's data
+   * as soon as the source is destroyed, rather than when it is finalized */
+  g_source_set_callback (source, completion_source_unused_callback, data,
+                         notify);
+}
+
+static void
+completion_source_push (GSource *source,
+                        Completion *completion)
+{
+  auto *self = reinterpret_cast<CogCompletionSource *> (source);
+
+  completion->link.data = completion;
+  completion->link.prev = completion->link.next = NULL;
+
+  g_mutex_lock (&self->lock);
+  g_queue_push_tail_link (&self->pending, &completion->link);
+  /* Only the first completion of a burst needs to wake up the context */
+  if (self->pending.length == 1)
+    g_source_set_ready_time (source, 0);
+  g_mutex_unlock (&self->lock);
+}
+
+void
+_cog_completion_source_return_pointer (GSource *source,
+                                       GTask *task,
+                                       void *result,
+                                       GDestroyNotify result_destroy)
+{
+  Completion *completion = g_new0 (Completion, 1);
+  completion->task = G_TASK (g_object_ref (task));
+  completion->result = result;
+  completion->result_destroy = result_destroy;
+  completion_source_push (source, completion);
+}
+
+void
+_cog_completion_source_return_error (GSource *source,
+                                     GTask *task,
+                                     GError *error)
+{
+  Completion *completion = g_new0 (Completion, 1);
+  completion->task = G_TASK (g_object_ref (task));
+  completion->error = error;
+  completion_source_push (source, completion);
+}
+
+void
+_cog_completion_source_call (GSource *source,
+                             void (*func) (void *data),
+                             void *data,
+                             GDestroyNotify data_destroy)
+{
+  Completion *completion = g_new0 (Completion, 1);
+  completion->func = func;
+  completion->result = data;
+  completion->result_destroy = data_destroy;
+  completion_source_push (source, completion);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include <aws/core/utils/threading/Executor.h>
+
+#include "cog/cog-executor.h"
+
+/* Returns an AWS SDK executor that hands its work to the given #CogExecutor,
+ * suitable for ClientConfiguration::executor. The returned object keeps a
+ * reference on @self. */
+std::shared_ptr<Aws::Utils::Threading::Executor> _cog_executor_to_internal (CogExecutor *self);
+
+gboolean _cog_executor_push (CogExecutor *self,
+                             std::function<void ()>&& fn);
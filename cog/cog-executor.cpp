@@ -0,0 +1,427 @@
+/**
+ * SECTION:executor
+ * @title: CogExecutor
+ * @short_description: Bounded worker pool for asynchronous requests
+ *
+ * By default, every asynchronous request made through a #CogClient is run on
+ * a new thread created just for that request.
+ * Under a burst of requests, that means a burst of short-lived threads.
+ *
+ * A #CogExecutor runs requests on a bounded pool of worker threads instead.
+ * At most #CogExecutor:max-threads requests are in progress at once, and at
+ * most #CogExecutor:max-queued requests wait for a free thread.
+ * Requests submitted while the queue is full fail with %G_IO_ERROR_BUSY.
+ *
+ * Pass the executor to #CogClient:executor when creating a client.
+ * One executor can be shared between several clients.
+ */
+
+#include <atomic>
+
+#include <gio/gio.h>
+
+#include "cog/cog-executor.h"
+#include "cog/cog-executor-private.h"
+#include "cog/cog-utils-private.h"
+
+#define GET_PRIVATE(o) (static_cast<CogExecutorPrivate *> (cog_executor_get_instance_private (COG_EXECUTOR (o))))
+
+#define DEFAULT_MAX_THREADS 8
+#define DEFAULT_MAX_QUEUED 256
+
+typedef struct
+{
+  GThreadPool *pool;
+  unsigned max_threads;
+  unsigned max_queued;
+
+  std::atomic<unsigned> queue_depth;
+  std::atomic<guint64> completed;
+  std::atomic<guint64> rejected;
+  std::atomic<gint64> total_wait;
+  std::atomic<gint64> max_wait;
+} CogExecutorPrivate;
+
+struct _CogExecutor {
+  GObject parent_instance;
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE (CogExecutor, cog_executor, G_TYPE_OBJECT)
+
+enum {
+  PROP_MAX_THREADS = 1,
+  PROP_MAX_QUEUED,
+  PROP_QUEUE_DEPTH,
+  PROP_COMPLETED_COUNT,
+  PROP_REJECTED_COUNT,
+  PROP_TOTAL_WAIT_TIME,
+  PROP_MAX_WAIT_TIME,
+  N_PROPERTIES
+};
+
+struct ExecutorJob
+{
+  std::function<void ()> fn;
+  gint64 queued_time;
+};
+
+class CogExecutorAdapter : public Aws::Utils::Threading::Executor {
+  CogExecutor *m_executor;
+public:
+  explicit CogExecutorAdapter (CogExecutor *executor) : m_executor (COG_EXECUTOR (g_object_ref (executor))) {}
+  ~CogExecutorAdapter () { g_object_unref (m_executor); }
+protected:
+  bool SubmitToThread (std::function<void ()>&& fn) override
+  {
+    return _cog_executor_push (m_executor, std::move (fn));
+  }
+};
+
+static void
+cog_executor_set_property (GObject *object,
+                           unsigned property_id,
+                           const GValue *value,
+                           GParamSpec *pspec)
+{
+  CogExecutor *self = COG_EXECUTOR (object);
+  CogExecutorPrivate *priv = GET_PRIVATE (self);
+
+  switch (property_id) {
+    case PROP_MAX_THREADS:
+      priv->max_threads = g_value_get_uint (value);
+      break;
+    case PROP_MAX_QUEUED:
+      priv->max_queued = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+cog_executor_get_property (GObject *object,
+                           unsigned property_id,
+                           GValue *value,
+                           GParamSpec *pspec)
+{
+  CogExecutor *self = COG_EXECUTOR (object);
+  CogExecutorPrivate *priv = GET_PRIVATE (self);
+
+  switch (property_id) {
+    case PROP_MAX_THREADS:
+      g_value_set_uint (value, priv->max_threads);
+      break;
+    case PROP_MAX_QUEUED:
+      g_value_set_uint (value, priv->max_queued);
+      break;
+    case PROP_QUEUE_DEPTH:
+      g_value_set_uint (value, priv->queue_depth);
+      break;
+    case PROP_COMPLETED_COUNT:
+      g_value_set_uint64 (value, priv->completed);
+      break;
+    case PROP_REJECTED_COUNT:
+      g_value_set_uint64 (value, priv->rejected);
+      break;
+    case PROP_TOTAL_WAIT_TIME:
+      g_value_set_int64 (value, priv->total_wait);
+      break;
+    case PROP_MAX_WAIT_TIME:
+      g_value_set_int64 (value, priv->max_wait);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+/**
+ * cog_executor_new:
+ * @max_threads: maximum number of requests in progress at once
+ * @max_queued: maximum number of requests waiting for a thread, or 0 for no
+ *   limit
+ *
+ * Create a new executor with a pool of at most @max_threads worker threads.
+ *
+ * Returns: (transfer full): a newly created #CogExecutor
+ */
+CogExecutor *
+cog_executor_new (unsigned max_threads,
+                  unsigned max_queued)
+{
+  g_return_val_if_fail (max_threads > 0, NULL);
+
+  return COG_EXECUTOR (g_object_new (COG_TYPE_EXECUTOR,
+                                     "max-threads", max_threads,
+                                     "max-queued", max_queued,
+                                     NULL));
+}
+
+static void
+executor_run_job (void *data,
+                  void *user_data)
+{
+  auto *job = static_cast<ExecutorJob *> (data);
+  CogExecutor *self = COG_EXECUTOR (user_data);
+  CogExecutorPrivate *priv = GET_PRIVATE (self);
+
+  priv->queue_depth--;
+
+  gint64 wait = g_get_monotonic_time () - job->queued_time;
+  priv->total_wait += wait;
+  gint64 max_wait = priv->max_wait;
+  while (wait > max_wait &&
+         !priv->max_wait.compare_exchange_weak (max_wait, wait))
+    ;
+
+  job->fn ();
+  delete job;
+
+  priv->completed++;
+
+  /* Taken in _cog_executor_push() */
+  g_object_unref (self);
+}
+
+static void
+cog_executor_constructed (GObject *object)
+{
+  CogExecutorPrivate *priv = GET_PRIVATE (object);
+  G_OBJECT_CLASS (cog_executor_parent_class)->constructed (object);
+
+  priv->pool = g_thread_pool_new (executor_run_job, object, priv->max_threads,
+                                  FALSE, NULL);
+}
+
+static void
+cog_executor_finalize (GObject *object)
+{
+  CogExecutorPrivate *priv = GET_PRIVATE (object);
+
+  /* Every queued job holds a reference on the executor, so the pool is empty
+   * by now. The last reference may have been dropped by a job on one of our
+   * own worker threads, so don't wait for the threads to exit. */
+  g_thread_pool_free (priv->pool, FALSE, FALSE);
+
+  priv->queue_depth.~atomic ();
+  priv->completed.~atomic ();
+  priv->rejected.~atomic ();
+  priv->total_wait.~atomic ();
+  priv->max_wait.~atomic ();
+
+  G_OBJECT_CLASS (cog_executor_parent_class)->finalize (object);
+}
+
+static void
+cog_executor_class_init (CogExecutorClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->constructed = cog_executor_constructed;
+  object_class->finalize = cog_executor_finalize;
+
+  object_class->set_property = cog_executor_set_property;
+  object_class->get_property = cog_executor_get_property;
+
+  g_object_class_install_property (object_class,
+                                   PROP_MAX_THREADS,
+                                   g_param_spec_uint ("max-threads",
+                                                      "Max threads",
+                                                      "Maximum number of worker threads",
+                                                      1, G_MAXINT,
+                                                      DEFAULT_MAX_THREADS,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_READWRITE)));
+
+  g_object_class_install_property (object_class,
+                                   PROP_MAX_QUEUED,
+                                   g_param_spec_uint ("max-queued",
+                                                      "Max queued",
+                                                      "Maximum number of requests waiting for a thread, 0 for no limit",
+                                                      0, G_MAXUINT,
+                                                      DEFAULT_MAX_QUEUED,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_READWRITE)));
+
+  g_object_class_install_property (object_class,
+                                   PROP_QUEUE_DEPTH,
+                                   g_param_spec_uint ("queue-depth",
+                                                      "Queue depth",
+                                                      "Number of requests currently waiting for a thread",
+                                                      0, G_MAXUINT, 0,
+                                                      G_PARAM_READABLE));
+
+  g_object_class_install_property (object_class,
+                                   PROP_COMPLETED_COUNT,
+                                   g_param_spec_uint64 ("completed-count",
+                                                        "Completed count",
+                                                        "Number of requests run to completion",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READABLE));
+
+  g_object_class_install_property (object_class,
+                                   PROP_REJECTED_COUNT,
+                                   g_param_spec_uint64 ("rejected-count",
+                                                        "Rejected count",
+                                                        "Number of requests refused because the queue was full",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READABLE));
+
+  g_object_class_install_property (object_class,
+                                   PROP_TOTAL_WAIT_TIME,
+                                   g_param_spec_int64 ("total-wait-time",
+                                                       "Total wait time",
+                                                       "Total time requests spent waiting for a thread, in microseconds",
+                                                       0, G_MAXINT64, 0,
+                                                       G_PARAM_READABLE));
+
+  g_object_class_install_property (object_class,
+                                   PROP_MAX_WAIT_TIME,
+                                   g_param_spec_int64 ("max-wait-time",
+                                                       "Max wait time",
+                                                       "Longest time a request spent waiting for a thread, in microseconds",
+                                                       0, G_MAXINT64, 0,
+                                                       G_PARAM_READABLE));
+}
+
+static void
+cog_executor_init (CogExecutor *self)
+{
+  CogExecutorPrivate *priv = GET_PRIVATE (self);
+
+  new (&priv->queue_depth) std::atomic<unsigned> (0);
+  new (&priv->completed) std::atomic<guint64> (0);
+  new (&priv->rejected) std::atomic<guint64> (0);
+  new (&priv->total_wait) std::atomic<gint64> (0);
+  new (&priv->max_wait) std::atomic<gint64> (0);
+}
+
+/* METHODS */
+
+/**
+ * cog_executor_get_max_threads:
+ * @self: the #CogExecutor
+ *
+ * Returns: the value of #CogExecutor:max-threads
+ */
+unsigned
+cog_executor_get_max_threads (CogExecutor *self)
+{
+  g_return_val_if_fail (COG_IS_EXECUTOR (self), 0);
+  return GET_PRIVATE (self)->max_threads;
+}
+
+/**
+ * cog_executor_get_max_queued:
+ * @self: the #CogExecutor
+ *
+ * Returns: the value of #CogExecutor:max-queued
+ */
+unsigned
+cog_executor_get_max_queued (CogExecutor *self)
+{
+  g_return_val_if_fail (COG_IS_EXECUTOR (self), 0);
+  return GET_PRIVATE (self)->max_queued;
+}
+
+/**
+ * cog_executor_get_queue_depth:
+ * @self: the #CogExecutor
+ *
+ * Returns: the number of requests currently waiting for a worker thread
+ */
+unsigned
+cog_executor_get_queue_depth (CogExecutor *self)
+{
+  g_return_val_if_fail (COG_IS_EXECUTOR (self), 0);
+  return GET_PRIVATE (self)->queue_depth;
+}
+
+/**
+ * cog_executor_get_completed_count:
+ * @self: the #CogExecutor
+ *
+ * Returns: the number of requests that have been run to completion
+ */
+guint64
+cog_executor_get_completed_count (CogExecutor *self)
+{
+  g_return_val_if_fail (COG_IS_EXECUTOR (self), 0);
+  return GET_PRIVATE (self)->completed;
+}
+
+/**
+ * cog_executor_get_rejected_count:
+ * @self: the #CogExecutor
+ *
+ * Returns: the number of requests that were refused because the queue was
+ *   full
+ */
+guint64
+cog_executor_get_rejected_count (CogExecutor *self)
+{
+  g_return_val_if_fail (COG_IS_EXECUTOR (self), 0);
+  return GET_PRIVATE (self)->rejected;
+}
+
+/**
+ * cog_executor_get_total_wait_time:
+ * @self: the #CogExecutor
+ *
+ * Together with cog_executor_get_completed_count(), this can be used to
+ * compute the average time a request waits for a worker thread.
+ *
+ * Returns: the total time in microseconds that requests have spent waiting
+ *   for a worker thread
+ */
+gint64
+cog_executor_get_total_wait_time (CogExecutor *self)
+{
+  g_return_val_if_fail (COG_IS_EXECUTOR (self), 0);
+  return GET_PRIVATE (self)->total_wait;
+}
+
+/**
+ * cog_executor_get_max_wait_time:
+ * @self: the #CogExecutor
+ *
+ * Returns: the longest time in microseconds that any request has spent
+ *   waiting for a worker thread
+ */
+gint64
+cog_executor_get_max_wait_time (CogExecutor *self)
+{
+  g_return_val_if_fail (COG_IS_EXECUTOR (self), 0);
+  return GET_PRIVATE (self)->max_wait;
+}
+
+/* PRIVATE */
+
+gboolean
+_cog_executor_push (CogExecutor *self,
+                    std::function<void ()>&& fn)
+{
+  CogExecutorPrivate *priv = GET_PRIVATE (self);
+
+  unsigned depth = priv->queue_depth++;
+  if (priv->max_queued && depth >= priv->max_queued)
+    {
+      priv->queue_depth--;
+      priv->rejected++;
+      return FALSE;
+    }
+
+  auto *job = new ExecutorJob { std::move (fn), g_get_monotonic_time () };
+  g_object_ref (self);  /* released in executor_run_job() */
+  g_thread_pool_push (priv->pool, job, NULL);
+  return TRUE;
+}
+
+std::shared_ptr<Aws::Utils::Threading::Executor>
+_cog_executor_to_internal (CogExecutor *self)
+{
+  return Aws::MakeShared<CogExecutorAdapter> (_COG_ALLOCATION_TAG, self);
+}
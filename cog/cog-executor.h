@@ -0,0 +1,48 @@
+#pragma once
+
+#if !(defined(_COG_INSIDE_COG_H) || defined(COMPILING_LIBCOG))
+#error "Please do not include this header file directly."
+#endif
+
+#include <glib-object.h>
+
+#include "cog/cog-macros.h"
+
+G_BEGIN_DECLS
+
+#define COG_TYPE_EXECUTOR (cog_executor_get_type())
+
+COG_AVAILABLE_IN_ALL
+G_DECLARE_FINAL_TYPE (CogExecutor, cog_executor, COG, EXECUTOR, GObject)
+
+struct _CogExecutorClass
+{
+  GObjectClass parent_class;
+};
+
+COG_AVAILABLE_IN_ALL
+CogExecutor *cog_executor_new (unsigned max_threads,
+                               unsigned max_queued);
+
+COG_AVAILABLE_IN_ALL
+unsigned cog_executor_get_max_threads (CogExecutor *self);
+
+COG_AVAILABLE_IN_ALL
+unsigned cog_executor_get_max_queued (CogExecutor *self);
+
+COG_AVAILABLE_IN_ALL
+unsigned cog_executor_get_queue_depth (CogExecutor *self);
+
+COG_AVAILABLE_IN_ALL
+guint64 cog_executor_get_completed_count (CogExecutor *self);
+
+COG_AVAILABLE_IN_ALL
+guint64 cog_executor_get_rejected_count (CogExecutor *self);
+
+COG_AVAILABLE_IN_ALL
+gint64 cog_executor_get_total_wait_time (CogExecutor *self);
+
+COG_AVAILABLE_IN_ALL
+gint64 cog_executor_get_max_wait_time (CogExecutor *self);
+
+G_END_DECLS
@@ -1,6 +1,10 @@
 #include <aws/core/Aws.h>
+#include <aws/core/utils/logging/LogLevel.h>
 
 #include "cog/cog-init.h"
+#include "cog/cog-memory-system-private.h"
+#include "cog/cog-request-monitor-private.h"
+#include "cog/cog-transport-private.h"
 #include "cog/cog-utils-private.h"
 
 /**
@@ -12,7 +16,8 @@
  * with cog_init_default() before creating service clients and using them.
  * You should then shut down the AWS SDK with cog_shutdown().
  *
- * You can set additional run-time options.
+ * You can set additional run-time options by initializing with
+ * cog_init_with_options() instead.
  *
  * # Initializing and Shutting Down the AWS SDK #
  *
@@ -30,10 +35,187 @@
  *   return 0;
  * }
  * ]|
+ *
+ * # Initialization Options #
+ *
+ * Build a #CogInitOptions with cog_init_options_new() and its setters, and
+ * pass it to cog_init_with_options():
+ *
+ * |[<!-- language="C" -->
+ * g_autoptr(CogInitOptions) init_options = cog_init_options_new ();
+ * cog_init_options_set_log_level (init_options, COG_LOG_LEVEL_WARNING);
+ * cog_init_options_set_pooled_memory (init_options, TRUE);
+ * cog_init_with_options (init_options);
+ * ]|
  */
 
 static Aws::SDKOptions options;
 static bool is_inited;
+/* Never freed, since the SDK may free memory until the process exits */
+static CogMemorySystem *memory_system;
+
+/**
+ * CogInitOptions:
+ *
+ * Options for initializing the AWS SDK with cog_init_with_options().
+ * Options that are not set keep the values that cog_init_default() uses.
+ */
+struct _CogInitOptions
+{
+  unsigned ref_count;
+  CogLogLevel log_level;
+  bool init_http : 1;
+  bool init_crypto : 1;
+  bool pooled_memory : 1;
+};
+
+G_DEFINE_BOXED_TYPE (CogInitOptions, cog_init_options,
+                     cog_init_options_ref, cog_init_options_unref)
+
+/* CogLogLevel values are passed on as they are */
+G_STATIC_ASSERT (int (Aws::Utils::Logging::LogLevel::Trace) ==
+                 COG_LOG_LEVEL_TRACE);
+
+/**
+ * cog_init_options_new:
+ *
+ * Creates options that initialize the AWS SDK the same way as
+ * cog_init_default(), to be changed with the cog_init_options_set_*()
+ * functions.
+ *
+ * Returns: (transfer full): a new #CogInitOptions
+ */
+CogInitOptions *
+cog_init_options_new (void)
+{
+  CogInitOptions *self = g_slice_new0 (CogInitOptions);
+  self->ref_count = 1;
+  self->log_level = COG_LOG_LEVEL_OFF;
+  self->init_http = true;
+  self->init_crypto = true;
+  self->pooled_memory = false;
+  return self;
+}
+
+/**
+ * cog_init_options_ref:
+ * @self: a #CogInitOptions
+ *
+ * Increments the reference count of @self by one.
+ *
+ * Returns: (transfer none): @self
+ */
+CogInitOptions *
+cog_init_options_ref (CogInitOptions *self)
+{
+  g_return_val_if_fail (self, NULL);
+  g_return_val_if_fail (self->ref_count, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+/**
+ * cog_init_options_unref:
+ * @self: (transfer none): a #CogInitOptions
+ *
+ * Decrements the reference count of @self by one, freeing the structure when
+ * the reference count reaches zero.
+ */
+void
+cog_init_options_unref (CogInitOptions *self)
+{
+  g_return_if_fail (self);
+  g_return_if_fail (self->ref_count);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+    g_slice_free (CogInitOptions, self);
+}
+
+/**
+ * cog_init_options_set_log_level:
+ * @self: a #CogInitOptions
+ * @log_level: how much to log
+ *
+ * Sets how much the AWS SDK logs.
+ * The SDK writes its log to a file named `aws_sdk_` followed by the date, in
+ * the current directory.
+ * The default is %COG_LOG_LEVEL_OFF.
+ */
+void
+cog_init_options_set_log_level (CogInitOptions *self,
+                                CogLogLevel log_level)
+{
+  g_return_if_fail (self);
+  g_return_if_fail (log_level <= COG_LOG_LEVEL_TRACE);
+
+  self->log_level = log_level;
+}
+
+/**
+ * cog_init_options_set_init_http:
+ * @self: a #CogInitOptions
+ * @init_http: whether to initialize the HTTP client library
+ *
+ * Sets whether the AWS SDK initializes libcurl when initialized, and cleans
+ * it up when shut down.
+ * Set it to %FALSE if your application also uses libcurl and initializes it
+ * itself.
+ * The default is %TRUE.
+ */
+void
+cog_init_options_set_init_http (CogInitOptions *self,
+                                gboolean init_http)
+{
+  g_return_if_fail (self);
+
+  self->init_http = init_http;
+}
+
+/**
+ * cog_init_options_set_init_crypto:
+ * @self: a #CogInitOptions
+ * @init_crypto: whether to initialize the crypto library
+ *
+ * Sets whether the AWS SDK initializes OpenSSL when initialized, and cleans
+ * it up when shut down.
+ * Set it to %FALSE if your application also uses OpenSSL and initializes it
+ * itself.
+ * The default is %TRUE.
+ */
+void
+cog_init_options_set_init_crypto (CogInitOptions *self,
+                                  gboolean init_crypto)
+{
+  g_return_if_fail (self);
+
+  self->init_crypto = init_crypto;
+}
+
+/**
+ * cog_init_options_set_pooled_memory:
+ * @self: a #CogInitOptions
+ * @pooled_memory: whether the AWS SDK allocates from pools
+ *
+ * Sets whether the AWS SDK allocates memory through Libcog's memory manager.
+ * It serves small blocks, which make up most of what is allocated for each
+ * request, from pools of blocks of the same size, and counts the memory in
+ * use by each part of the SDK; see cog_get_memory_statistics().
+ * Memory in the pools is kept for reuse until the process exits.
+ *
+ * This only has an effect if the AWS SDK was built with custom memory
+ * management enabled.
+ * The default is %FALSE.
+ */
+void
+cog_init_options_set_pooled_memory (CogInitOptions *self,
+                                    gboolean pooled_memory)
+{
+  g_return_if_fail (self);
+
+  self->pooled_memory = pooled_memory;
+}
 
 /**
  * cog_init_default:
@@ -46,8 +228,50 @@ static bool is_inited;
 void
 cog_init_default (void)
 {
+  g_autoptr(CogInitOptions) init_options = cog_init_options_new ();
+  cog_init_with_options (init_options);
+}
+
+/**
+ * cog_init_with_options:
+ * @init_options: a #CogInitOptions
+ *
+ * Like cog_init_default(), but initializes the AWS SDK with @init_options.
+ * @init_options is not used anymore once this function returns.
+ */
+void
+cog_init_with_options (CogInitOptions *init_options)
+{
+  g_return_if_fail (init_options);
   g_return_if_fail (!is_inited);
 
+  options.loggingOptions.logLevel =
+    Aws::Utils::Logging::LogLevel (init_options->log_level);
+  options.httpOptions.initAndCleanupCurl = init_options->init_http;
+  options.cryptoOptions.initAndCleanupOpenSSL = init_options->init_crypto;
+
+  if (init_options->pooled_memory)
+    {
+      if (!memory_system)
+        memory_system = new CogMemorySystem ();
+      options.memoryManagementOptions.memoryManager = memory_system;
+    }
+  else
+    {
+      options.memoryManagementOptions.memoryManager = nullptr;
+    }
+
+  /* Route all HTTP clients through our factory, so that clients can be given
+   * a #CogTransport */
+  options.httpOptions.httpClientFactory_create_fn = [] {
+    return _cog_http_client_factory_new (options.httpOptions.initAndCleanupCurl);
+  };
+
+  /* Lets clients measure their requests; see CogClient::request-completed */
+  options.monitoringOptions.customizedMonitoringFactory_create_fn = {
+    _cog_monitoring_factory_new
+  };
+
   Aws::InitAPI (options);
   is_inited = true;
 }
@@ -80,6 +304,35 @@ cog_shutdown (void)
   g_return_if_fail (is_inited);
 
   Aws::ShutdownAPI (options);
+}
+
+/**
+ * cog_get_memory_statistics:
+ *
+ * Gets a snapshot of the memory allocated by the AWS SDK, if it was
+ * initialized with cog_init_options_set_pooled_memory().
+ *
+ * The result is a dictionary with an entry for each allocation tag, which
+ * names the part of the SDK that allocated the memory; memory allocated by
+ * Libcog itself is tagged `libcog`.
+ * Each entry is itself a dictionary with these keys:
+ *
+ * - `live-bytes` (`t`): number of bytes allocated and not freed yet
+ * - `live-allocations` (`t`): number of blocks allocated and not freed yet
+ * - `allocations` (`t`): number of blocks allocated in total
+ *
+ * Like cog_client_get_statistics(), the counters are updated without locking.
+ *
+ * Returns: (transfer full) (nullable): a new #GVariant of type `a{sa{sv}}`, or
+ *   %NULL if the SDK does not allocate through Libcog's memory manager
+ */
+GVariant *
+cog_get_memory_statistics (void)
+{
+  g_return_val_if_fail (is_inited, NULL);
 
-  _cog_free_static_data ();
+  if (!memory_system ||
+      options.memoryManagementOptions.memoryManager != memory_system)
+    return NULL;
+  return g_variant_ref_sink (memory_system->snapshot ());
 }
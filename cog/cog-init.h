@@ -4,18 +4,81 @@
 #error "Please do not include this header file directly."
 #endif
 
-#include <glib.h>
+#include <glib-object.h>
 #include "cog/cog-macros.h"
 
 G_BEGIN_DECLS
 
+/**
+ * CogLogLevel:
+ * @COG_LOG_LEVEL_OFF: Nothing is logged.
+ * @COG_LOG_LEVEL_FATAL: Only fatal errors are logged.
+ * @COG_LOG_LEVEL_ERROR: Errors are logged.
+ * @COG_LOG_LEVEL_WARNING: Warnings and errors are logged.
+ * @COG_LOG_LEVEL_INFO: Informational messages are logged as well.
+ * @COG_LOG_LEVEL_DEBUG: Debug messages are logged as well.
+ * @COG_LOG_LEVEL_TRACE: Everything is logged, including each request and
+ *   response.
+ *
+ * How much the AWS SDK logs; see cog_init_options_set_log_level().
+ */
+typedef enum {
+  COG_LOG_LEVEL_OFF,
+  COG_LOG_LEVEL_FATAL,
+  COG_LOG_LEVEL_ERROR,
+  COG_LOG_LEVEL_WARNING,
+  COG_LOG_LEVEL_INFO,
+  COG_LOG_LEVEL_DEBUG,
+  COG_LOG_LEVEL_TRACE,
+} CogLogLevel;
+
+#define COG_TYPE_INIT_OPTIONS (cog_init_options_get_type ())
+
+typedef struct _CogInitOptions CogInitOptions;
+
+COG_AVAILABLE_IN_ALL
+GType cog_init_options_get_type (void) G_GNUC_CONST;
+
+COG_AVAILABLE_IN_ALL
+CogInitOptions *cog_init_options_new (void);
+
+COG_AVAILABLE_IN_ALL
+CogInitOptions *cog_init_options_ref (CogInitOptions *self);
+
+COG_AVAILABLE_IN_ALL
+void cog_init_options_unref (CogInitOptions *self);
+
+COG_AVAILABLE_IN_ALL
+void cog_init_options_set_log_level (CogInitOptions *self,
+                                     CogLogLevel log_level);
+
+COG_AVAILABLE_IN_ALL
+void cog_init_options_set_init_http (CogInitOptions *self,
+                                     gboolean init_http);
+
+COG_AVAILABLE_IN_ALL
+void cog_init_options_set_init_crypto (CogInitOptions *self,
+                                       gboolean init_crypto);
+
+COG_AVAILABLE_IN_ALL
+void cog_init_options_set_pooled_memory (CogInitOptions *self,
+                                         gboolean pooled_memory);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (CogInitOptions, cog_init_options_unref)
+
 COG_AVAILABLE_IN_ALL
 void cog_init_default (void);
 
+COG_AVAILABLE_IN_ALL
+void cog_init_with_options (CogInitOptions *init_options);
+
 COG_AVAILABLE_IN_ALL
 gboolean cog_is_inited (void);
 
 COG_AVAILABLE_IN_ALL
 void cog_shutdown (void);
 
+COG_AVAILABLE_IN_ALL
+GVariant *cog_get_memory_statistics (void);
+
 G_END_DECLS
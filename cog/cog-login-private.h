@@ -0,0 +1,31 @@
+#pragma once
+
+#include "cog/cog-client.h"
+#include "cog/cog-login.h"
+#include "cog/cog-srp.h"
+
+/* What a login needs to answer Cognito's challenges by itself, and how far it
+ * has got. Only one step of a login runs at a time, on one of the client's
+ * worker threads, so the fields from srp_session on are changed without a
+ * lock. */
+struct _CogLogin
+{
+  unsigned ref_count;
+  CogSrpClient *srp_client;
+  char *client_id;
+  char *username;
+  char *password;
+  char *new_password;
+  char *device_key;
+  char *device_group_key;
+  char *device_password;
+
+  /* Of the last SRP_A sent, for the user or for the device */
+  CogSrpSession *srp_session;
+  /* Of the challenge waiting for a response */
+  CogChallengeName challenge_name;
+  char *session;
+  /* The USERNAME that Cognito sent with the challenge, which is the one to
+   * respond with, even if the user logged in with an alias */
+  char *challenge_username;
+};
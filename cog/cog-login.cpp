@@ -0,0 +1,176 @@
+/**
+ * SECTION:login
+ * @title: CogLogin
+ * @short_description: Log a user in with SRP in one call
+ *
+ * Logging in with %COG_AUTH_FLOW_USER_SRP_AUTH takes several round trips to
+ * Cognito: cog_client_initiate_auth(), then a response to
+ * %COG_CHALLENGE_NAME_PASSWORD_VERIFIER, and possibly responses for a
+ * remembered device or a required new password.
+ * A #CogLogin holds what is needed for all of them, so that
+ * cog_client_log_in_async() can run them one after the other on a worker
+ * thread and only call back when the login is done, or when it needs input
+ * from the user such as an MFA code.
+ *
+ * |[<!-- language="C" -->
+ * CogLogin *login = cog_login_new (srp_client, client_id, username,
+ *                                  password);
+ * cog_login_set_device (login, device_key, device_group_key, device_password);
+ * cog_client_log_in_async (client, login, NULL, on_log_in_step, login);
+ * ]|
+ */
+
+#include <glib-object.h>
+
+#include "cog/cog-login.h"
+#include "cog/cog-login-private.h"
+
+/**
+ * CogLogin:
+ *
+ * One user's login with %COG_AUTH_FLOW_USER_SRP_AUTH, to run with
+ * cog_client_log_in_async().
+ * Besides the user's password, it holds what is needed to answer the other
+ * challenges that Cognito may send without asking the user: a new password for
+ * %COG_CHALLENGE_NAME_NEW_PASSWORD_REQUIRED, and a remembered device's keys
+ * for %COG_CHALLENGE_NAME_DEVICE_SRP_AUTH.
+ *
+ * A #CogLogin can only be used for one login, and only with one call to
+ * cog_client_log_in_async() or cog_client_log_in_respond_async() at a time.
+ */
+
+G_DEFINE_BOXED_TYPE (CogLogin, cog_login, cog_login_ref, cog_login_unref)
+
+/**
+ * cog_login_new:
+ * @srp_client: a #CogSrpClient for the user pool
+ * @client_id: the app client ID
+ * @username: the user's username or alias
+ * @password: the user's password
+ *
+ * Creates a login for @username in the user pool of @srp_client.
+ *
+ * Returns: (transfer full): a new #CogLogin
+ */
+CogLogin *
+cog_login_new (CogSrpClient *srp_client,
+               const char *client_id,
+               const char *username,
+               const char *password)
+{
+  g_return_val_if_fail (COG_IS_SRP_CLIENT (srp_client), NULL);
+  g_return_val_if_fail (client_id, NULL);
+  g_return_val_if_fail (username, NULL);
+  g_return_val_if_fail (password, NULL);
+
+  CogLogin *self = g_slice_new0 (CogLogin);
+  self->ref_count = 1;
+  self->srp_client = COG_SRP_CLIENT (g_object_ref (srp_client));
+  self->client_id = g_strdup (client_id);
+  self->username = g_strdup (username);
+  self->password = g_strdup (password);
+  self->challenge_name = COG_CHALLENGE_NAME_NOT_SET;
+  return self;
+}
+
+/**
+ * cog_login_ref:
+ * @self: a #CogLogin
+ *
+ * Increments the reference count of @self by one.
+ *
+ * Returns: (transfer none): @self
+ */
+CogLogin *
+cog_login_ref (CogLogin *self)
+{
+  g_return_val_if_fail (self, NULL);
+  g_return_val_if_fail (self->ref_count, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+/**
+ * cog_login_unref:
+ * @self: (transfer none): a #CogLogin
+ *
+ * Decrements the reference count of @self by one, freeing the structure when
+ * the reference count reaches zero.
+ */
+void
+cog_login_unref (CogLogin *self)
+{
+  g_return_if_fail (self);
+  g_return_if_fail (self->ref_count);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+    {
+      g_object_unref (self->srp_client);
+      g_free (self->client_id);
+      g_free (self->username);
+      g_free (self->password);
+      g_free (self->new_password);
+      g_free (self->device_key);
+      g_free (self->device_group_key);
+      g_free (self->device_password);
+      g_clear_pointer (&self->srp_session, cog_srp_session_unref);
+      g_free (self->session);
+      g_free (self->challenge_username);
+      g_slice_free (CogLogin, self);
+    }
+}
+
+/**
+ * cog_login_set_new_password:
+ * @self: a #CogLogin
+ * @new_password: (nullable): the password to set
+ *
+ * Sets the password with which to answer
+ * %COG_CHALLENGE_NAME_NEW_PASSWORD_REQUIRED, which Cognito sends to users who
+ * must change their password, for example after an administrator created
+ * their account.
+ * If %NULL, the default, that challenge is left to the app.
+ */
+void
+cog_login_set_new_password (CogLogin *self,
+                            const char *new_password)
+{
+  g_return_if_fail (self);
+
+  g_free (self->new_password);
+  self->new_password = g_strdup (new_password);
+}
+
+/**
+ * cog_login_set_device:
+ * @self: a #CogLogin
+ * @device_key: (nullable): the key of a device remembered by an earlier login
+ * @device_group_key: (nullable): the device's group key
+ * @device_password: (nullable): the device's password
+ *
+ * Sets the remembered device to log in from.
+ * Its key is sent along with the login, and
+ * %COG_CHALLENGE_NAME_DEVICE_SRP_AUTH is answered with the device's own SRP
+ * exchange, in which the device group key and device key take the places of
+ * the user pool's name and the user ID.
+ * If @device_key is %NULL, the default, no device is sent and that challenge
+ * is left to the app.
+ */
+void
+cog_login_set_device (CogLogin *self,
+                      const char *device_key,
+                      const char *device_group_key,
+                      const char *device_password)
+{
+  g_return_if_fail (self);
+  g_return_if_fail (!device_key || (device_group_key && device_password));
+
+  g_free (self->device_key);
+  g_free (self->device_group_key);
+  g_free (self->device_password);
+  self->device_key = g_strdup (device_key);
+  self->device_group_key = g_strdup (device_group_key);
+  self->device_password = g_strdup (device_password);
+}
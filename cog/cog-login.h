@@ -0,0 +1,45 @@
+#pragma once
+
+#if !(defined(_COG_INSIDE_COG_H) || defined(COMPILING_LIBCOG))
+#error "Please do not include this header file directly."
+#endif
+
+#include <glib-object.h>
+
+#include "cog/cog-macros.h"
+#include "cog/cog-srp.h"
+
+G_BEGIN_DECLS
+
+#define COG_TYPE_LOGIN (cog_login_get_type ())
+
+typedef struct _CogLogin CogLogin;
+
+COG_AVAILABLE_IN_ALL
+GType cog_login_get_type (void) G_GNUC_CONST;
+
+COG_AVAILABLE_IN_ALL
+CogLogin *cog_login_new (CogSrpClient *srp_client,
+                         const char *client_id,
+                         const char *username,
+                         const char *password);
+
+COG_AVAILABLE_IN_ALL
+CogLogin *cog_login_ref (CogLogin *self);
+
+COG_AVAILABLE_IN_ALL
+void cog_login_unref (CogLogin *self);
+
+COG_AVAILABLE_IN_ALL
+void cog_login_set_new_password (CogLogin *self,
+                                 const char *new_password);
+
+COG_AVAILABLE_IN_ALL
+void cog_login_set_device (CogLogin *self,
+                           const char *device_key,
+                           const char *device_group_key,
+                           const char *device_password);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (CogLogin, cog_login_unref)
+
+G_END_DECLS
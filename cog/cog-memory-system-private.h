@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+
+#include <aws/core/utils/memory/MemorySystemInterface.h>
+#include <glib.h>
+
+/* Blocks of 32 bytes up to this many powers of two, header included, are
+ * served from pools; larger or more strictly aligned ones from malloc() */
+#define COG_MEMORY_N_SIZE_CLASSES 8
+/* Allocation tags after this many are counted together as "(other)" */
+#define COG_MEMORY_MAX_TAGS 64
+/* Size of the hash table from tag addresses to tags, which is never filled
+ * more than three quarters */
+#define COG_MEMORY_TAG_ALIAS_BITS 10
+#define COG_MEMORY_TAG_ALIAS_SLOTS (1 << COG_MEMORY_TAG_ALIAS_BITS)
+
+/* Memory manager for the AWS SDK, installed by cog_init_with_options().
+ *
+ * Most of what the SDK allocates is small and short-lived: strings, headers
+ * and model objects built and thrown away for each request. Those blocks are
+ * taken from a free list per size class, so that the same few blocks keep
+ * being reused instead of going through malloc() and free() every time. Pools
+ * only grow, a slab at a time, and are kept until the process exits.
+ *
+ * Each thread keeps a few free blocks of each size class to itself, and only
+ * takes a pool's lock to move a batch of them at a time, so that threads
+ * sending requests at the same time do not contend for the pools. A thread's
+ * blocks go back to the pools when it exits; so the memory system must
+ * outlive every thread that used it, which it does, since it is never
+ * destroyed once installed.
+ *
+ * Live bytes and allocations are counted for each allocation tag, with
+ * relaxed atomic counters like those of #CogOperationStats. The SDK passes
+ * its tags as string literals, so a tag is looked up by address first, in a
+ * hash table that can be read without locking, and only looked up by name
+ * the first time an address is seen. */
+class CogMemorySystem : public Aws::Utils::Memory::MemorySystemInterface {
+public:
+  CogMemorySystem ();
+  ~CogMemorySystem ();
+
+  void Begin () override;
+  void End () override;
+  void *AllocateMemory (std::size_t size,
+                        std::size_t alignment,
+                        const char *tag = nullptr) override;
+  void FreeMemory (void *memory) override;
+
+  /* Returns a new floating a{sa{sv}} dictionary; see
+   * cog_get_memory_statistics() */
+  GVariant *snapshot (void) const;
+
+private:
+  struct Block {
+    Block *next;
+  };
+
+  struct Pool {
+    GMutex lock;
+    Block *free_list;
+    GPtrArray *slabs;
+  };
+
+  struct TagStats {
+    char *name;
+    std::atomic<guint64> live_bytes;
+    std::atomic<guint64> live_allocations;
+    std::atomic<guint64> n_allocations;
+  };
+
+  struct TagAlias {
+    std::atomic<const char *> address;
+    unsigned index;
+  };
+
+  /* Free blocks that belong to one thread, taken from the pools of @owner */
+  struct ThreadCache {
+    CogMemorySystem *owner;
+    bool finished;  /* destroyed as the thread exits */
+    Block *free_lists[COG_MEMORY_N_SIZE_CLASSES];
+    unsigned lengths[COG_MEMORY_N_SIZE_CLASSES];
+
+    ~ThreadCache ();
+  };
+
+  unsigned tag_index (const char *tag);
+  ThreadCache *thread_cache (void);
+  unsigned pool_take (unsigned size_class,
+                      Block **list,
+                      unsigned n_blocks);
+  void pool_give (unsigned size_class,
+                  Block *list);
+  void *pool_allocate (unsigned size_class);
+  void pool_free (unsigned size_class,
+                  Block *block);
+
+  Pool m_pools[COG_MEMORY_N_SIZE_CLASSES];
+  static thread_local ThreadCache t_cache;
+
+  GMutex m_tags_lock;
+  TagStats m_tags[COG_MEMORY_MAX_TAGS];
+  std::atomic<unsigned> m_n_tags;
+  GHashTable *m_tag_names;  /* (owned by m_tags) name → index + 1 */
+  TagAlias m_aliases[COG_MEMORY_TAG_ALIAS_SLOTS];
+  unsigned m_n_aliases;  /* only used under m_tags_lock */
+};
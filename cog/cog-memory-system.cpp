@@ -0,0 +1,453 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "cog/cog-memory-system-private.h"
+
+/* Counters are independent of each other and of any other memory, so relaxed
+ * ordering is enough */
+#define RELAXED std::memory_order_relaxed
+
+/* The smallest block is 2^5 = 32 bytes, header included */
+#define MIN_BLOCK_SIZE_BITS 5
+/* Pools grow by this much at a time */
+#define SLAB_SIZE (64 * 1024)
+/* Blocks moved between a thread's cache and a pool at a time, for the
+ * smallest size class; a thread keeps at most twice as many */
+#define CACHE_BATCH 32
+
+#define NO_TAG "(none)"
+#define OTHER_TAGS "(other)"
+
+/* Precedes every block handed out, so that FreeMemory(), which is not told
+ * the size or the tag, can account for the block and put it back where it
+ * came from. Its size is also the alignment of all blocks. */
+struct Header {
+  guint16 size_class;  /* COG_MEMORY_N_SIZE_CLASSES if from malloc() */
+  guint16 tag;
+  guint32 offset;  /* from the start of the malloc()ed memory */
+  guint64 size;
+};
+
+G_STATIC_ASSERT (sizeof (Header) == 16);
+G_STATIC_ASSERT (COG_MEMORY_MAX_TAGS <= G_MAXUINT16);
+
+static unsigned
+size_class_for (gsize total)
+{
+  return MAX (g_bit_storage (total - 1), MIN_BLOCK_SIZE_BITS) -
+         MIN_BLOCK_SIZE_BITS;
+}
+
+static gsize
+block_size (unsigned size_class)
+{
+  return gsize (1) << (size_class + MIN_BLOCK_SIZE_BITS);
+}
+
+/* Fewer of the larger blocks, so that a batch never takes more than a quarter
+ * of a slab */
+static unsigned
+cache_batch (unsigned size_class)
+{
+  return CLAMP (SLAB_SIZE / 4 / block_size (size_class), 1, CACHE_BATCH);
+}
+
+/* String literals have no useful alignment, so mix all the bits of the
+ * address */
+static unsigned
+alias_slot (const char *address)
+{
+  guint64 hash = guint64 (guintptr (address)) *
+                 G_GUINT64_CONSTANT (0x9e3779b97f4a7c15);
+  return hash >> (64 - COG_MEMORY_TAG_ALIAS_BITS);
+}
+
+static guint8 *
+align_up (guint8 *pointer,
+          gsize alignment)
+{
+  guintptr address = guintptr (pointer);
+  return pointer + (((address + alignment - 1) & ~guintptr (alignment - 1)) -
+                    address);
+}
+
+thread_local CogMemorySystem::ThreadCache CogMemorySystem::t_cache;
+
+CogMemorySystem::CogMemorySystem ()
+  : m_n_tags (0),
+    m_tag_names (g_hash_table_new (g_str_hash, g_str_equal)),
+    m_n_aliases (0)
+{
+  for (Pool& pool : m_pools)
+    {
+      g_mutex_init (&pool.lock);
+      pool.free_list = nullptr;
+      pool.slabs = g_ptr_array_new_with_free_func (free);
+    }
+
+  g_mutex_init (&m_tags_lock);
+  for (TagStats& stats : m_tags)
+    {
+      stats.name = nullptr;
+      stats.live_bytes.store (0, RELAXED);
+      stats.live_allocations.store (0, RELAXED);
+      stats.n_allocations.store (0, RELAXED);
+    }
+  m_tags[COG_MEMORY_MAX_TAGS - 1].name = g_strdup (OTHER_TAGS);
+
+  for (TagAlias& alias : m_aliases)
+    {
+      alias.address.store (nullptr, RELAXED);
+      alias.index = 0;
+    }
+}
+
+/* Only called once nothing allocated from the pools is in use anymore, and
+ * every thread that used them has exited */
+CogMemorySystem::~CogMemorySystem ()
+{
+  for (Pool& pool : m_pools)
+    {
+      g_ptr_array_unref (pool.slabs);
+      g_mutex_clear (&pool.lock);
+    }
+
+  g_hash_table_unref (m_tag_names);
+  for (TagStats& stats : m_tags)
+    g_free (stats.name);
+  g_mutex_clear (&m_tags_lock);
+}
+
+/* Gives the thread's blocks back. Other destructors that run as the thread
+ * exits may still allocate or free memory afterwards, which then goes
+ * straight to the pools. */
+CogMemorySystem::ThreadCache::~ThreadCache ()
+{
+  if (owner)
+    {
+      for (unsigned ix = 0; ix < COG_MEMORY_N_SIZE_CLASSES; ix++)
+        if (free_lists[ix])
+          owner->pool_give (ix, free_lists[ix]);
+    }
+  owner = nullptr;
+  finished = true;
+}
+
+void
+CogMemorySystem::Begin ()
+{
+}
+
+/* The SDK may still free memory after this, while static objects are
+ * destroyed, so the pools stay */
+void
+CogMemorySystem::End ()
+{
+}
+
+unsigned
+CogMemorySystem::tag_index (const char *tag)
+{
+  if (!tag)
+    tag = NO_TAG;
+
+  /* The table is never full, so there is always an empty slot to stop at */
+  unsigned slot = alias_slot (tag);
+  const char *address;
+  while ((address = m_aliases[slot].address.load (std::memory_order_acquire)))
+    {
+      if (address == tag)
+        return m_aliases[slot].index;
+      slot = (slot + 1) % COG_MEMORY_TAG_ALIAS_SLOTS;
+    }
+
+  /* First time this address is seen */
+  g_mutex_lock (&m_tags_lock);
+
+  /* Another thread may have added it in the meantime, further along */
+  while ((address = m_aliases[slot].address.load (RELAXED)))
+    {
+      if (address == tag)
+        {
+          g_mutex_unlock (&m_tags_lock);
+          return m_aliases[slot].index;
+        }
+      slot = (slot + 1) % COG_MEMORY_TAG_ALIAS_SLOTS;
+    }
+
+  unsigned index = COG_MEMORY_MAX_TAGS - 1;
+  void *found;
+  if (g_hash_table_lookup_extended (m_tag_names, tag, NULL, &found))
+    {
+      index = GPOINTER_TO_UINT (found) - 1;
+    }
+  else
+    {
+      unsigned n_tags = m_n_tags.load (RELAXED);
+      if (n_tags < COG_MEMORY_MAX_TAGS - 1)
+        {
+          m_tags[n_tags].name = g_strdup (tag);
+          g_hash_table_insert (m_tag_names, m_tags[n_tags].name,
+                               GUINT_TO_POINTER (n_tags + 1));
+          index = n_tags;
+          m_n_tags.store (n_tags + 1, std::memory_order_release);
+        }
+    }
+
+  /* Once the table is three quarters full, addresses not seen yet are always
+   * looked up by name; the SDK only has a few dozen tags */
+  if (m_n_aliases < COG_MEMORY_TAG_ALIAS_SLOTS / 4 * 3)
+    {
+      m_aliases[slot].index = index;
+      m_aliases[slot].address.store (tag, std::memory_order_release);
+      m_n_aliases++;
+    }
+
+  g_mutex_unlock (&m_tags_lock);
+  return index;
+}
+
+/* Returns the calling thread's cache, or %NULL if it cannot have one: because
+ * it already has one for another memory system, or because it is exiting */
+CogMemorySystem::ThreadCache *
+CogMemorySystem::thread_cache (void)
+{
+  ThreadCache *cache = &t_cache;
+  if (G_LIKELY (cache->owner == this))
+    return cache;
+  if (cache->owner || cache->finished)
+    return nullptr;
+  cache->owner = this;
+  return cache;
+}
+
+/* Moves up to @n_blocks free blocks of @size_class from its pool to the front
+ * of @list, growing the pool if it has none. Returns how many were moved,
+ * which is 0 if out of memory. */
+unsigned
+CogMemorySystem::pool_take (unsigned size_class,
+                            Block **list,
+                            unsigned n_blocks)
+{
+  Pool& pool = m_pools[size_class];
+
+  g_mutex_lock (&pool.lock);
+
+  if (!pool.free_list)
+    {
+      void *slab = malloc (SLAB_SIZE + sizeof (Header) - 1);
+      if (!slab)
+        {
+          g_mutex_unlock (&pool.lock);
+          return 0;
+        }
+      g_ptr_array_add (pool.slabs, slab);
+
+      gsize size = block_size (size_class);
+      guint8 *start = align_up (static_cast<guint8 *> (slab), sizeof (Header));
+      for (gsize end = SLAB_SIZE; end >= size; end -= size)
+        {
+          Block *free_block = reinterpret_cast<Block *> (start + end - size);
+          free_block->next = pool.free_list;
+          pool.free_list = free_block;
+        }
+    }
+
+  Block *first = pool.free_list;
+  Block *last = first;
+  unsigned n_taken = 1;
+  while (n_taken < n_blocks && last->next)
+    {
+      last = last->next;
+      n_taken++;
+    }
+  pool.free_list = last->next;
+
+  g_mutex_unlock (&pool.lock);
+
+  last->next = *list;
+  *list = first;
+  return n_taken;
+}
+
+/* Puts all the blocks of @list back in the pool for @size_class */
+void
+CogMemorySystem::pool_give (unsigned size_class,
+                            Block *list)
+{
+  Pool& pool = m_pools[size_class];
+
+  Block *last = list;
+  while (last->next)
+    last = last->next;
+
+  g_mutex_lock (&pool.lock);
+  last->next = pool.free_list;
+  pool.free_list = list;
+  g_mutex_unlock (&pool.lock);
+}
+
+void *
+CogMemorySystem::pool_allocate (unsigned size_class)
+{
+  ThreadCache *cache = thread_cache ();
+  if (G_UNLIKELY (!cache))
+    {
+      Block *block = nullptr;
+      pool_take (size_class, &block, 1);
+      return block;
+    }
+
+  Block *&free_list = cache->free_lists[size_class];
+  if (!free_list)
+    cache->lengths[size_class] = pool_take (size_class, &free_list,
+                                            cache_batch (size_class));
+
+  Block *block = free_list;
+  if (block)
+    {
+      free_list = block->next;
+      cache->lengths[size_class]--;
+    }
+  return block;
+}
+
+void
+CogMemorySystem::pool_free (unsigned size_class,
+                            Block *block)
+{
+  ThreadCache *cache = thread_cache ();
+  if (G_UNLIKELY (!cache))
+    {
+      block->next = nullptr;
+      pool_give (size_class, block);
+      return;
+    }
+
+  Block *&free_list = cache->free_lists[size_class];
+  block->next = free_list;
+  free_list = block;
+
+  /* Keep the most recently freed batch, which is the likeliest to still be
+   * in the CPU cache, and give back the rest */
+  unsigned batch = cache_batch (size_class);
+  if (++cache->lengths[size_class] <= 2 * batch)
+    return;
+
+  Block *kept = free_list;
+  for (unsigned ix = 1; ix < batch; ix++)
+    kept = kept->next;
+  Block *excess = kept->next;
+  kept->next = nullptr;
+  cache->lengths[size_class] = batch;
+  pool_give (size_class, excess);
+}
+
+void *
+CogMemorySystem::AllocateMemory (std::size_t size,
+                                 std::size_t alignment,
+                                 const char *tag)
+{
+  unsigned index = tag_index (tag);
+  unsigned size_class = size_class_for (size + sizeof (Header));
+  guint8 *base, *memory;
+
+  if (alignment <= sizeof (Header) && size_class < COG_MEMORY_N_SIZE_CLASSES)
+    {
+      base = static_cast<guint8 *> (pool_allocate (size_class));
+      if (!base)
+        return nullptr;
+      memory = base + sizeof (Header);
+    }
+  else
+    {
+      size_class = COG_MEMORY_N_SIZE_CLASSES;
+      alignment = MAX (alignment, sizeof (Header));
+      base = static_cast<guint8 *> (malloc (size + sizeof (Header) +
+                                            alignment - 1));
+      if (!base)
+        return nullptr;
+      memory = align_up (base + sizeof (Header), alignment);
+    }
+
+  Header *header = reinterpret_cast<Header *> (memory) - 1;
+  header->size_class = size_class;
+  header->tag = index;
+  header->offset = memory - base;
+  header->size = size;
+
+  TagStats& stats = m_tags[index];
+  stats.live_bytes.fetch_add (size, RELAXED);
+  stats.live_allocations.fetch_add (1, RELAXED);
+  stats.n_allocations.fetch_add (1, RELAXED);
+
+  return memory;
+}
+
+void
+CogMemorySystem::FreeMemory (void *memory)
+{
+  if (!memory)
+    return;
+
+  Header *header = static_cast<Header *> (memory) - 1;
+  TagStats& stats = m_tags[header->tag];
+  stats.live_bytes.fetch_sub (header->size, RELAXED);
+  stats.live_allocations.fetch_sub (1, RELAXED);
+
+  guint8 *base = static_cast<guint8 *> (memory) - header->offset;
+  unsigned size_class = header->size_class;
+  if (size_class == COG_MEMORY_N_SIZE_CLASSES)
+    {
+      free (base);
+      return;
+    }
+
+  pool_free (size_class, reinterpret_cast<Block *> (base));
+}
+
+static void
+add_tag_statistics (GVariantBuilder *builder,
+                    const char *name,
+                    guint64 live_bytes,
+                    guint64 live_allocations,
+                    guint64 n_allocations)
+{
+  GVariantBuilder dict;
+  g_variant_builder_init (&dict, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&dict, "{sv}", "live-bytes",
+                         g_variant_new_uint64 (live_bytes));
+  g_variant_builder_add (&dict, "{sv}", "live-allocations",
+                         g_variant_new_uint64 (live_allocations));
+  g_variant_builder_add (&dict, "{sv}", "allocations",
+                         g_variant_new_uint64 (n_allocations));
+  g_variant_builder_add (builder, "{s@a{sv}}", name,
+                         g_variant_builder_end (&dict));
+}
+
+GVariant *
+CogMemorySystem::snapshot (void) const
+{
+  GVariantBuilder builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+
+  unsigned n_tags = m_n_tags.load (std::memory_order_acquire);
+  for (unsigned ix = 0; ix < n_tags; ix++)
+    {
+      const TagStats& stats = m_tags[ix];
+      add_tag_statistics (&builder, stats.name,
+                          stats.live_bytes.load (RELAXED),
+                          stats.live_allocations.load (RELAXED),
+                          stats.n_allocations.load (RELAXED));
+    }
+
+  const TagStats& other = m_tags[COG_MEMORY_MAX_TAGS - 1];
+  guint64 n_other = other.n_allocations.load (RELAXED);
+  if (n_other > 0)
+    add_tag_statistics (&builder, other.name, other.live_bytes.load (RELAXED),
+                        other.live_allocations.load (RELAXED), n_other);
+
+  return g_variant_builder_end (&builder);
+}
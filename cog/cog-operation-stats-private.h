@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+
+#include <glib.h>
+
+/* Each power of two of latency is split into this many histogram buckets, so
+ * a bucket's width is at most 1/8 of its lower bound */
+#define COG_LATENCY_SUB_BUCKET_BITS 3
+#define COG_LATENCY_SUB_BUCKETS (1 << COG_LATENCY_SUB_BUCKET_BITS)
+/* Enough buckets for latencies below 2^41 µs, about 25 days; longer ones are
+ * counted in the last bucket. Latencies below COG_LATENCY_SUB_BUCKETS µs get a
+ * bucket each, and each power of two above gets COG_LATENCY_SUB_BUCKETS. */
+#define COG_LATENCY_MAX_BITS 40
+#define COG_N_LATENCY_BUCKETS \
+  ((COG_LATENCY_MAX_BITS - COG_LATENCY_SUB_BUCKET_BITS + 2) * \
+   COG_LATENCY_SUB_BUCKETS)
+
+/* Error codes from this one up are counted as CoreErrors::UNKNOWN */
+#define COG_N_ERROR_CODES 256
+
+/* Statistics about the requests that #CogClient sends for one Cognito
+ * operation. Recording a request only updates a few relaxed atomic counters,
+ * so any number of threads can record at once without contending for a lock;
+ * a snapshot reads them without stopping the recording threads, so the
+ * counters in it may be off by the requests in progress at the time. */
+class CogOperationStats {
+public:
+  CogOperationStats ();
+
+  /* Sends a request by calling @send, which must return the AWS SDK outcome
+   * of the request, and records it */
+  template <typename Send>
+  auto record (Send&& send) -> decltype (send ())
+  {
+    begin ();
+    gint64 start = g_get_monotonic_time ();
+    auto outcome = send ();
+    end (g_get_monotonic_time () - start,
+         outcome.IsSuccess () ? -1 : int (outcome.GetError ().GetErrorType ()));
+    return outcome;
+  }
+
+  /* Returns a new floating a{sv} dictionary; see cog_client_get_statistics() */
+  GVariant *snapshot (void) const;
+
+private:
+  void begin (void);
+  void end (gint64 latency,
+            int error_code);
+
+  std::atomic<guint64> m_n_requests;
+  std::atomic<unsigned> m_n_in_flight;
+  std::atomic<guint64> m_n_retries;
+  std::atomic<guint64> m_latency_sum;
+  std::atomic<guint64> m_n_errors[COG_N_ERROR_CODES];
+  std::atomic<guint64> m_latency_buckets[COG_N_LATENCY_BUCKETS];
+};
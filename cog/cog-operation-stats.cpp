@@ -0,0 +1,118 @@
+#include <aws/core/client/CoreErrors.h>
+#include <glib.h>
+
+#include "cog/cog-operation-stats-private.h"
+#include "cog/cog-retry-strategy-private.h"
+
+/* Counters are independent of each other and of any other memory, so relaxed
+ * ordering is enough */
+#define RELAXED std::memory_order_relaxed
+
+/* Index of the bucket counting @latency, in the style of HdrHistogram: the
+ * bucket is picked by the position of the highest set bit and the
+ * COG_LATENCY_SUB_BUCKET_BITS bits below it */
+static unsigned
+latency_bucket (guint64 latency)
+{
+  if (latency < COG_LATENCY_SUB_BUCKETS)
+    return latency;
+
+  unsigned exponent = g_bit_storage (latency) - 1;
+  if (exponent > COG_LATENCY_MAX_BITS)
+    return COG_N_LATENCY_BUCKETS - 1;
+
+  unsigned sub_bucket = (latency >> (exponent - COG_LATENCY_SUB_BUCKET_BITS)) &
+                        (COG_LATENCY_SUB_BUCKETS - 1);
+  return (exponent - COG_LATENCY_SUB_BUCKET_BITS + 1) *
+         COG_LATENCY_SUB_BUCKETS + sub_bucket;
+}
+
+/* Smallest latency counted in bucket @index */
+static guint64
+latency_bucket_lower_bound (unsigned index)
+{
+  if (index < COG_LATENCY_SUB_BUCKETS)
+    return index;
+
+  unsigned exponent = index / COG_LATENCY_SUB_BUCKETS +
+                      COG_LATENCY_SUB_BUCKET_BITS - 1;
+  guint64 sub_bucket = index % COG_LATENCY_SUB_BUCKETS;
+  return (COG_LATENCY_SUB_BUCKETS + sub_bucket) <<
+         (exponent - COG_LATENCY_SUB_BUCKET_BITS);
+}
+
+CogOperationStats::CogOperationStats ()
+  : m_n_requests (0),
+    m_n_in_flight (0),
+    m_n_retries (0),
+    m_latency_sum (0)
+{
+  for (auto& count : m_n_errors)
+    count.store (0, RELAXED);
+  for (auto& count : m_latency_buckets)
+    count.store (0, RELAXED);
+}
+
+void
+CogOperationStats::begin (void)
+{
+  m_n_requests.fetch_add (1, RELAXED);
+  m_n_in_flight.fetch_add (1, RELAXED);
+  /* Forget any retries left over from a request that was not recorded */
+  CogRetryStrategy::take_retries ();
+}
+
+void
+CogOperationStats::end (gint64 latency,
+                        int error_code)
+{
+  m_n_in_flight.fetch_sub (1, RELAXED);
+  m_n_retries.fetch_add (CogRetryStrategy::take_retries (), RELAXED);
+  m_latency_sum.fetch_add (latency, RELAXED);
+  m_latency_buckets[latency_bucket (latency)].fetch_add (1, RELAXED);
+
+  if (error_code < 0)
+    return;
+  if (error_code >= COG_N_ERROR_CODES)
+    error_code = int (Aws::Client::CoreErrors::UNKNOWN);
+  m_n_errors[error_code].fetch_add (1, RELAXED);
+}
+
+GVariant *
+CogOperationStats::snapshot (void) const
+{
+  GVariantBuilder errors;
+  g_variant_builder_init (&errors, G_VARIANT_TYPE ("a{it}"));
+  for (int code = 0; code < COG_N_ERROR_CODES; code++)
+    {
+      guint64 count = m_n_errors[code].load (RELAXED);
+      if (count > 0)
+        g_variant_builder_add (&errors, "{it}", code, count);
+    }
+
+  GVariantBuilder histogram;
+  g_variant_builder_init (&histogram, G_VARIANT_TYPE ("a(tt)"));
+  for (unsigned ix = 0; ix < COG_N_LATENCY_BUCKETS; ix++)
+    {
+      guint64 count = m_latency_buckets[ix].load (RELAXED);
+      if (count > 0)
+        g_variant_builder_add (&histogram, "(tt)",
+                               latency_bucket_lower_bound (ix), count);
+    }
+
+  GVariantBuilder dict;
+  g_variant_builder_init (&dict, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&dict, "{sv}", "requests",
+                         g_variant_new_uint64 (m_n_requests.load (RELAXED)));
+  g_variant_builder_add (&dict, "{sv}", "in-flight",
+                         g_variant_new_uint32 (m_n_in_flight.load (RELAXED)));
+  g_variant_builder_add (&dict, "{sv}", "retries",
+                         g_variant_new_uint64 (m_n_retries.load (RELAXED)));
+  g_variant_builder_add (&dict, "{sv}", "errors",
+                         g_variant_builder_end (&errors));
+  g_variant_builder_add (&dict, "{sv}", "latency-sum",
+                         g_variant_new_uint64 (m_latency_sum.load (RELAXED)));
+  g_variant_builder_add (&dict, "{sv}", "latency-histogram",
+                         g_variant_builder_end (&histogram));
+  return g_variant_builder_end (&dict);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include <aws/core/http/HttpClient.h>
+#include <aws/core/utils/memory/stl/AWSString.h>
+#include <aws/core/utils/threading/Executor.h>
+#include <gio/gio.h>
+
+/* Called once all the connections of a prewarm have been tried, with the
+ * number that were opened, and if none were, the first error, which it takes
+ * ownership of */
+typedef std::function<void (unsigned n_opened, GError *error)> CogPrewarmDone;
+
+/* Opens @n_connections connections to @endpoint at once, with one job each
+ * on @executor, by sending a bare request through @network_client; any
+ * response will do, even an error status, since the HTTP client keeps the
+ * connection in its pool afterwards. A job that @executor refuses fails with
+ * %G_IO_ERROR_BUSY, and one that starts after @cancellable is cancelled fails
+ * with %G_IO_ERROR_CANCELLED. @done is called on the thread of the last job
+ * to finish. */
+void _cog_prewarm (const std::shared_ptr<Aws::Http::HttpClient>& network_client,
+                   const Aws::String& endpoint,
+                   Aws::Utils::Threading::Executor& executor,
+                   unsigned n_connections,
+                   GCancellable *cancellable,
+                   CogPrewarmDone&& done);
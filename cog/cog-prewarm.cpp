@@ -0,0 +1,123 @@
+#include <atomic>
+
+#include <aws/core/http/HttpClientFactory.h>
+#include <aws/core/http/HttpRequest.h>
+#include <aws/core/http/HttpResponse.h>
+#include <aws/core/utils/stream/ResponseStream.h>
+
+#include "cog/cog-prewarm-private.h"
+#include "cog/cog-utils.h"
+#include "cog/cog-utils-private.h"
+
+/* Shared by the jobs opening the connections for one prewarm */
+struct PrewarmState {
+  PrewarmState (GCancellable *cancellable,
+                unsigned n_jobs,
+                CogPrewarmDone&& done)
+    : cancellable (cancellable ?
+                   G_CANCELLABLE (g_object_ref (cancellable)) : NULL),
+      done (std::move (done)),
+      n_pending (n_jobs),
+      n_opened (0),
+      error (NULL)
+  {
+    g_mutex_init (&lock);
+  }
+
+  ~PrewarmState ()
+  {
+    g_clear_object (&cancellable);
+    g_clear_error (&error);
+    g_mutex_clear (&lock);
+  }
+
+  GCancellable *cancellable;
+  CogPrewarmDone done;
+  std::atomic<unsigned> n_pending;
+  std::atomic<unsigned> n_opened;
+  GMutex lock;
+  GError *error;  /* the first one */
+};
+
+static bool
+prewarm_connection (const Aws::Http::HttpClient& network_client,
+                    const Aws::String& endpoint,
+                    GCancellable *cancellable,
+                    GError **error)
+{
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    return false;
+
+  auto request =
+    Aws::Http::CreateHttpRequest (endpoint, Aws::Http::HttpMethod::HTTP_GET,
+                                  Aws::Utils::Stream::DefaultResponseStreamFactoryMethod);
+  auto response = network_client.MakeRequest (request);
+  if (!response || response->HasClientError ())
+    {
+      g_set_error (error, COG_IDENTITY_PROVIDER_ERROR,
+                   COG_IDENTITY_PROVIDER_ERROR_NETWORK_CONNECTION,
+                   "Could not connect to %s: %s", endpoint.c_str (),
+                   response ? response->GetClientErrorMessage ().c_str () :
+                              "no response");
+      return false;
+    }
+  return true;
+}
+
+/* Takes ownership of @error. The last job to finish calls @state's done
+ * function. */
+static void
+prewarm_job_done (PrewarmState *state,
+                  GError *error)
+{
+  if (error)
+    {
+      g_mutex_lock (&state->lock);
+      if (!state->error)
+        state->error = error;
+      else
+        g_error_free (error);
+      g_mutex_unlock (&state->lock);
+    }
+  else
+    {
+      state->n_opened++;
+    }
+
+  if (state->n_pending.fetch_sub (1) != 1)
+    return;
+
+  unsigned n_opened = state->n_opened;
+  if (n_opened > 0)
+    state->done (n_opened, NULL);
+  else
+    state->done (0, g_steal_pointer (&state->error));
+}
+
+void
+_cog_prewarm (const std::shared_ptr<Aws::Http::HttpClient>& network_client,
+              const Aws::String& endpoint,
+              Aws::Utils::Threading::Executor& executor,
+              unsigned n_connections,
+              GCancellable *cancellable,
+              CogPrewarmDone&& done)
+{
+  g_return_if_fail (n_connections > 0);
+
+  auto state = Aws::MakeShared<PrewarmState> (_COG_ALLOCATION_TAG, cancellable,
+                                              n_connections, std::move (done));
+  for (unsigned ix = 0; ix < n_connections; ix++)
+    {
+      bool submitted = executor.Submit ([network_client, endpoint, state]
+        {
+          GError *error = NULL;
+          prewarm_connection (*network_client, endpoint, state->cancellable,
+                              &error);
+          prewarm_job_done (state.get (), error);
+        });
+      if (!submitted)
+        prewarm_job_done (state.get (),
+                          g_error_new_literal (G_IO_ERROR, G_IO_ERROR_BUSY,
+                                               "Too many requests waiting to be sent"));
+    }
+}
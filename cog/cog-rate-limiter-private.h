@@ -0,0 +1,62 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include <gio/gio.h>
+
+/* Token bucket used by #CogClient to stay under a request-rate quota.
+ *
+ * The bucket holds up to @burst tokens and is refilled at @rate tokens per
+ * second; each request takes one. A request that finds the bucket empty
+ * reserves the next token to arrive and waits for it, unless @max_waiting
+ * requests are already waiting, in which case it is refused. All methods are
+ * thread-safe. */
+class CogRateLimiter : public std::enable_shared_from_this<CogRateLimiter> {
+public:
+  CogRateLimiter (double rate,
+                  unsigned burst,
+                  unsigned max_waiting);
+  ~CogRateLimiter ();
+
+  /* Takes a token, or reserves the next one to arrive. Sets @ready_time to
+   * the monotonic time at which the reserved token is due, or to 0 if a token
+   * was taken right away. Fails with %G_IO_ERROR_WOULD_BLOCK if too many
+   * requests are already waiting. A reservation must be waited for with
+   * wait() or wait_async(). */
+  bool reserve (gint64 *ready_time,
+                GError **error);
+
+  /* Blocks the calling thread until @ready_time. Fails with
+   * %G_IO_ERROR_CANCELLED, giving back the reservation, if @cancellable is
+   * cancelled first. */
+  bool wait (gint64 ready_time,
+             GCancellable *cancellable,
+             GError **error);
+
+  /* Calls @fn at @ready_time without blocking a thread in the meantime, or
+   * as soon as @cancellable is cancelled, in which case the reservation is
+   * given back and @fn gets %G_IO_ERROR_CANCELLED, which it takes ownership
+   * of. @fn runs on a thread shared by all rate limiters, so it must not
+   * block. */
+  void wait_async (gint64 ready_time,
+                   GCancellable *cancellable,
+                   std::function<void (GError *error)>&& fn);
+
+  /* reserve() and wait() in one */
+  bool acquire (GCancellable *cancellable,
+                GError **error);
+
+private:
+  void refill (gint64 now);
+  void end_wait (bool cancelled);
+
+  double m_rate;  /* tokens per microsecond */
+  double m_burst;
+  unsigned m_max_waiting;
+
+  GMutex m_lock;
+  double m_tokens;  /* negative when tokens have been reserved */
+  gint64 m_last_refill;
+  unsigned m_n_waiting;
+};
@@ -0,0 +1,211 @@
+#include <gio/gio.h>
+
+#include "cog/cog-rate-limiter-private.h"
+
+/* How often a waiting request checks whether it has been cancelled */
+#define CANCEL_CHECK_INTERVAL_USEC (50 * G_TIME_SPAN_MILLISECOND)
+
+CogRateLimiter::CogRateLimiter (double rate,
+                                unsigned burst,
+                                unsigned max_waiting)
+  : m_rate (rate / G_USEC_PER_SEC),
+    m_burst (MAX (burst, 1)),
+    m_max_waiting (max_waiting),
+    m_tokens (m_burst),
+    m_last_refill (g_get_monotonic_time ()),
+    m_n_waiting (0)
+{
+  g_mutex_init (&m_lock);
+}
+
+CogRateLimiter::~CogRateLimiter ()
+{
+  g_mutex_clear (&m_lock);
+}
+
+void
+CogRateLimiter::refill (gint64 now)
+{
+  m_tokens = MIN (m_tokens + (now - m_last_refill) * m_rate, m_burst);
+  m_last_refill = now;
+}
+
+bool
+CogRateLimiter::reserve (gint64 *ready_time,
+                         GError **error)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  g_mutex_lock (&m_lock);
+  refill (now);
+  if (m_tokens >= 1.0)
+    {
+      m_tokens -= 1.0;
+      g_mutex_unlock (&m_lock);
+      *ready_time = 0;
+      return true;
+    }
+  if (m_n_waiting >= m_max_waiting)
+    {
+      g_mutex_unlock (&m_lock);
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+                           "Request rate limit exceeded");
+      return false;
+    }
+
+  /* Reserve the next token that is not already promised to someone else, so
+   * that waiting requests are let through in order */
+  m_tokens -= 1.0;
+  *ready_time = now + MAX (gint64 (-m_tokens / m_rate), 1);
+  m_n_waiting++;
+  g_mutex_unlock (&m_lock);
+  return true;
+}
+
+void
+CogRateLimiter::end_wait (bool cancelled)
+{
+  g_mutex_lock (&m_lock);
+  m_n_waiting--;
+  if (cancelled)
+    m_tokens += 1.0;  /* give back the reservation */
+  g_mutex_unlock (&m_lock);
+}
+
+bool
+CogRateLimiter::wait (gint64 ready_time,
+                      GCancellable *cancellable,
+                      GError **error)
+{
+  if (ready_time == 0)
+    return true;
+
+  bool cancelled = false;
+  gint64 now;
+  while (!(cancelled = g_cancellable_is_cancelled (cancellable)) &&
+         (now = g_get_monotonic_time ()) < ready_time)
+    g_usleep (MIN (ready_time - now, CANCEL_CHECK_INTERVAL_USEC));
+
+  end_wait (cancelled);
+
+  if (cancelled)
+    {
+      g_cancellable_set_error_if_cancelled (cancellable, error);
+      return false;
+    }
+  return true;
+}
+
+static void *
+timer_thread (void *data)
+{
+  auto *context = static_cast<GMainContext *> (data);
+  g_main_context_push_thread_default (context);
+  while (true)
+    g_main_context_iteration (context, TRUE);
+  return NULL;
+}
+
+/* Returns the context of the thread that ends the waits of all rate limiters
+ * in the process */
+static GMainContext *
+timer_context (void)
+{
+  static GMainContext *context = []
+    {
+      GMainContext *retval = g_main_context_new ();
+      g_thread_unref (g_thread_new ("cog-rate-limit", timer_thread, retval));
+      return retval;
+    } ();
+  return context;
+}
+
+struct AsyncWait
+{
+  std::shared_ptr<CogRateLimiter> limiter;
+  std::function<void (GError *)> fn;
+  GSource *source;  /* (unowned) */
+};
+
+static gboolean
+wait_source_dispatch (GSource *source G_GNUC_UNUSED,
+                      GSourceFunc callback,
+                      void *data)
+{
+  return callback (data);
+}
+
+static GSourceFuncs wait_source_funcs = {
+  NULL,  /* prepare */
+  NULL,  /* check */
+  wait_source_dispatch,
+  NULL,  /* finalize */
+};
+
+static void
+async_wait_free (void *data)
+{
+  delete static_cast<AsyncWait *> (data);
+}
+
+static gboolean
+async_wait_ready (void *data)
+{
+  auto *wait = static_cast<AsyncWait *> (data);
+  wait->limiter->end_wait (false);
+  wait->fn (NULL);
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+async_wait_cancelled (GCancellable *cancellable,
+                      void *data)
+{
+  auto *wait = static_cast<AsyncWait *> (data);
+  GError *error = NULL;
+  g_cancellable_set_error_if_cancelled (cancellable, &error);
+  wait->limiter->end_wait (true);
+  wait->fn (error);
+  /* Frees @wait, through the parent's destroy notify */
+  g_source_destroy (wait->source);
+  return G_SOURCE_REMOVE;
+}
+
+void
+CogRateLimiter::wait_async (gint64 ready_time,
+                            GCancellable *cancellable,
+                            std::function<void (GError *error)>&& fn)
+{
+  if (ready_time == 0)
+    {
+      fn (NULL);
+      return;
+    }
+
+  GSource *source = g_source_new (&wait_source_funcs, sizeof (GSource));
+  auto *wait = new AsyncWait { shared_from_this (), std::move (fn), source };
+  g_source_set_name (source, "CogRateLimiter wait");
+  g_source_set_ready_time (source, ready_time);
+  g_source_set_callback (source, async_wait_ready, wait, async_wait_free);
+
+  if (cancellable)
+    {
+      GSource *cancelled = g_cancellable_source_new (cancellable);
+      g_source_set_callback (cancelled, (GSourceFunc) async_wait_cancelled,
+                             wait, NULL);
+      g_source_add_child_source (source, cancelled);
+      g_source_unref (cancelled);
+    }
+
+  g_source_attach (source, timer_context ());
+  g_source_unref (source);
+}
+
+bool
+CogRateLimiter::acquire (GCancellable *cancellable,
+                         GError **error)
+{
+  gint64 ready_time;
+  return reserve (&ready_time, error) &&
+         wait (ready_time, cancellable, error);
+}
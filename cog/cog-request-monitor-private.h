@@ -0,0 +1,51 @@
+#pragma once
+
+#include <aws/core/AmazonWebServiceRequest.h>
+#include <aws/core/monitoring/MonitoringFactory.h>
+#include <aws/core/utils/memory/stl/AWSMap.h>
+#include <aws/core/utils/memory/stl/AWSString.h>
+#include <glib.h>
+
+#include "cog/cog-client.h"
+
+/* Collects #CogRequestMetrics for one call into the AWS SDK. Create it on the
+ * stack just before the call, and call finish() right after it; all requests
+ * sent on the same thread in between are measured, through the monitoring
+ * hooks that the SDK calls on that thread. When no monitor is active, the
+ * hooks return right away. */
+class CogRequestMonitor {
+public:
+  CogRequestMonitor ();
+  ~CogRequestMonitor ();
+
+  /* Fills in @metrics and stops measuring */
+  void finish (CogRequestMetrics *metrics);
+
+  /* Returns the monitor active on the calling thread, if any */
+  static CogRequestMonitor *current (void);
+
+  void data_sent (long long bytes);
+  void data_received (long long bytes);
+  void attempt_completed (const Aws::Map<Aws::String, int64_t>& http_metrics);
+  void retrying (void);
+
+private:
+  CogRequestMonitor *m_previous;
+  gint64 m_start;
+  unsigned m_attempts;
+  guint64 m_bytes_sent;
+  guint64 m_bytes_received;
+  gint64 m_http_time;
+  /* Of the latest attempt */
+  gint64 m_last_sent;
+  gint64 m_first_received;
+  gint64 m_last_received;
+  Aws::Map<Aws::String, int64_t> m_http_metrics;
+};
+
+/* Makes @request report the data it sends and receives to the monitor active
+ * on the sending thread */
+void _cog_request_monitor_install (Aws::AmazonWebServiceRequest& request);
+
+/* For SDKOptions::monitoringOptions */
+Aws::UniquePtr<Aws::Monitoring::MonitoringFactory> _cog_monitoring_factory_new (void);
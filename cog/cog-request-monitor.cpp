@@ -0,0 +1,220 @@
+#include <aws/core/client/AWSError.h>
+#include <aws/core/client/CoreErrors.h>
+#include <aws/core/http/HttpRequest.h>
+#include <aws/core/http/HttpResponse.h>
+#include <aws/core/monitoring/CoreMetrics.h>
+#include <aws/core/monitoring/HttpClientMetrics.h>
+#include <aws/core/monitoring/MonitoringFactory.h>
+#include <aws/core/monitoring/MonitoringInterface.h>
+#include <glib.h>
+
+#include "cog/cog-request-monitor-private.h"
+#include "cog/cog-utils-private.h"
+
+using Aws::Client::HttpResponseOutcome;
+using Aws::Http::HttpRequest;
+using Aws::Http::HttpResponse;
+using Aws::Monitoring::CoreMetricsCollection;
+using Aws::Monitoring::GetHttpClientMetricNameByType;
+using Aws::Monitoring::HttpClientMetricsType;
+
+static thread_local CogRequestMonitor *current_monitor = nullptr;
+
+CogRequestMonitor::CogRequestMonitor ()
+  : m_previous (current_monitor),
+    m_start (g_get_monotonic_time ()),
+    m_attempts (1),
+    m_bytes_sent (0),
+    m_bytes_received (0),
+    m_http_time (-1),
+    m_last_sent (-1),
+    m_first_received (-1),
+    m_last_received (-1)
+{
+  current_monitor = this;
+}
+
+CogRequestMonitor::~CogRequestMonitor ()
+{
+  if (current_monitor == this)
+    current_monitor = m_previous;
+}
+
+CogRequestMonitor *
+CogRequestMonitor::current (void)
+{
+  return current_monitor;
+}
+
+void
+CogRequestMonitor::data_sent (long long bytes)
+{
+  m_bytes_sent += bytes;
+  m_last_sent = g_get_monotonic_time ();
+}
+
+void
+CogRequestMonitor::data_received (long long bytes)
+{
+  m_bytes_received += bytes;
+  m_last_received = g_get_monotonic_time ();
+  if (m_first_received < 0)
+    m_first_received = m_last_received;
+}
+
+void
+CogRequestMonitor::attempt_completed (const Aws::Map<Aws::String, int64_t>& http_metrics)
+{
+  m_http_metrics = http_metrics;
+
+  auto latency =
+    http_metrics.find (GetHttpClientMetricNameByType (HttpClientMetricsType::RequestLatency));
+  if (latency != http_metrics.end ())
+    m_http_time =
+      MAX (m_http_time, 0) + latency->second * G_TIME_SPAN_MILLISECOND;
+}
+
+void
+CogRequestMonitor::retrying (void)
+{
+  m_attempts++;
+  m_last_sent = m_first_received = m_last_received = -1;
+}
+
+/* Returns the HTTP client metric of @type in microseconds, or -1 if the HTTP
+ * client did not report it */
+static gint64
+http_metric (const Aws::Map<Aws::String, int64_t>& metrics,
+             HttpClientMetricsType type)
+{
+  auto iter = metrics.find (GetHttpClientMetricNameByType (type));
+  if (iter == metrics.end ())
+    return -1;
+  return iter->second * G_TIME_SPAN_MILLISECOND;
+}
+
+static gint64
+difference (gint64 end,
+            gint64 start)
+{
+  if (end < 0 || start < 0)
+    return -1;
+  return MAX (end - start, 0);
+}
+
+void
+CogRequestMonitor::finish (CogRequestMetrics *metrics)
+{
+  metrics->total = g_get_monotonic_time () - m_start;
+  metrics->overhead = difference (metrics->total, m_http_time);
+  metrics->attempts = m_attempts;
+  metrics->bytes_sent = m_bytes_sent;
+  metrics->bytes_received = m_bytes_received;
+
+  /* libcurl reports each of these as the time since the start of the
+   * transfer, rather than the duration of the phase */
+  gint64 dns = http_metric (m_http_metrics, HttpClientMetricsType::DnsLatency);
+  gint64 connected = http_metric (m_http_metrics,
+                                  HttpClientMetricsType::ConnectLatency);
+  gint64 handshaken = http_metric (m_http_metrics,
+                                   HttpClientMetricsType::SslLatency);
+  metrics->acquire_connection =
+    http_metric (m_http_metrics, HttpClientMetricsType::AcquireConnectionLatency);
+  metrics->dns = dns;
+  metrics->connect = difference (connected, dns);
+  metrics->tls = handshaken > 0 ? difference (handshaken, connected) : -1;
+  metrics->connection_reused =
+    http_metric (m_http_metrics, HttpClientMetricsType::ConnectionReused) > 0;
+
+  metrics->time_to_first_byte = difference (m_first_received, m_last_sent);
+  metrics->transfer = difference (m_last_received, m_first_received);
+
+  current_monitor = m_previous;
+}
+
+void
+_cog_request_monitor_install (Aws::AmazonWebServiceRequest& request)
+{
+  request.SetDataSentEventHandler ([] (const HttpRequest *, long long bytes)
+    {
+      if (CogRequestMonitor *monitor = CogRequestMonitor::current ())
+        monitor->data_sent (bytes);
+    });
+  request.SetDataReceivedEventHandler ([] (const HttpRequest *,
+                                           HttpResponse *,
+                                           long long bytes)
+    {
+      if (CogRequestMonitor *monitor = CogRequestMonitor::current ())
+        monitor->data_received (bytes);
+    });
+}
+
+/* The SDK calls these on the thread sending the request, so the context is
+ * just the monitor active on that thread */
+class CogMonitoring : public Aws::Monitoring::MonitoringInterface {
+public:
+  void *
+  OnRequestStarted (const Aws::String&,
+                    const Aws::String&,
+                    const std::shared_ptr<const HttpRequest>&) const override
+  {
+    return CogRequestMonitor::current ();
+  }
+
+  void
+  OnRequestSucceeded (const Aws::String&,
+                      const Aws::String&,
+                      const std::shared_ptr<const HttpRequest>&,
+                      const HttpResponseOutcome&,
+                      const CoreMetricsCollection& metrics,
+                      void *context) const override
+  {
+    if (auto *monitor = static_cast<CogRequestMonitor *> (context))
+      monitor->attempt_completed (metrics.httpClientMetrics);
+  }
+
+  void
+  OnRequestFailed (const Aws::String&,
+                   const Aws::String&,
+                   const std::shared_ptr<const HttpRequest>&,
+                   const HttpResponseOutcome&,
+                   const CoreMetricsCollection& metrics,
+                   void *context) const override
+  {
+    if (auto *monitor = static_cast<CogRequestMonitor *> (context))
+      monitor->attempt_completed (metrics.httpClientMetrics);
+  }
+
+  void
+  OnRequestRetry (const Aws::String&,
+                  const Aws::String&,
+                  const std::shared_ptr<const HttpRequest>&,
+                  void *context) const override
+  {
+    if (auto *monitor = static_cast<CogRequestMonitor *> (context))
+      monitor->retrying ();
+  }
+
+  void
+  OnFinish (const Aws::String&,
+            const Aws::String&,
+            const std::shared_ptr<const HttpRequest>&,
+            void *) const override
+  {
+  }
+};
+
+class CogMonitoringFactory : public Aws::Monitoring::MonitoringFactory {
+public:
+  Aws::UniquePtr<Aws::Monitoring::MonitoringInterface>
+  CreateMonitoringInstance () const override
+  {
+    return Aws::MakeUnique<CogMonitoring> (_COG_ALLOCATION_TAG);
+  }
+};
+
+Aws::UniquePtr<Aws::Monitoring::MonitoringFactory>
+_cog_monitoring_factory_new (void)
+{
+  return Aws::MakeUnique<CogMonitoringFactory> (_COG_ALLOCATION_TAG);
+}
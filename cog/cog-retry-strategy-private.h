@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+
+#include <aws/core/client/AWSError.h>
+#include <aws/core/client/CoreErrors.h>
+#include <aws/core/client/RetryStrategy.h>
+#include <glib.h>
+
+/* Retry policy of #CogClient, installed in the AWS SDK client.
+ *
+ * A failed request is tried at most @max_attempts times in total. Between
+ * attempts it waits a random time between zero and an exponentially growing
+ * cap (so-called full jitter), so that many clients throttled at the same
+ * moment do not retry in lockstep.
+ *
+ * All requests made through the client share a retry budget: each request
+ * adds @budget_ratio of a token, up to a small maximum, and each retry takes
+ * away a whole token. With a budget ratio of 0.1, retries can make up at most
+ * about a tenth of the traffic once the initial tokens are used, so retries
+ * cannot multiply the load on an overloaded service. All methods are
+ * thread-safe. */
+class CogRetryStrategy : public Aws::Client::RetryStrategy {
+public:
+  CogRetryStrategy (unsigned max_attempts,
+                    unsigned base_delay_ms,
+                    unsigned max_delay_ms,
+                    double budget_ratio);
+  ~CogRetryStrategy ();
+
+  bool ShouldRetry (const Aws::Client::AWSError<Aws::Client::CoreErrors>& error,
+                    long attempted_retries) const override;
+
+  long CalculateDelayBeforeNextRetry (const Aws::Client::AWSError<Aws::Client::CoreErrors>& error,
+                                      long attempted_retries) const override;
+
+  /* Call once for each request made, to add to the retry budget */
+  void record_request (void);
+
+  guint64 n_retries (void) const { return m_n_retries; }
+  guint64 n_retries_over_budget (void) const { return m_n_retries_over_budget; }
+
+  /* Returns the number of attempts made by the last request that failed on
+   * the calling thread, and forgets it; 0 if not known. Call this once after
+   * each failed request. */
+  static unsigned take_attempts (void);
+
+  /* Forgets the attempts of any earlier request on the calling thread. Call
+   * this before sending each request, so that an error which does not get as
+   * far as ShouldRetry() is not reported with another request's count. */
+  static void reset_attempts (void);
+
+  /* Returns the number of retries made on the calling thread since the last
+   * call, whether the requests in question failed or not */
+  static unsigned take_retries (void);
+
+private:
+  bool withdraw (void) const;
+
+  unsigned m_max_attempts;
+  unsigned m_base_delay_ms;
+  unsigned m_max_delay_ms;
+  double m_budget_ratio;
+
+  mutable GMutex m_lock;
+  mutable double m_balance;
+
+  mutable std::atomic<guint64> m_n_retries;
+  mutable std::atomic<guint64> m_n_retries_over_budget;
+};
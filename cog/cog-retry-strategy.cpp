@@ -0,0 +1,132 @@
+#include <math.h>
+
+#include <aws/cognito-idp/CognitoIdentityProviderErrors.h>
+#include <aws/core/client/AWSError.h>
+#include <aws/core/client/CoreErrors.h>
+#include <glib.h>
+
+#include "cog/cog-retry-strategy-private.h"
+
+using Aws::Client::AWSError;
+using Aws::Client::CoreErrors;
+using Aws::CognitoIdentityProvider::CognitoIdentityProviderErrors;
+
+/* The retry budget starts full, and never holds more than this many tokens,
+ * so that a burst of errors after a quiet period can only cause a few retries
+ * before the ratio takes over */
+#define MAX_BUDGET_BALANCE 10.0
+
+/* The retry attempts of the last failed request on each thread. The SDK makes
+ * all attempts of a request, and calls ShouldRetry() after each failed one, on
+ * the thread that sent the request. */
+static thread_local unsigned last_attempts = 0;
+/* Retries made by each thread since take_retries() was last called */
+static thread_local unsigned n_thread_retries = 0;
+
+CogRetryStrategy::CogRetryStrategy (unsigned max_attempts,
+                                    unsigned base_delay_ms,
+                                    unsigned max_delay_ms,
+                                    double budget_ratio)
+  : m_max_attempts (max_attempts),
+    m_base_delay_ms (base_delay_ms),
+    m_max_delay_ms (max_delay_ms),
+    m_budget_ratio (budget_ratio),
+    m_balance (MAX_BUDGET_BALANCE),
+    m_n_retries (0),
+    m_n_retries_over_budget (0)
+{
+  g_mutex_init (&m_lock);
+}
+
+CogRetryStrategy::~CogRetryStrategy ()
+{
+  g_mutex_clear (&m_lock);
+}
+
+static bool
+error_is_retryable (const AWSError<CoreErrors>& error)
+{
+  /* Cognito reports these as not retryable, but they are exactly the errors
+   * that call for backing off and trying again */
+  switch (static_cast<CognitoIdentityProviderErrors> (error.GetErrorType ()))
+    {
+    case CognitoIdentityProviderErrors::THROTTLING:
+    case CognitoIdentityProviderErrors::TOO_MANY_REQUESTS:
+    case CognitoIdentityProviderErrors::SERVICE_UNAVAILABLE:
+      return true;
+    default:
+      return error.ShouldRetry ();
+    }
+}
+
+bool
+CogRetryStrategy::ShouldRetry (const AWSError<CoreErrors>& error,
+                               long attempted_retries) const
+{
+  last_attempts = attempted_retries + 1;
+
+  if (last_attempts >= m_max_attempts || !error_is_retryable (error))
+    return false;
+
+  if (!withdraw ())
+    {
+      m_n_retries_over_budget++;
+      return false;
+    }
+
+  m_n_retries++;
+  n_thread_retries++;
+  return true;
+}
+
+long
+CogRetryStrategy::CalculateDelayBeforeNextRetry (const AWSError<CoreErrors>& error G_GNUC_UNUSED,
+                                                 long attempted_retries) const
+{
+  /* Full jitter: anywhere between zero and the exponential backoff cap */
+  double cap = m_base_delay_ms * exp2 (attempted_retries);
+  if (cap > m_max_delay_ms)
+    cap = m_max_delay_ms;
+  return long (g_random_double () * cap);
+}
+
+void
+CogRetryStrategy::record_request (void)
+{
+  g_mutex_lock (&m_lock);
+  m_balance = MIN (m_balance + m_budget_ratio, MAX_BUDGET_BALANCE);
+  g_mutex_unlock (&m_lock);
+}
+
+bool
+CogRetryStrategy::withdraw (void) const
+{
+  g_mutex_lock (&m_lock);
+  bool retval = m_balance >= 1.0;
+  if (retval)
+    m_balance -= 1.0;
+  g_mutex_unlock (&m_lock);
+  return retval;
+}
+
+unsigned
+CogRetryStrategy::take_attempts (void)
+{
+  unsigned retval = last_attempts;
+  last_attempts = 0;
+  return retval;
+}
+
+void
+CogRetryStrategy::reset_attempts (void)
+{
+  last_attempts = 0;
+}
+
+unsigned
+CogRetryStrategy::take_retries (void)
+{
+  unsigned retval = n_thread_retries;
+  n_thread_retries = 0;
+  return retval;
+}
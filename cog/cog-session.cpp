@@ -0,0 +1,609 @@
+/**
+ * SECTION:session
+ * @title: CogSession
+ * @short_description: Keep a user's tokens fresh
+ *
+ * A #CogSession holds the tokens obtained when a user logs in, and refreshes
+ * them with %COG_AUTH_FLOW_REFRESH_TOKEN_AUTH when they are about to expire.
+ *
+ * Once the tokens are within #CogSession:refresh-margin of expiring, the next
+ * request for a token starts a refresh in the background and still returns the
+ * current token right away.
+ * Only if the tokens have actually expired does the request wait for the
+ * refresh to complete.
+ *
+ * At most one refresh is in progress at any time: all requests for a token
+ * that arrive during a refresh, from any thread, wait for that same refresh to
+ * complete and share its result.
+ */
+
+#include <memory>
+
+#include <gio/gio.h>
+
+#include "cog/cog-authentication-result.h"
+#include "cog/cog-client.h"
+#include "cog/cog-session.h"
+#include "cog/cog-utils-private.h"
+
+#define GET_PRIVATE(o) (static_cast<CogSessionPrivate *> (cog_session_get_instance_private (COG_SESSION (o))))
+
+#define DEFAULT_REFRESH_MARGIN_S 60
+/* Minimum time between refreshes started ahead of expiry, if one fails */
+#define REFRESH_RETRY_INTERVAL_US (10 * G_USEC_PER_SEC)
+
+typedef enum {
+  TOKEN_ACCESS,
+  TOKEN_ID,
+} TokenKind;
+
+/* A refresh in progress, shared between everyone waiting for it */
+struct RefreshFlight
+{
+  bool done = false;
+  GError *error = NULL;
+  /* GTasks from cog_session_get_access_token_async() */
+  GPtrArray *tasks = g_ptr_array_new ();
+
+  ~RefreshFlight ()
+  {
+    g_clear_error (&error);
+    g_ptr_array_unref (tasks);
+  }
+};
+
+typedef struct
+{
+  CogClient *client;
+  char *client_id;
+  CogAuthenticationResult *initial_result;
+  unsigned refresh_margin;
+
+  GMutex lock;
+  GCond refreshed;
+  char *access_token;
+  char *id_token;
+  char *refresh_token;
+  gint64 expiry_time;  /* monotonic */
+  gint64 next_early_refresh_time;  /* monotonic */
+  std::shared_ptr<RefreshFlight> flight;
+  unsigned refresh_count;
+} CogSessionPrivate;
+
+struct _CogSession {
+  GObject parent_instance;
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE (CogSession, cog_session, G_TYPE_OBJECT)
+
+enum {
+  PROP_CLIENT = 1,
+  PROP_CLIENT_ID,
+  PROP_AUTH_RESULT,
+  PROP_REFRESH_MARGIN,
+  N_PROPERTIES
+};
+
+static void
+cog_session_set_property (GObject *object,
+                          unsigned property_id,
+                          const GValue *value,
+                          GParamSpec *pspec)
+{
+  CogSession *self = COG_SESSION (object);
+  CogSessionPrivate *priv = GET_PRIVATE (self);
+
+  switch (property_id) {
+    case PROP_CLIENT:
+      priv->client = COG_CLIENT (g_value_dup_object (value));
+      break;
+    case PROP_CLIENT_ID:
+      priv->client_id = g_value_dup_string (value);
+      break;
+    case PROP_AUTH_RESULT:
+      priv->initial_result =
+        static_cast<CogAuthenticationResult *> (g_value_dup_boxed (value));
+      break;
+    case PROP_REFRESH_MARGIN:
+      priv->refresh_margin = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+cog_session_get_property (GObject *object,
+                          unsigned property_id,
+                          GValue *value,
+                          GParamSpec *pspec)
+{
+  CogSession *self = COG_SESSION (object);
+  CogSessionPrivate *priv = GET_PRIVATE (self);
+
+  switch (property_id) {
+    case PROP_CLIENT:
+      g_value_set_object (value, priv->client);
+      break;
+    case PROP_CLIENT_ID:
+      g_value_set_string (value, priv->client_id);
+      break;
+    case PROP_AUTH_RESULT:
+      g_value_set_boxed (value, priv->initial_result);
+      break;
+    case PROP_REFRESH_MARGIN:
+      g_value_set_uint (value, priv->refresh_margin);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+/**
+ * cog_session_new:
+ * @client: the #CogClient with which to refresh the tokens
+ * @client_id: the app client ID that the tokens were issued to
+ * @auth_result: the result of logging in, which must include a refresh token
+ *
+ * Create a new session holding the tokens in @auth_result.
+ * The tokens are considered to expire #CogAuthenticationResult:expires-in
+ * seconds from now.
+ *
+ * Returns: (transfer full): a newly created #CogSession
+ */
+CogSession *
+cog_session_new (CogClient *client,
+                 const char *client_id,
+                 CogAuthenticationResult *auth_result)
+{
+  g_return_val_if_fail (COG_IS_CLIENT (client), NULL);
+  g_return_val_if_fail (client_id, NULL);
+  g_return_val_if_fail (auth_result, NULL);
+  g_return_val_if_fail (auth_result->refresh_token, NULL);
+
+  return COG_SESSION (g_object_new (COG_TYPE_SESSION,
+                                    "client", client,
+                                    "client-id", client_id,
+                                    "auth-result", auth_result,
+                                    NULL));
+}
+
+/* Must be called with the lock held */
+static void
+session_store_tokens (CogSession *self,
+                      CogAuthenticationResult *result)
+{
+  CogSessionPrivate *priv = GET_PRIVATE (self);
+
+  g_free (priv->access_token);
+  priv->access_token = g_strdup (result->access_token);
+  g_free (priv->id_token);
+  priv->id_token = g_strdup (result->id_token);
+
+  /* Cognito does not issue a new refresh token when refreshing */
+  if (result->refresh_token)
+    {
+      g_free (priv->refresh_token);
+      priv->refresh_token = g_strdup (result->refresh_token);
+    }
+
+  priv->expiry_time = g_get_monotonic_time () +
+    gint64 (result->expires_in) * G_USEC_PER_SEC;
+}
+
+static void
+cog_session_constructed (GObject *object)
+{
+  CogSession *self = COG_SESSION (object);
+  CogSessionPrivate *priv = GET_PRIVATE (self);
+  G_OBJECT_CLASS (cog_session_parent_class)->constructed (object);
+
+  g_return_if_fail (priv->client && priv->client_id && priv->initial_result);
+
+  session_store_tokens (self, priv->initial_result);
+}
+
+static void
+cog_session_finalize (GObject *object)
+{
+  CogSessionPrivate *priv = GET_PRIVATE (object);
+
+  g_clear_object (&priv->client);
+  g_clear_pointer (&priv->client_id, g_free);
+  g_clear_pointer (&priv->initial_result, cog_authentication_result_unref);
+  g_clear_pointer (&priv->access_token, g_free);
+  g_clear_pointer (&priv->id_token, g_free);
+  g_clear_pointer (&priv->refresh_token, g_free);
+  g_mutex_clear (&priv->lock);
+  g_cond_clear (&priv->refreshed);
+  priv->flight.~shared_ptr ();
+
+  G_OBJECT_CLASS (cog_session_parent_class)->finalize (object);
+}
+
+static void
+cog_session_class_init (CogSessionClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->constructed = cog_session_constructed;
+  object_class->finalize = cog_session_finalize;
+
+  object_class->set_property = cog_session_set_property;
+  object_class->get_property = cog_session_get_property;
+
+  g_object_class_install_property (object_class,
+                                   PROP_CLIENT,
+                                   g_param_spec_object ("client",
+                                                        "Client",
+                                                        "Client with which to refresh the tokens",
+                                                        COG_TYPE_CLIENT,
+                                                        (GParamFlags)
+                                                        (G_PARAM_CONSTRUCT_ONLY |
+                                                         G_PARAM_READWRITE)));
+
+  g_object_class_install_property (object_class,
+                                   PROP_CLIENT_ID,
+                                   g_param_spec_string ("client-id",
+                                                        "Client ID",
+                                                        "App client ID the tokens were issued to",
+                                                        NULL,
+                                                        (GParamFlags)
+                                                        (G_PARAM_CONSTRUCT_ONLY |
+                                                         G_PARAM_READWRITE)));
+
+  /**
+   * CogSession:auth-result:
+   *
+   * The result of logging in, with which the session was created.
+   * This is not updated when the tokens are refreshed.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_AUTH_RESULT,
+                                   g_param_spec_boxed ("auth-result",
+                                                       "Authentication result",
+                                                       "Initial tokens",
+                                                       COG_TYPE_AUTHENTICATION_RESULT,
+                                                       (GParamFlags)
+                                                       (G_PARAM_CONSTRUCT_ONLY |
+                                                        G_PARAM_READWRITE)));
+
+  /**
+   * CogSession:refresh-margin:
+   *
+   * Time in seconds before the tokens expire at which to start refreshing
+   * them.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_REFRESH_MARGIN,
+                                   g_param_spec_uint ("refresh-margin",
+                                                      "Refresh margin",
+                                                      "Time in seconds before expiry to refresh the tokens",
+                                                      0, G_MAXINT,
+                                                      DEFAULT_REFRESH_MARGIN_S,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_READWRITE)));
+}
+
+static void
+cog_session_init (CogSession *self)
+{
+  CogSessionPrivate *priv = GET_PRIVATE (self);
+
+  g_mutex_init (&priv->lock);
+  g_cond_init (&priv->refreshed);
+  new (&priv->flight) std::shared_ptr<RefreshFlight> ();
+}
+
+/* PRIVATE */
+
+/* Performs the refresh for @flight, which the caller must have installed as
+ * the current flight, and hands the outcome to everyone waiting for it. Blocks,
+ * and must be called without the lock held. */
+static void
+session_run_refresh (CogSession *self,
+                     const std::shared_ptr<RefreshFlight>& flight)
+{
+  CogSessionPrivate *priv = GET_PRIVATE (self);
+
+  g_mutex_lock (&priv->lock);
+  g_autoptr(GHashTable) auth_parameters =
+    g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+  g_hash_table_insert (auth_parameters, (void *) COG_PARAMETER_REFRESH_TOKEN,
+                       g_strdup (priv->refresh_token));
+  /* Only needed for the client to compute the secret hash, if it has a client
+   * secret; the refresh flow takes the user's sub for that */
+  char *sub = priv->id_token ? _cog_token_get_subject (priv->id_token) : NULL;
+  if (!sub)
+    sub = _cog_token_get_subject (priv->access_token);
+  if (sub)
+    g_hash_table_insert (auth_parameters, (void *) COG_PARAMETER_USERNAME, sub);
+  g_mutex_unlock (&priv->lock);
+
+  /* Don't let any one caller's cancellable cancel the refresh for everyone */
+  g_autoptr(CogAuthenticationResult) result = NULL;
+  CogChallengeName challenge_name;
+  g_autoptr(GHashTable) challenge_parameters = NULL;
+  g_autofree char *session = NULL;
+  GError *error = NULL;
+  if (cog_client_initiate_auth (priv->client,
+                                COG_AUTH_FLOW_REFRESH_TOKEN_AUTH,
+                                auth_parameters, priv->client_id, NULL, NULL,
+                                NULL, NULL, &result, &challenge_name,
+                                &challenge_parameters, &session, &error) &&
+      !result)
+    {
+      g_set_error (&error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "Refreshing tokens unexpectedly returned challenge %d",
+                   int (challenge_name));
+    }
+
+  g_mutex_lock (&priv->lock);
+
+  gint64 now = g_get_monotonic_time ();
+  if (error)
+    {
+      flight->error = error;
+      priv->next_early_refresh_time = now + REFRESH_RETRY_INTERVAL_US;
+    }
+  else
+    {
+      session_store_tokens (self, result);
+      priv->refresh_count++;
+    }
+  g_autofree char *access_token = g_strdup (priv->access_token);
+
+  flight->done = true;
+  priv->flight.reset ();
+  g_cond_broadcast (&priv->refreshed);
+
+  g_mutex_unlock (&priv->lock);
+
+  for (unsigned ix = 0; ix < flight->tasks->len; ix++)
+    {
+      GTask *task = G_TASK (g_ptr_array_index (flight->tasks, ix));
+      if (flight->error)
+        g_task_return_error (task, g_error_copy (flight->error));
+      else
+        g_task_return_pointer (task, g_strdup (access_token), g_free);
+      g_object_unref (task);
+    }
+}
+
+struct BackgroundRefresh
+{
+  CogSession *session;
+  std::shared_ptr<RefreshFlight> flight;
+};
+
+static void *
+refresh_thread (void *data)
+{
+  auto *refresh = static_cast<BackgroundRefresh *> (data);
+  session_run_refresh (refresh->session, refresh->flight);
+  g_object_unref (refresh->session);
+  delete refresh;
+  return NULL;
+}
+
+/* Must be called with the lock held. Starts a refresh in a new thread and
+ * returns it. A plain thread is used rather than g_task_run_in_thread(), so as
+ * not to depend on the calling thread running a main loop. */
+static std::shared_ptr<RefreshFlight>
+session_start_background_refresh (CogSession *self)
+{
+  CogSessionPrivate *priv = GET_PRIVATE (self);
+
+  priv->flight = std::make_shared<RefreshFlight> ();
+
+  auto *refresh = new BackgroundRefresh { COG_SESSION (g_object_ref (self)),
+                                          priv->flight };
+  g_thread_unref (g_thread_new ("cog-session-refresh", refresh_thread,
+                                refresh));
+
+  return priv->flight;
+}
+
+/* Must be called with the lock held. Returns TRUE if the tokens are not
+ * expired, and starts refreshing them in the background if they are about
+ * to. */
+static gboolean
+session_check_tokens (CogSession *self)
+{
+  CogSessionPrivate *priv = GET_PRIVATE (self);
+  gint64 now = g_get_monotonic_time ();
+
+  if (now >= priv->expiry_time)
+    return FALSE;
+
+  if (now >= priv->expiry_time - gint64 (priv->refresh_margin) * G_USEC_PER_SEC &&
+      !priv->flight && now >= priv->next_early_refresh_time)
+    session_start_background_refresh (self);
+
+  return TRUE;
+}
+
+static char *
+session_get_token (CogSession *self,
+                   TokenKind kind,
+                   GCancellable *cancellable,
+                   GError **error)
+{
+  CogSessionPrivate *priv = GET_PRIVATE (self);
+
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    return NULL;
+
+  g_mutex_lock (&priv->lock);
+
+  while (!session_check_tokens (self))
+    {
+      std::shared_ptr<RefreshFlight> flight = priv->flight;
+      if (!flight)
+        {
+          /* Nobody is refreshing yet; do it on this thread */
+          flight = priv->flight = std::make_shared<RefreshFlight> ();
+          g_mutex_unlock (&priv->lock);
+          session_run_refresh (self, flight);
+          g_mutex_lock (&priv->lock);
+        }
+      else
+        {
+          while (!flight->done)
+            g_cond_wait (&priv->refreshed, &priv->lock);
+        }
+
+      if (flight->error)
+        {
+          g_mutex_unlock (&priv->lock);
+          g_propagate_error (error, g_error_copy (flight->error));
+          return NULL;
+        }
+    }
+
+  char *retval = g_strdup (kind == TOKEN_ID ? priv->id_token :
+                           priv->access_token);
+  g_mutex_unlock (&priv->lock);
+
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    g_clear_pointer (&retval, g_free);
+  return retval;
+}
+
+/* METHODS */
+
+/**
+ * cog_session_get_access_token:
+ * @self: the #CogSession
+ * @cancellable: (nullable): optional #GCancellable object
+ * @error: error location
+ *
+ * Returns the session's access token, first refreshing it if it has expired.
+ * If the token needs refreshing and another caller is already doing so, waits
+ * for that refresh instead of starting a new one.
+ *
+ * Returns: (transfer full): a valid access token, or %NULL on error
+ */
+char *
+cog_session_get_access_token (CogSession *self,
+                              GCancellable *cancellable,
+                              GError **error)
+{
+  g_return_val_if_fail (COG_IS_SESSION (self), NULL);
+  g_return_val_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable), NULL);
+  g_return_val_if_fail (!error || !*error, NULL);
+
+  return session_get_token (self, TOKEN_ACCESS, cancellable, error);
+}
+
+/**
+ * cog_session_get_access_token_async:
+ * @self: the #CogSession
+ * @cancellable: (nullable): optional #GCancellable object
+ * @callback: (nullable): a callback to call when the operation is complete
+ * @user_data: (nullable): the data to pass to @callback
+ *
+ * See cog_session_get_access_token() for documentation.
+ * This version does not block while the token is being refreshed, and calls
+ * @callback when finished.
+ * In your @callback, you must call cog_session_get_access_token_finish() to
+ * get the token.
+ */
+void
+cog_session_get_access_token_async (CogSession *self,
+                                    GCancellable *cancellable,
+                                    GAsyncReadyCallback callback,
+                                    gpointer user_data)
+{
+  g_return_if_fail (COG_IS_SESSION (self));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  CogSessionPrivate *priv = GET_PRIVATE (self);
+  GTask *task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, (void *) cog_session_get_access_token_async);
+
+  g_mutex_lock (&priv->lock);
+
+  if (session_check_tokens (self))
+    {
+      char *access_token = g_strdup (priv->access_token);
+      g_mutex_unlock (&priv->lock);
+      g_task_return_pointer (task, access_token, g_free);
+      g_object_unref (task);
+      return;
+    }
+
+  std::shared_ptr<RefreshFlight> flight = priv->flight;
+  if (!flight)
+    flight = session_start_background_refresh (self);
+  /* The task's reference is released when the flight completes */
+  g_ptr_array_add (flight->tasks, task);
+
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * cog_session_get_access_token_finish:
+ * @self: the #CogSession
+ * @res: the #GAsyncResult passed to your callback
+ * @error: error location
+ *
+ * See cog_session_get_access_token_async().
+ *
+ * Returns: (transfer full): a valid access token, or %NULL on error
+ */
+char *
+cog_session_get_access_token_finish (CogSession *self,
+                                     GAsyncResult *res,
+                                     GError **error)
+{
+  g_return_val_if_fail (COG_IS_SESSION (self), NULL);
+  g_return_val_if_fail (g_task_is_valid (res, self), NULL);
+  g_return_val_if_fail (!error || !*error, NULL);
+
+  return static_cast<char *> (g_task_propagate_pointer (G_TASK (res), error));
+}
+
+/**
+ * cog_session_get_id_token:
+ * @self: the #CogSession
+ * @cancellable: (nullable): optional #GCancellable object
+ * @error: error location
+ *
+ * Like cog_session_get_access_token(), but returns the session's ID token.
+ *
+ * Returns: (transfer full) (nullable): a valid ID token, or %NULL on error or
+ *   if the session has no ID token
+ */
+char *
+cog_session_get_id_token (CogSession *self,
+                          GCancellable *cancellable,
+                          GError **error)
+{
+  g_return_val_if_fail (COG_IS_SESSION (self), NULL);
+  g_return_val_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable), NULL);
+  g_return_val_if_fail (!error || !*error, NULL);
+
+  return session_get_token (self, TOKEN_ID, cancellable, error);
+}
+
+/**
+ * cog_session_get_refresh_count:
+ * @self: the #CogSession
+ *
+ * Returns: the number of times the tokens have been refreshed successfully
+ */
+unsigned
+cog_session_get_refresh_count (CogSession *self)
+{
+  g_return_val_if_fail (COG_IS_SESSION (self), 0);
+
+  CogSessionPrivate *priv = GET_PRIVATE (self);
+  g_mutex_lock (&priv->lock);
+  unsigned retval = priv->refresh_count;
+  g_mutex_unlock (&priv->lock);
+  return retval;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#if !(defined(_COG_INSIDE_COG_H) || defined(COMPILING_LIBCOG))
+#error "Please do not include this header file directly."
+#endif
+
+#include <glib-object.h>
+#include <gio/gio.h>
+
+#include "cog/cog-authentication-result.h"
+#include "cog/cog-client.h"
+#include "cog/cog-macros.h"
+
+G_BEGIN_DECLS
+
+#define COG_TYPE_SESSION (cog_session_get_type())
+
+COG_AVAILABLE_IN_ALL
+G_DECLARE_FINAL_TYPE (CogSession, cog_session, COG, SESSION, GObject)
+
+struct _CogSessionClass
+{
+  GObjectClass parent_class;
+};
+
+COG_AVAILABLE_IN_ALL
+CogSession *cog_session_new (CogClient *client,
+                             const char *client_id,
+                             CogAuthenticationResult *auth_result);
+
+COG_AVAILABLE_IN_ALL
+char *cog_session_get_access_token (CogSession *self,
+                                    GCancellable *cancellable,
+                                    GError **error);
+
+COG_AVAILABLE_IN_ALL
+void cog_session_get_access_token_async (CogSession *self,
+                                         GCancellable *cancellable,
+                                         GAsyncReadyCallback callback,
+                                         gpointer user_data);
+
+COG_AVAILABLE_IN_ALL
+char *cog_session_get_access_token_finish (CogSession *self,
+                                           GAsyncResult *res,
+                                           GError **error);
+
+COG_AVAILABLE_IN_ALL
+char *cog_session_get_id_token (CogSession *self,
+                                GCancellable *cancellable,
+                                GError **error);
+
+COG_AVAILABLE_IN_ALL
+unsigned cog_session_get_refresh_count (CogSession *self);
+
+G_END_DECLS
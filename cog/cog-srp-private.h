@@ -0,0 +1,17 @@
+#pragma once
+
+#include <glib.h>
+
+#include "cog/cog-srp.h"
+
+G_BEGIN_DECLS
+
+/* Like cog_srp_client_start_session(), but with the secret exponent given as
+ * @a_hex instead of picked at random, and with @now as the time of the
+ * responses instead of the current time, so that a session's results can be
+ * compared with known answers. Only for tests. */
+CogSrpSession *_cog_srp_client_start_fixed_session (CogSrpClient *self,
+                                                    const char *a_hex,
+                                                    GDateTime *now);
+
+G_END_DECLS
@@ -0,0 +1,924 @@
+/**
+ * SECTION:srp
+ * @title: CogSrpClient
+ * @short_description: Compute the client side of Cognito's SRP authentication
+ *
+ * With %COG_AUTH_FLOW_USER_SRP_AUTH, the password never leaves the device.
+ * Instead, the client proves that it knows the password through the Secure
+ * Remote Password protocol, which Cognito runs in the 3072-bit group of RFC
+ * 5054 with generator 2.
+ *
+ * For each login, start a #CogSrpSession with cog_srp_client_start_session()
+ * and pass cog_srp_session_get_srp_a() as %COG_PARAMETER_SRP_A to
+ * cog_client_initiate_auth().
+ * When Cognito answers with %COG_CHALLENGE_NAME_PASSWORD_VERIFIER,
+ * cog_srp_session_respond_to_password_verifier() turns the challenge
+ * parameters and the password into the challenge responses.
+ * Remembered devices prove themselves the same way, with a session of their
+ * own and cog_srp_session_respond_to_device_password_verifier().
+ * cog_client_log_in_async() does all of this for you.
+ *
+ * Most of the work in a session goes into two modular exponentiations.
+ * The first, which gives the session's public value *A*, does not depend on
+ * the password, so a #CogSrpClient keeps #CogSrpClient:n-precomputed sessions
+ * ready, computed on worker threads before they are needed.
+ * Powers of the generator are computed with a table of its powers built once
+ * per process, which takes one multiplication for every four bits of the
+ * exponent, instead of a squaring for every bit and some multiplications.
+ * The table takes about 1.5 MB.
+ *
+ * A #CogSrpClient may be used from several threads at once.
+ * Each #CogSrpSession must only be used for one login.
+ */
+
+#define OPENSSL_API_COMPAT 0x10100000L
+
+#include <string.h>
+
+#include <gio/gio.h>
+#include <openssl/bn.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/sha.h>
+
+#include "cog/cog-client.h"
+#include "cog/cog-srp.h"
+#include "cog/cog-srp-private.h"
+
+#define GET_PRIVATE(o) (static_cast<CogSrpClientPrivate *> (cog_srp_client_get_instance_private (COG_SRP_CLIENT (o))))
+
+#define DEFAULT_N_PRECOMPUTED 2
+
+/* Size of the group's elements */
+#define GROUP_BYTES 384
+/* Size of a session's secret exponent, as in Amazon's own SDKs */
+#define EXPONENT_BYTES 128
+/* The fixed-base table has a row for every WINDOW_BITS bits of an exponent,
+ * with an entry for each of their values */
+#define WINDOW_BITS 4
+#define WINDOW_SIZE (1 << WINDOW_BITS)
+#define WINDOWS_PER_BYTE (8 / WINDOW_BITS)
+#define N_WINDOWS (EXPONENT_BYTES * WINDOWS_PER_BYTE)
+
+#define DERIVED_KEY_INFO "Caldera Derived Key\x01"
+#define DERIVED_KEY_BYTES 16
+
+G_STATIC_ASSERT (8 % WINDOW_BITS == 0);
+
+struct SrpGroup
+{
+  BIGNUM *n;
+  BIGNUM *g;
+  BIGNUM *k;
+  BN_MONT_CTX *mont;
+  /* Entry [window][digit] is g^(digit << (window * WINDOW_BITS)), in
+   * Montgomery form, as GROUP_BYTES big-endian bytes */
+  unsigned char *table;
+};
+
+static SrpGroup srp_group;
+
+/* Writes @bn to @buf the way Cognito hashes numbers: big-endian, with a
+ * leading zero byte if the top bit is set, so that it reads as positive. @buf
+ * must have room for GROUP_BYTES + 1 bytes, and @bn must fit in GROUP_BYTES.
+ * Returns the number of bytes written. */
+static size_t
+padded_bytes (const BIGNUM *bn,
+              unsigned char *buf)
+{
+  size_t length = BN_num_bytes (bn);
+  buf[0] = 0;
+  BN_bn2bin (bn, buf + 1);
+  if (length > 0 && !(buf[1] & 0x80))
+    {
+      memmove (buf, buf + 1, length);
+      return length;
+    }
+  return length + 1;
+}
+
+static void
+digest_padded (EVP_MD_CTX *md,
+               const BIGNUM *bn)
+{
+  unsigned char buf[GROUP_BYTES + 1];
+  EVP_DigestUpdate (md, buf, padded_bytes (bn, buf));
+}
+
+static void
+digest_to_bn (EVP_MD_CTX *md,
+              BIGNUM *result)
+{
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  EVP_DigestFinal_ex (md, digest, NULL);
+  BN_bin2bn (digest, sizeof digest, result);
+}
+
+/* Sets @result to the hash of @first and @second, as used for k and u */
+static void
+hash_pair (const BIGNUM *first,
+           const BIGNUM *second,
+           BIGNUM *result)
+{
+  EVP_MD_CTX *md = EVP_MD_CTX_new ();
+  EVP_DigestInit_ex (md, EVP_sha256 (), NULL);
+  digest_padded (md, first);
+  digest_padded (md, second);
+  digest_to_bn (md, result);
+  EVP_MD_CTX_free (md);
+}
+
+static const SrpGroup *
+srp_group_get (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized))
+    {
+      BN_CTX *ctx = BN_CTX_new ();
+
+      /* The same prime as group 15 of RFC 3526 */
+      srp_group.n = BN_get_rfc3526_prime_3072 (NULL);
+      srp_group.g = BN_new ();
+      BN_set_word (srp_group.g, 2);
+      srp_group.k = BN_new ();
+      hash_pair (srp_group.n, srp_group.g, srp_group.k);
+      srp_group.mont = BN_MONT_CTX_new ();
+      BN_MONT_CTX_set (srp_group.mont, srp_group.n, ctx);
+
+      srp_group.table = g_new (unsigned char,
+                           N_WINDOWS * WINDOW_SIZE * GROUP_BYTES);
+      BIGNUM *base = BN_new ();
+      BIGNUM *entry = BN_new ();
+      BN_to_montgomery (base, srp_group.g, srp_group.mont, ctx);
+      for (unsigned window = 0; window < N_WINDOWS; window++)
+        {
+          unsigned char *row = srp_group.table +
+                               window * WINDOW_SIZE * GROUP_BYTES;
+          BN_to_montgomery (entry, BN_value_one (), srp_group.mont, ctx);
+          for (unsigned digit = 0; digit < WINDOW_SIZE; digit++)
+            {
+              BN_bn2binpad (entry, row + digit * GROUP_BYTES, GROUP_BYTES);
+              BN_mod_mul_montgomery (entry, entry, base, srp_group.mont, ctx);
+            }
+          /* Now base^WINDOW_SIZE, the base of the next row */
+          BN_copy (base, entry);
+        }
+      BN_free (base);
+      BN_free (entry);
+      BN_CTX_free (ctx);
+
+      g_once_init_leave (&initialized, 1);
+    }
+
+  return &srp_group;
+}
+
+/* Sets @result to g^@exponent mod N, where @exponent fits in @n_bytes bytes,
+ * at most EXPONENT_BYTES. Every entry of each row of the table is read, so
+ * that the exponent's digits do not show in which memory is accessed. */
+static void
+fixed_base_exp (BIGNUM *result,
+                const BIGNUM *exponent,
+                size_t n_bytes,
+                BN_CTX *ctx)
+{
+  const SrpGroup *group = srp_group_get ();
+  unsigned char digits[EXPONENT_BYTES];
+  unsigned char selected[GROUP_BYTES];
+
+  g_assert (n_bytes <= EXPONENT_BYTES);
+  BN_bn2binpad (exponent, digits, n_bytes);
+
+  BN_CTX_start (ctx);
+  BIGNUM *entry = BN_CTX_get (ctx);
+  BN_to_montgomery (result, BN_value_one (), group->mont, ctx);
+
+  for (unsigned window = 0; window < n_bytes * WINDOWS_PER_BYTE; window++)
+    {
+      unsigned char byte = digits[n_bytes - 1 - window / WINDOWS_PER_BYTE];
+      unsigned digit = (byte >> (window % WINDOWS_PER_BYTE * WINDOW_BITS)) &
+                       (WINDOW_SIZE - 1);
+      const unsigned char *row = group->table +
+                                 window * WINDOW_SIZE * GROUP_BYTES;
+
+      memset (selected, 0, sizeof selected);
+      for (unsigned candidate = 0; candidate < WINDOW_SIZE; candidate++)
+        {
+          /* All ones if candidate == digit, zero otherwise */
+          unsigned char mask = ((candidate ^ digit) - 1) >> 8;
+          const unsigned char *entry_bytes = row + candidate * GROUP_BYTES;
+          for (unsigned ix = 0; ix < GROUP_BYTES; ix++)
+            selected[ix] |= entry_bytes[ix] & mask;
+        }
+
+      BN_bin2bn (selected, GROUP_BYTES, entry);
+      BN_mod_mul_montgomery (result, result, entry, group->mont, ctx);
+    }
+
+  BN_from_montgomery (result, result, group->mont, ctx);
+  BN_CTX_end (ctx);
+  OPENSSL_cleanse (digits, sizeof digits);
+  OPENSSL_cleanse (selected, sizeof selected);
+}
+
+/* Parses all of @hex into @bn, which must fit in GROUP_BYTES */
+static bool
+parse_hex (const char *hex,
+           BIGNUM *bn)
+{
+  return BN_hex2bn (&bn, hex) == int (strlen (hex)) &&
+         BN_num_bytes (bn) <= GROUP_BYTES;
+}
+
+/* Formats @now the way Cognito expects, for example `Tue Oct 6 09:05:02 UTC
+ * 2026`, whatever the locale */
+static char *
+format_timestamp (GDateTime *now)
+{
+  static const char * const days[] = {
+    "Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun",
+  };
+  static const char * const months[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec",
+  };
+
+  return g_strdup_printf ("%s %s %d %02d:%02d:%02d UTC %d",
+                          days[g_date_time_get_day_of_week (now) - 1],
+                          months[g_date_time_get_month (now) - 1],
+                          g_date_time_get_day_of_month (now),
+                          g_date_time_get_hour (now),
+                          g_date_time_get_minute (now),
+                          g_date_time_get_second (now),
+                          g_date_time_get_year (now));
+}
+
+/**
+ * CogSrpSession:
+ *
+ * The client's side of one run of the SRP protocol, started with
+ * cog_srp_client_start_session().
+ */
+struct _CogSrpSession
+{
+  unsigned ref_count;
+  char *pool_name;  /* NULL if the user pool ID was invalid */
+  BIGNUM *a;
+  BIGNUM *big_a;
+  char *srp_a;
+  GDateTime *now;  /* only set by tests */
+};
+
+G_DEFINE_BOXED_TYPE (CogSrpSession, cog_srp_session,
+                     cog_srp_session_ref, cog_srp_session_unref)
+
+/* Computes the public value from the secret exponent @a, which it takes
+ * ownership of; this is the part that can be done before the password is
+ * known */
+static CogSrpSession *
+srp_session_new_with_exponent (const char *pool_name,
+                               BIGNUM *a)
+{
+  CogSrpSession *self = g_slice_new0 (CogSrpSession);
+  self->ref_count = 1;
+  self->pool_name = g_strdup (pool_name);
+  self->a = a;
+  self->big_a = BN_new ();
+
+  BN_CTX *ctx = BN_CTX_new ();
+  fixed_base_exp (self->big_a, self->a, EXPONENT_BYTES, ctx);
+  BN_CTX_free (ctx);
+
+  char *hex = BN_bn2hex (self->big_a);
+  self->srp_a = g_ascii_strdown (hex, -1);
+  OPENSSL_free (hex);
+
+  return self;
+}
+
+/* Picks the secret exponent at random */
+static CogSrpSession *
+srp_session_new (const char *pool_name)
+{
+  BIGNUM *a = BN_secure_new ();
+  if (BN_rand (a, EXPONENT_BYTES * 8, BN_RAND_TOP_ANY,
+               BN_RAND_BOTTOM_ANY) != 1)
+    g_error ("Could not generate a random SRP exponent");
+  return srp_session_new_with_exponent (pool_name, a);
+}
+
+/**
+ * cog_srp_session_ref:
+ * @self: a #CogSrpSession
+ *
+ * Increments the reference count of @self by one.
+ *
+ * Returns: (transfer none): @self
+ */
+CogSrpSession *
+cog_srp_session_ref (CogSrpSession *self)
+{
+  g_return_val_if_fail (self, NULL);
+  g_return_val_if_fail (self->ref_count, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+/**
+ * cog_srp_session_unref:
+ * @self: (transfer none): a #CogSrpSession
+ *
+ * Decrements the reference count of @self by one, freeing the structure when
+ * the reference count reaches zero.
+ */
+void
+cog_srp_session_unref (CogSrpSession *self)
+{
+  g_return_if_fail (self);
+  g_return_if_fail (self->ref_count);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+    {
+      g_free (self->pool_name);
+      BN_clear_free (self->a);
+      BN_free (self->big_a);
+      g_free (self->srp_a);
+      g_clear_pointer (&self->now, g_date_time_unref);
+      g_slice_free (CogSrpSession, self);
+    }
+}
+
+/**
+ * cog_srp_session_get_srp_a:
+ * @self: a #CogSrpSession
+ *
+ * Returns: the session's public value, to pass as %COG_PARAMETER_SRP_A
+ */
+const char *
+cog_srp_session_get_srp_a (CogSrpSession *self)
+{
+  g_return_val_if_fail (self, NULL);
+  return self->srp_a;
+}
+
+/* Computes the password claim signature for @user_id in @realm, proving
+ * knowledge of @password to a server that sent @salt_hex and @b_hex. Returns
+ * it base64-encoded, or NULL if the server's values are invalid. */
+static char *
+srp_session_sign (CogSrpSession *self,
+                  const char *realm,
+                  const char *user_id,
+                  const char *password,
+                  const char *salt_hex,
+                  const char *b_hex,
+                  const unsigned char *secret_block,
+                  size_t secret_block_length,
+                  const char *timestamp,
+                  GError **error)
+{
+  const SrpGroup *group = srp_group_get ();
+  char *retval = NULL;
+
+  BN_CTX *ctx = BN_CTX_new ();
+  BN_CTX_start (ctx);
+  BIGNUM *salt = BN_CTX_get (ctx);
+  BIGNUM *b = BN_CTX_get (ctx);
+  BIGNUM *u = BN_CTX_get (ctx);
+  BIGNUM *x = BN_CTX_get (ctx);
+  BIGNUM *tmp = BN_CTX_get (ctx);
+  BIGNUM *base = BN_CTX_get (ctx);
+  BIGNUM *exponent = BN_CTX_get (ctx);
+  BIGNUM *s = BN_CTX_get (ctx);
+
+  unsigned char u_bytes[GROUP_BYTES + 1];
+  unsigned char s_bytes[GROUP_BYTES + 1];
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  unsigned char prk[SHA256_DIGEST_LENGTH];
+  unsigned char key[SHA256_DIGEST_LENGTH];
+  size_t u_length, s_length;
+  GByteArray *message;
+  EVP_MD_CTX *md;
+
+  if (!parse_hex (salt_hex, salt))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Invalid %s challenge parameter", COG_PARAMETER_SALT);
+      goto out;
+    }
+  if (!parse_hex (b_hex, b) || !BN_nnmod (tmp, b, group->n, ctx) ||
+      BN_is_zero (tmp))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Invalid %s challenge parameter", COG_PARAMETER_SRP_B);
+      goto out;
+    }
+
+  hash_pair (self->big_a, b, u);
+  if (BN_is_zero (u))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Invalid %s challenge parameter", COG_PARAMETER_SRP_B);
+      goto out;
+    }
+
+  /* x = H(salt | H(realm | user_id | ":" | password)) */
+  md = EVP_MD_CTX_new ();
+  EVP_DigestInit_ex (md, EVP_sha256 (), NULL);
+  EVP_DigestUpdate (md, realm, strlen (realm));
+  EVP_DigestUpdate (md, user_id, strlen (user_id));
+  EVP_DigestUpdate (md, ":", 1);
+  EVP_DigestUpdate (md, password, strlen (password));
+  EVP_DigestFinal_ex (md, digest, NULL);
+  EVP_DigestInit_ex (md, EVP_sha256 (), NULL);
+  digest_padded (md, salt);
+  EVP_DigestUpdate (md, digest, sizeof digest);
+  digest_to_bn (md, x);
+  EVP_MD_CTX_free (md);
+
+  /* S = (B - k * g^x)^(a + u * x) */
+  fixed_base_exp (tmp, x, SHA256_DIGEST_LENGTH, ctx);
+  BN_mod_mul (tmp, group->k, tmp, group->n, ctx);
+  BN_mod_sub (base, b, tmp, group->n, ctx);
+  BN_mul (tmp, u, x, ctx);
+  BN_add (exponent, self->a, tmp);
+  BN_set_flags (exponent, BN_FLG_CONSTTIME);
+  BN_mod_exp_mont_consttime (s, base, exponent, group->n, ctx, group->mont);
+
+  /* The key is derived from S with HKDF, salted with u */
+  u_length = padded_bytes (u, u_bytes);
+  s_length = padded_bytes (s, s_bytes);
+  HMAC (EVP_sha256 (), u_bytes, u_length, s_bytes, s_length, prk, NULL);
+  HMAC (EVP_sha256 (), prk, sizeof prk,
+        (const unsigned char *) DERIVED_KEY_INFO, strlen (DERIVED_KEY_INFO),
+        key, NULL);
+
+  message = g_byte_array_new ();
+  g_byte_array_append (message, (const guint8 *) realm, strlen (realm));
+  g_byte_array_append (message, (const guint8 *) user_id, strlen (user_id));
+  g_byte_array_append (message, secret_block, secret_block_length);
+  g_byte_array_append (message, (const guint8 *) timestamp,
+                       strlen (timestamp));
+  HMAC (EVP_sha256 (), key, DERIVED_KEY_BYTES, message->data, message->len,
+        digest, NULL);
+  g_byte_array_unref (message);
+
+  retval = g_base64_encode (digest, sizeof digest);
+
+  OPENSSL_cleanse (s_bytes, sizeof s_bytes);
+  OPENSSL_cleanse (prk, sizeof prk);
+  OPENSSL_cleanse (key, sizeof key);
+
+out:
+  OPENSSL_cleanse (digest, sizeof digest);
+  BN_clear (x);
+  BN_clear (exponent);
+  BN_clear (s);
+  BN_CTX_end (ctx);
+  BN_CTX_free (ctx);
+  return retval;
+}
+
+static const char *
+lookup_challenge_parameter (GHashTable *challenge_parameters,
+                            const char *name,
+                            GError **error)
+{
+  auto *value = static_cast<const char *> (g_hash_table_lookup (challenge_parameters,
+                                                                name));
+  if (!value)
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                 "Missing %s challenge parameter", name);
+  return value;
+}
+
+/* Computes the challenge responses that prove knowledge of @password for
+ * @user_id in @realm, or returns NULL if @challenge_parameters are invalid.
+ * @username is the response's USERNAME, if known. */
+static GHashTable *
+srp_session_respond (CogSrpSession *self,
+                     const char *realm,
+                     const char *user_id,
+                     const char *username,
+                     const char *password,
+                     GHashTable *challenge_parameters,
+                     GError **error)
+{
+  const char *salt, *srp_b, *secret_block;
+  if (!(salt = lookup_challenge_parameter (challenge_parameters,
+                                           COG_PARAMETER_SALT, error)) ||
+      !(srp_b = lookup_challenge_parameter (challenge_parameters,
+                                            COG_PARAMETER_SRP_B, error)) ||
+      !(secret_block = lookup_challenge_parameter (challenge_parameters,
+                                                   COG_PARAMETER_SECRET_BLOCK,
+                                                   error)))
+    return NULL;
+
+  size_t secret_block_length;
+  g_autofree unsigned char *secret_block_bytes =
+    g_base64_decode (secret_block, &secret_block_length);
+
+  GDateTime *now = self->now ? g_date_time_ref (self->now) :
+                               g_date_time_new_now_utc ();
+  char *timestamp = format_timestamp (now);
+  g_date_time_unref (now);
+
+  char *signature = srp_session_sign (self, realm, user_id, password, salt,
+                                      srp_b, secret_block_bytes,
+                                      secret_block_length, timestamp, error);
+  if (!signature)
+    {
+      g_free (timestamp);
+      return NULL;
+    }
+
+  GHashTable *responses = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                 g_free, g_free);
+  if (username)
+    g_hash_table_insert (responses, g_strdup (COG_PARAMETER_USERNAME),
+                         g_strdup (username));
+  g_hash_table_insert (responses,
+                       g_strdup (COG_PARAMETER_PASSWORD_CLAIM_SECRET_BLOCK),
+                       g_strdup (secret_block));
+  g_hash_table_insert (responses,
+                       g_strdup (COG_PARAMETER_PASSWORD_CLAIM_SIGNATURE),
+                       signature);
+  g_hash_table_insert (responses, g_strdup (COG_PARAMETER_TIMESTAMP),
+                       timestamp);
+  return responses;
+}
+
+/**
+ * cog_srp_session_respond_to_password_verifier:
+ * @self: a #CogSrpSession
+ * @password: the user's password
+ * @challenge_parameters: (element-type utf8 utf8): the challenge parameters
+ *   that came with %COG_CHALLENGE_NAME_PASSWORD_VERIFIER
+ * @error: error location
+ *
+ * Computes the responses to a %COG_CHALLENGE_NAME_PASSWORD_VERIFIER challenge
+ * for the login that @self was started for.
+ * @challenge_parameters must contain %COG_PARAMETER_SALT,
+ * %COG_PARAMETER_SRP_B, %COG_PARAMETER_SECRET_BLOCK and
+ * %COG_PARAMETER_USER_ID_FOR_SRP, as Cognito sends them.
+ *
+ * The responses are %COG_PARAMETER_USERNAME,
+ * %COG_PARAMETER_PASSWORD_CLAIM_SECRET_BLOCK,
+ * %COG_PARAMETER_PASSWORD_CLAIM_SIGNATURE and %COG_PARAMETER_TIMESTAMP.
+ * Add %COG_PARAMETER_SECRET_HASH if your app client has a secret.
+ *
+ * Returns: (transfer full) (element-type utf8 utf8): a new dictionary of
+ *   challenge responses, or %NULL if @challenge_parameters are invalid, or if
+ *   @self was started by a #CogSrpClient with an invalid user pool ID
+ */
+GHashTable *
+cog_srp_session_respond_to_password_verifier (CogSrpSession *self,
+                                              const char *password,
+                                              GHashTable *challenge_parameters,
+                                              GError **error)
+{
+  g_return_val_if_fail (self, NULL);
+  g_return_val_if_fail (password, NULL);
+  g_return_val_if_fail (challenge_parameters, NULL);
+  g_return_val_if_fail (!error || !*error, NULL);
+
+  if (!self->pool_name)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                           "Invalid user pool ID");
+      return NULL;
+    }
+
+  const char *user_id = lookup_challenge_parameter (challenge_parameters,
+                                                    COG_PARAMETER_USER_ID_FOR_SRP,
+                                                    error);
+  if (!user_id)
+    return NULL;
+
+  auto *username =
+    static_cast<const char *> (g_hash_table_lookup (challenge_parameters,
+                                                    COG_PARAMETER_USERNAME));
+  return srp_session_respond (self, self->pool_name, user_id,
+                              username ? username : user_id, password,
+                              challenge_parameters, error);
+}
+
+/**
+ * cog_srp_session_respond_to_device_password_verifier:
+ * @self: a #CogSrpSession
+ * @device_group_key: the device's group key, from the #CogNewDeviceMetadata
+ *   of the login that remembered it
+ * @device_key: the device's key, from the same #CogNewDeviceMetadata
+ * @device_password: the password that was set for the device when it was
+ *   confirmed
+ * @challenge_parameters: (element-type utf8 utf8): the challenge parameters
+ *   that came with %COG_CHALLENGE_NAME_DEVICE_PASSWORD_VERIFIER
+ * @error: error location
+ *
+ * Like cog_srp_session_respond_to_password_verifier(), but proves that this
+ * is a remembered device instead, for a session whose
+ * cog_srp_session_get_srp_a() was passed with
+ * %COG_CHALLENGE_NAME_DEVICE_SRP_AUTH.
+ * @challenge_parameters must contain %COG_PARAMETER_SALT,
+ * %COG_PARAMETER_SRP_B and %COG_PARAMETER_SECRET_BLOCK.
+ *
+ * The responses also include %COG_PARAMETER_DEVICE_KEY, and include
+ * %COG_PARAMETER_USERNAME if @challenge_parameters do.
+ *
+ * Returns: (transfer full) (element-type utf8 utf8): a new dictionary of
+ *   challenge responses, or %NULL if @challenge_parameters are invalid
+ */
+GHashTable *
+cog_srp_session_respond_to_device_password_verifier (CogSrpSession *self,
+                                                     const char *device_group_key,
+                                                     const char *device_key,
+                                                     const char *device_password,
+                                                     GHashTable *challenge_parameters,
+                                                     GError **error)
+{
+  g_return_val_if_fail (self, NULL);
+  g_return_val_if_fail (device_group_key, NULL);
+  g_return_val_if_fail (device_key, NULL);
+  g_return_val_if_fail (device_password, NULL);
+  g_return_val_if_fail (challenge_parameters, NULL);
+  g_return_val_if_fail (!error || !*error, NULL);
+
+  auto *username =
+    static_cast<const char *> (g_hash_table_lookup (challenge_parameters,
+                                                    COG_PARAMETER_USERNAME));
+  GHashTable *responses = srp_session_respond (self, device_group_key,
+                                               device_key, username,
+                                               device_password,
+                                               challenge_parameters, error);
+  if (responses)
+    g_hash_table_insert (responses, g_strdup (COG_PARAMETER_DEVICE_KEY),
+                         g_strdup (device_key));
+  return responses;
+}
+
+typedef struct
+{
+  char *user_pool_id;
+  char *pool_name;
+  unsigned n_precomputed;
+
+  GMutex lock;
+  /* Of CogSrpSession, ready to be started */
+  GQueue ready;
+  unsigned n_pending;
+} CogSrpClientPrivate;
+
+struct _CogSrpClient {
+  GObject parent_instance;
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE (CogSrpClient, cog_srp_client, G_TYPE_OBJECT)
+
+enum {
+  PROP_USER_POOL_ID = 1,
+  PROP_N_PRECOMPUTED,
+  N_PROPERTIES
+};
+
+/* Runs on a worker thread, with a reference to the client */
+static void
+precompute_session (void *data,
+                    void *unused G_GNUC_UNUSED)
+{
+  CogSrpClient *self = COG_SRP_CLIENT (data);
+  CogSrpClientPrivate *priv = GET_PRIVATE (self);
+
+  CogSrpSession *session = srp_session_new (priv->pool_name);
+
+  g_mutex_lock (&priv->lock);
+  g_queue_push_tail (&priv->ready, session);
+  priv->n_pending--;
+  g_mutex_unlock (&priv->lock);
+
+  g_object_unref (self);
+}
+
+/* Shared by all clients, so that they use at most one thread per processor
+ * between them */
+static GThreadPool *
+precompute_pool_get (void)
+{
+  static GThreadPool *pool =
+    g_thread_pool_new (precompute_session, NULL, g_get_num_processors (),
+                       FALSE, NULL);
+  return pool;
+}
+
+/* Starts computing sessions on worker threads, until n-precomputed are ready
+ * or underway */
+static void
+srp_client_refill (CogSrpClient *self)
+{
+  CogSrpClientPrivate *priv = GET_PRIVATE (self);
+
+  g_mutex_lock (&priv->lock);
+  unsigned n_underway = priv->ready.length + priv->n_pending;
+  unsigned n_missing = priv->n_precomputed > n_underway ?
+                       priv->n_precomputed - n_underway : 0;
+  priv->n_pending += n_missing;
+  g_mutex_unlock (&priv->lock);
+
+  for (unsigned ix = 0; ix < n_missing; ix++)
+    g_thread_pool_push (precompute_pool_get (), g_object_ref (self), NULL);
+}
+
+static void
+cog_srp_client_set_property (GObject *object,
+                             unsigned property_id,
+                             const GValue *value,
+                             GParamSpec *pspec)
+{
+  CogSrpClient *self = COG_SRP_CLIENT (object);
+  CogSrpClientPrivate *priv = GET_PRIVATE (self);
+
+  switch (property_id) {
+    case PROP_USER_POOL_ID:
+      priv->user_pool_id = g_value_dup_string (value);
+      break;
+    case PROP_N_PRECOMPUTED:
+      priv->n_precomputed = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+cog_srp_client_get_property (GObject *object,
+                             unsigned property_id,
+                             GValue *value,
+                             GParamSpec *pspec)
+{
+  CogSrpClient *self = COG_SRP_CLIENT (object);
+  CogSrpClientPrivate *priv = GET_PRIVATE (self);
+
+  switch (property_id) {
+    case PROP_USER_POOL_ID:
+      g_value_set_string (value, priv->user_pool_id);
+      break;
+    case PROP_N_PRECOMPUTED:
+      g_value_set_uint (value, priv->n_precomputed);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+/**
+ * cog_srp_client_new:
+ * @user_pool_id: ID of the user pool to log in to, e.g. `us-east-1_AbCdEfGhI`
+ *
+ * Create a new SRP client, which starts precomputing sessions right away.
+ *
+ * Returns: (transfer full): a newly created #CogSrpClient, or %NULL if
+ *   @user_pool_id is not of the form `region_name`
+ */
+CogSrpClient *
+cog_srp_client_new (const char *user_pool_id)
+{
+  g_return_val_if_fail (user_pool_id, NULL);
+  g_return_val_if_fail (strchr (user_pool_id, '_'), NULL);
+
+  return COG_SRP_CLIENT (g_object_new (COG_TYPE_SRP_CLIENT,
+                                       "user-pool-id", user_pool_id,
+                                       NULL));
+}
+
+static void
+cog_srp_client_constructed (GObject *object)
+{
+  CogSrpClientPrivate *priv = GET_PRIVATE (object);
+  G_OBJECT_CLASS (cog_srp_client_parent_class)->constructed (object);
+
+  /* The pool name that goes into the hashes is the user pool ID without the
+   * region name prefix. Without one, sessions are still computed, but fail to
+   * respond to %COG_CHALLENGE_NAME_PASSWORD_VERIFIER. */
+  const char *separator = priv->user_pool_id ?
+                          strchr (priv->user_pool_id, '_') : NULL;
+  if (separator)
+    priv->pool_name = g_strdup (separator + 1);
+
+  srp_client_refill (COG_SRP_CLIENT (object));
+}
+
+static void
+cog_srp_client_finalize (GObject *object)
+{
+  CogSrpClientPrivate *priv = GET_PRIVATE (object);
+
+  g_clear_pointer (&priv->user_pool_id, g_free);
+  g_clear_pointer (&priv->pool_name, g_free);
+  g_mutex_clear (&priv->lock);
+  CogSrpSession *session;
+  while ((session = static_cast<CogSrpSession *> (g_queue_pop_head (&priv->ready))))
+    cog_srp_session_unref (session);
+
+  G_OBJECT_CLASS (cog_srp_client_parent_class)->finalize (object);
+}
+
+static void
+cog_srp_client_class_init (CogSrpClientClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->constructed = cog_srp_client_constructed;
+  object_class->finalize = cog_srp_client_finalize;
+
+  object_class->set_property = cog_srp_client_set_property;
+  object_class->get_property = cog_srp_client_get_property;
+
+  g_object_class_install_property (object_class,
+                                   PROP_USER_POOL_ID,
+                                   g_param_spec_string ("user-pool-id",
+                                                        "User pool ID",
+                                                        "ID of the user pool to log in to",
+                                                        NULL,
+                                                        (GParamFlags)
+                                                        (G_PARAM_CONSTRUCT_ONLY |
+                                                         G_PARAM_READWRITE)));
+
+  /**
+   * CogSrpClient:n-precomputed:
+   *
+   * Number of sessions to keep ready for cog_srp_client_start_session().
+   * Each one that is started is replaced on a worker thread.
+   * If 0, or if logins are started faster than sessions are computed, a
+   * session is computed on the thread starting it instead.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_N_PRECOMPUTED,
+                                   g_param_spec_uint ("n-precomputed",
+                                                      "Number precomputed",
+                                                      "Number of sessions to keep ready",
+                                                      0, G_MAXINT,
+                                                      DEFAULT_N_PRECOMPUTED,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_READWRITE)));
+}
+
+static void
+cog_srp_client_init (CogSrpClient *self)
+{
+  CogSrpClientPrivate *priv = GET_PRIVATE (self);
+  g_mutex_init (&priv->lock);
+  g_queue_init (&priv->ready);
+}
+
+/**
+ * cog_srp_client_start_session:
+ * @self: the #CogSrpClient
+ *
+ * Starts the client's side of the SRP protocol for a new login, with one of
+ * the precomputed sessions if there is one ready.
+ *
+ * Returns: (transfer full): a #CogSrpSession to use for one login
+ */
+CogSrpSession *
+cog_srp_client_start_session (CogSrpClient *self)
+{
+  g_return_val_if_fail (COG_IS_SRP_CLIENT (self), NULL);
+
+  CogSrpClientPrivate *priv = GET_PRIVATE (self);
+
+  g_mutex_lock (&priv->lock);
+  auto *session = static_cast<CogSrpSession *> (g_queue_pop_head (&priv->ready));
+  g_mutex_unlock (&priv->lock);
+
+  if (!session)
+    session = srp_session_new (priv->pool_name);
+  srp_client_refill (self);
+  return session;
+}
+
+CogSrpSession *
+_cog_srp_client_start_fixed_session (CogSrpClient *self,
+                                     const char *a_hex,
+                                     GDateTime *now)
+{
+  g_return_val_if_fail (COG_IS_SRP_CLIENT (self), NULL);
+  g_return_val_if_fail (a_hex, NULL);
+  g_return_val_if_fail (now, NULL);
+
+  CogSrpClientPrivate *priv = GET_PRIVATE (self);
+  BIGNUM *a = BN_secure_new ();
+  if (!parse_hex (a_hex, a) || BN_num_bytes (a) > EXPONENT_BYTES)
+    {
+      BN_clear_free (a);
+      g_return_val_if_reached (NULL);
+    }
+
+  CogSrpSession *session = srp_session_new_with_exponent (priv->pool_name, a);
+  session->now = g_date_time_ref (now);
+  return session;
+}
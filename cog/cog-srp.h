@@ -0,0 +1,61 @@
+#pragma once
+
+#if !(defined(_COG_INSIDE_COG_H) || defined(COMPILING_LIBCOG))
+#error "Please do not include this header file directly."
+#endif
+
+#include <glib-object.h>
+
+#include "cog/cog-macros.h"
+
+G_BEGIN_DECLS
+
+#define COG_TYPE_SRP_SESSION (cog_srp_session_get_type ())
+
+typedef struct _CogSrpSession CogSrpSession;
+
+COG_AVAILABLE_IN_ALL
+GType cog_srp_session_get_type (void) G_GNUC_CONST;
+
+COG_AVAILABLE_IN_ALL
+CogSrpSession *cog_srp_session_ref (CogSrpSession *self);
+
+COG_AVAILABLE_IN_ALL
+void cog_srp_session_unref (CogSrpSession *self);
+
+COG_AVAILABLE_IN_ALL
+const char *cog_srp_session_get_srp_a (CogSrpSession *self);
+
+COG_AVAILABLE_IN_ALL
+GHashTable *cog_srp_session_respond_to_password_verifier (CogSrpSession *self,
+                                                          const char *password,
+                                                          GHashTable *challenge_parameters,
+                                                          GError **error);
+
+COG_AVAILABLE_IN_ALL
+GHashTable *cog_srp_session_respond_to_device_password_verifier (CogSrpSession *self,
+                                                                 const char *device_group_key,
+                                                                 const char *device_key,
+                                                                 const char *device_password,
+                                                                 GHashTable *challenge_parameters,
+                                                                 GError **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (CogSrpSession, cog_srp_session_unref)
+
+#define COG_TYPE_SRP_CLIENT (cog_srp_client_get_type())
+
+COG_AVAILABLE_IN_ALL
+G_DECLARE_FINAL_TYPE (CogSrpClient, cog_srp_client, COG, SRP_CLIENT, GObject)
+
+struct _CogSrpClientClass
+{
+  GObjectClass parent_class;
+};
+
+COG_AVAILABLE_IN_ALL
+CogSrpClient *cog_srp_client_new (const char *user_pool_id);
+
+COG_AVAILABLE_IN_ALL
+CogSrpSession *cog_srp_client_start_session (CogSrpClient *self);
+
+G_END_DECLS
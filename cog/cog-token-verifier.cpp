@@ -0,0 +1,824 @@
+/**
+ * SECTION:token-verifier
+ * @title: CogTokenVerifier
+ * @short_description: Verify access and ID tokens without contacting Cognito
+ *
+ * The access and ID tokens issued by a Cognito user pool are JSON Web Tokens
+ * signed with one of the user pool's RSA keys, which are published as a JSON
+ * Web Key Set (JWKS) at
+ * `https://cognito-idp.<region>.amazonaws.com/<user-pool-id>/.well-known/jwks.json`.
+ *
+ * Once the key set is loaded into a #CogTokenVerifier, either from that URL
+ * with cog_token_verifier_fetch_keys_async() or from a local copy with
+ * cog_token_verifier_load_keys_from_file(), cog_token_verifier_verify() checks
+ * a token's signature, expiry, issuer, audience, and use entirely locally.
+ * This is much cheaper than a call to cog_client_get_user(), though unlike
+ * that, it cannot tell whether the token has been revoked.
+ *
+ * Tokens that were verified successfully are remembered by their SHA-256 hash
+ * until they expire, so verifying the same token again is nearly free.
+ *
+ * A #CogTokenVerifier may be used from several threads at once.
+ */
+
+#define OPENSSL_API_COMPAT 0x10100000L
+
+#include <string.h>
+
+#include <memory>
+
+#include <aws/core/client/ClientConfiguration.h>
+#include <aws/core/http/HttpClient.h>
+#include <aws/core/http/HttpClientFactory.h>
+#include <aws/core/http/HttpRequest.h>
+#include <aws/core/http/HttpResponse.h>
+#include <aws/core/utils/json/JsonSerializer.h>
+#include <aws/core/utils/memory/stl/AWSMap.h>
+#include <aws/core/utils/memory/stl/AWSString.h>
+#include <aws/core/utils/memory/stl/AWSStringStream.h>
+#include <aws/core/utils/stream/ResponseStream.h>
+#include <gio/gio.h>
+#include <openssl/bn.h>
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+#include <openssl/sha.h>
+
+#include "cog/cog-enums.h"
+#include "cog/cog-token-verifier.h"
+#include "cog/cog-utils-private.h"
+
+#define GET_PRIVATE(o) (static_cast<CogTokenVerifierPrivate *> (cog_token_verifier_get_instance_private (COG_TOKEN_VERIFIER (o))))
+
+#define DEFAULT_CACHE_SIZE 1024
+#define N_CACHE_SHARDS 16
+
+using Aws::Http::HttpMethod;
+using Aws::Http::HttpResponseCode;
+using Aws::Utils::Json::JsonValue;
+using Aws::Utils::Json::JsonView;
+
+typedef std::shared_ptr<EVP_PKEY> KeyRef;
+typedef Aws::UnorderedMap<Aws::String, KeyRef> KeySet;
+
+struct VerifiedToken
+{
+  /* The keys_generation of the keys that the token was verified with */
+  unsigned keys_generation;
+  gint64 expiration;
+  CogTokenUse token_use;
+  Aws::String subject;
+};
+
+/* The cache of verified tokens is split up, so that threads verifying
+ * different tokens rarely contend for the same lock */
+struct CacheShard
+{
+  GMutex lock;
+  /* Keys are SHA-256 digests of tokens */
+  Aws::UnorderedMap<Aws::String, VerifiedToken> tokens;
+
+  CacheShard () { g_mutex_init (&lock); }
+  ~CacheShard () { g_mutex_clear (&lock); }
+};
+
+typedef struct
+{
+  char *user_pool_id;
+  char *client_id;
+  char *issuer;
+  unsigned cache_size;
+
+  GRWLock keys_lock;
+  std::shared_ptr<const KeySet> keys;
+  /* Incremented whenever the keys are replaced. A verification that is still
+   * running with the old keys must not add its result to the cache, and a
+   * result from before the keys were replaced must not be used. */
+  unsigned keys_generation;
+
+  CacheShard shards[N_CACHE_SHARDS];
+} CogTokenVerifierPrivate;
+
+struct _CogTokenVerifier {
+  GObject parent_instance;
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE (CogTokenVerifier, cog_token_verifier, G_TYPE_OBJECT)
+
+G_DEFINE_QUARK(cog-token-error, cog_token_error)
+
+enum {
+  PROP_USER_POOL_ID = 1,
+  PROP_CLIENT_ID,
+  PROP_CACHE_SIZE,
+  N_PROPERTIES
+};
+
+static void
+cog_token_verifier_set_property (GObject *object,
+                                 unsigned property_id,
+                                 const GValue *value,
+                                 GParamSpec *pspec)
+{
+  CogTokenVerifier *self = COG_TOKEN_VERIFIER (object);
+  CogTokenVerifierPrivate *priv = GET_PRIVATE (self);
+
+  switch (property_id) {
+    case PROP_USER_POOL_ID:
+      priv->user_pool_id = g_value_dup_string (value);
+      break;
+    case PROP_CLIENT_ID:
+      priv->client_id = g_value_dup_string (value);
+      break;
+    case PROP_CACHE_SIZE:
+      priv->cache_size = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+cog_token_verifier_get_property (GObject *object,
+                                 unsigned property_id,
+                                 GValue *value,
+                                 GParamSpec *pspec)
+{
+  CogTokenVerifier *self = COG_TOKEN_VERIFIER (object);
+  CogTokenVerifierPrivate *priv = GET_PRIVATE (self);
+
+  switch (property_id) {
+    case PROP_USER_POOL_ID:
+      g_value_set_string (value, priv->user_pool_id);
+      break;
+    case PROP_CLIENT_ID:
+      g_value_set_string (value, priv->client_id);
+      break;
+    case PROP_CACHE_SIZE:
+      g_value_set_uint (value, priv->cache_size);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+/**
+ * cog_token_verifier_new:
+ * @user_pool_id: ID of the user pool that issues the tokens, e.g.
+ *   `us-east-1_AbCdEfGhI`
+ * @client_id: ID of the app client that the tokens must be issued to
+ *
+ * Create a new token verifier with no keys loaded.
+ *
+ * Returns: (transfer full): a newly created #CogTokenVerifier
+ */
+CogTokenVerifier *
+cog_token_verifier_new (const char *user_pool_id,
+                        const char *client_id)
+{
+  g_return_val_if_fail (user_pool_id, NULL);
+  g_return_val_if_fail (client_id, NULL);
+
+  return COG_TOKEN_VERIFIER (g_object_new (COG_TYPE_TOKEN_VERIFIER,
+                                           "user-pool-id", user_pool_id,
+                                           "client-id", client_id,
+                                           NULL));
+}
+
+static void
+cog_token_verifier_constructed (GObject *object)
+{
+  CogTokenVerifierPrivate *priv = GET_PRIVATE (object);
+  G_OBJECT_CLASS (cog_token_verifier_parent_class)->constructed (object);
+
+  g_return_if_fail (priv->user_pool_id && priv->client_id);
+
+  /* User pool IDs are prefixed with the region name */
+  const char *separator = strchr (priv->user_pool_id, '_');
+  g_return_if_fail (separator);
+  g_autofree char *region = g_strndup (priv->user_pool_id,
+                                       separator - priv->user_pool_id);
+  priv->issuer = g_strdup_printf ("https://cognito-idp.%s.amazonaws.com/%s",
+                                  region, priv->user_pool_id);
+}
+
+static void
+cog_token_verifier_finalize (GObject *object)
+{
+  CogTokenVerifierPrivate *priv = GET_PRIVATE (object);
+
+  g_clear_pointer (&priv->user_pool_id, g_free);
+  g_clear_pointer (&priv->client_id, g_free);
+  g_clear_pointer (&priv->issuer, g_free);
+  g_rw_lock_clear (&priv->keys_lock);
+  priv->keys.~shared_ptr ();
+  for (auto& shard : priv->shards)
+    shard.~CacheShard ();
+
+  G_OBJECT_CLASS (cog_token_verifier_parent_class)->finalize (object);
+}
+
+static void
+cog_token_verifier_class_init (CogTokenVerifierClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->constructed = cog_token_verifier_constructed;
+  object_class->finalize = cog_token_verifier_finalize;
+
+  object_class->set_property = cog_token_verifier_set_property;
+  object_class->get_property = cog_token_verifier_get_property;
+
+  g_object_class_install_property (object_class,
+                                   PROP_USER_POOL_ID,
+                                   g_param_spec_string ("user-pool-id",
+                                                        "User pool ID",
+                                                        "ID of the user pool that issues the tokens",
+                                                        NULL,
+                                                        (GParamFlags)
+                                                        (G_PARAM_CONSTRUCT_ONLY |
+                                                         G_PARAM_READWRITE)));
+
+  g_object_class_install_property (object_class,
+                                   PROP_CLIENT_ID,
+                                   g_param_spec_string ("client-id",
+                                                        "Client ID",
+                                                        "ID of the app client the tokens are issued to",
+                                                        NULL,
+                                                        (GParamFlags)
+                                                        (G_PARAM_CONSTRUCT_ONLY |
+                                                         G_PARAM_READWRITE)));
+
+  /**
+   * CogTokenVerifier:cache-size:
+   *
+   * Maximum number of successfully verified tokens to remember.
+   * If 0, every token is verified from scratch.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_CACHE_SIZE,
+                                   g_param_spec_uint ("cache-size",
+                                                      "Cache size",
+                                                      "Number of verified tokens to remember",
+                                                      0, G_MAXINT,
+                                                      DEFAULT_CACHE_SIZE,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_READWRITE)));
+}
+
+static void
+cog_token_verifier_init (CogTokenVerifier *self)
+{
+  CogTokenVerifierPrivate *priv = GET_PRIVATE (self);
+
+  g_rw_lock_init (&priv->keys_lock);
+  new (&priv->keys) std::shared_ptr<const KeySet> ();
+  for (auto& shard : priv->shards)
+    new (&shard) CacheShard ();
+}
+
+/* PRIVATE */
+
+static KeyRef
+rsa_key_new (const Aws::String& modulus,
+             const Aws::String& exponent)
+{
+  size_t n_length, e_length;
+  g_autofree unsigned char *n =
+    _cog_base64url_decode (modulus.c_str (), modulus.size (), &n_length);
+  g_autofree unsigned char *e =
+    _cog_base64url_decode (exponent.c_str (), exponent.size (), &e_length);
+  if (!n || !e || n_length == 0 || e_length == 0)
+    return nullptr;
+
+  BIGNUM *bn_n = BN_bin2bn (n, n_length, NULL);
+  BIGNUM *bn_e = BN_bin2bn (e, e_length, NULL);
+  RSA *rsa = RSA_new ();
+  if (!bn_n || !bn_e || !rsa || !RSA_set0_key (rsa, bn_n, bn_e, NULL))
+    {
+      BN_free (bn_n);
+      BN_free (bn_e);
+      RSA_free (rsa);
+      return nullptr;
+    }
+
+  EVP_PKEY *key = EVP_PKEY_new ();
+  if (!key || !EVP_PKEY_assign_RSA (key, rsa))
+    {
+      EVP_PKEY_free (key);
+      RSA_free (rsa);
+      return nullptr;
+    }
+
+  return KeyRef (key, EVP_PKEY_free);
+}
+
+static std::shared_ptr<const KeySet>
+parse_jwks (const char *jwks,
+            GError **error)
+{
+  JsonValue json (jwks);
+  if (!json.WasParseSuccessful ())
+    {
+      g_set_error (error, COG_TOKEN_ERROR, COG_TOKEN_ERROR_INVALID_KEYS,
+                   "Key set is not valid JSON: %s",
+                   json.GetErrorMessage ().c_str ());
+      return nullptr;
+    }
+
+  JsonView view = json.View ();
+  if (!view.KeyExists ("keys") || !view.GetObject ("keys").IsListType ())
+    {
+      g_set_error_literal (error, COG_TOKEN_ERROR, COG_TOKEN_ERROR_INVALID_KEYS,
+                           "Key set has no keys");
+      return nullptr;
+    }
+
+  auto keys = Aws::MakeShared<KeySet> (_COG_ALLOCATION_TAG);
+  auto array = view.GetArray ("keys");
+  for (size_t ix = 0; ix < array.GetLength (); ix++)
+    {
+      const JsonView& jwk = array[ix];
+
+      /* Skip keys that can't be used to verify RS256 signatures */
+      if (jwk.GetString ("kty") != "RSA" ||
+          (jwk.KeyExists ("use") && jwk.GetString ("use") != "sig") ||
+          (jwk.KeyExists ("alg") && jwk.GetString ("alg") != "RS256"))
+        continue;
+
+      Aws::String kid = jwk.GetString ("kid");
+      KeyRef key = rsa_key_new (jwk.GetString ("n"), jwk.GetString ("e"));
+      if (kid.empty () || !key)
+        {
+          g_set_error (error, COG_TOKEN_ERROR, COG_TOKEN_ERROR_INVALID_KEYS,
+                       "Key %zu in the key set is not a valid RSA key", ix);
+          return nullptr;
+        }
+      keys->emplace (std::move (kid), std::move (key));
+    }
+
+  return keys;
+}
+
+static gboolean
+verifier_load_keys (CogTokenVerifier *self,
+                    const char *jwks,
+                    GError **error)
+{
+  CogTokenVerifierPrivate *priv = GET_PRIVATE (self);
+
+  std::shared_ptr<const KeySet> keys = parse_jwks (jwks, error);
+  if (!keys)
+    return FALSE;
+
+  g_rw_lock_writer_lock (&priv->keys_lock);
+  priv->keys.swap (keys);
+  g_atomic_int_inc (&priv->keys_generation);
+  g_rw_lock_writer_unlock (&priv->keys_lock);
+
+  /* Tokens verified with a key that was just removed are no longer valid.
+   * The generation already keeps them from being used; this frees them. */
+  for (auto& shard : priv->shards)
+    {
+      g_mutex_lock (&shard.lock);
+      shard.tokens.clear ();
+      g_mutex_unlock (&shard.lock);
+    }
+
+  return TRUE;
+}
+
+/* Sets @generation to the keys_generation of the keys that the key was
+ * looked up in */
+static KeyRef
+verifier_lookup_key (CogTokenVerifier *self,
+                     const Aws::String& kid,
+                     unsigned *generation)
+{
+  CogTokenVerifierPrivate *priv = GET_PRIVATE (self);
+  KeyRef retval;
+
+  g_rw_lock_reader_lock (&priv->keys_lock);
+  *generation = priv->keys_generation;
+  if (priv->keys)
+    {
+      auto found = priv->keys->find (kid);
+      if (found != priv->keys->end ())
+        retval = found->second;
+    }
+  g_rw_lock_reader_unlock (&priv->keys_lock);
+
+  return retval;
+}
+
+/* Decodes one base64url-encoded JSON part of a token */
+static gboolean
+decode_json_part (const char *start,
+                  const char *end,
+                  JsonValue *json)
+{
+  size_t length;
+  g_autofree unsigned char *decoded = _cog_base64url_decode (start, end - start,
+                                                             &length);
+  if (!decoded)
+    return FALSE;
+
+  *json = JsonValue (Aws::String (reinterpret_cast<char *> (decoded), length));
+  return json->WasParseSuccessful ();
+}
+
+static gboolean
+verify_signature (const KeyRef& key,
+                  const char *signed_data,
+                  size_t signed_length,
+                  const char *signature64,
+                  size_t signature64_length)
+{
+  size_t signature_length;
+  g_autofree unsigned char *signature =
+    _cog_base64url_decode (signature64, signature64_length, &signature_length);
+  if (!signature)
+    return FALSE;
+
+  EVP_MD_CTX *ctx = EVP_MD_CTX_new ();
+  gboolean retval = ctx &&
+    EVP_DigestVerifyInit (ctx, NULL, EVP_sha256 (), NULL, key.get ()) == 1 &&
+    EVP_DigestVerify (ctx, signature, signature_length,
+                      reinterpret_cast<const unsigned char *> (signed_data),
+                      signed_length) == 1;
+  EVP_MD_CTX_free (ctx);
+  return retval;
+}
+
+static gboolean
+verifier_verify_uncached (CogTokenVerifier *self,
+                          const char *token,
+                          CogTokenUse token_use,
+                          VerifiedToken *verified,
+                          GError **error)
+{
+  CogTokenVerifierPrivate *priv = GET_PRIVATE (self);
+
+  const char *header_end = strchr (token, '.');
+  const char *payload_end = header_end ? strchr (header_end + 1, '.') : NULL;
+  if (!payload_end || strchr (payload_end + 1, '.'))
+    {
+      g_set_error_literal (error, COG_TOKEN_ERROR, COG_TOKEN_ERROR_MALFORMED,
+                           "Token does not consist of three parts");
+      return FALSE;
+    }
+
+  JsonValue header;
+  if (!decode_json_part (token, header_end, &header) ||
+      header.View ().GetString ("alg") != "RS256")
+    {
+      g_set_error_literal (error, COG_TOKEN_ERROR, COG_TOKEN_ERROR_MALFORMED,
+                           "Token header is invalid or algorithm is not RS256");
+      return FALSE;
+    }
+
+  Aws::String kid = header.View ().GetString ("kid");
+  unsigned keys_generation;
+  KeyRef key = verifier_lookup_key (self, kid, &keys_generation);
+  if (!key)
+    {
+      g_set_error (error, COG_TOKEN_ERROR, COG_TOKEN_ERROR_UNKNOWN_KEY,
+                   "Token is signed with unknown key '%s'", kid.c_str ());
+      return FALSE;
+    }
+
+  if (!verify_signature (key, token, payload_end - token, payload_end + 1,
+                         strlen (payload_end + 1)))
+    {
+      g_set_error_literal (error, COG_TOKEN_ERROR,
+                           COG_TOKEN_ERROR_INVALID_SIGNATURE,
+                           "Token signature does not match");
+      return FALSE;
+    }
+
+  JsonValue payload;
+  if (!decode_json_part (header_end + 1, payload_end, &payload))
+    {
+      g_set_error_literal (error, COG_TOKEN_ERROR, COG_TOKEN_ERROR_MALFORMED,
+                           "Token payload is invalid");
+      return FALSE;
+    }
+  JsonView claims = payload.View ();
+
+  if (!claims.KeyExists ("exp") || !claims.GetObject ("exp").IsIntegerType ())
+    {
+      g_set_error_literal (error, COG_TOKEN_ERROR, COG_TOKEN_ERROR_MALFORMED,
+                           "Token has no expiration time");
+      return FALSE;
+    }
+  gint64 expiration = claims.GetInt64 ("exp");
+  if (expiration <= g_get_real_time () / G_USEC_PER_SEC)
+    {
+      g_set_error_literal (error, COG_TOKEN_ERROR, COG_TOKEN_ERROR_EXPIRED,
+                           "Token has expired");
+      return FALSE;
+    }
+
+  if (claims.GetString ("iss") != priv->issuer)
+    {
+      g_set_error (error, COG_TOKEN_ERROR, COG_TOKEN_ERROR_WRONG_ISSUER,
+                   "Token was not issued by %s", priv->issuer);
+      return FALSE;
+    }
+
+  const char *expected_use = token_use == COG_TOKEN_USE_ID ? "id" : "access";
+  if (claims.GetString ("token_use") != expected_use)
+    {
+      g_set_error (error, COG_TOKEN_ERROR, COG_TOKEN_ERROR_WRONG_TOKEN_USE,
+                   "Token is not an %s token", expected_use);
+      return FALSE;
+    }
+
+  /* Access tokens name the app client in "client_id", ID tokens in "aud" */
+  const char *audience_claim = token_use == COG_TOKEN_USE_ID ? "aud" : "client_id";
+  if (claims.GetString (audience_claim) != priv->client_id)
+    {
+      g_set_error (error, COG_TOKEN_ERROR, COG_TOKEN_ERROR_WRONG_AUDIENCE,
+                   "Token was not issued to client %s", priv->client_id);
+      return FALSE;
+    }
+
+  verified->keys_generation = keys_generation;
+  verified->expiration = expiration;
+  verified->token_use = token_use;
+  verified->subject = claims.GetString ("sub");
+  return TRUE;
+}
+
+/* METHODS */
+
+/**
+ * cog_token_verifier_load_keys_from_data:
+ * @self: the #CogTokenVerifier
+ * @jwks: the JSON Web Key Set of the user pool
+ * @error: error location
+ *
+ * Replaces the verifier's keys with the RS256 signing keys in @jwks.
+ *
+ * Returns: %TRUE if the keys were loaded, %FALSE on error
+ */
+gboolean
+cog_token_verifier_load_keys_from_data (CogTokenVerifier *self,
+                                        const char *jwks,
+                                        GError **error)
+{
+  g_return_val_if_fail (COG_IS_TOKEN_VERIFIER (self), FALSE);
+  g_return_val_if_fail (jwks, FALSE);
+  g_return_val_if_fail (!error || !*error, FALSE);
+
+  return verifier_load_keys (self, jwks, error);
+}
+
+/**
+ * cog_token_verifier_load_keys_from_file:
+ * @self: the #CogTokenVerifier
+ * @path: (type filename): file containing the JSON Web Key Set of the user pool
+ * @error: error location
+ *
+ * Replaces the verifier's keys with the RS256 signing keys in the file @path.
+ *
+ * Returns: %TRUE if the keys were loaded, %FALSE on error
+ */
+gboolean
+cog_token_verifier_load_keys_from_file (CogTokenVerifier *self,
+                                        const char *path,
+                                        GError **error)
+{
+  g_return_val_if_fail (COG_IS_TOKEN_VERIFIER (self), FALSE);
+  g_return_val_if_fail (path, FALSE);
+  g_return_val_if_fail (!error || !*error, FALSE);
+
+  g_autofree char *jwks = NULL;
+  if (!g_file_get_contents (path, &jwks, NULL, error))
+    return FALSE;
+
+  return verifier_load_keys (self, jwks, error);
+}
+
+static void
+fetch_keys_thread (GTask *task,
+                   void *source,
+                   void *task_data G_GNUC_UNUSED,
+                   GCancellable *cancellable G_GNUC_UNUSED)
+{
+  CogTokenVerifier *self = COG_TOKEN_VERIFIER (source);
+  CogTokenVerifierPrivate *priv = GET_PRIVATE (self);
+
+  g_autofree char *url = g_strconcat (priv->issuer, "/.well-known/jwks.json",
+                                      NULL);
+  Aws::Client::ClientConfiguration config;
+  auto http_client = Aws::Http::CreateHttpClient (config);
+  auto request =
+    Aws::Http::CreateHttpRequest (Aws::String (url), HttpMethod::HTTP_GET,
+                                  Aws::Utils::Stream::DefaultResponseStreamFactoryMethod);
+  auto response = http_client->MakeRequest (request);
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  if (!response || response->HasClientError ())
+    {
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                               "Could not fetch %s: %s", url,
+                               response ? response->GetClientErrorMessage ().c_str () : "");
+      return;
+    }
+  if (response->GetResponseCode () != HttpResponseCode::OK)
+    {
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                               "Could not fetch %s: HTTP status %d", url,
+                               int (response->GetResponseCode ()));
+      return;
+    }
+
+  Aws::StringStream body;
+  body << response->GetResponseBody ().rdbuf ();
+
+  GError *error = NULL;
+  if (!verifier_load_keys (self, body.str ().c_str (), &error))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+/**
+ * cog_token_verifier_fetch_keys_async:
+ * @self: the #CogTokenVerifier
+ * @cancellable: (nullable): optional #GCancellable object
+ * @callback: (nullable): a callback to call when the operation is complete
+ * @user_data: (nullable): the data to pass to @callback
+ *
+ * Downloads the user pool's JSON Web Key Set from Cognito, and replaces the
+ * verifier's keys with the RS256 signing keys in it.
+ * User pools rarely change their keys; you may want to fetch them again if a
+ * token fails to verify with %COG_TOKEN_ERROR_UNKNOWN_KEY.
+ *
+ * In your @callback, you must call cog_token_verifier_fetch_keys_finish() to
+ * get the result.
+ */
+void
+cog_token_verifier_fetch_keys_async (CogTokenVerifier *self,
+                                     GCancellable *cancellable,
+                                     GAsyncReadyCallback callback,
+                                     gpointer user_data)
+{
+  g_return_if_fail (COG_IS_TOKEN_VERIFIER (self));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  GTask *task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, (void *) cog_token_verifier_fetch_keys_async);
+  g_task_run_in_thread (task, fetch_keys_thread);
+  g_object_unref (task);
+}
+
+/**
+ * cog_token_verifier_fetch_keys_finish:
+ * @self: the #CogTokenVerifier
+ * @res: the #GAsyncResult passed to your callback
+ * @error: error location
+ *
+ * See cog_token_verifier_fetch_keys_async().
+ *
+ * Returns: %TRUE if the keys were fetched and loaded, %FALSE on error
+ */
+gboolean
+cog_token_verifier_fetch_keys_finish (CogTokenVerifier *self,
+                                      GAsyncResult *res,
+                                      GError **error)
+{
+  g_return_val_if_fail (COG_IS_TOKEN_VERIFIER (self), FALSE);
+  g_return_val_if_fail (g_task_is_valid (res, self), FALSE);
+  g_return_val_if_fail (!error || !*error, FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+/**
+ * cog_token_verifier_get_n_keys:
+ * @self: the #CogTokenVerifier
+ *
+ * Returns: the number of signing keys currently loaded
+ */
+unsigned
+cog_token_verifier_get_n_keys (CogTokenVerifier *self)
+{
+  g_return_val_if_fail (COG_IS_TOKEN_VERIFIER (self), 0);
+
+  CogTokenVerifierPrivate *priv = GET_PRIVATE (self);
+  g_rw_lock_reader_lock (&priv->keys_lock);
+  unsigned retval = priv->keys ? priv->keys->size () : 0;
+  g_rw_lock_reader_unlock (&priv->keys_lock);
+  return retval;
+}
+
+/**
+ * cog_token_verifier_verify:
+ * @self: the #CogTokenVerifier
+ * @token: an access token or ID token issued by the user pool
+ * @token_use: whether @token must be an access token or an ID token
+ * @subject: (out) (optional): location for the `sub` claim of the token,
+ *   which uniquely identifies the user
+ * @error: error location
+ *
+ * Checks that @token was signed by one of the loaded keys, has not expired,
+ * was issued by #CogTokenVerifier:user-pool-id to #CogTokenVerifier:client-id,
+ * and is of the kind given by @token_use.
+ *
+ * Returns: %TRUE if @token is valid, %FALSE with a #CogTokenError otherwise
+ */
+gboolean
+cog_token_verifier_verify (CogTokenVerifier *self,
+                           const char *token,
+                           CogTokenUse token_use,
+                           char **subject,
+                           GError **error)
+{
+  g_return_val_if_fail (COG_IS_TOKEN_VERIFIER (self), FALSE);
+  g_return_val_if_fail (token, FALSE);
+  g_return_val_if_fail (!error || !*error, FALSE);
+
+  CogTokenVerifierPrivate *priv = GET_PRIVATE (self);
+
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  SHA256 (reinterpret_cast<const unsigned char *> (token), strlen (token),
+          digest);
+  Aws::String cache_key (reinterpret_cast<char *> (digest), sizeof digest);
+  CacheShard& shard = priv->shards[digest[0] % N_CACHE_SHARDS];
+
+  if (priv->cache_size > 0)
+    {
+      gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+      bool found = false;
+
+      g_mutex_lock (&shard.lock);
+      auto entry = shard.tokens.find (cache_key);
+      if (entry != shard.tokens.end ())
+        {
+          if (entry->second.expiration <= now ||
+              entry->second.keys_generation !=
+                unsigned (g_atomic_int_get (&priv->keys_generation)))
+            {
+              shard.tokens.erase (entry);
+            }
+          else if (entry->second.token_use == token_use)
+            {
+              found = true;
+              if (subject)
+                *subject = g_strdup (entry->second.subject.c_str ());
+            }
+        }
+      g_mutex_unlock (&shard.lock);
+
+      if (found)
+        return TRUE;
+    }
+
+  VerifiedToken verified;
+  if (!verifier_verify_uncached (self, token, token_use, &verified, error))
+    return FALSE;
+
+  if (subject)
+    *subject = g_strdup (verified.subject.c_str ());
+
+  if (priv->cache_size > 0)
+    {
+      size_t shard_capacity = MAX (1, priv->cache_size / N_CACHE_SHARDS);
+      gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+
+      g_mutex_lock (&shard.lock);
+      if (verified.keys_generation !=
+          unsigned (g_atomic_int_get (&priv->keys_generation)))
+        {
+          /* The keys were replaced while verifying */
+          g_mutex_unlock (&shard.lock);
+          return TRUE;
+        }
+      if (shard.tokens.size () >= shard_capacity)
+        {
+          /* Make room by dropping expired tokens, or else an arbitrary one */
+          for (auto iter = shard.tokens.begin (); iter != shard.tokens.end (); )
+            {
+              if (iter->second.expiration <= now)
+                iter = shard.tokens.erase (iter);
+              else
+                ++iter;
+            }
+          if (shard.tokens.size () >= shard_capacity)
+            shard.tokens.erase (shard.tokens.begin ());
+        }
+      shard.tokens.emplace (std::move (cache_key), std::move (verified));
+      g_mutex_unlock (&shard.lock);
+    }
+
+  return TRUE;
+}
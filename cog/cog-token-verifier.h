@@ -0,0 +1,112 @@
+#pragma once
+
+#if !(defined(_COG_INSIDE_COG_H) || defined(COMPILING_LIBCOG))
+#error "Please do not include this header file directly."
+#endif
+
+#include <glib-object.h>
+#include <gio/gio.h>
+
+#include "cog/cog-macros.h"
+
+G_BEGIN_DECLS
+
+/**
+ * CogTokenUse:
+ * @COG_TOKEN_USE_ACCESS: An access token, as in
+ *   #CogAuthenticationResult:access-token.
+ * @COG_TOKEN_USE_ID: An ID token, as in #CogAuthenticationResult:id-token.
+ *
+ * The kind of token to verify, as given by its `token_use` claim.
+ */
+typedef enum {
+  COG_TOKEN_USE_ACCESS,
+  COG_TOKEN_USE_ID,
+} CogTokenUse;
+
+/**
+ * CogTokenError:
+ * @COG_TOKEN_ERROR_MALFORMED: The token is not a well-formed JSON Web Token,
+ *   or is not signed with RS256.
+ * @COG_TOKEN_ERROR_UNKNOWN_KEY: The token is signed with a key that is not in
+ *   the loaded key set.
+ * @COG_TOKEN_ERROR_INVALID_SIGNATURE: The token's signature does not match.
+ * @COG_TOKEN_ERROR_EXPIRED: The token has expired.
+ * @COG_TOKEN_ERROR_WRONG_ISSUER: The token was not issued by the expected user
+ *   pool.
+ * @COG_TOKEN_ERROR_WRONG_AUDIENCE: The token was not issued to the expected
+ *   app client.
+ * @COG_TOKEN_ERROR_WRONG_TOKEN_USE: The token is not of the expected
+ *   #CogTokenUse.
+ * @COG_TOKEN_ERROR_INVALID_KEYS: A key set could not be loaded.
+ *
+ * Reasons why a token could not be verified.
+ */
+typedef enum {
+  COG_TOKEN_ERROR_MALFORMED,
+  COG_TOKEN_ERROR_UNKNOWN_KEY,
+  COG_TOKEN_ERROR_INVALID_SIGNATURE,
+  COG_TOKEN_ERROR_EXPIRED,
+  COG_TOKEN_ERROR_WRONG_ISSUER,
+  COG_TOKEN_ERROR_WRONG_AUDIENCE,
+  COG_TOKEN_ERROR_WRONG_TOKEN_USE,
+  COG_TOKEN_ERROR_INVALID_KEYS,
+} CogTokenError;
+
+/**
+ * COG_TOKEN_ERROR:
+ *
+ * Error domain for the #CogTokenError enumeration.
+ */
+#define COG_TOKEN_ERROR cog_token_error_quark ()
+
+COG_AVAILABLE_IN_ALL
+GQuark cog_token_error_quark (void);
+
+#define COG_TYPE_TOKEN_VERIFIER (cog_token_verifier_get_type())
+
+COG_AVAILABLE_IN_ALL
+G_DECLARE_FINAL_TYPE (CogTokenVerifier, cog_token_verifier, COG,
+                      TOKEN_VERIFIER, GObject)
+
+struct _CogTokenVerifierClass
+{
+  GObjectClass parent_class;
+};
+
+COG_AVAILABLE_IN_ALL
+CogTokenVerifier *cog_token_verifier_new (const char *user_pool_id,
+                                          const char *client_id);
+
+COG_AVAILABLE_IN_ALL
+gboolean cog_token_verifier_load_keys_from_data (CogTokenVerifier *self,
+                                                 const char *jwks,
+                                                 GError **error);
+
+COG_AVAILABLE_IN_ALL
+gboolean cog_token_verifier_load_keys_from_file (CogTokenVerifier *self,
+                                                 const char *path,
+                                                 GError **error);
+
+COG_AVAILABLE_IN_ALL
+void cog_token_verifier_fetch_keys_async (CogTokenVerifier *self,
+                                          GCancellable *cancellable,
+                                          GAsyncReadyCallback callback,
+                                          gpointer user_data);
+
+COG_AVAILABLE_IN_ALL
+gboolean cog_token_verifier_fetch_keys_finish (CogTokenVerifier *self,
+                                               GAsyncResult *res,
+                                               GError **error);
+
+COG_AVAILABLE_IN_ALL
+unsigned cog_token_verifier_get_n_keys (CogTokenVerifier *self);
+
+COG_AVAILABLE_IN_ALL
+gboolean cog_token_verifier_verify (CogTokenVerifier *self,
+                                    const char *token,
+                                    CogTokenUse token_use,
+                                    char **subject,
+                                    GError **error);
+
+G_END_DECLS
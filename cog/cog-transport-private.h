@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory>
+
+#include <aws/core/http/HttpClient.h>
+#include <aws/core/http/HttpClientFactory.h>
+
+#include "cog/cog-transport.h"
+
+/* The HTTP client factory that libcog installs in the AWS SDK. It creates the
+ * SDK's default HTTP client, unless a #CogTransportScope with a transport is
+ * active on the calling thread. */
+std::shared_ptr<Aws::Http::HttpClientFactory> _cog_http_client_factory_new (bool init_curl);
+
+/* Wrap the construction of an SDK service client in one of these, to route
+ * its HTTP requests through @transport (which may be NULL for the default HTTP
+ * client). Afterwards, http_client() is the HTTP client that the service
+ * client was given, and network_client() is the one underneath it that talks
+ * to the network, which is null if @transport is replaying. */
+class CogTransportScope {
+  CogTransport *m_transport;
+  CogTransportScope *m_previous;
+  std::shared_ptr<Aws::Http::HttpClient> m_http_client;
+  std::shared_ptr<Aws::Http::HttpClient> m_network_client;
+
+  friend class CogHttpClientFactory;
+public:
+  explicit CogTransportScope (CogTransport *transport);
+  ~CogTransportScope ();
+  std::shared_ptr<Aws::Http::HttpClient> http_client (void) const { return m_http_client; }
+  std::shared_ptr<Aws::Http::HttpClient> network_client (void) const { return m_network_client; }
+};
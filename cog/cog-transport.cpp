@@ -0,0 +1,830 @@
+/**
+ * SECTION:transport
+ * @title: CogTransport
+ * @short_description: Record and replay HTTP exchanges with Cognito
+ *
+ * A #CogTransport sits between a #CogClient and the network.
+ * Pass it to #CogClient:transport when creating a client.
+ *
+ * In %COG_TRANSPORT_MODE_RECORD mode, requests are sent over the network as
+ * usual, and each request and its response are recorded in memory.
+ * Call cog_transport_save() to write them to a compact binary file.
+ *
+ * In %COG_TRANSPORT_MODE_REPLAY mode, the recorded exchanges are loaded from
+ * that file, and requests are answered from memory without ever touching the
+ * network, optionally after an artificial delay given by
+ * #CogTransport:latency.
+ * A request is answered with the exchange that has the same operation and the
+ * same request body; if there is none, the exchanges recorded for the same
+ * operation are served in turn.
+ * This makes it possible to measure the overhead of Libcog itself with
+ * repeatable results.
+ *
+ * Recordings contain request bodies verbatim, including any passwords and
+ * tokens, so treat them as secrets.
+ *
+ * With #CogTransport:keep-requests, a transport also keeps each request that
+ * it handles, so that tests can check what a client sends; see
+ * cog_transport_get_requests().
+ *
+ * Transports only take effect if the AWS SDK was initialized with
+ * cog_init_default().
+ *
+ * The file is a serialized #GVariant of type `(sua(ssqa{ss}ay))`: a magic
+ * string, a format version, and an array of exchanges consisting of the
+ * operation name, request body, HTTP status, response headers, and response
+ * body.
+ */
+
+#include <string.h>
+
+#include <utility>
+
+#include <aws/core/client/ClientConfiguration.h>
+#include <aws/core/client/CoreErrors.h>
+#include <aws/core/http/HttpRequest.h>
+#include <aws/core/http/HttpResponse.h>
+#include <aws/core/http/URI.h>
+#include <aws/core/http/curl/CurlHttpClient.h>
+#include <aws/core/http/standard/StandardHttpRequest.h>
+#include <aws/core/http/standard/StandardHttpResponse.h>
+#include <aws/core/utils/memory/stl/AWSMap.h>
+#include <aws/core/utils/memory/stl/AWSStringStream.h>
+#include <aws/core/utils/memory/stl/AWSVector.h>
+#include <gio/gio.h>
+
+#include "cog/cog-enums.h"
+#include "cog/cog-transport.h"
+#include "cog/cog-transport-private.h"
+#include "cog/cog-utils-private.h"
+
+#define GET_PRIVATE(o) (static_cast<CogTransportPrivate *> (cog_transport_get_instance_private (COG_TRANSPORT (o))))
+
+#define FILE_MAGIC "libcog-transport"
+#define FILE_VERSION 1
+#define EXCHANGE_FORMAT "(ssqa{ss}ay)"
+#define FILE_FORMAT "(sua" EXCHANGE_FORMAT ")"
+
+#define TARGET_HEADER "x-amz-target"
+
+/* How often a simulated round trip checks whether it has been aborted */
+#define ABORT_CHECK_INTERVAL_USEC 1000
+
+using Aws::Client::ClientConfiguration;
+using Aws::Client::CoreErrors;
+using Aws::Http::CurlHttpClient;
+using Aws::Http::HttpClient;
+using Aws::Http::HttpMethod;
+using Aws::Http::HttpRequest;
+using Aws::Http::HttpResponse;
+using Aws::Http::HttpResponseCode;
+using Aws::Http::Standard::StandardHttpRequest;
+using Aws::Http::Standard::StandardHttpResponse;
+using Aws::Http::URI;
+using Aws::Utils::RateLimits::RateLimiterInterface;
+
+struct Exchange
+{
+  Aws::String target;
+  Aws::String request_body;
+  HttpResponseCode status;
+  Aws::Vector<std::pair<Aws::String, Aws::String>> headers;
+  Aws::String response_body;
+};
+
+struct SentRequest
+{
+  Aws::String target;
+  Aws::Vector<std::pair<Aws::String, Aws::String>> headers;
+  Aws::String body;
+};
+
+struct ReplayCursor
+{
+  Aws::Vector<size_t> exchanges;
+  size_t next;
+};
+
+typedef struct
+{
+  CogTransportMode mode;
+  char *path;
+  unsigned latency;
+  int keep_requests;
+
+  GMutex lock;
+  Aws::Vector<Exchange> exchanges;
+  Aws::Vector<SentRequest> requests;
+  /* Replay indexes into @exchanges; keys of @by_request are the operation
+   * name and request body separated by a newline */
+  Aws::UnorderedMap<Aws::String, size_t> by_request;
+  Aws::UnorderedMap<Aws::String, ReplayCursor> by_target;
+} CogTransportPrivate;
+
+struct _CogTransport {
+  GObject parent_instance;
+};
+
+static void cog_transport_initable_iface_init (GInitableIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (CogTransport, cog_transport, G_TYPE_OBJECT,
+                         G_ADD_PRIVATE (CogTransport)
+                         G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE,
+                                                cog_transport_initable_iface_init))
+
+enum {
+  PROP_MODE = 1,
+  PROP_PATH,
+  PROP_LATENCY,
+  PROP_KEEP_REQUESTS,
+  N_PROPERTIES
+};
+
+static void
+cog_transport_set_property (GObject *object,
+                            unsigned property_id,
+                            const GValue *value,
+                            GParamSpec *pspec)
+{
+  CogTransport *self = COG_TRANSPORT (object);
+  CogTransportPrivate *priv = GET_PRIVATE (self);
+
+  switch (property_id) {
+    case PROP_MODE:
+      priv->mode = (CogTransportMode) g_value_get_enum (value);
+      break;
+    case PROP_PATH:
+      priv->path = g_value_dup_string (value);
+      break;
+    case PROP_LATENCY:
+      g_atomic_int_set (&priv->latency, g_value_get_uint (value));
+      break;
+    case PROP_KEEP_REQUESTS:
+      g_atomic_int_set (&priv->keep_requests, g_value_get_boolean (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+cog_transport_get_property (GObject *object,
+                            unsigned property_id,
+                            GValue *value,
+                            GParamSpec *pspec)
+{
+  CogTransport *self = COG_TRANSPORT (object);
+  CogTransportPrivate *priv = GET_PRIVATE (self);
+
+  switch (property_id) {
+    case PROP_MODE:
+      g_value_set_enum (value, priv->mode);
+      break;
+    case PROP_PATH:
+      g_value_set_string (value, priv->path);
+      break;
+    case PROP_LATENCY:
+      g_value_set_uint (value, g_atomic_int_get (&priv->latency));
+      break;
+    case PROP_KEEP_REQUESTS:
+      g_value_set_boolean (value, g_atomic_int_get (&priv->keep_requests));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+/**
+ * cog_transport_new_recorder:
+ * @path: (type filename): file to save the recorded exchanges to
+ *
+ * Create a new transport that sends requests over the network and records
+ * them.
+ * The recording is written to @path when you call cog_transport_save().
+ *
+ * Returns: (transfer full): a newly created #CogTransport
+ */
+CogTransport *
+cog_transport_new_recorder (const char *path)
+{
+  g_return_val_if_fail (path, NULL);
+
+  return COG_TRANSPORT (g_initable_new (COG_TYPE_TRANSPORT, NULL, NULL,
+                                        "mode", COG_TRANSPORT_MODE_RECORD,
+                                        "path", path,
+                                        NULL));
+}
+
+/**
+ * cog_transport_new_replayer:
+ * @path: (type filename): file containing recorded exchanges
+ * @error: error location
+ *
+ * Create a new transport that answers requests from the exchanges previously
+ * recorded in @path.
+ *
+ * Returns: (transfer full): a newly created #CogTransport, or %NULL if @path
+ *   could not be loaded
+ */
+CogTransport *
+cog_transport_new_replayer (const char *path,
+                            GError **error)
+{
+  g_return_val_if_fail (path, NULL);
+  g_return_val_if_fail (!error || !*error, NULL);
+
+  return COG_TRANSPORT (g_initable_new (COG_TYPE_TRANSPORT, NULL, error,
+                                        "mode", COG_TRANSPORT_MODE_REPLAY,
+                                        "path", path,
+                                        NULL));
+}
+
+static void
+transport_index_exchanges (CogTransportPrivate *priv)
+{
+  for (size_t ix = 0; ix < priv->exchanges.size (); ix++)
+    {
+      const Exchange& exchange = priv->exchanges[ix];
+      priv->by_request.emplace (exchange.target + '\n' + exchange.request_body,
+                                ix);
+      priv->by_target[exchange.target].exchanges.push_back (ix);
+    }
+}
+
+static gboolean
+transport_load (CogTransport *self,
+                GError **error)
+{
+  CogTransportPrivate *priv = GET_PRIVATE (self);
+
+  g_autoptr(GMappedFile) file = g_mapped_file_new (priv->path, FALSE, error);
+  if (!file)
+    return FALSE;
+
+  g_autoptr(GBytes) bytes = g_mapped_file_get_bytes (file);
+  g_autoptr(GVariant) contents =
+    g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (FILE_FORMAT),
+                                                  bytes, FALSE));
+  /* Recordings are always stored little-endian */
+  if (G_BYTE_ORDER == G_BIG_ENDIAN)
+    {
+      GVariant *swapped = g_variant_byteswap (contents);
+      g_variant_unref (contents);
+      contents = swapped;
+    }
+
+  const char *magic;
+  guint32 version;
+  g_autoptr(GVariantIter) iter = NULL;
+  g_variant_get (contents, "(&sua" EXCHANGE_FORMAT ")", &magic, &version,
+                 &iter);
+  if (strcmp (magic, FILE_MAGIC) != 0 || version != FILE_VERSION)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "%s is not a recording in a format supported by Libcog",
+                   priv->path);
+      return FALSE;
+    }
+
+  const char *target, *request_body;
+  guint16 status;
+  GVariantIter *headers_iter;
+  GVariant *body;
+  while (g_variant_iter_next (iter, "(&s&sqa{ss}@ay)", &target, &request_body,
+                              &status, &headers_iter, &body))
+    {
+      Exchange exchange;
+      exchange.target = target;
+      exchange.request_body = request_body;
+      exchange.status = HttpResponseCode (status);
+
+      const char *name, *value;
+      while (g_variant_iter_next (headers_iter, "{&s&s}", &name, &value))
+        exchange.headers.emplace_back (name, value);
+      g_variant_iter_free (headers_iter);
+
+      size_t length;
+      auto *data = static_cast<const char *> (g_variant_get_fixed_array (body,
+                                                                         &length,
+                                                                         1));
+      exchange.response_body.assign (data, length);
+      g_variant_unref (body);
+
+      priv->exchanges.push_back (std::move (exchange));
+    }
+
+  transport_index_exchanges (priv);
+  return TRUE;
+}
+
+static gboolean
+cog_transport_initable_init (GInitable *initable,
+                             GCancellable *cancellable G_GNUC_UNUSED,
+                             GError **error)
+{
+  CogTransportPrivate *priv = GET_PRIVATE (initable);
+
+  if (priv->mode != COG_TRANSPORT_MODE_REPLAY)
+    return TRUE;
+
+  return transport_load (COG_TRANSPORT (initable), error);
+}
+
+static void
+cog_transport_initable_iface_init (GInitableIface *iface)
+{
+  iface->init = cog_transport_initable_init;
+}
+
+static void
+cog_transport_finalize (GObject *object)
+{
+  CogTransportPrivate *priv = GET_PRIVATE (object);
+
+  g_clear_pointer (&priv->path, g_free);
+  g_mutex_clear (&priv->lock);
+  priv->exchanges.~vector ();
+  priv->requests.~vector ();
+  priv->by_request.~unordered_map ();
+  priv->by_target.~unordered_map ();
+
+  G_OBJECT_CLASS (cog_transport_parent_class)->finalize (object);
+}
+
+static void
+cog_transport_class_init (CogTransportClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = cog_transport_finalize;
+
+  object_class->set_property = cog_transport_set_property;
+  object_class->get_property = cog_transport_get_property;
+
+  g_object_class_install_property (object_class,
+                                   PROP_MODE,
+                                   g_param_spec_enum ("mode",
+                                                      "Mode",
+                                                      "Whether to record or replay",
+                                                      COG_TYPE_TRANSPORT_MODE,
+                                                      COG_TRANSPORT_MODE_RECORD,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_READWRITE)));
+
+  g_object_class_install_property (object_class,
+                                   PROP_PATH,
+                                   g_param_spec_string ("path",
+                                                        "Path",
+                                                        "File holding the recorded exchanges",
+                                                        NULL,
+                                                        (GParamFlags)
+                                                        (G_PARAM_CONSTRUCT_ONLY |
+                                                         G_PARAM_READWRITE)));
+
+  /**
+   * CogTransport:latency:
+   *
+   * In %COG_TRANSPORT_MODE_REPLAY mode, the time in microseconds to wait
+   * before answering each request, to simulate a network round trip.
+   * Like a real request, the wait ends early if the request is aborted, for
+   * example by cancelling its #GCancellable.
+   * Ignored in %COG_TRANSPORT_MODE_RECORD mode.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_LATENCY,
+                                   g_param_spec_uint ("latency",
+                                                      "Latency",
+                                                      "Simulated round-trip time in microseconds",
+                                                      0, G_MAXUINT, 0,
+                                                      (GParamFlags)
+                                                      (G_PARAM_CONSTRUCT |
+                                                       G_PARAM_READWRITE)));
+
+  /**
+   * CogTransport:keep-requests:
+   *
+   * Whether to keep a copy of each request that the transport handles, in
+   * either mode, for cog_transport_get_requests().
+   * Off by default, since the copies are never freed while the transport
+   * lives.
+   */
+  g_object_class_install_property (object_class,
+                                   PROP_KEEP_REQUESTS,
+                                   g_param_spec_boolean ("keep-requests",
+                                                         "Keep requests",
+                                                         "Whether to keep the requests handled",
+                                                         FALSE,
+                                                         (GParamFlags)
+                                                         (G_PARAM_CONSTRUCT |
+                                                          G_PARAM_READWRITE)));
+}
+
+static void
+cog_transport_init (CogTransport *self)
+{
+  CogTransportPrivate *priv = GET_PRIVATE (self);
+
+  g_mutex_init (&priv->lock);
+  new (&priv->exchanges) Aws::Vector<Exchange> ();
+  new (&priv->requests) Aws::Vector<SentRequest> ();
+  new (&priv->by_request) Aws::UnorderedMap<Aws::String, size_t> ();
+  new (&priv->by_target) Aws::UnorderedMap<Aws::String, ReplayCursor> ();
+}
+
+/* METHODS */
+
+/**
+ * cog_transport_save:
+ * @self: the #CogTransport
+ * @error: error location
+ *
+ * Writes all exchanges recorded so far to #CogTransport:path.
+ * Only valid in %COG_TRANSPORT_MODE_RECORD mode.
+ *
+ * Returns: %TRUE if the file was written successfully, %FALSE on error
+ */
+gboolean
+cog_transport_save (CogTransport *self,
+                    GError **error)
+{
+  g_return_val_if_fail (COG_IS_TRANSPORT (self), FALSE);
+  g_return_val_if_fail (!error || !*error, FALSE);
+
+  CogTransportPrivate *priv = GET_PRIVATE (self);
+  g_return_val_if_fail (priv->mode == COG_TRANSPORT_MODE_RECORD, FALSE);
+
+  GVariantBuilder builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a" EXCHANGE_FORMAT));
+
+  g_mutex_lock (&priv->lock);
+  for (auto& exchange : priv->exchanges)
+    {
+      GVariantBuilder headers;
+      g_variant_builder_init (&headers, G_VARIANT_TYPE ("a{ss}"));
+      for (auto& header : exchange.headers)
+        g_variant_builder_add (&headers, "{ss}", header.first.c_str (),
+                               header.second.c_str ());
+
+      GVariant *body =
+        g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE,
+                                   exchange.response_body.data (),
+                                   exchange.response_body.size (), 1);
+      g_variant_builder_add (&builder, "(ssqa{ss}@ay)",
+                             exchange.target.c_str (),
+                             exchange.request_body.c_str (),
+                             guint16 (exchange.status), &headers, body);
+    }
+  g_mutex_unlock (&priv->lock);
+
+  g_autoptr(GVariant) contents =
+    g_variant_ref_sink (g_variant_new ("(su@a" EXCHANGE_FORMAT ")", FILE_MAGIC,
+                                       FILE_VERSION,
+                                       g_variant_builder_end (&builder)));
+  if (G_BYTE_ORDER == G_BIG_ENDIAN)
+    {
+      GVariant *swapped = g_variant_byteswap (contents);
+      g_variant_unref (contents);
+      contents = swapped;
+    }
+
+  return g_file_set_contents (priv->path,
+                              static_cast<const char *> (g_variant_get_data (contents)),
+                              g_variant_get_size (contents), error);
+}
+
+/**
+ * cog_transport_get_mode:
+ * @self: the #CogTransport
+ *
+ * Returns: the value of #CogTransport:mode
+ */
+CogTransportMode
+cog_transport_get_mode (CogTransport *self)
+{
+  g_return_val_if_fail (COG_IS_TRANSPORT (self), COG_TRANSPORT_MODE_RECORD);
+  return GET_PRIVATE (self)->mode;
+}
+
+/**
+ * cog_transport_get_n_exchanges:
+ * @self: the #CogTransport
+ *
+ * Returns: the number of exchanges recorded so far, or loaded from the
+ *   recording
+ */
+unsigned
+cog_transport_get_n_exchanges (CogTransport *self)
+{
+  g_return_val_if_fail (COG_IS_TRANSPORT (self), 0);
+
+  CogTransportPrivate *priv = GET_PRIVATE (self);
+  g_mutex_lock (&priv->lock);
+  unsigned retval = priv->exchanges.size ();
+  g_mutex_unlock (&priv->lock);
+  return retval;
+}
+
+/**
+ * cog_transport_get_requests:
+ * @self: the #CogTransport
+ *
+ * Returns the requests that @self has handled so far, in the order in which
+ * they were made, if #CogTransport:keep-requests was set when they were made.
+ * The result is a #GVariant of type `a(sa{ss}s)`: for each request, the
+ * operation name, the HTTP headers with lowercase names, and the body.
+ * Like a recording, it contains any passwords and tokens that were sent.
+ *
+ * Returns: (transfer full): the requests
+ */
+GVariant *
+cog_transport_get_requests (CogTransport *self)
+{
+  g_return_val_if_fail (COG_IS_TRANSPORT (self), NULL);
+
+  CogTransportPrivate *priv = GET_PRIVATE (self);
+  GVariantBuilder builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sa{ss}s)"));
+
+  g_mutex_lock (&priv->lock);
+  for (auto& request : priv->requests)
+    {
+      GVariantBuilder headers;
+      g_variant_builder_init (&headers, G_VARIANT_TYPE ("a{ss}"));
+      for (auto& header : request.headers)
+        g_variant_builder_add (&headers, "{ss}", header.first.c_str (),
+                               header.second.c_str ());
+      g_variant_builder_add (&builder, "(sa{ss}s)", request.target.c_str (),
+                             &headers, request.body.c_str ());
+    }
+  g_mutex_unlock (&priv->lock);
+
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+/* PRIVATE */
+
+/* Reads the whole of @stream and rewinds it, so that it can be read again by
+ * its owner. */
+static Aws::String
+read_and_rewind (Aws::IOStream& stream)
+{
+  Aws::StringStream contents;
+  contents << stream.rdbuf ();
+  stream.clear ();
+  stream.seekg (0);
+  return contents.str ();
+}
+
+static Aws::String
+request_body (const HttpRequest& request)
+{
+  auto stream = request.GetContentBody ();
+  if (!stream)
+    return "";
+  return read_and_rewind (*stream);
+}
+
+static Aws::String
+request_target (const HttpRequest& request)
+{
+  if (!request.HasHeader (TARGET_HEADER))
+    return "";
+  return request.GetHeaderValue (TARGET_HEADER);
+}
+
+/* Keeps a copy of @request if #CogTransport:keep-requests is set */
+static void
+transport_keep_request (CogTransport *self,
+                        const HttpRequest& request,
+                        const Aws::String& target,
+                        const Aws::String& body)
+{
+  CogTransportPrivate *priv = GET_PRIVATE (self);
+
+  if (!g_atomic_int_get (&priv->keep_requests))
+    return;
+
+  SentRequest kept;
+  kept.target = target;
+  kept.body = body;
+  for (auto& header : request.GetHeaders ())
+    kept.headers.emplace_back (header.first, header.second);
+
+  g_mutex_lock (&priv->lock);
+  priv->requests.push_back (std::move (kept));
+  g_mutex_unlock (&priv->lock);
+}
+
+static std::shared_ptr<HttpResponse>
+transport_record (CogTransport *self,
+                  const HttpClient& network,
+                  const std::shared_ptr<HttpRequest>& request,
+                  RateLimiterInterface *read_limiter,
+                  RateLimiterInterface *write_limiter)
+{
+  CogTransportPrivate *priv = GET_PRIVATE (self);
+
+  Exchange exchange;
+  exchange.target = request_target (*request);
+  exchange.request_body = request_body (*request);
+  transport_keep_request (self, *request, exchange.target,
+                          exchange.request_body);
+
+  auto response = network.MakeRequest (request, read_limiter, write_limiter);
+  if (!response || response->HasClientError ())
+    return response;
+
+  exchange.status = response->GetResponseCode ();
+  for (auto& header : response->GetHeaders ())
+    exchange.headers.emplace_back (header.first, header.second);
+  exchange.response_body = read_and_rewind (response->GetResponseBody ());
+
+  g_mutex_lock (&priv->lock);
+  priv->exchanges.push_back (std::move (exchange));
+  g_mutex_unlock (&priv->lock);
+
+  return response;
+}
+
+static const Exchange *
+transport_find_exchange (CogTransportPrivate *priv,
+                         const Aws::String& target,
+                         const Aws::String& body)
+{
+  auto exact = priv->by_request.find (target + '\n' + body);
+  if (exact != priv->by_request.end ())
+    return &priv->exchanges[exact->second];
+
+  auto cursor = priv->by_target.find (target);
+  if (cursor == priv->by_target.end ())
+    return nullptr;
+
+  g_mutex_lock (&priv->lock);
+  size_t ix = cursor->second.exchanges[cursor->second.next];
+  cursor->second.next = (cursor->second.next + 1) % cursor->second.exchanges.size ();
+  g_mutex_unlock (&priv->lock);
+
+  return &priv->exchanges[ix];
+}
+
+static bool
+request_aborted (const HttpRequest& request)
+{
+  auto& handler = request.GetContinueRequestHandler ();
+  return handler && !handler (&request);
+}
+
+static std::shared_ptr<HttpResponse>
+transport_replay (CogTransport *self,
+                  const std::shared_ptr<HttpRequest>& request)
+{
+  CogTransportPrivate *priv = GET_PRIVATE (self);
+  auto response = Aws::MakeShared<StandardHttpResponse> (_COG_ALLOCATION_TAG,
+                                                         request);
+
+  Aws::String body = request_body (*request);
+  Aws::String target = request_target (*request);
+  transport_keep_request (self, *request, target, body);
+  auto& data_sent = request->GetDataSentEventHandler ();
+  if (data_sent)
+    data_sent (request.get (), body.size ());
+
+  gint64 deadline = g_get_monotonic_time () + g_atomic_int_get (&priv->latency);
+  gint64 now;
+  while (!request_aborted (*request) &&
+         (now = g_get_monotonic_time ()) < deadline)
+    g_usleep (MIN (deadline - now, ABORT_CHECK_INTERVAL_USEC));
+
+  if (request_aborted (*request))
+    {
+      response->SetClientErrorType (CoreErrors::USER_CANCELLED);
+      response->SetClientErrorMessage ("Request cancelled");
+      return response;
+    }
+
+  const Exchange *exchange = transport_find_exchange (priv, target, body);
+  /* The SDK retries NETWORK_CONNECTION errors, but a missing recording will
+   * not turn up on the next attempt */
+  if (!exchange)
+    {
+      response->SetClientErrorType (CoreErrors::RESOURCE_NOT_FOUND);
+      response->SetClientErrorMessage ("No recorded exchange for " + target);
+      return response;
+    }
+
+  response->SetResponseCode (exchange->status);
+  for (auto& header : exchange->headers)
+    response->AddHeader (header.first, header.second);
+  response->GetResponseBody ().write (exchange->response_body.data (),
+                                      exchange->response_body.size ());
+
+  auto& data_received = request->GetDataReceivedEventHandler ();
+  if (data_received)
+    data_received (request.get (), response.get (),
+                   exchange->response_body.size ());
+  return response;
+}
+
+class CogTransportHttpClient : public HttpClient {
+  CogTransport *m_transport;
+  std::shared_ptr<HttpClient> m_network;
+public:
+  CogTransportHttpClient (CogTransport *transport,
+                          std::shared_ptr<HttpClient> network)
+    : m_transport (COG_TRANSPORT (g_object_ref (transport))),
+      m_network (std::move (network)) {}
+  ~CogTransportHttpClient () { g_object_unref (m_transport); }
+
+  std::shared_ptr<HttpResponse>
+  MakeRequest (const std::shared_ptr<HttpRequest>& request,
+               RateLimiterInterface *read_limiter = nullptr,
+               RateLimiterInterface *write_limiter = nullptr) const override
+  {
+    if (m_network)
+      return transport_record (m_transport, *m_network, request, read_limiter,
+                               write_limiter);
+    return transport_replay (m_transport, request);
+  }
+};
+
+static thread_local CogTransportScope *current_scope = nullptr;
+
+CogTransportScope::CogTransportScope (CogTransport *transport)
+  : m_transport (transport), m_previous (current_scope)
+{
+  current_scope = this;
+}
+
+CogTransportScope::~CogTransportScope ()
+{
+  current_scope = m_previous;
+}
+
+class CogHttpClientFactory : public Aws::Http::HttpClientFactory {
+  bool m_init_curl;
+public:
+  explicit CogHttpClientFactory (bool init_curl) : m_init_curl (init_curl) {}
+
+  std::shared_ptr<HttpClient>
+  CreateHttpClient (const ClientConfiguration& config) const override
+  {
+    CogTransport *transport = current_scope ? current_scope->m_transport : NULL;
+    std::shared_ptr<HttpClient> client;
+
+    if (!transport || cog_transport_get_mode (transport) == COG_TRANSPORT_MODE_RECORD)
+      client = Aws::MakeShared<CurlHttpClient> (_COG_ALLOCATION_TAG, config);
+    std::shared_ptr<HttpClient> network_client = client;
+    if (transport)
+      client = Aws::MakeShared<CogTransportHttpClient> (_COG_ALLOCATION_TAG,
+                                                        transport, client);
+
+    if (current_scope)
+      {
+        current_scope->m_http_client = client;
+        current_scope->m_network_client = network_client;
+      }
+    return client;
+  }
+
+  std::shared_ptr<HttpRequest>
+  CreateHttpRequest (const Aws::String& uri,
+                     HttpMethod method,
+                     const Aws::IOStreamFactory& stream_factory) const override
+  {
+    return CreateHttpRequest (URI (uri), method, stream_factory);
+  }
+
+  std::shared_ptr<HttpRequest>
+  CreateHttpRequest (const URI& uri,
+                     HttpMethod method,
+                     const Aws::IOStreamFactory& stream_factory) const override
+  {
+    auto request = Aws::MakeShared<StandardHttpRequest> (_COG_ALLOCATION_TAG,
+                                                         uri, method);
+    request->SetResponseStreamFactory (stream_factory);
+    return request;
+  }
+
+  void
+  InitStaticState () override
+  {
+    if (m_init_curl)
+      CurlHttpClient::InitGlobalState ();
+  }
+
+  void
+  CleanupStaticState () override
+  {
+    if (m_init_curl)
+      CurlHttpClient::CleanupGlobalState ();
+  }
+};
+
+std::shared_ptr<Aws::Http::HttpClientFactory>
+_cog_http_client_factory_new (bool init_curl)
+{
+  return Aws::MakeShared<CogHttpClientFactory> (_COG_ALLOCATION_TAG, init_curl);
+}
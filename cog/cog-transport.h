@@ -0,0 +1,58 @@
+#pragma once
+
+#if !(defined(_COG_INSIDE_COG_H) || defined(COMPILING_LIBCOG))
+#error "Please do not include this header file directly."
+#endif
+
+#include <glib-object.h>
+#include <gio/gio.h>
+
+#include "cog/cog-macros.h"
+
+G_BEGIN_DECLS
+
+/**
+ * CogTransportMode:
+ * @COG_TRANSPORT_MODE_RECORD: Requests are sent over the network, and each
+ *   request and its response are recorded.
+ * @COG_TRANSPORT_MODE_REPLAY: Requests are never sent over the network; they
+ *   are answered with previously recorded responses.
+ *
+ * Mode of operation of a #CogTransport.
+ */
+typedef enum {
+  COG_TRANSPORT_MODE_RECORD,
+  COG_TRANSPORT_MODE_REPLAY,
+} CogTransportMode;
+
+#define COG_TYPE_TRANSPORT (cog_transport_get_type())
+
+COG_AVAILABLE_IN_ALL
+G_DECLARE_FINAL_TYPE (CogTransport, cog_transport, COG, TRANSPORT, GObject)
+
+struct _CogTransportClass
+{
+  GObjectClass parent_class;
+};
+
+COG_AVAILABLE_IN_ALL
+CogTransport *cog_transport_new_recorder (const char *path);
+
+COG_AVAILABLE_IN_ALL
+CogTransport *cog_transport_new_replayer (const char *path,
+                                          GError **error);
+
+COG_AVAILABLE_IN_ALL
+gboolean cog_transport_save (CogTransport *self,
+                             GError **error);
+
+COG_AVAILABLE_IN_ALL
+CogTransportMode cog_transport_get_mode (CogTransport *self);
+
+COG_AVAILABLE_IN_ALL
+unsigned cog_transport_get_n_exchanges (CogTransport *self);
+
+COG_AVAILABLE_IN_ALL
+GVariant *cog_transport_get_requests (CogTransport *self);
+
+G_END_DECLS
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <memory>
+
+#include <aws/cognito-idp/model/AttributeType.h>
+#include <aws/cognito-idp/model/GetUserResult.h>
+#include <aws/core/utils/memory/stl/AWSList.h>
+#include <aws/core/utils/memory/stl/AWSMap.h>
+#include <aws/core/utils/memory/stl/AWSString.h>
+#include <aws/core/utils/memory/stl/AWSVector.h>
+#include <glib.h>
+
+typedef std::shared_ptr<const Aws::CognitoIdentityProvider::Model::GetUserResult> CogGetUserResultRef;
+
+/* Cache of GetUser results keyed by access token, used by #CogClient.
+ *
+ * An entry is fresh for @ttl seconds after it was fetched, and may then be
+ * served stale for another @stale_time seconds while it is fetched again, but
+ * never after its access token expires. When the approximate memory used by
+ * all entries exceeds @max_size bytes, the least recently used entries are
+ * evicted. All methods are thread-safe.
+ *
+ * Every write to the cache is stamped with a generation, so that a result
+ * fetched before a later write, such as one from update_attributes(), cannot
+ * overwrite it when it arrives. */
+class CogUserCache {
+public:
+  CogUserCache (unsigned ttl,
+                unsigned stale_time,
+                size_t max_size);
+  ~CogUserCache ();
+
+  /* Returns the cached result for @access_token, or nullptr. If the result is
+   * stale and no other caller is already fetching it again, sets @revalidate
+   * to true; the caller must then fetch it and call either insert() or
+   * revalidation_failed(). Sets @generation to the generation that a result
+   * fetched after this call must be inserted with. */
+  CogGetUserResultRef lookup (const char *access_token,
+                              bool *revalidate,
+                              guint64 *generation);
+
+  /* Stores @result, fetched after a lookup() that returned @generation, unless
+   * the entry for @access_token was written since then */
+  void insert (const char *access_token,
+               const CogGetUserResultRef& result,
+               guint64 generation);
+
+  /* Call when fetching a stale entry again failed. If @remove is true, the
+   * entry is dropped, otherwise it continues to be served until it expires. */
+  void revalidation_failed (const char *access_token,
+                            bool remove);
+
+  /* Write-through after a successful UpdateUserAttributes request */
+  void update_attributes (const char *access_token,
+                          const Aws::Vector<Aws::CognitoIdentityProvider::Model::AttributeType>& attributes);
+
+  /* Drops the entry for @access_token, for when its user changed in a way that
+   * cannot be written through */
+  void invalidate (const char *access_token);
+
+private:
+  struct Entry {
+    Aws::String access_token;
+    CogGetUserResultRef result;
+    gint64 stale_time;
+    gint64 expiry_time;
+    size_t size;
+    guint64 generation;
+    bool revalidating;
+  };
+  typedef Aws::List<Entry>::iterator EntryIter;
+
+  void remove_entry (EntryIter entry);
+  void evict (void);
+
+  gint64 m_ttl;
+  gint64 m_stale_time;
+  size_t m_max_size;
+
+  GMutex m_lock;
+  Aws::List<Entry> m_lru;  /* most recently used first */
+  Aws::UnorderedMap<Aws::String, EntryIter> m_index;
+  size_t m_size;
+  guint64 m_generation;  /* of the latest write */
+  guint64 m_orphan_generation;  /* of the latest write with no entry left */
+};
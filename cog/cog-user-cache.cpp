@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <iterator>
+
+#include <aws/cognito-idp/model/AttributeType.h>
+#include <aws/cognito-idp/model/GetUserResult.h>
+#include <glib.h>
+
+#include "cog/cog-user-cache-private.h"
+#include "cog/cog-utils-private.h"
+
+using Aws::CognitoIdentityProvider::Model::AttributeType;
+using Aws::CognitoIdentityProvider::Model::GetUserResult;
+using Aws::CognitoIdentityProvider::Model::MFAOptionType;
+
+/* Rough estimate of the memory taken up by a cache entry, including the copy
+ * of the access token used as the index key */
+static size_t
+entry_size (const Aws::String& access_token,
+            const GetUserResult& result)
+{
+  size_t size = 128 + sizeof (GetUserResult) + 2 * access_token.size () +
+    result.GetUsername ().size () + result.GetPreferredMfaSetting ().size ();
+  for (auto& attribute : result.GetUserAttributes ())
+    size += sizeof (AttributeType) + attribute.GetName ().size () +
+      attribute.GetValue ().size ();
+  size += result.GetMFAOptions ().size () * sizeof (MFAOptionType);
+  for (auto& setting : result.GetUserMFASettingList ())
+    size += sizeof (Aws::String) + setting.size ();
+  return size;
+}
+
+CogUserCache::CogUserCache (unsigned ttl,
+                            unsigned stale_time,
+                            size_t max_size)
+  : m_ttl (ttl * G_USEC_PER_SEC),
+    m_stale_time (stale_time * G_USEC_PER_SEC),
+    m_max_size (max_size),
+    m_size (0),
+    m_generation (0),
+    m_orphan_generation (0)
+{
+  g_mutex_init (&m_lock);
+}
+
+CogUserCache::~CogUserCache ()
+{
+  g_mutex_clear (&m_lock);
+}
+
+/* Must be called with the lock held */
+void
+CogUserCache::remove_entry (EntryIter entry)
+{
+  m_size -= entry->size;
+  m_index.erase (entry->access_token);
+  m_lru.erase (entry);
+}
+
+/* Must be called with the lock held */
+void
+CogUserCache::evict (void)
+{
+  while (m_size > m_max_size && !m_lru.empty ())
+    remove_entry (std::prev (m_lru.end ()));
+}
+
+CogGetUserResultRef
+CogUserCache::lookup (const char *access_token,
+                      bool *revalidate,
+                      guint64 *generation)
+{
+  CogGetUserResultRef retval;
+  *revalidate = false;
+
+  g_mutex_lock (&m_lock);
+
+  *generation = m_generation;
+
+  auto found = m_index.find (access_token);
+  if (found != m_index.end ())
+    {
+      EntryIter entry = found->second;
+      gint64 now = g_get_monotonic_time ();
+
+      if (now >= entry->expiry_time)
+        {
+          remove_entry (entry);
+        }
+      else
+        {
+          m_lru.splice (m_lru.begin (), m_lru, entry);
+          if (now >= entry->stale_time && !entry->revalidating)
+            {
+              entry->revalidating = true;
+              *revalidate = true;
+            }
+          retval = entry->result;
+        }
+    }
+
+  g_mutex_unlock (&m_lock);
+  return retval;
+}
+
+void
+CogUserCache::insert (const char *access_token,
+                      const CogGetUserResultRef& result,
+                      guint64 generation)
+{
+  gint64 now = g_get_monotonic_time ();
+  gint64 stale_time = now + m_ttl;
+  gint64 expiry_time = stale_time + m_stale_time;
+
+  /* Never serve a result for a token that the server would reject */
+  gint64 token_expiration = _cog_token_get_expiration (access_token);
+  if (token_expiration)
+    {
+      gint64 token_expiry_time = now + token_expiration * G_USEC_PER_SEC -
+        g_get_real_time ();
+      stale_time = MIN (stale_time, token_expiry_time);
+      expiry_time = MIN (expiry_time, token_expiry_time);
+    }
+
+  Entry entry { access_token, result, stale_time, expiry_time, 0, 0, false };
+  entry.size = entry_size (entry.access_token, *result);
+
+  g_mutex_lock (&m_lock);
+
+  /* Drop the result if the entry was written after it was looked up, since it
+   * may be older than what is cached. A write that left no entry behind has no
+   * generation of its own, so it counts against every token. */
+  auto found = m_index.find (entry.access_token);
+  if (found != m_index.end () ? found->second->generation > generation
+                              : m_orphan_generation > generation)
+    {
+      if (found != m_index.end ())
+        found->second->revalidating = false;
+      g_mutex_unlock (&m_lock);
+      return;
+    }
+
+  if (found != m_index.end ())
+    remove_entry (found->second);
+
+  if (expiry_time > now && entry.size <= m_max_size)
+    {
+      entry.generation = ++m_generation;
+      m_size += entry.size;
+      m_lru.push_front (std::move (entry));
+      m_index.emplace (m_lru.front ().access_token, m_lru.begin ());
+      evict ();
+    }
+  else if (found != m_index.end ())
+    {
+      m_orphan_generation = ++m_generation;
+    }
+
+  g_mutex_unlock (&m_lock);
+}
+
+void
+CogUserCache::revalidation_failed (const char *access_token,
+                                   bool remove)
+{
+  g_mutex_lock (&m_lock);
+
+  auto found = m_index.find (access_token);
+  if (found != m_index.end ())
+    {
+      if (remove)
+        remove_entry (found->second);
+      else
+        found->second->revalidating = false;
+    }
+
+  g_mutex_unlock (&m_lock);
+}
+
+void
+CogUserCache::update_attributes (const char *access_token,
+                                 const Aws::Vector<AttributeType>& attributes)
+{
+  g_mutex_lock (&m_lock);
+
+  auto found = m_index.find (access_token);
+  if (found != m_index.end ())
+    {
+      EntryIter entry = found->second;
+      const GetUserResult& old_result = *entry->result;
+
+      /* Cached results are shared with callers, so they are never modified in
+       * place */
+      auto *result = new GetUserResult ();
+      result->SetUsername (old_result.GetUsername ());
+      result->SetMFAOptions (old_result.GetMFAOptions ());
+      result->SetPreferredMfaSetting (old_result.GetPreferredMfaSetting ());
+      result->SetUserMFASettingList (old_result.GetUserMFASettingList ());
+
+      Aws::Vector<AttributeType> merged = old_result.GetUserAttributes ();
+      for (auto& update : attributes)
+        {
+          auto existing = std::find_if (merged.begin (), merged.end (),
+                                        [&update] (const AttributeType& attr)
+            {
+              return attr.GetName () == update.GetName ();
+            });
+          if (existing != merged.end ())
+            existing->SetValue (update.GetValue ());
+          else
+            merged.push_back (update);
+        }
+      result->SetUserAttributes (std::move (merged));
+
+      m_size -= entry->size;
+      entry->result.reset (result);
+      entry->size = entry_size (entry->access_token, *result);
+      entry->generation = ++m_generation;
+      m_size += entry->size;
+      m_lru.splice (m_lru.begin (), m_lru, entry);
+      evict ();
+    }
+  else
+    {
+      /* A result fetched before the update must not be cached either */
+      m_orphan_generation = ++m_generation;
+    }
+
+  g_mutex_unlock (&m_lock);
+}
+
+void
+CogUserCache::invalidate (const char *access_token)
+{
+  g_mutex_lock (&m_lock);
+
+  auto found = m_index.find (access_token);
+  if (found != m_index.end ())
+    remove_entry (found->second);
+  m_orphan_generation = ++m_generation;
+
+  g_mutex_unlock (&m_lock);
+}
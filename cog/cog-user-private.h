@@ -0,0 +1,7 @@
+#pragma once
+
+#include <aws/cognito-idp/model/GetUserResult.h>
+
+#include "cog/cog-user.h"
+
+CogUser *_cog_user_new_from_internal (const Aws::CognitoIdentityProvider::Model::GetUserResult& result);
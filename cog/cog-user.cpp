@@ -0,0 +1,352 @@
+/**
+ * SECTION:user
+ * @title: CogUser
+ * @short_description: User attributes and metadata
+ *
+ * A #CogUser holds the result of cog_client_fetch_user().
+ * Unlike the return values of cog_client_get_user(), it keeps all the data in
+ * one block of memory, and the attributes are looked up by name with
+ * cog_user_get_attribute() without building a dictionary.
+ * Use cog_user_get_attributes() if you do need a dictionary of all of them.
+ *
+ * A #CogUser cannot be modified, so it can be shared between threads.
+ */
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <aws/cognito-idp/model/AttributeType.h>
+#include <aws/cognito-idp/model/GetUserResult.h>
+#include <glib-object.h>
+
+#include "cog/cog-boxed-private.h"
+#include "cog/cog-user.h"
+#include "cog/cog-user-private.h"
+
+using Aws::CognitoIdentityProvider::Model::GetUserResult;
+
+typedef struct
+{
+  const char *name;
+  const char *value;
+} CogUserAttribute;
+
+struct _CogUser
+{
+  unsigned ref_count;
+  unsigned n_attributes;
+  const char *username;
+  const char *preferred_mfa_setting;
+  /* The remaining pointers, except these two, point into the same block of
+   * memory as the struct itself */
+  GList *mfa_options;
+  GHashTable *attributes_view;  /* (atomic), created on demand */
+  const char **mfa_settings;
+  CogUserAttribute *attributes;  /* sorted by name */
+};
+
+G_DEFINE_BOXED_TYPE (CogUser, cog_user, cog_user_ref, cog_user_unref)
+
+/* The standard attributes, plus the ones that every user has. These names are
+ * not copied for each user, since nearly every user has some of them. Keep
+ * sorted for bsearch(). */
+static const char * const common_attribute_names[] = {
+  "address",
+  "birthdate",
+  "email",
+  "email_verified",
+  "family_name",
+  "gender",
+  "given_name",
+  "locale",
+  "middle_name",
+  "name",
+  "nickname",
+  "phone_number",
+  "phone_number_verified",
+  "picture",
+  "preferred_username",
+  "profile",
+  "sub",
+  "updated_at",
+  "website",
+  "zoneinfo",
+};
+
+static int
+compare_name (const void *key,
+              const void *element)
+{
+  return strcmp (static_cast<const char *> (key),
+                 *static_cast<const char * const *> (element));
+}
+
+static const char *
+common_attribute_name (const char *name)
+{
+  auto *found = static_cast<const char * const *> (
+    bsearch (name, common_attribute_names,
+             G_N_ELEMENTS (common_attribute_names),
+             sizeof (common_attribute_names[0]), compare_name));
+  return found ? *found : NULL;
+}
+
+/* Copies @string to *@cursor and advances *@cursor past it */
+static const char *
+copy_string (char **cursor,
+             const Aws::String& string)
+{
+  char *retval = *cursor;
+  memcpy (retval, string.c_str (), string.size () + 1);
+  *cursor += string.size () + 1;
+  return retval;
+}
+
+CogUser *
+_cog_user_new_from_internal (const GetUserResult& result)
+{
+  auto& attributes = result.GetUserAttributes ();
+  auto& mfa_settings = result.GetUserMFASettingList ();
+  auto& preferred_mfa_setting = result.GetPreferredMfaSetting ();
+
+  size_t strings_size = result.GetUsername ().size () + 1;
+  if (!preferred_mfa_setting.empty ())
+    strings_size += preferred_mfa_setting.size () + 1;
+  for (auto& attribute : attributes)
+    {
+      if (!common_attribute_name (attribute.GetName ().c_str ()))
+        strings_size += attribute.GetName ().size () + 1;
+      strings_size += attribute.GetValue ().size () + 1;
+    }
+  for (auto& setting : mfa_settings)
+    strings_size += setting.size () + 1;
+
+  size_t attributes_size = attributes.size () * sizeof (CogUserAttribute);
+  size_t mfa_settings_size = (mfa_settings.size () + 1) * sizeof (char *);
+  auto *block = static_cast<char *> (g_malloc (sizeof (CogUser) +
+                                               attributes_size +
+                                               mfa_settings_size +
+                                               strings_size));
+
+  auto *self = reinterpret_cast<CogUser *> (block);
+  self->ref_count = 1;
+  self->n_attributes = attributes.size ();
+  self->attributes = reinterpret_cast<CogUserAttribute *> (block +
+                                                           sizeof (CogUser));
+  self->mfa_settings = reinterpret_cast<const char **> (block +
+                                                        sizeof (CogUser) +
+                                                        attributes_size);
+  self->attributes_view = NULL;
+  char *cursor = block + sizeof (CogUser) + attributes_size + mfa_settings_size;
+
+  self->username = copy_string (&cursor, result.GetUsername ());
+  self->preferred_mfa_setting = NULL;
+  if (!preferred_mfa_setting.empty ())
+    self->preferred_mfa_setting = copy_string (&cursor, preferred_mfa_setting);
+
+  CogUserAttribute *attribute_iter = self->attributes;
+  for (auto& attribute : attributes)
+    {
+      attribute_iter->name = common_attribute_name (attribute.GetName ().c_str ());
+      if (!attribute_iter->name)
+        attribute_iter->name = copy_string (&cursor, attribute.GetName ());
+      attribute_iter->value = copy_string (&cursor, attribute.GetValue ());
+      attribute_iter++;
+    }
+  std::sort (self->attributes, self->attributes + self->n_attributes,
+             [](const CogUserAttribute& a, const CogUserAttribute& b)
+    {
+      return strcmp (a.name, b.name) < 0;
+    });
+
+  const char **setting_iter = self->mfa_settings;
+  for (auto& setting : mfa_settings)
+    *setting_iter++ = copy_string (&cursor, setting);
+  *setting_iter = NULL;
+
+  /* Deprecated, and in practice nearly always empty */
+  self->mfa_options = NULL;
+  for (auto& option : result.GetMFAOptions ())
+    self->mfa_options = g_list_prepend (self->mfa_options,
+                                        _cog_mfa_option_from_internal (option));
+  self->mfa_options = g_list_reverse (self->mfa_options);
+
+  return self;
+}
+
+/**
+ * cog_user_ref:
+ * @self: a #CogUser
+ *
+ * Increments the reference count of @self by one.
+ *
+ * Returns: (transfer none): @self
+ */
+CogUser *
+cog_user_ref (CogUser *self)
+{
+  g_return_val_if_fail (self, NULL);
+  g_return_val_if_fail (self->ref_count, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+/**
+ * cog_user_unref:
+ * @self: (transfer none): a #CogUser
+ *
+ * Decrements the reference count of @self by one, freeing the structure when
+ * the reference count reaches zero.
+ */
+void
+cog_user_unref (CogUser *self)
+{
+  g_return_if_fail (self);
+  g_return_if_fail (self->ref_count);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+    {
+      g_list_free_full (self->mfa_options,
+                        (GDestroyNotify) cog_mfa_option_unref);
+      g_clear_pointer (&self->attributes_view, g_hash_table_unref);
+      g_free (self);
+    }
+}
+
+/**
+ * cog_user_get_username:
+ * @self: a #CogUser
+ *
+ * Returns: the username of the user
+ */
+const char *
+cog_user_get_username (CogUser *self)
+{
+  g_return_val_if_fail (self, NULL);
+  return self->username;
+}
+
+/**
+ * cog_user_get_attribute:
+ * @self: a #CogUser
+ * @name: the name of an attribute, such as `email`
+ *
+ * Looks up one of the user's attributes.
+ * For custom attributes, @name must start with `custom:`.
+ *
+ * Returns: (nullable): the value of the attribute @name, or %NULL if the user
+ *   does not have it
+ */
+const char *
+cog_user_get_attribute (CogUser *self,
+                        const char *name)
+{
+  g_return_val_if_fail (self, NULL);
+  g_return_val_if_fail (name, NULL);
+
+  auto *end = self->attributes + self->n_attributes;
+  auto *found = std::lower_bound (self->attributes, end, name,
+                                  [](const CogUserAttribute& attribute,
+                                     const char *key)
+    {
+      return strcmp (attribute.name, key) < 0;
+    });
+  if (found == end || strcmp (found->name, name) != 0)
+    return NULL;
+  return found->value;
+}
+
+/**
+ * cog_user_get_n_attributes:
+ * @self: a #CogUser
+ *
+ * Returns: the number of attributes that the user has
+ */
+unsigned
+cog_user_get_n_attributes (CogUser *self)
+{
+  g_return_val_if_fail (self, 0);
+  return self->n_attributes;
+}
+
+/**
+ * cog_user_get_attributes:
+ * @self: a #CogUser
+ *
+ * Gets all of the user's attributes as a dictionary.
+ * The dictionary is created the first time this is called, and is owned by
+ * @self; it must not be modified.
+ * To look up only a few attributes, cog_user_get_attribute() is cheaper.
+ *
+ * Returns: (transfer none) (element-type utf8 utf8): a dictionary of user
+ *   attributes
+ */
+GHashTable *
+cog_user_get_attributes (CogUser *self)
+{
+  g_return_val_if_fail (self, NULL);
+
+  auto *view = static_cast<GHashTable *> (g_atomic_pointer_get (&self->attributes_view));
+  if (view)
+    return view;
+
+  /* Keys and values belong to @self */
+  view = g_hash_table_new (g_str_hash, g_str_equal);
+  for (unsigned ix = 0; ix < self->n_attributes; ix++)
+    g_hash_table_insert (view, (char *) self->attributes[ix].name,
+                         (char *) self->attributes[ix].value);
+
+  if (!g_atomic_pointer_compare_and_exchange (&self->attributes_view, NULL,
+                                              view))
+    {
+      /* Another thread got there first */
+      g_hash_table_unref (view);
+      view = static_cast<GHashTable *> (g_atomic_pointer_get (&self->attributes_view));
+    }
+  return view;
+}
+
+/**
+ * cog_user_dup_mfa_options:
+ * @self: a #CogUser
+ *
+ * Returns: (transfer full) (element-type CogMFAOption): the options for MFA
+ *   (e.g., email or phone number)
+ */
+GList *
+cog_user_dup_mfa_options (CogUser *self)
+{
+  g_return_val_if_fail (self, NULL);
+  return g_list_copy_deep (self->mfa_options, (GCopyFunc) cog_mfa_option_ref,
+                           NULL);
+}
+
+/**
+ * cog_user_get_preferred_mfa_setting:
+ * @self: a #CogUser
+ *
+ * Returns: (nullable): the user's preferred MFA setting, or %NULL if none
+ */
+const char *
+cog_user_get_preferred_mfa_setting (CogUser *self)
+{
+  g_return_val_if_fail (self, NULL);
+  return self->preferred_mfa_setting;
+}
+
+/**
+ * cog_user_get_mfa_settings:
+ * @self: a #CogUser
+ *
+ * Returns: (array zero-terminated=1) (transfer none): list of the user's MFA
+ *   settings
+ */
+const char * const *
+cog_user_get_mfa_settings (CogUser *self)
+{
+  g_return_val_if_fail (self, NULL);
+  return self->mfa_settings;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#if !(defined(_COG_INSIDE_COG_H) || defined(COMPILING_LIBCOG))
+#error "Please do not include this header file directly."
+#endif
+
+#include <glib-object.h>
+
+#include "cog/cog-macros.h"
+
+G_BEGIN_DECLS
+
+#define COG_TYPE_USER (cog_user_get_type ())
+
+typedef struct _CogUser CogUser;
+
+COG_AVAILABLE_IN_ALL
+GType cog_user_get_type (void) G_GNUC_CONST;
+
+COG_AVAILABLE_IN_ALL
+CogUser *cog_user_ref (CogUser *self);
+
+COG_AVAILABLE_IN_ALL
+void cog_user_unref (CogUser *self);
+
+COG_AVAILABLE_IN_ALL
+const char *cog_user_get_username (CogUser *self);
+
+COG_AVAILABLE_IN_ALL
+const char *cog_user_get_attribute (CogUser *self,
+                                    const char *name);
+
+COG_AVAILABLE_IN_ALL
+unsigned cog_user_get_n_attributes (CogUser *self);
+
+COG_AVAILABLE_IN_ALL
+GHashTable *cog_user_get_attributes (CogUser *self);
+
+COG_AVAILABLE_IN_ALL
+GList *cog_user_dup_mfa_options (CogUser *self);
+
+COG_AVAILABLE_IN_ALL
+const char *cog_user_get_preferred_mfa_setting (CogUser *self);
+
+COG_AVAILABLE_IN_ALL
+const char * const *cog_user_get_mfa_settings (CogUser *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (CogUser, cog_user_unref)
+
+G_END_DECLS
@@ -4,17 +4,11 @@
 #include <aws/core/utils/memory/stl/AWSVector.h>
 #include <glib.h>
 
+#include "cog/cog-validators-private.h"
+
 /* This "allocation tag" is passed to all AWS memory management functions */
 #define _COG_ALLOCATION_TAG "libcog"
 
-void _cog_free_static_data (void);
-
-gboolean _cog_is_valid_access_token (const char *string);
-gboolean _cog_is_valid_client_id (const char *string);
-gboolean _cog_is_valid_password (const char *string);
-gboolean _cog_is_valid_secret_hash (const char *string);
-gboolean _cog_is_valid_username (const char *string);
-
 void _cog_hash_table_to_vector (GHashTable *hash_table,
                                 Aws::Vector<Aws::CognitoIdentityProvider::Model::AttributeType> *vector);
 
@@ -22,3 +16,16 @@ void _cog_vector_to_hash_table (const Aws::Vector<Aws::CognitoIdentityProvider::
                                 GHashTable *hash_table);
 
 char **_cog_vector_to_strv (const Aws::Vector<Aws::String>& vector);
+
+unsigned char *_cog_base64url_decode (const char *data,
+                                      size_t length,
+                                      size_t *out_length);
+
+gint64 _cog_token_get_expiration (const char *token);
+
+char *_cog_token_get_subject (const char *token);
+
+/* Records on @error, in the %COG_IDENTITY_PROVIDER_ERROR domain, how many
+ * times the failed request was sent */
+void _cog_identity_provider_error_set_attempts (GError *error,
+                                                unsigned attempts);
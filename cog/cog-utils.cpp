@@ -1,4 +1,7 @@
+#include <string.h>
+
 #include <aws/cognito-idp/model/AttributeType.h>
+#include <aws/core/utils/json/JsonSerializer.h>
 #include <aws/core/utils/memory/stl/AWSVector.h>
 #include <glib.h>
 
@@ -6,6 +9,7 @@
 #include "cog/cog-utils-private.h"
 
 using Aws::CognitoIdentityProvider::Model::AttributeType;
+using Aws::Utils::Json::JsonValue;
 
 /**
  * SECTION:types
@@ -15,38 +19,57 @@ using Aws::CognitoIdentityProvider::Model::AttributeType;
  * Enumerations, string constants, and exception types used by Libcog.
  */
 
-G_DEFINE_QUARK(cog-identity-provider-error, cog_identity_provider_error)
-
-#define DEFINE_REGEX_VALIDATOR(name, pattern) \
-  static GRegex * name ## _regex = NULL; \
-  gboolean \
-  _cog_is_valid_ ## name (const char *string) \
-  { \
-    if (g_once_init_enter (& name ## _regex)) \
-      { \
-        GError *error = NULL; \
-        GRegex *regex = g_regex_new ("^" pattern "$", G_REGEX_OPTIMIZE, \
-                                     GRegexMatchFlags (0), &error); \
-        if (!regex) \
-          g_error ("Programmer error: %s", error->message); \
-        g_once_init_leave (& name ## _regex, regex); \
-      } \
-    return g_regex_match (name ## _regex, string, GRegexMatchFlags (0), NULL); \
-  }
-
-DEFINE_REGEX_VALIDATOR(access_token, "[A-Za-z0-9-_=.]+")
-DEFINE_REGEX_VALIDATOR(client_id, "[\\w+]+")
-DEFINE_REGEX_VALIDATOR(password, "[\\S]+")
-DEFINE_REGEX_VALIDATOR(secret_hash, "[\\w+=/]+")
-DEFINE_REGEX_VALIDATOR(username, "[\\p{L}\\p{M}\\p{S}\\p{N}\\p{P}]+")
+typedef struct
+{
+  unsigned attempts;
+} CogIdentityProviderErrorPrivate;
+
+static void
+cog_identity_provider_error_private_init (CogIdentityProviderErrorPrivate *priv)
+{
+  priv->attempts = 0;
+}
+
+static void
+cog_identity_provider_error_private_copy (const CogIdentityProviderErrorPrivate *src,
+                                          CogIdentityProviderErrorPrivate *dest)
+{
+  dest->attempts = src->attempts;
+}
+
+static void
+cog_identity_provider_error_private_clear (CogIdentityProviderErrorPrivate *priv G_GNUC_UNUSED)
+{
+}
+
+G_DEFINE_EXTENDED_ERROR (CogIdentityProviderError, cog_identity_provider_error)
+
+/**
+ * cog_identity_provider_error_get_attempts:
+ * @error: a #GError
+ *
+ * Gets the number of times that the request which failed with @error was
+ * sent, including retries; see #CogClient:max-attempts.
+ *
+ * Returns: the number of attempts, or 0 if @error is not in the
+ *   %COG_IDENTITY_PROVIDER_ERROR domain or did not come from a response
+ */
+unsigned
+cog_identity_provider_error_get_attempts (const GError *error)
+{
+  g_return_val_if_fail (error, 0);
+
+  if (error->domain != COG_IDENTITY_PROVIDER_ERROR)
+    return 0;
+  return cog_identity_provider_error_get_private (error)->attempts;
+}
 
 void
-_cog_free_static_data (void)
+_cog_identity_provider_error_set_attempts (GError *error,
+                                           unsigned attempts)
 {
-  g_clear_pointer (&client_id_regex, g_regex_unref);
-  g_clear_pointer (&password_regex, g_regex_unref);
-  g_clear_pointer (&secret_hash_regex, g_regex_unref);
-  g_clear_pointer (&username_regex, g_regex_unref);
+  g_return_if_fail (error && error->domain == COG_IDENTITY_PROVIDER_ERROR);
+  cog_identity_provider_error_get_private (error)->attempts = attempts;
 }
 
 void
@@ -83,3 +106,92 @@ _cog_vector_to_strv (const Aws::Vector<Aws::String>& vector)
   *iter = NULL;
   return retval;
 }
+
+/* Decodes @length bytes of unpadded base64url, as used in JSON Web Tokens.
+ * Returns %NULL if @data is not valid base64url. */
+unsigned char *
+_cog_base64url_decode (const char *data,
+                       size_t length,
+                       size_t *out_length)
+{
+  if (length % 4 == 1)
+    return NULL;
+
+  /* Convert to padded base64 */
+  g_autofree char *base64 = g_new (char, length + 3);
+  size_t ix;
+  for (ix = 0; ix < length; ix++)
+    {
+      char c = data[ix];
+      if (c == '-')
+        c = '+';
+      else if (c == '_')
+        c = '/';
+      else if (!g_ascii_isalnum (c))
+        return NULL;
+      base64[ix] = c;
+    }
+  while (ix % 4 != 0)
+    base64[ix++] = '=';
+  base64[ix] = '\0';
+
+  return g_base64_decode (base64, out_length);
+}
+
+/* Decodes the claims of a JSON Web Token into @json. Returns false if @token
+ * is not a JWT. Does not verify the token's signature. */
+static bool
+token_get_claims (const char *token,
+                  JsonValue *json)
+{
+  const char *payload_start = strchr (token, '.');
+  if (!payload_start)
+    return false;
+  payload_start++;
+  const char *payload_end = strchr (payload_start, '.');
+  if (!payload_end)
+    return false;
+
+  size_t payload_length;
+  g_autofree unsigned char *payload =
+    _cog_base64url_decode (payload_start, payload_end - payload_start,
+                           &payload_length);
+  if (!payload)
+    return false;
+
+  *json = JsonValue (Aws::String (reinterpret_cast<char *> (payload),
+                                  payload_length));
+  return json->WasParseSuccessful ();
+}
+
+/* Returns the "exp" claim of a JSON Web Token, in seconds since the Unix epoch,
+ * or 0 if @token is not a JWT or has no expiration time. Does not verify the
+ * token's signature. */
+gint64
+_cog_token_get_expiration (const char *token)
+{
+  JsonValue json;
+  if (!token_get_claims (token, &json))
+    return 0;
+
+  auto claims = json.View ();
+  if (!claims.ValueExists ("exp") || !claims.GetObject ("exp").IsIntegerType ())
+    return 0;
+  return claims.GetInt64 ("exp");
+}
+
+/* Returns a newly allocated copy of the "sub" claim of a JSON Web Token, or
+ * %NULL if @token is not a JWT or has no subject. Does not verify the token's
+ * signature. */
+char *
+_cog_token_get_subject (const char *token)
+{
+  JsonValue json;
+  if (!token_get_claims (token, &json))
+    return NULL;
+
+  auto claims = json.View ();
+  if (!claims.ValueExists ("sub") || !claims.GetObject ("sub").IsString ())
+    return NULL;
+  return g_strdup (claims.GetString ("sub").c_str ());
+}
@@ -219,4 +219,7 @@ typedef enum {
 COG_AVAILABLE_IN_ALL
 GQuark cog_identity_provider_error_quark (void);
 
+COG_AVAILABLE_IN_ALL
+unsigned cog_identity_provider_error_get_attempts (const GError *error);
+
 G_END_DECLS
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <glib.h>
+
+/* Each of these checks that @string matches the pattern that the Cognito API
+ * documents for the parameter, exactly as an anchored GRegex would. If
+ * @length is not %NULL, it is set to strlen (@string) when @string is valid,
+ * so that callers can check length limits without scanning again. */
+
+gboolean _cog_is_valid_access_token (const char *string,
+                                     size_t *length);
+gboolean _cog_is_valid_client_id (const char *string,
+                                  size_t *length);
+gboolean _cog_is_valid_password (const char *string,
+                                 size_t *length);
+gboolean _cog_is_valid_secret_hash (const char *string,
+                                    size_t *length);
+gboolean _cog_is_valid_username (const char *string,
+                                 size_t *length);
@@ -0,0 +1,234 @@
+/* Validators for the string parameters of the Cognito API. Each parameter
+ * must match a pattern of the form ^[class]+$, which used to be checked with
+ * GRegex. These check the same patterns in a single pass over the string,
+ * without running a regex.
+ *
+ * They reproduce the GRegex semantics exactly:
+ *  - GRegex compiles patterns in UTF-8 mode with Unicode properties, so \w, \s
+ *    and \S classify non-ASCII characters by their Unicode general category.
+ *  - Without G_REGEX_DOLLAR_ENDONLY, $ also matches before a newline at the
+ *    very end of the string, so one trailing '\n' is accepted.
+ *  - Since PCRE2 10.43, \w also includes nonspacing marks and connector
+ *    punctuation. Which PCRE GLib uses is only known at runtime, so this is
+ *    checked once.
+ * Strings that are not valid UTF-8 are rejected. */
+
+#include <glib.h>
+
+#include "cog/cog-validators-private.h"
+
+enum
+{
+  /* [A-Za-z0-9-_=.], the characters of a JSON Web Token */
+  ACCESS_TOKEN_CHAR = 1 << 0,
+  /* \w */
+  WORD_CHAR = 1 << 1,
+  /* \S */
+  NON_SPACE_CHAR = 1 << 2,
+  /* [\p{L}\p{M}\p{S}\p{N}\p{P}] */
+  GRAPHIC_CHAR = 1 << 3,
+  /* Literal characters added to \w in some classes */
+  PLUS_CHAR = 1 << 4,
+  EQUALS_OR_SLASH_CHAR = 1 << 5,
+};
+
+static constexpr bool
+is_ascii_alnum (unsigned c)
+{
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+    (c >= '0' && c <= '9');
+}
+
+static constexpr unsigned char
+classify_ascii (unsigned c)
+{
+  return
+    ((is_ascii_alnum (c) || c == '-' || c == '_' || c == '=' || c == '.') ?
+     ACCESS_TOKEN_CHAR : 0) |
+    ((is_ascii_alnum (c) || c == '_') ? WORD_CHAR : 0) |
+    /* \s is HT, LF, VT, FF, CR and space */
+    (((c < '\t' || c > '\r') && c != ' ') ? NON_SPACE_CHAR : 0) |
+    /* Every printable ASCII character except space is a letter, number,
+     * punctuation or symbol */
+    ((c > ' ' && c < 0x7f) ? GRAPHIC_CHAR : 0) |
+    (c == '+' ? PLUS_CHAR : 0) |
+    ((c == '=' || c == '/') ? EQUALS_OR_SLASH_CHAR : 0);
+}
+
+struct AsciiTable
+{
+  unsigned char flags[128];
+
+  constexpr AsciiTable () : flags ()
+  {
+    for (unsigned c = 0; c < 128; c++)
+      flags[c] = classify_ascii (c);
+  }
+};
+
+static constexpr AsciiTable ascii_table;
+
+#define CATEGORY(type) (1u << G_UNICODE_ ## type)
+
+static constexpr unsigned letter_categories =
+  CATEGORY (LOWERCASE_LETTER) | CATEGORY (MODIFIER_LETTER) |
+  CATEGORY (OTHER_LETTER) | CATEGORY (TITLECASE_LETTER) |
+  CATEGORY (UPPERCASE_LETTER);
+static constexpr unsigned mark_categories =
+  CATEGORY (SPACING_MARK) | CATEGORY (ENCLOSING_MARK) |
+  CATEGORY (NON_SPACING_MARK);
+static constexpr unsigned number_categories =
+  CATEGORY (DECIMAL_NUMBER) | CATEGORY (LETTER_NUMBER) |
+  CATEGORY (OTHER_NUMBER);
+static constexpr unsigned punctuation_categories =
+  CATEGORY (CONNECT_PUNCTUATION) | CATEGORY (DASH_PUNCTUATION) |
+  CATEGORY (CLOSE_PUNCTUATION) | CATEGORY (FINAL_PUNCTUATION) |
+  CATEGORY (INITIAL_PUNCTUATION) | CATEGORY (OTHER_PUNCTUATION) |
+  CATEGORY (OPEN_PUNCTUATION);
+static constexpr unsigned symbol_categories =
+  CATEGORY (CURRENCY_SYMBOL) | CATEGORY (MODIFIER_SYMBOL) |
+  CATEGORY (MATH_SYMBOL) | CATEGORY (OTHER_SYMBOL);
+static constexpr unsigned separator_categories =
+  CATEGORY (LINE_SEPARATOR) | CATEGORY (PARAGRAPH_SEPARATOR) |
+  CATEGORY (SPACE_SEPARATOR);
+
+#undef CATEGORY
+
+static inline bool
+unichar_in_categories (gunichar ch,
+                       unsigned categories)
+{
+  return (1u << g_unichar_type (ch)) & categories;
+}
+
+/* These classify non-ASCII characters */
+
+static unsigned
+word_categories (void)
+{
+  static gsize categories = 0;
+
+  if (g_once_init_enter (&categories))
+    {
+      gsize value = letter_categories | number_categories;
+
+      /* Ask GRegex whether U+0301 COMBINING ACUTE ACCENT is a word character */
+      GRegex *regex = g_regex_new ("^\\w$", GRegexCompileFlags (0),
+                                   GRegexMatchFlags (0), NULL);
+      if (regex && g_regex_match (regex, "\xcc\x81", GRegexMatchFlags (0), NULL))
+        value |= (1u << G_UNICODE_NON_SPACING_MARK) |
+          (1u << G_UNICODE_CONNECT_PUNCTUATION);
+      g_clear_pointer (&regex, g_regex_unref);
+
+      g_once_init_leave (&categories, value);
+    }
+
+  return categories;
+}
+
+static bool
+unichar_is_word (gunichar ch)
+{
+  return unichar_in_categories (ch, word_categories ());
+}
+
+static bool
+unichar_is_non_space (gunichar ch)
+{
+  /* Besides the separators, PCRE's \s includes NEL and the Mongolian vowel
+   * separator, which are not in category Z */
+  return !unichar_in_categories (ch, separator_categories) &&
+    ch != 0x85 && ch != 0x180e;
+}
+
+static bool
+unichar_is_graphic (gunichar ch)
+{
+  return unichar_in_categories (ch, letter_categories | mark_categories |
+                                    number_categories |
+                                    punctuation_categories |
+                                    symbol_categories);
+}
+
+/* Checks that @string matches ^[class]+$, where @ascii_flags selects the ASCII
+ * characters in the class and @unichar_in_class, if given, decides whether
+ * other characters are in it */
+static gboolean
+scan (const char *string,
+      unsigned char ascii_flags,
+      bool (*unichar_in_class) (gunichar),
+      size_t *length)
+{
+  const char *iter = string;
+
+  while (true)
+    {
+      auto c = static_cast<unsigned char> (*iter);
+      if (c < 0x80)
+        {
+          if (!(ascii_table.flags[c] & ascii_flags))
+            break;
+          iter++;
+          continue;
+        }
+
+      if (!unichar_in_class)
+        return FALSE;
+
+      gunichar ch = g_utf8_get_char_validated (iter, -1);
+      if (ch == gunichar (-1) || ch == gunichar (-2) || !unichar_in_class (ch))
+        return FALSE;
+      iter = g_utf8_next_char (iter);
+    }
+
+  if (iter == string)
+    return FALSE;
+  if (*iter == '\n')
+    iter++;
+  if (*iter != '\0')
+    return FALSE;
+
+  if (length)
+    *length = iter - string;
+  return TRUE;
+}
+
+gboolean
+_cog_is_valid_access_token (const char *string,
+                            size_t *length)
+{
+  return scan (string, ACCESS_TOKEN_CHAR, NULL, length);
+}
+
+/* [\w+]+ */
+gboolean
+_cog_is_valid_client_id (const char *string,
+                         size_t *length)
+{
+  return scan (string, WORD_CHAR | PLUS_CHAR, unichar_is_word, length);
+}
+
+/* [\S]+ */
+gboolean
+_cog_is_valid_password (const char *string,
+                        size_t *length)
+{
+  return scan (string, NON_SPACE_CHAR, unichar_is_non_space, length);
+}
+
+/* [\w+=/]+ */
+gboolean
+_cog_is_valid_secret_hash (const char *string,
+                           size_t *length)
+{
+  return scan (string, WORD_CHAR | PLUS_CHAR | EQUALS_OR_SLASH_CHAR,
+               unichar_is_word, length);
+}
+
+/* [\p{L}\p{M}\p{S}\p{N}\p{P}]+ */
+gboolean
+_cog_is_valid_username (const char *string,
+                        size_t *length)
+{
+  return scan (string, GRAPHIC_CHAR, unichar_is_graphic, length);
+}
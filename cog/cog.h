@@ -10,7 +10,14 @@ G_BEGIN_DECLS
 
 /* Pull in other header files */
 #include "cog/cog-client.h"
+#include "cog/cog-executor.h"
 #include "cog/cog-init.h"
+#include "cog/cog-login.h"
+#include "cog/cog-session.h"
+#include "cog/cog-srp.h"
+#include "cog/cog-token-verifier.h"
+#include "cog/cog-transport.h"
+#include "cog/cog-user.h"
 #include "cog/cog-utils.h"
 #include "cog/cog-version.h"
 
@@ -31,9 +31,19 @@ function _init() {
     const Cog = this;
 
     promisify(Cog.Client.prototype, 'get_user_async', 'get_user_finish');
+    promisify(Cog.Client.prototype, 'fetch_user_async', 'fetch_user_finish');
+    promisify(Cog.Client.prototype, 'get_user_batch_async',
+        'get_user_batch_finish');
     promisify(Cog.Client.prototype, 'initiate_auth_async',
         'initiate_auth_finish');
+    promisify(Cog.Client.prototype, 'log_in_async', 'log_in_finish');
+    promisify(Cog.Client.prototype, 'log_in_respond_async', 'log_in_finish');
+    promisify(Cog.Client.prototype, 'prewarm_async', 'prewarm_finish');
     promisify(Cog.Client.prototype, 'sign_up_async', 'sign_up_finish');
     promisify(Cog.Client.prototype, 'update_user_attributes_async',
         'update_user_attributes_finish');
+    promisify(Cog.Session.prototype, 'get_access_token_async',
+        'get_access_token_finish');
+    promisify(Cog.TokenVerifier.prototype, 'fetch_keys_async',
+        'fetch_keys_finish');
 }
@@ -0,0 +1,219 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Compares the pooled memory system that Libcog can install in the AWS SDK
+ * with the SDK's default, which calls malloc() and free(): first checks that
+ * the pooled one hands out usable, aligned memory and counts it under the
+ * right tags, then measures how many allocations per second each can do, on
+ * one thread and on as many threads as there are processors. With --check,
+ * only does the checks. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <cstddef>
+
+#include <glib.h>
+
+#include "cog/cog-memory-system-private.h"
+
+#define DURATION_USEC (G_USEC_PER_SEC / 2)
+/* Allocations each thread keeps alive at a time, like the strings and model
+ * objects of a request in flight */
+#define N_LIVE 64
+
+/* What the SDK does without a memory manager */
+class MallocMemorySystem : public Aws::Utils::Memory::MemorySystemInterface {
+public:
+  void Begin () override {}
+  void End () override {}
+
+  void *
+  AllocateMemory (std::size_t size,
+                  std::size_t alignment G_GNUC_UNUSED,
+                  const char *tag G_GNUC_UNUSED = nullptr) override
+  {
+    return malloc (size);
+  }
+
+  void FreeMemory (void *memory) override { free (memory); }
+};
+
+/* The SDK passes its tags as string literals */
+static const char *tags[] = {
+  "AWSClient", "AWSString", "CurlHttpClient", "HttpRequest", "JsonValue",
+  "StandardHttpResponse", "libcog", nullptr,
+};
+
+/* Mostly small sizes, with the odd large one */
+static std::size_t
+random_size (GRand *rand)
+{
+  if (g_rand_int_range (rand, 0, 16) == 0)
+    return g_rand_int_range (rand, 1024, 8192);
+  return g_rand_int_range (rand, 1, 256);
+}
+
+static guint64
+tag_statistic (GVariant *statistics,
+               const char *tag,
+               const char *name)
+{
+  guint64 value = 0;
+  g_autoptr(GVariant) entry =
+    g_variant_lookup_value (statistics, tag, G_VARIANT_TYPE_VARDICT);
+  if (entry)
+    g_variant_lookup (entry, name, "t", &value);
+  return value;
+}
+
+/* Runs on a thread of its own, so that the blocks it keeps to itself go back
+ * to @data before it is destroyed */
+static void *
+check_memory_system (void *data)
+{
+  CogMemorySystem& memory = *static_cast<CogMemorySystem *> (data);
+  GRand *rand = g_rand_new_with_seed (42);
+  void *live[N_LIVE * 4] = { nullptr };
+  std::size_t sizes[G_N_ELEMENTS (live)];
+
+  for (unsigned round = 0; round < 100000; round++)
+    {
+      unsigned ix = g_rand_int_range (rand, 0, G_N_ELEMENTS (live));
+      if (live[ix])
+        {
+          guint8 fill = guint8 (ix);
+          for (std::size_t byte = 0; byte < sizes[ix]; byte++)
+            if (static_cast<guint8 *> (live[ix])[byte] != fill)
+              g_error ("Block %u was overwritten", ix);
+          memory.FreeMemory (live[ix]);
+        }
+
+      std::size_t alignment = std::size_t (1) << g_rand_int_range (rand, 0, 7);
+      sizes[ix] = random_size (rand);
+      live[ix] = memory.AllocateMemory (sizes[ix], alignment,
+                                        tags[ix % G_N_ELEMENTS (tags)]);
+      if (!live[ix])
+        g_error ("Out of memory");
+      if (guintptr (live[ix]) % alignment != 0)
+        g_error ("Block of %zu bytes not aligned to %zu", sizes[ix],
+                 alignment);
+      memset (live[ix], guint8 (ix), sizes[ix]);
+    }
+
+  g_autoptr(GVariant) statistics = g_variant_ref_sink (memory.snapshot ());
+  guint64 total = 0;
+  for (unsigned ix = 0; ix < G_N_ELEMENTS (live); ix++)
+    if (live[ix])
+      total += sizes[ix];
+  guint64 counted = 0;
+  for (const char *tag : tags)
+    counted += tag_statistic (statistics, tag ? tag : "(none)", "live-bytes");
+  if (counted != total)
+    g_error ("Counted %" G_GUINT64_FORMAT " live bytes instead of %"
+             G_GUINT64_FORMAT, counted, total);
+
+  for (void *block : live)
+    memory.FreeMemory (block);
+
+  g_autoptr(GVariant) freed = g_variant_ref_sink (memory.snapshot ());
+  for (const char *tag : tags)
+    {
+      const char *name = tag ? tag : "(none)";
+      if (tag_statistic (freed, name, "live-allocations") != 0)
+        g_error ("Tag %s still has live allocations", name);
+    }
+
+  g_rand_free (rand);
+  return NULL;
+}
+
+typedef struct
+{
+  Aws::Utils::Memory::MemorySystemInterface *memory;
+  gint64 deadline;
+  guint64 count;
+} Worker;
+
+static void *
+run_worker (void *data)
+{
+  auto *worker = static_cast<Worker *> (data);
+  GRand *rand = g_rand_new_with_seed (GPOINTER_TO_UINT (g_thread_self ()));
+  void *live[N_LIVE] = { nullptr };
+  std::size_t sizes[1024];
+  for (auto& size : sizes)
+    size = random_size (rand);
+
+  unsigned next = 0;
+  while (g_get_monotonic_time () < worker->deadline)
+    {
+      for (unsigned ix = 0; ix < 1000; ix++, next++)
+        {
+          void *&slot = live[next % N_LIVE];
+          std::size_t size = sizes[next % G_N_ELEMENTS (sizes)];
+          const char *tag = tags[next % G_N_ELEMENTS (tags)];
+          worker->memory->FreeMemory (slot);
+          slot = worker->memory->AllocateMemory (size,
+                                                 alignof (std::max_align_t),
+                                                 tag);
+        }
+      worker->count += 1000;
+    }
+
+  for (void *block : live)
+    worker->memory->FreeMemory (block);
+  g_rand_free (rand);
+  return NULL;
+}
+
+static double
+measure (Aws::Utils::Memory::MemorySystemInterface *memory,
+         unsigned n_threads)
+{
+  gint64 start = g_get_monotonic_time ();
+  Worker *workers = g_new (Worker, n_threads);
+  GThread **threads = g_new (GThread *, n_threads);
+
+  for (unsigned ix = 0; ix < n_threads; ix++)
+    {
+      workers[ix] = { memory, start + DURATION_USEC, 0 };
+      threads[ix] = g_thread_new ("benchmark", run_worker, &workers[ix]);
+    }
+
+  guint64 count = 0;
+  for (unsigned ix = 0; ix < n_threads; ix++)
+    {
+      g_thread_join (threads[ix]);
+      count += workers[ix].count;
+    }
+  g_free (threads);
+  g_free (workers);
+
+  return count * (double) G_USEC_PER_SEC / (g_get_monotonic_time () - start);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  gboolean check_only = argc > 1 && strcmp (argv[1], "--check") == 0;
+
+  CogMemorySystem checked_memory;
+  g_thread_join (g_thread_new ("check", check_memory_system, &checked_memory));
+  if (check_only)
+    return 0;
+
+  MallocMemorySystem malloc_memory;
+  CogMemorySystem pooled_memory;
+  unsigned n_processors = g_get_num_processors ();
+
+  for (unsigned n_threads : { 1u, n_processors })
+    {
+      double malloc_rate = measure (&malloc_memory, n_threads);
+      double pooled_rate = measure (&pooled_memory, n_threads);
+      g_print ("%2u thread(s)  malloc: %12.0f/s  pooled: %12.0f/s  (%.1fx)\n",
+               n_threads, malloc_rate, pooled_rate, pooled_rate / malloc_rate);
+    }
+
+  return 0;
+}
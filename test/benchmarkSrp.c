@@ -0,0 +1,489 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Measures how much processor time the client side of an SRP login takes,
+ * counting all threads, with each session computed when the login starts and
+ * with sessions precomputed in the background. With --check, checks a session
+ * with a fixed secret exponent against a known answer computed with a port of
+ * pycognito's aws_srp.py, then plays the server side of the protocol with
+ * plain OpenSSL arithmetic, and checks that the signatures computed by
+ * CogSrpSession are the ones the server expects. */
+
+#define OPENSSL_API_COMPAT 0x10100000L
+
+#include <string.h>
+#include <sys/resource.h>
+
+#include <glib.h>
+#include <openssl/bn.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+
+#include "cog/cog.h"
+#include "cog/cog-srp-private.h"
+
+#define USER_POOL_ID "us-east-1_Benchmark"
+#define POOL_NAME "Benchmark"
+#define USER_ID "benchmark-user"
+#define PASSWORD "correct horse battery staple"
+#define DURATION_USEC (2 * G_USEC_PER_SEC)
+#define N_CHECKS 20
+
+/* The known answer: a login to KNOWN_USER_POOL_ID with these values gives
+ * KNOWN_SRP_A and KNOWN_SIGNATURE, as computed by pycognito's AWSSRP */
+#define KNOWN_USER_POOL_ID "eu-west-1_KnownAnswer"
+#define KNOWN_USER_ID "7d4e1b5c-2a3f-4e8b-9c1d-0f6a5b3e2d1c"
+#define KNOWN_PASSWORD "Password1!"
+#define KNOWN_A \
+  "b35d2ed9a5d2a9129672a82b2a6925fcba00f12fd3457c1726b5b700560fb2a4" \
+  "525b394b2fef439047b7f71333c504fac5e87e51663ee31de68b4b5bf8748636" \
+  "3a0c707eeed5a47c3e3222908d39e9497cdd779488aa4c649e97d183dd0c36fc" \
+  "390ecc9b39ea19057b30c895e382d4c7157e0e00ebcfa9b84cbb460d9e560ba4"
+#define KNOWN_SALT "9f39d5f6bbeb913e0bfb633f4b1f4196"
+#define KNOWN_SRP_B \
+  "86266f11a78d7e5e5f7bb0ccd828fe8d0f137cf5d37c6dea3e37ee30367804a4" \
+  "0581e46cca064069b5a44948c07bfce567a45053f7453e397c0c376a48f37be8" \
+  "e69308eb15a9269bf0d4910e5315552c5ded19783b82e6e4f7ed969471bc27ee" \
+  "7a2648cea0b72d7bf0a65c3626826e8f13b70033640fbce7d7e4d5d2e5e04886" \
+  "236c39ed85cd96d80bf416f6a292110c7871839145191b97ab0c3d010d553dcb" \
+  "299af3750b26beb6aee04fdea959538d48edfee8039114ab6c564fbe4dbc78e4" \
+  "2db088f92744fe597bc719f6d30493fd5d74cd65a015c0fa2b1aafd41960a0d6" \
+  "4c2629908754ddc804313db97ed6844e5d8707034beba8e542371df282d8f7d6" \
+  "6e4a42eb299e2dcdb0d6efb58e58a4e42c79547395001f2dad9f2c6cb2c7f8e0" \
+  "6d855b028a8de84af901aaf635c46e2097e96a61183d09e065b2a1bb9ac34a4d" \
+  "f4a6a4d85eb3955ce5eb88ef6c1e0372b9df34359177e9521802a774f175f766" \
+  "a183dc4b6c909d76bb57fd074410b858a20ff5691a092df93f740c217d3d8f97"
+#define KNOWN_SRP_A \
+  "17cdbe7a320434400b21fa6fd62d6fabdf87c3451e9a724f2e5690ce871a192c" \
+  "5b8788039daddedc30f45ab44d6de91a1c7aac4978c9c0985bc0f06491766303" \
+  "e4920b3833ccae862bffa38ffa7e1ebd56ff59935c5e52760b9fb5b43b5127bb" \
+  "71fdd5e40835797b0d5a7af84602eb3efbce3c1b1c469be92a869ebd6802daed" \
+  "753cb837f2b5881d466ff90393a5bcc615b186e52df790cde5cf2f4c579a4ba2" \
+  "2bc154ddf86e543c705e58d11ec15af8d214ee8215aa814cc3270e18ba24d17c" \
+  "b1dc0a9b07ac104d2c0fc2629af0b1b6d5303bb010850e509e1a3c2d3d8b49a0" \
+  "fbe941e87ed9e86bee0d1ce9c83df8c04fac5fdaf69a952bcaea9d1934e86580" \
+  "9b4c30bb205a97e733d0927a03d2da294b74bbe7e327a87d862865061ebf8368" \
+  "348c3dd26d78e921f90c9fad6f8024be9eb25ac7d68a40763502a2579b8115c0" \
+  "4b3f76f36963dfd718030e24d1826c466b608535c19b75c25d4a07c7edce239c" \
+  "5183bf0018ba63c928643175d94a264ee2bdef5b8462ef134a091c78b4f3af02"
+#define KNOWN_SECRET_BLOCK \
+  "bUuifVc3rxtj7s//BKgeH62ELuHAB27MRqgzOdNXnBJ0pYAMmEtdVLLwDOtICFzY"
+#define KNOWN_TIMESTAMP "Tue Oct 6 09:05:02 UTC 2026"
+#define KNOWN_SIGNATURE "6njnbNOjFVkqlWlZHuKfIUBthlCeDowAon6oyXUDpIY="
+
+typedef struct
+{
+  BIGNUM *n;
+  BIGNUM *g;
+  BIGNUM *k;
+  BIGNUM *salt;
+  BIGNUM *verifier;
+  BIGNUM *b;
+  BIGNUM *big_b;
+  char *secret_block;
+  BN_CTX *ctx;
+} Server;
+
+static void
+digest_padded (EVP_MD_CTX *md,
+               const BIGNUM *bn)
+{
+  unsigned char buf[385];
+  buf[0] = 0;
+  BN_bn2bin (bn, buf + 1);
+  size_t length = BN_num_bytes (bn);
+  if (length > 0 && !(buf[1] & 0x80))
+    EVP_DigestUpdate (md, buf + 1, length);
+  else
+    EVP_DigestUpdate (md, buf, length + 1);
+}
+
+static BIGNUM *
+hash_pair (const BIGNUM *first,
+           const BIGNUM *second)
+{
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  EVP_MD_CTX *md = EVP_MD_CTX_new ();
+  EVP_DigestInit_ex (md, EVP_sha256 (), NULL);
+  digest_padded (md, first);
+  digest_padded (md, second);
+  EVP_DigestFinal_ex (md, digest, NULL);
+  EVP_MD_CTX_free (md);
+  return BN_bin2bn (digest, sizeof digest, NULL);
+}
+
+static void
+server_init (Server *server)
+{
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  const char *identity = POOL_NAME USER_ID ":" PASSWORD;
+
+  server->ctx = BN_CTX_new ();
+  server->n = BN_get_rfc3526_prime_3072 (NULL);
+  server->g = BN_new ();
+  BN_set_word (server->g, 2);
+  server->k = hash_pair (server->n, server->g);
+
+  server->salt = BN_new ();
+  BN_rand (server->salt, 128, BN_RAND_TOP_ANY, BN_RAND_BOTTOM_ANY);
+  EVP_Digest (identity, strlen (identity), digest, NULL, EVP_sha256 (), NULL);
+  EVP_MD_CTX *md = EVP_MD_CTX_new ();
+  EVP_DigestInit_ex (md, EVP_sha256 (), NULL);
+  digest_padded (md, server->salt);
+  EVP_DigestUpdate (md, digest, sizeof digest);
+  EVP_DigestFinal_ex (md, digest, NULL);
+  EVP_MD_CTX_free (md);
+  BIGNUM *x = BN_bin2bn (digest, sizeof digest, NULL);
+  server->verifier = BN_new ();
+  BN_mod_exp (server->verifier, server->g, x, server->n, server->ctx);
+  BN_free (x);
+
+  unsigned char secret_block[64];
+  RAND_bytes (secret_block, sizeof secret_block);
+  server->secret_block = g_base64_encode (secret_block, sizeof secret_block);
+
+  server->b = BN_new ();
+  server->big_b = BN_new ();
+}
+
+/* Starts a new run of the protocol, with a new B */
+static GHashTable *
+server_challenge (Server *server)
+{
+  BIGNUM *tmp = BN_new ();
+  BN_rand (server->b, 256, BN_RAND_TOP_ANY, BN_RAND_BOTTOM_ANY);
+  BN_mod_exp (tmp, server->g, server->b, server->n, server->ctx);
+  BN_mod_mul (server->big_b, server->k, server->verifier, server->n,
+              server->ctx);
+  BN_mod_add (server->big_b, server->big_b, tmp, server->n, server->ctx);
+  BN_free (tmp);
+
+  char *salt = BN_bn2hex (server->salt);
+  char *big_b = BN_bn2hex (server->big_b);
+  GHashTable *params = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                              g_free);
+  g_hash_table_insert (params, COG_PARAMETER_SALT, g_strdup (salt));
+  g_hash_table_insert (params, COG_PARAMETER_SRP_B, g_strdup (big_b));
+  g_hash_table_insert (params, COG_PARAMETER_SECRET_BLOCK,
+                       g_strdup (server->secret_block));
+  g_hash_table_insert (params, COG_PARAMETER_USER_ID_FOR_SRP,
+                       g_strdup (USER_ID));
+  OPENSSL_free (salt);
+  OPENSSL_free (big_b);
+  return params;
+}
+
+/* Returns the signature that the server expects for @srp_a and @timestamp */
+static char *
+server_expected_signature (Server *server,
+                           const char *srp_a,
+                           const char *timestamp)
+{
+  BIGNUM *big_a = NULL;
+  BN_hex2bn (&big_a, srp_a);
+  BIGNUM *u = hash_pair (big_a, server->big_b);
+
+  /* S = (A * v^u)^b */
+  BIGNUM *s = BN_new ();
+  BN_mod_exp (s, server->verifier, u, server->n, server->ctx);
+  BN_mod_mul (s, big_a, s, server->n, server->ctx);
+  BN_mod_exp (s, s, server->b, server->n, server->ctx);
+
+  unsigned char u_bytes[385], s_bytes[385];
+  unsigned char prk[SHA256_DIGEST_LENGTH], key[SHA256_DIGEST_LENGTH];
+  unsigned char signature[SHA256_DIGEST_LENGTH];
+  size_t u_length = BN_num_bytes (u), s_length = BN_num_bytes (s);
+  u_bytes[0] = s_bytes[0] = 0;
+  BN_bn2bin (u, u_bytes + 1);
+  BN_bn2bin (s, s_bytes + 1);
+  const unsigned char *u_start = u_bytes[1] & 0x80 ? u_bytes : u_bytes + 1;
+  const unsigned char *s_start = s_bytes[1] & 0x80 ? s_bytes : s_bytes + 1;
+  u_length += u_start == u_bytes;
+  s_length += s_start == s_bytes;
+
+  const char *info = "Caldera Derived Key\x01";
+  HMAC (EVP_sha256 (), u_start, u_length, s_start, s_length, prk, NULL);
+  HMAC (EVP_sha256 (), prk, sizeof prk, (const unsigned char *) info,
+        strlen (info), key, NULL);
+
+  size_t secret_block_length;
+  unsigned char *secret_block = g_base64_decode (server->secret_block,
+                                                 &secret_block_length);
+  GByteArray *message = g_byte_array_new ();
+  g_byte_array_append (message, (const guint8 *) POOL_NAME USER_ID,
+                       strlen (POOL_NAME USER_ID));
+  g_byte_array_append (message, secret_block, secret_block_length);
+  g_byte_array_append (message, (const guint8 *) timestamp,
+                       strlen (timestamp));
+  HMAC (EVP_sha256 (), key, 16, message->data, message->len, signature,
+        NULL);
+
+  g_byte_array_unref (message);
+  g_free (secret_block);
+  BN_free (big_a);
+  BN_free (u);
+  BN_free (s);
+  return g_base64_encode (signature, sizeof signature);
+}
+
+static void
+server_clear (Server *server)
+{
+  BN_free (server->n);
+  BN_free (server->g);
+  BN_free (server->k);
+  BN_free (server->salt);
+  BN_free (server->verifier);
+  BN_free (server->b);
+  BN_free (server->big_b);
+  g_free (server->secret_block);
+  BN_CTX_free (server->ctx);
+}
+
+/* Returns the number of checks that failed */
+static unsigned
+run_known_answer_check (void)
+{
+  GError *error = NULL;
+  unsigned n_failed = 0;
+  CogSrpClient *client =
+    COG_SRP_CLIENT (g_object_new (COG_TYPE_SRP_CLIENT,
+                                  "user-pool-id", KNOWN_USER_POOL_ID,
+                                  "n-precomputed", 0,
+                                  NULL));
+  GDateTime *now = g_date_time_new_utc (2026, 10, 6, 9, 5, 2);
+  CogSrpSession *session = _cog_srp_client_start_fixed_session (client,
+                                                                KNOWN_A, now);
+
+  if (g_strcmp0 (cog_srp_session_get_srp_a (session), KNOWN_SRP_A) != 0)
+    {
+      g_printerr ("Known answer: SRP_A %s, expected %s\n",
+                  cog_srp_session_get_srp_a (session), KNOWN_SRP_A);
+      n_failed++;
+    }
+
+  GHashTable *params = g_hash_table_new (g_str_hash, g_str_equal);
+  g_hash_table_insert (params, COG_PARAMETER_SALT, KNOWN_SALT);
+  g_hash_table_insert (params, COG_PARAMETER_SRP_B, KNOWN_SRP_B);
+  g_hash_table_insert (params, COG_PARAMETER_SECRET_BLOCK, KNOWN_SECRET_BLOCK);
+  g_hash_table_insert (params, COG_PARAMETER_USER_ID_FOR_SRP, KNOWN_USER_ID);
+  GHashTable *responses =
+    cog_srp_session_respond_to_password_verifier (session, KNOWN_PASSWORD,
+                                                  params, &error);
+  if (!responses)
+    g_error ("Could not respond: %s", error->message);
+
+  const char *timestamp = g_hash_table_lookup (responses,
+                                               COG_PARAMETER_TIMESTAMP);
+  const char *signature =
+    g_hash_table_lookup (responses, COG_PARAMETER_PASSWORD_CLAIM_SIGNATURE);
+  if (g_strcmp0 (timestamp, KNOWN_TIMESTAMP) != 0)
+    {
+      g_printerr ("Known answer: timestamp %s, expected %s\n", timestamp,
+                  KNOWN_TIMESTAMP);
+      n_failed++;
+    }
+  if (g_strcmp0 (signature, KNOWN_SIGNATURE) != 0)
+    {
+      g_printerr ("Known answer: signature %s, expected %s\n", signature,
+                  KNOWN_SIGNATURE);
+      n_failed++;
+    }
+
+  g_hash_table_unref (responses);
+  g_hash_table_unref (params);
+  cog_srp_session_unref (session);
+  g_date_time_unref (now);
+  g_object_unref (client);
+  return n_failed;
+}
+
+/* A user pool ID without a region name prefix must make logins fail, rather
+ * than crash */
+static unsigned
+run_invalid_pool_check (Server *server)
+{
+  GError *error = NULL;
+  unsigned n_failed = 0;
+  CogSrpClient *client =
+    COG_SRP_CLIENT (g_object_new (COG_TYPE_SRP_CLIENT,
+                                  "user-pool-id", POOL_NAME,
+                                  NULL));
+  CogSrpSession *session = cog_srp_client_start_session (client);
+  GHashTable *params = server_challenge (server);
+
+  if (cog_srp_session_respond_to_password_verifier (session, PASSWORD, params,
+                                                    &error) ||
+      !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT))
+    {
+      g_printerr ("Invalid user pool ID was not refused\n");
+      n_failed++;
+    }
+
+  g_clear_error (&error);
+  g_hash_table_unref (params);
+  cog_srp_session_unref (session);
+  g_object_unref (client);
+  return n_failed;
+}
+
+static int
+run_check (Server *server)
+{
+  GError *error = NULL;
+  CogSrpClient *client = cog_srp_client_new (USER_POOL_ID);
+  unsigned ix, n_failed = 0;
+
+  for (ix = 0; ix < N_CHECKS; ix++)
+    {
+      CogSrpSession *session = cog_srp_client_start_session (client);
+      GHashTable *params = server_challenge (server);
+      GHashTable *responses =
+        cog_srp_session_respond_to_password_verifier (session, PASSWORD,
+                                                      params, &error);
+      if (!responses)
+        g_error ("Could not respond: %s", error->message);
+
+      const char *timestamp = g_hash_table_lookup (responses,
+                                                   COG_PARAMETER_TIMESTAMP);
+      const char *signature =
+        g_hash_table_lookup (responses,
+                             COG_PARAMETER_PASSWORD_CLAIM_SIGNATURE);
+      char *expected =
+        server_expected_signature (server,
+                                   cog_srp_session_get_srp_a (session),
+                                   timestamp);
+      if (g_strcmp0 (signature, expected) != 0)
+        {
+          g_printerr ("Signature %s, expected %s\n", signature, expected);
+          n_failed++;
+        }
+      if (g_strcmp0 (g_hash_table_lookup (responses,
+                                          COG_PARAMETER_PASSWORD_CLAIM_SECRET_BLOCK),
+                     server->secret_block) != 0)
+        {
+          g_printerr ("Secret block was not returned\n");
+          n_failed++;
+        }
+
+      g_free (expected);
+      g_hash_table_unref (responses);
+      g_hash_table_unref (params);
+      cog_srp_session_unref (session);
+    }
+
+  /* An invalid B must be refused */
+  CogSrpSession *session = cog_srp_client_start_session (client);
+  GHashTable *params = server_challenge (server);
+  char *n = BN_bn2hex (server->n);
+  g_hash_table_insert (params, COG_PARAMETER_SRP_B, g_strdup (n));
+  OPENSSL_free (n);
+  if (cog_srp_session_respond_to_password_verifier (session, PASSWORD, params,
+                                                    &error) ||
+      !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA))
+    {
+      g_printerr ("B = N was not refused\n");
+      n_failed++;
+    }
+  g_clear_error (&error);
+  g_hash_table_unref (params);
+  cog_srp_session_unref (session);
+
+  g_object_unref (client);
+
+  n_failed += run_known_answer_check ();
+  n_failed += run_invalid_pool_check (server);
+
+  /* Each signature checked against the server counts as one check, plus B = N
+   * and the invalid pool ID, and the three known values */
+  unsigned n_checks = N_CHECKS + 5;
+  g_print ("%u of %u checks passed\n", n_checks - n_failed, n_checks);
+  return n_failed == 0 ? 0 : 1;
+}
+
+/* Processor time used so far by all the threads of the process, including
+ * those precomputing sessions */
+static gint64
+cpu_time_usec (void)
+{
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_USEC_PER_SEC +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static void
+run_benchmark (const char *name,
+               Server *server,
+               unsigned n_precomputed)
+{
+  GError *error = NULL;
+  CogSrpClient *client =
+    COG_SRP_CLIENT (g_object_new (COG_TYPE_SRP_CLIENT,
+                                  "user-pool-id", USER_POOL_ID,
+                                  "n-precomputed", n_precomputed,
+                                  NULL));
+  GHashTable *params = server_challenge (server);
+  guint64 count = 0;
+
+  /* Give the precomputed sessions time to be ready */
+  if (n_precomputed > 0)
+    g_usleep (G_USEC_PER_SEC / 2);
+
+  gint64 start = g_get_monotonic_time ();
+  gint64 cpu_start = cpu_time_usec ();
+  gint64 deadline = start + DURATION_USEC;
+  while (g_get_monotonic_time () < deadline)
+    {
+      CogSrpSession *session = cog_srp_client_start_session (client);
+      GHashTable *responses =
+        cog_srp_session_respond_to_password_verifier (session, PASSWORD,
+                                                      params, &error);
+      if (!responses)
+        g_error ("Could not respond: %s", error->message);
+      g_hash_table_unref (responses);
+      cog_srp_session_unref (session);
+      count++;
+    }
+  gint64 elapsed = g_get_monotonic_time () - start;
+  gint64 cpu_elapsed = cpu_time_usec () - cpu_start;
+
+  /* Logins per second only measure the cost of a login on one thread when
+   * nothing is precomputed; processor time per login counts the workers */
+  g_print ("%s: %.2f ms of processor time per login, %.0f logins/s\n", name,
+           cpu_elapsed / 1000.0 / count,
+           count * (double) G_USEC_PER_SEC / elapsed);
+
+  g_hash_table_unref (params);
+  g_object_unref (client);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  Server server;
+  int retval = 0;
+
+  server_init (&server);
+
+  if (argc > 1 && strcmp (argv[1], "--check") == 0)
+    {
+      retval = run_check (&server);
+    }
+  else
+    {
+      /* Builds the table of powers before timing anything */
+      CogSrpClient *client = cog_srp_client_new (USER_POOL_ID);
+      cog_srp_session_unref (cog_srp_client_start_session (client));
+      g_object_unref (client);
+
+      run_benchmark ("Sessions computed at start", &server, 0);
+      run_benchmark ("Sessions precomputed in the background", &server,
+                     g_get_num_processors ());
+    }
+
+  server_clear (&server);
+  return retval;
+}
@@ -0,0 +1,211 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Measures how many tokens per second CogTokenVerifier can verify, using all
+ * processors, both with a cold cache (every token verified from scratch) and a
+ * warm cache (the same token verified over and over). */
+
+#define OPENSSL_API_COMPAT 0x10100000L
+
+#include <string.h>
+
+#include <glib.h>
+#include <openssl/bn.h>
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+
+#include "cog/cog.h"
+
+#define USER_POOL_ID "us-east-1_Benchmark"
+#define CLIENT_ID "benchmarkclient"
+#define KEY_ID "benchmark-key"
+#define DURATION_USEC (2 * G_USEC_PER_SEC)
+
+typedef struct
+{
+  CogTokenVerifier *verifier;
+  const char *token;
+  gint64 deadline;
+  guint64 count;
+} Worker;
+
+static char *
+base64url_encode (const unsigned char *data,
+                  size_t length)
+{
+  char *retval = g_base64_encode (data, length);
+  char *iter;
+  for (iter = retval; *iter && *iter != '='; iter++)
+    {
+      if (*iter == '+')
+        *iter = '-';
+      else if (*iter == '/')
+        *iter = '_';
+    }
+  *iter = '\0';
+  return retval;
+}
+
+static char *
+bignum_to_base64url (const BIGNUM *bn)
+{
+  size_t length = BN_num_bytes (bn);
+  unsigned char *data = g_malloc (length);
+  BN_bn2bin (bn, data);
+  char *retval = base64url_encode (data, length);
+  g_free (data);
+  return retval;
+}
+
+static EVP_PKEY *
+generate_key (void)
+{
+  EVP_PKEY *key = NULL;
+  EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id (EVP_PKEY_RSA, NULL);
+  if (!ctx || EVP_PKEY_keygen_init (ctx) != 1 ||
+      EVP_PKEY_CTX_set_rsa_keygen_bits (ctx, 2048) != 1 ||
+      EVP_PKEY_keygen (ctx, &key) != 1)
+    g_error ("Could not generate RSA key");
+  EVP_PKEY_CTX_free (ctx);
+  return key;
+}
+
+static char *
+make_jwks (EVP_PKEY *key)
+{
+  const BIGNUM *n, *e;
+  RSA_get0_key (EVP_PKEY_get0_RSA (key), &n, &e, NULL);
+  char *n64 = bignum_to_base64url (n);
+  char *e64 = bignum_to_base64url (e);
+  char *retval = g_strdup_printf ("{\"keys\": [{\"kty\": \"RSA\", "
+                                  "\"alg\": \"RS256\", \"use\": \"sig\", "
+                                  "\"kid\": \"" KEY_ID "\", "
+                                  "\"n\": \"%s\", \"e\": \"%s\"}]}",
+                                  n64, e64);
+  g_free (n64);
+  g_free (e64);
+  return retval;
+}
+
+static char *
+make_token (EVP_PKEY *key,
+            unsigned serial)
+{
+  const char *header = "{\"kid\":\"" KEY_ID "\",\"alg\":\"RS256\"}";
+  char *payload =
+    g_strdup_printf ("{\"sub\":\"user-%u\","
+                     "\"iss\":\"https://cognito-idp.us-east-1.amazonaws.com/" USER_POOL_ID "\","
+                     "\"client_id\":\"" CLIENT_ID "\",\"token_use\":\"access\","
+                     "\"exp\":%" G_GINT64_FORMAT "}",
+                     serial, g_get_real_time () / G_USEC_PER_SEC + 3600);
+  char *header64 = base64url_encode ((const unsigned char *) header,
+                                     strlen (header));
+  char *payload64 = base64url_encode ((const unsigned char *) payload,
+                                      strlen (payload));
+  char *signed_data = g_strconcat (header64, ".", payload64, NULL);
+
+  unsigned char signature[512];
+  size_t signature_length = sizeof signature;
+  EVP_MD_CTX *ctx = EVP_MD_CTX_new ();
+  if (EVP_DigestSignInit (ctx, NULL, EVP_sha256 (), NULL, key) != 1 ||
+      EVP_DigestSign (ctx, signature, &signature_length,
+                      (const unsigned char *) signed_data,
+                      strlen (signed_data)) != 1)
+    g_error ("Could not sign token");
+  EVP_MD_CTX_free (ctx);
+
+  char *signature64 = base64url_encode (signature, signature_length);
+  char *retval = g_strconcat (signed_data, ".", signature64, NULL);
+
+  g_free (payload);
+  g_free (header64);
+  g_free (payload64);
+  g_free (signed_data);
+  g_free (signature64);
+  return retval;
+}
+
+static void *
+worker_run (void *data)
+{
+  Worker *worker = data;
+  GError *error = NULL;
+
+  while (g_get_monotonic_time () < worker->deadline)
+    {
+      if (!cog_token_verifier_verify (worker->verifier, worker->token,
+                                      COG_TOKEN_USE_ACCESS, NULL, &error))
+        g_error ("Verification failed: %s", error->message);
+      worker->count++;
+    }
+
+  return NULL;
+}
+
+static void
+run_benchmark (const char *name,
+               const char *jwks,
+               const char *token,
+               unsigned cache_size,
+               unsigned n_threads)
+{
+  GError *error = NULL;
+  CogTokenVerifier *verifier =
+    COG_TOKEN_VERIFIER (g_object_new (COG_TYPE_TOKEN_VERIFIER,
+                                      "user-pool-id", USER_POOL_ID,
+                                      "client-id", CLIENT_ID,
+                                      "cache-size", cache_size,
+                                      NULL));
+  if (!cog_token_verifier_load_keys_from_data (verifier, jwks, &error))
+    g_error ("Could not load keys: %s", error->message);
+
+  Worker *workers = g_new0 (Worker, n_threads);
+  GThread **threads = g_new0 (GThread *, n_threads);
+  gint64 start = g_get_monotonic_time ();
+  unsigned ix;
+
+  for (ix = 0; ix < n_threads; ix++)
+    {
+      workers[ix].verifier = verifier;
+      workers[ix].token = token;
+      workers[ix].deadline = start + DURATION_USEC;
+      threads[ix] = g_thread_new (name, worker_run, &workers[ix]);
+    }
+
+  guint64 total = 0;
+  for (ix = 0; ix < n_threads; ix++)
+    {
+      g_thread_join (threads[ix]);
+      total += workers[ix].count;
+    }
+  gint64 elapsed = g_get_monotonic_time () - start;
+
+  g_print ("%s, %u threads: %.0f verifications/s\n", name, n_threads,
+           total * (double) G_USEC_PER_SEC / elapsed);
+
+  g_free (threads);
+  g_free (workers);
+  g_object_unref (verifier);
+}
+
+int
+main (void)
+{
+  cog_init_default ();
+
+  EVP_PKEY *key = generate_key ();
+  char *jwks = make_jwks (key);
+  char *token = make_token (key, 1);
+  unsigned n_threads = g_get_num_processors ();
+
+  run_benchmark ("Cold cache", jwks, token, 0, 1);
+  run_benchmark ("Cold cache", jwks, token, 0, n_threads);
+  run_benchmark ("Warm cache", jwks, token, 1024, 1);
+  run_benchmark ("Warm cache", jwks, token, 1024, n_threads);
+
+  g_free (token);
+  g_free (jwks);
+  EVP_PKEY_free (key);
+
+  cog_shutdown ();
+  return 0;
+}
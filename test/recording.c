@@ -0,0 +1,70 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include <string.h>
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "test/recording.h"
+
+static void
+add_exchange (GVariantBuilder *exchanges,
+              const RecordedExchange *exchange)
+{
+  char *full_target = g_strconcat ("AWSCognitoIdentityProviderService.",
+                                   exchange->target, NULL);
+  GVariantBuilder headers;
+  g_variant_builder_init (&headers, G_VARIANT_TYPE ("a{ss}"));
+  g_variant_builder_add (&headers, "{ss}", "content-type",
+                         "application/x-amz-json-1.1");
+  g_variant_builder_add (exchanges, "(ssqa{ss}@ay)", full_target, "{}", 200,
+                         &headers,
+                         g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE,
+                                                    exchange->body,
+                                                    strlen (exchange->body),
+                                                    1));
+  g_free (full_target);
+}
+
+/* Writes @exchanges to a temporary file and creates a client that replays
+ * them, in fixture->client */
+void
+recording_fixture_set_up (RecordingFixture *fixture,
+                          const RecordedExchange *exchanges,
+                          size_t n_exchanges)
+{
+  GError *error = NULL;
+
+  fixture->tmpdir = g_dir_make_tmp ("libcog-test-XXXXXX", &error);
+  g_assert_no_error (error);
+  fixture->path = g_build_filename (fixture->tmpdir, "test.rec", NULL);
+
+  GVariantBuilder builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssqa{ss}ay)"));
+  for (size_t ix = 0; ix < n_exchanges; ix++)
+    add_exchange (&builder, &exchanges[ix]);
+  GVariant *recording =
+    g_variant_ref_sink (g_variant_new ("(sua(ssqa{ss}ay))", "libcog-transport",
+                                       1, &builder));
+  g_file_set_contents (fixture->path, g_variant_get_data (recording),
+                       g_variant_get_size (recording), &error);
+  g_assert_no_error (error);
+  g_variant_unref (recording);
+
+  CogTransport *transport = cog_transport_new_replayer (fixture->path, &error);
+  g_assert_no_error (error);
+  fixture->client = COG_CLIENT (g_object_new (COG_TYPE_CLIENT,
+                                              "transport", transport, NULL));
+  g_object_unref (transport);
+}
+
+void
+recording_fixture_tear_down (RecordingFixture *fixture)
+{
+  g_object_unref (fixture->client);
+  g_unlink (fixture->path);
+  g_rmdir (fixture->tmpdir);
+  g_free (fixture->path);
+  g_free (fixture->tmpdir);
+}
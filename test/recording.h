@@ -0,0 +1,28 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#pragma once
+
+#include <stddef.h>
+
+#include "cog/cog.h"
+
+/* A canned answer to one Cognito operation, e.g. "GetUser" */
+typedef struct
+{
+  const char *target;
+  const char *body;
+} RecordedExchange;
+
+/* A client that answers requests from a recording in a temporary file, for
+ * the C tests; like writeRecording() in recording.js */
+typedef struct
+{
+  char *tmpdir;
+  char *path;
+  CogClient *client;
+} RecordingFixture;
+
+void recording_fixture_set_up (RecordingFixture *fixture,
+                               const RecordedExchange *exchanges,
+                               size_t n_exchanges);
+void recording_fixture_tear_down (RecordingFixture *fixture);
@@ -0,0 +1,69 @@
+/* exported makeRecording, readRequests, removeRecordings, replayRecording,
+secretHash, writeRecording */
+
+const {Cog, Gio, GLib} = imports.gi;
+const ByteArray = imports.byteArray;
+
+// Temporary files made by makeRecording(), as [tmpdir, path]
+const recordings = [];
+
+// Writes a file that can be loaded with Cog.Transport.new_replayer().
+// exchanges: array of {target, request, status, body}, where target is the
+// name of the Cognito operation, e.g. 'GetUser'
+function writeRecording(path, exchanges) {
+    const recording = new GLib.Variant('(sua(ssqa{ss}ay))', [
+        'libcog-transport', 1,
+        exchanges.map(({target, request = '{}', status = 200, body}) => [
+            `AWSCognitoIdentityProviderService.${target}`, request, status,
+            {'content-type': 'application/x-amz-json-1.1'},
+            ByteArray.fromString(body),
+        ]),
+    ]);
+    GLib.file_set_contents(path, recording.get_data_as_bytes().toArray());
+}
+
+// Returns the requests that a transport with keepRequests set has handled so
+// far, as an array of {target, headers, body}, where target is the name of the
+// Cognito operation and headers has lowercase names
+function readRequests(transport) {
+    const requests = transport.get_requests().deep_unpack();
+    return requests.map(([target, headers, body]) => ({
+        target: target.replace(/^AWSCognitoIdentityProviderService\./, ''),
+        headers,
+        body: JSON.parse(body),
+    }));
+}
+
+// Computes SECRET_HASH the way Cognito documents it, for comparing with the
+// requests returned by readRequests()
+function secretHash(secret, username, clientId) {
+    const hex = GLib.compute_hmac_for_string(GLib.ChecksumType.SHA256,
+        ByteArray.fromString(secret), `${username}${clientId}`, -1);
+    const digest = hex.match(/../g).map(byte => parseInt(byte, 16));
+    return GLib.base64_encode(Uint8Array.from(digest));
+}
+
+// Writes a recording of exchanges to a file in a new temporary directory, like
+// recording_fixture_set_up() in recording.c, and returns its path. Call
+// removeRecordings() once the tests using it are done.
+function makeRecording(exchanges) {
+    const tmpdir = GLib.Dir.make_tmp('libcog-test-XXXXXX');
+    const path = GLib.build_filenamev([tmpdir, 'test.rec']);
+    writeRecording(path, exchanges);
+    recordings.push([tmpdir, path]);
+    return path;
+}
+
+// Returns a transport replaying a recording of exchanges made with
+// makeRecording()
+function replayRecording(exchanges) {
+    return Cog.Transport.new_replayer(makeRecording(exchanges));
+}
+
+// Deletes the files that makeRecording() has made so far
+function removeRecordings() {
+    recordings.splice(0).forEach(([tmpdir, path]) => {
+        Gio.File.new_for_path(path).delete(null);
+        Gio.File.new_for_path(tmpdir).delete(null);
+    });
+}
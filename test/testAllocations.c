@@ -0,0 +1,273 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Checks that the asynchronous API unpacks each result into its return values
+ * on the worker thread, so that the _finish() functions only hand them over
+ * and do not allocate anything. Allocations are counted by wrapping the C
+ * library's allocator, which is specific to glibc. */
+
+#include <stdlib.h>
+
+#include <gio/gio.h>
+#include <glib.h>
+
+#include "cog/cog.h"
+#include "test/recording.h"
+
+#define ACCESS_TOKEN "token"
+#define CLIENT_ID "testclient"
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n_members,
+                            size_t size);
+extern void *__libc_realloc (void *ptr,
+                             size_t size);
+
+static __thread gboolean counting;
+static __thread unsigned n_allocations;
+
+void *
+malloc (size_t size)
+{
+  if (counting)
+    n_allocations++;
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n_members,
+        size_t size)
+{
+  if (counting)
+    n_allocations++;
+  return __libc_calloc (n_members, size);
+}
+
+void *
+realloc (void *ptr,
+         size_t size)
+{
+  if (counting)
+    n_allocations++;
+  return __libc_realloc (ptr, size);
+}
+
+static void
+start_counting (void)
+{
+  n_allocations = 0;
+  counting = TRUE;
+}
+
+static unsigned
+stop_counting (void)
+{
+  counting = FALSE;
+  return n_allocations;
+}
+
+typedef struct
+{
+  RecordingFixture recording;
+  GAsyncResult *res;
+} Fixture;
+
+static const RecordedExchange exchanges[] = {
+  {"GetUser",
+   "{\"Username\": \"alice\", \"UserAttributes\": "
+   "[{\"Name\": \"email\", \"Value\": \"alice@example.com\"}]}"},
+  {"InitiateAuth",
+   "{\"AuthenticationResult\": {\"AccessToken\": \"access\", "
+   "\"ExpiresIn\": 3600, \"IdToken\": \"id\", "
+   "\"RefreshToken\": \"refresh\", \"TokenType\": \"Bearer\"}}"},
+  {"SignUp",
+   "{\"UserConfirmed\": false, \"UserSub\": \"sub\", "
+   "\"CodeDeliveryDetails\": {\"AttributeName\": \"email\", "
+   "\"DeliveryMedium\": \"EMAIL\", \"Destination\": \"a***@e***\"}}"},
+  {"UpdateUserAttributes",
+   "{\"CodeDeliveryDetailsList\": [{\"AttributeName\": \"email\", "
+   "\"DeliveryMedium\": \"EMAIL\", \"Destination\": \"b***@e***\"}]}"},
+};
+
+static void
+fixture_set_up (Fixture *fixture,
+                const void *data G_GNUC_UNUSED)
+{
+  recording_fixture_set_up (&fixture->recording, exchanges,
+                            G_N_ELEMENTS (exchanges));
+}
+
+static void
+fixture_tear_down (Fixture *fixture,
+                   const void *data G_GNUC_UNUSED)
+{
+  g_clear_object (&fixture->res);
+  recording_fixture_tear_down (&fixture->recording);
+}
+
+static void
+store_result (GObject *source G_GNUC_UNUSED,
+              GAsyncResult *res,
+              void *data)
+{
+  Fixture *fixture = data;
+  fixture->res = g_object_ref (res);
+}
+
+static void
+wait_for_result (Fixture *fixture)
+{
+  while (!fixture->res)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+test_get_user_finish (Fixture *fixture,
+                      const void *data G_GNUC_UNUSED)
+{
+  char *username, *preferred_mfa_setting, **user_mfa_settings_list;
+  GHashTable *user_attributes;
+  GList *mfa_options;
+  GError *error = NULL;
+
+  cog_client_get_user_async (fixture->recording.client, ACCESS_TOKEN, NULL,
+                             store_result, fixture);
+  wait_for_result (fixture);
+
+  start_counting ();
+  gboolean success =
+    cog_client_get_user_finish (fixture->recording.client, fixture->res,
+                                &username, &user_attributes, &mfa_options,
+                                &preferred_mfa_setting,
+                                &user_mfa_settings_list, &error);
+  g_assert_cmpuint (stop_counting (), ==, 0);
+
+  g_assert_no_error (error);
+  g_assert_true (success);
+  g_assert_cmpstr (username, ==, "alice");
+  g_assert_cmpstr (g_hash_table_lookup (user_attributes, "email"), ==,
+                   "alice@example.com");
+
+  g_free (username);
+  g_hash_table_unref (user_attributes);
+  g_list_free_full (mfa_options, (GDestroyNotify) cog_mfa_option_unref);
+  g_free (preferred_mfa_setting);
+  g_strfreev (user_mfa_settings_list);
+}
+
+static void
+test_initiate_auth_finish (Fixture *fixture,
+                           const void *data G_GNUC_UNUSED)
+{
+  CogAuthenticationResult *auth_result;
+  CogChallengeName challenge_name;
+  GHashTable *challenge_parameters;
+  char *session;
+  GError *error = NULL;
+
+  GHashTable *auth_parameters = g_hash_table_new (g_str_hash, g_str_equal);
+  g_hash_table_insert (auth_parameters, COG_PARAMETER_USERNAME, "alice");
+  g_hash_table_insert (auth_parameters, COG_PARAMETER_PASSWORD, "password");
+  cog_client_initiate_auth_async (fixture->recording.client,
+                                  COG_AUTH_FLOW_USER_PASSWORD_AUTH,
+                                  auth_parameters, CLIENT_ID, NULL, NULL,
+                                  NULL, NULL, store_result, fixture);
+  g_hash_table_unref (auth_parameters);
+  wait_for_result (fixture);
+
+  start_counting ();
+  gboolean success =
+    cog_client_initiate_auth_finish (fixture->recording.client, fixture->res,
+                                     &auth_result, &challenge_name,
+                                     &challenge_parameters, &session, &error);
+  g_assert_cmpuint (stop_counting (), ==, 0);
+
+  g_assert_no_error (error);
+  g_assert_true (success);
+  g_assert_cmpint (challenge_name, ==, COG_CHALLENGE_NAME_NOT_SET);
+  g_assert_cmpstr (auth_result->access_token, ==, "access");
+
+  cog_authentication_result_unref (auth_result);
+}
+
+static void
+test_sign_up_finish (Fixture *fixture,
+                     const void *data G_GNUC_UNUSED)
+{
+  gboolean user_confirmed;
+  CogCodeDeliveryDetails *code_delivery_details;
+  const char *user_sub;
+  GError *error = NULL;
+
+  cog_client_sign_up_async (fixture->recording.client, CLIENT_ID, NULL,
+                            "alice", "password", NULL, NULL, NULL, NULL, NULL,
+                            store_result, fixture);
+  wait_for_result (fixture);
+
+  start_counting ();
+  gboolean success =
+    cog_client_sign_up_finish (fixture->recording.client, fixture->res,
+                               &user_confirmed, &code_delivery_details,
+                               &user_sub, &error);
+  g_assert_cmpuint (stop_counting (), ==, 0);
+
+  g_assert_no_error (error);
+  g_assert_true (success);
+  g_assert_false (user_confirmed);
+  g_assert_cmpstr (user_sub, ==, "sub");
+
+  cog_code_delivery_details_unref (code_delivery_details);
+  g_free ((char *) user_sub);
+}
+
+static void
+test_update_user_attributes_finish (Fixture *fixture,
+                                    const void *data G_GNUC_UNUSED)
+{
+  GList *code_delivery_details_list;
+  GError *error = NULL;
+
+  GHashTable *user_attributes = g_hash_table_new (g_str_hash, g_str_equal);
+  g_hash_table_insert (user_attributes, "email", "bob@example.com");
+  cog_client_update_user_attributes_async (fixture->recording.client,
+                                           ACCESS_TOKEN, user_attributes, NULL,
+                                           store_result, fixture);
+  g_hash_table_unref (user_attributes);
+  wait_for_result (fixture);
+
+  start_counting ();
+  gboolean success =
+    cog_client_update_user_attributes_finish (fixture->recording.client,
+                                              fixture->res,
+                                              &code_delivery_details_list,
+                                              &error);
+  g_assert_cmpuint (stop_counting (), ==, 0);
+
+  g_assert_no_error (error);
+  g_assert_true (success);
+  g_assert_cmpuint (g_list_length (code_delivery_details_list), ==, 1);
+
+  g_list_free_full (code_delivery_details_list,
+                    (GDestroyNotify) cog_code_delivery_details_unref);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+  cog_init_default ();
+
+  g_test_add ("/allocations/get-user-finish", Fixture, NULL,
+              fixture_set_up, test_get_user_finish, fixture_tear_down);
+  g_test_add ("/allocations/initiate-auth-finish", Fixture, NULL,
+              fixture_set_up, test_initiate_auth_finish, fixture_tear_down);
+  g_test_add ("/allocations/sign-up-finish", Fixture, NULL,
+              fixture_set_up, test_sign_up_finish, fixture_tear_down);
+  g_test_add ("/allocations/update-user-attributes-finish", Fixture, NULL,
+              fixture_set_up, test_update_user_attributes_finish,
+              fixture_tear_down);
+
+  int retval = g_test_run ();
+  cog_shutdown ();
+  return retval;
+}
@@ -1,10 +1,15 @@
-const {Cog} = imports.gi;
+const {Cog, Gio, GLib} = imports.gi;
+const {makeRecording, readRequests, removeRecordings, replayRecording,
+    secretHash} = imports.test.recording;
 
-describe('API client', function () {
-    beforeAll(function () {
-        Cog.init_default();
-    });
+// Libcog may only be initialized once per process
+beforeAll(function () {
+    Cog.init_default();
+});
+
+afterAll(removeRecordings);
 
+describe('API client', function () {
     it('can be constructed', function () {
         void new Cog.Client();
     });
@@ -12,4 +17,942 @@ describe('API client', function () {
     it('can be constructed with params', function () {
         void new Cog.Client({region: Cog.Region.US_EAST_2});
     });
+
+    it('can be constructed with HTTP transport settings', function () {
+        const client = new Cog.Client({
+            maxConnections: 64,
+            connectTimeout: 500,
+            requestTimeout: 10000,
+            tcpKeepAlive: false,
+            tcpKeepAliveInterval: 20000,
+        });
+        expect(client.maxConnections).toEqual(64);
+        expect(client.connectTimeout).toEqual(500);
+        expect(client.requestTimeout).toEqual(10000);
+        expect(client.tcpKeepAlive).toBeFalsy();
+        expect(client.tcpKeepAliveInterval).toEqual(20000);
+    });
+
+    it('can be constructed with an executor', function () {
+        const executor = new Cog.Executor({maxThreads: 4, maxQueued: 16});
+        const client = new Cog.Client({executor});
+        expect(client.executor).toBe(executor);
+        expect(executor.queueDepth).toEqual(0);
+    });
+});
+
+describe('User cache', function () {
+    let transport;
+
+    beforeAll(function () {
+        transport = replayRecording([{
+            target: 'GetUser',
+            body: JSON.stringify({
+                Username: 'alice',
+                UserAttributes: [{Name: 'email', Value: 'alice@example.com'}],
+            }),
+        }, {
+            target: 'UpdateUserAttributes',
+            body: '{}',
+        }]);
+    });
+
+    function getEmail(client, token) {
+        const [, , attributes] = client.get_user(token, null);
+        return attributes['email'];
+    }
+
+    it('is disabled by default', function () {
+        const client = new Cog.Client({transport});
+        expect(client.userCacheTtl).toEqual(0);
+        client.update_user_attributes('token', {email: 'bob@example.com'},
+            null);
+        expect(getEmail(client, 'token')).toEqual('alice@example.com');
+    });
+
+    it('is updated by a successful attribute update', function () {
+        const client = new Cog.Client({transport, userCacheTtl: 60});
+        expect(getEmail(client, 'token')).toEqual('alice@example.com');
+        client.update_user_attributes('token', {email: 'bob@example.com'},
+            null);
+        expect(getEmail(client, 'token')).toEqual('bob@example.com');
+        expect(getEmail(client, 'other-token')).toEqual('alice@example.com');
+    });
+
+    // The server keeps the old email until the new one is verified
+    it('drops the user when an attribute update must be verified', function () {
+        const client = new Cog.Client({
+            transport: replayRecording([{
+                target: 'GetUser',
+                body: JSON.stringify({
+                    Username: 'alice',
+                    UserAttributes: [{Name: 'email', Value: 'alice@example.com'}],
+                }),
+            }, {
+                target: 'UpdateUserAttributes',
+                body: JSON.stringify({
+                    CodeDeliveryDetailsList: [{
+                        AttributeName: 'email',
+                        DeliveryMedium: 'EMAIL',
+                        Destination: 'b***@e***.com',
+                    }],
+                }),
+            }, {
+                target: 'GetUser',
+                body: JSON.stringify({
+                    Username: 'alice',
+                    UserAttributes: [{Name: 'email', Value: 'carol@example.com'}],
+                }),
+            }]),
+            userCacheTtl: 60,
+        });
+        expect(getEmail(client, 'token')).toEqual('alice@example.com');
+        const [, details] = client.update_user_attributes('token',
+            {email: 'bob@example.com'}, null);
+        expect(details.length).toEqual(1);
+        expect(getEmail(client, 'token')).toEqual('carol@example.com');
+    });
+
+    it('does not keep results larger than its maximum size', function () {
+        const client = new Cog.Client({
+            transport,
+            userCacheTtl: 60,
+            userCacheMaxSize: 1,
+        });
+        expect(getEmail(client, 'token')).toEqual('alice@example.com');
+        client.update_user_attributes('token', {email: 'bob@example.com'},
+            null);
+        expect(getEmail(client, 'token')).toEqual('alice@example.com');
+    });
+});
+
+describe('Concurrent get_user requests', function () {
+    let path;
+
+    beforeAll(function () {
+        path = makeRecording([
+            {target: 'GetUser', body: JSON.stringify({Username: 'alice'})},
+            {target: 'GetUser', body: JSON.stringify({Username: 'bob'})},
+        ]);
+    });
+
+    // The replayer serves the recorded responses in turn, so every request
+    // sees "alice" only if a single GetUser was sent
+    it('are coalesced for the same access token', async function () {
+        const transport = Cog.Transport.new_replayer(path);
+        transport.latency = 100000;
+        const client = new Cog.Client({transport});
+        const results = await Promise.all([...Array(5)].map(() =>
+            client.get_user_async('token', null)));
+        expect(results.map(([, username]) => username))
+            .toEqual(Array(5).fill('alice'));
+    });
+
+    it('are not coalesced for different access tokens', async function () {
+        const transport = Cog.Transport.new_replayer(path);
+        transport.latency = 100000;
+        const client = new Cog.Client({transport});
+        const results = await Promise.all(['token1', 'token2'].map(token =>
+            client.get_user_async(token, null)));
+        expect(results.map(([, username]) => username).sort())
+            .toEqual(['alice', 'bob']);
+    });
+});
+
+describe('Completions', function () {
+    let path;
+
+    beforeAll(function () {
+        path = makeRecording([
+            {target: 'GetUser', body: JSON.stringify({Username: 'alice'})},
+        ]);
+    });
+
+    it('are all counted', async function () {
+        const transport = Cog.Transport.new_replayer(path);
+        const client = new Cog.Client({transport});
+        await Promise.all(['token1', 'token2', 'token3'].map(token =>
+            client.get_user_async(token, null)));
+        expect(client.get_dispatched_completion_count()).toEqual(3);
+        expect(client.get_completion_dispatch_count()).toBeGreaterThan(0);
+        expect(client.get_completion_dispatch_count()).toBeLessThanOrEqual(3);
+    });
+
+    it('are delivered at most completion-max-batch at a time', async function () {
+        const transport = Cog.Transport.new_replayer(path);
+        transport.latency = 100000;
+        const client = new Cog.Client({transport, completionMaxBatch: 2});
+        const tokens = [...Array(7)].map((_, ix) => `token${ix}`);
+        await Promise.all(tokens.map(token =>
+            client.get_user_async(token, null)));
+        expect(client.get_dispatched_completion_count()).toEqual(7);
+        expect(client.get_max_completions_per_dispatch()).toBeLessThanOrEqual(2);
+        expect(client.get_completion_dispatch_count()).toBeGreaterThanOrEqual(4);
+    });
+});
+
+describe('Batch get_user requests', function () {
+    let client;
+
+    beforeEach(function () {
+        const transport = replayRecording([
+            {target: 'GetUser', body: JSON.stringify({Username: 'alice'})},
+            {
+                target: 'GetUser',
+                status: 400,
+                body: JSON.stringify({
+                    __type: 'NotAuthorizedException',
+                    message: 'Access Token has expired',
+                }),
+            },
+        ]);
+        client = new Cog.Client({transport});
+    });
+
+    function getUsername(item) {
+        const [, username] = item.get_user();
+        return username;
+    }
+
+    it('returns results and errors in input order', async function () {
+        const items = await client.get_user_batch_async(
+            ['token1', 'malformed token', 'token2'], 1, null, null);
+        expect(items.map(item => item.get_index())).toEqual([0, 1, 2]);
+        expect(items.map(item => item.get_access_token()))
+            .toEqual(['token1', 'malformed token', 'token2']);
+        expect(getUsername(items[0])).toEqual('alice');
+        expect(() => items[1].get_user()).toThrowError(
+            Cog.IdentityProviderError, /Malformed/);
+        expect(() => items[2].get_user()).toThrowError(
+            Cog.IdentityProviderError, /expired/);
+    });
+
+    it('returns an empty array for no tokens', async function () {
+        const items = await client.get_user_batch_async([], 0, null, null);
+        expect(items.length).toEqual(0);
+    });
+
+    it('reports each item as it completes', function (done) {
+        const seen = [];
+        client.get_user_batch_async(['token1', 'token2'], 1, null,
+            (client_, item) => seen.push(item.get_index()),
+            (client_, res) => {
+                const items = client_.get_user_batch_finish(res);
+                expect(items.length).toEqual(2);
+                expect(seen).toEqual([0, 1]);
+                done();
+            });
+    });
+
+    it('fails lookups not yet started when cancelled', async function () {
+        const cancellable = new Gio.Cancellable();
+        cancellable.cancel();
+        const items = await client.get_user_batch_async(['token1', 'token2'],
+            1, cancellable, null);
+        items.forEach(item => expect(() => item.get_user()).toThrowError(
+            Gio.IOErrorEnum, /cancelled/i));
+    });
+});
+
+describe('Cancelling a request', function () {
+    const LATENCY = 500000;  // µs
+    let transport;
+
+    async function expectCancelled(promise) {
+        const error = await promise.then(() => null, e => e);
+        expect(error).not.toBeNull();
+        expect(error.matches(Gio.IOErrorEnum, Gio.IOErrorEnum.CANCELLED))
+            .toBeTruthy();
+    }
+
+    beforeEach(function () {
+        transport = replayRecording([
+            {target: 'GetUser', body: JSON.stringify({Username: 'alice'})},
+        ]);
+        transport.latency = LATENCY;
+    });
+
+    it('aborts it while it is being sent', async function () {
+        const client = new Cog.Client({transport});
+        const cancellable = new Gio.Cancellable();
+        const start = GLib.get_monotonic_time();
+        const promise = client.fetch_user_async('token', cancellable);
+        GLib.timeout_add(GLib.PRIORITY_DEFAULT, 50, () => {
+            cancellable.cancel();
+            return GLib.SOURCE_REMOVE;
+        });
+        await expectCancelled(promise);
+        expect(GLib.get_monotonic_time() - start).toBeLessThan(LATENCY);
+    });
+
+    it('drops it while it is waiting to be sent', async function () {
+        const executor = new Cog.Executor({maxThreads: 1, maxQueued: 4});
+        const client = new Cog.Client({transport, executor});
+        const cancellable = new Gio.Cancellable();
+        const start = GLib.get_monotonic_time();
+        const first = client.fetch_user_async('token1', null);
+        const second = client.fetch_user_async('token2', cancellable);
+        cancellable.cancel();
+        await expectCancelled(second);
+        await first;
+        // The dropped request would have taken another round trip
+        expect(GLib.get_monotonic_time() - start).toBeLessThan(2 * LATENCY);
+    });
+
+    it('does not abort a shared request another caller is waiting on',
+        async function () {
+            const client = new Cog.Client({transport});
+            const cancellable = new Gio.Cancellable();
+            const cancelled = client.fetch_user_async('token', cancellable);
+            const other = client.fetch_user_async('token', null);
+            cancellable.cancel();
+            await expectCancelled(cancelled);
+            expect((await other).get_username()).toEqual('alice');
+        });
+});
+
+describe('Retrying a request', function () {
+    let transport;
+
+    beforeEach(function () {
+        transport = replayRecording([
+            {
+                target: 'GetUser',
+                status: 400,
+                body: JSON.stringify({
+                    __type: 'TooManyRequestsException',
+                    message: 'Too many requests',
+                }),
+            },
+        ]);
+    });
+
+    function getUserError(client) {
+        try {
+            client.get_user('token', null);
+        } catch (e) {
+            return e;
+        }
+        return null;
+    }
+
+    it('reports the number of attempts', function () {
+        const client = new Cog.Client({
+            transport,
+            maxAttempts: 3,
+            retryBaseDelay: 1,
+        });
+        const error = getUserError(client);
+        expect(error.matches(Cog.IdentityProviderError,
+            Cog.IdentityProviderError.TOO_MANY_REQUESTS)).toBeTruthy();
+        expect(error.message).toMatch(/\(3 attempts\)$/);
+        expect(Cog.identity_provider_error_get_attempts(error)).toEqual(3);
+    });
+
+    it('does not retry with max-attempts of 1', function () {
+        const client = new Cog.Client({transport, maxAttempts: 1});
+        const error = getUserError(client);
+        expect(error.message).toEqual('Too many requests');
+        expect(Cog.identity_provider_error_get_attempts(error)).toEqual(1);
+    });
+
+    it('reports no attempts for errors that are not from the server',
+        function () {
+            const error = new GLib.Error(Gio.IOErrorEnum,
+                Gio.IOErrorEnum.CANCELLED, 'Operation was cancelled');
+            expect(Cog.identity_provider_error_get_attempts(error)).toEqual(0);
+        });
+
+    it('stops retrying when the retry budget is used up', function () {
+        const client = new Cog.Client({
+            transport,
+            maxAttempts: 3,
+            retryBaseDelay: 1,
+            retryBudget: 0,
+        });
+        // The budget starts with 10 retries, enough for 5 of these requests
+        for (let ix = 0; ix < 5; ix++)
+            expect(getUserError(client).message).toMatch(/\(3 attempts\)$/);
+        expect(getUserError(client).message).toEqual('Too many requests');
+    });
+});
+
+describe('Rate limits', function () {
+    let client, path;
+
+    beforeEach(function () {
+        path = makeRecording([
+            {target: 'GetUser', body: JSON.stringify({Username: 'alice'})},
+            {target: 'SignUp', body: JSON.stringify({UserConfirmed: true})},
+        ]);
+        client = new Cog.Client({
+            transport: Cog.Transport.new_replayer(path),
+        });
+    });
+
+    function fetchUserError(token) {
+        try {
+            client.fetch_user(token, null);
+        } catch (e) {
+            return e;
+        }
+        return null;
+    }
+
+    it('fails requests over the limit when none may wait', function () {
+        client.set_rate_limit(Cog.QuotaCategory.USER_ACCOUNT_READ, 1, 2, 0);
+        expect(fetchUserError('token1')).toBeNull();
+        expect(fetchUserError('token2')).toBeNull();
+        const error = fetchUserError('token3');
+        expect(error.matches(Gio.IOErrorEnum, Gio.IOErrorEnum.WOULD_BLOCK))
+            .toBeTruthy();
+    });
+
+    it('makes requests over the limit wait their turn', function () {
+        client.set_rate_limit(Cog.QuotaCategory.USER_ACCOUNT_READ, 10, 1, 1);
+        const start = GLib.get_monotonic_time();
+        expect(fetchUserError('token1')).toBeNull();
+        expect(fetchUserError('token2')).toBeNull();
+        expect(GLib.get_monotonic_time() - start).toBeGreaterThan(90000);
+    });
+
+    it('limits each category separately', function () {
+        client.set_rate_limit(Cog.QuotaCategory.USER_ACCOUNT_READ, 1, 1, 0);
+        expect(fetchUserError('token1')).toBeNull();
+        const [confirmed] = client.sign_up('client', null, 'bob', 'password',
+            null, null, null, null, null);
+        expect(confirmed).toBeTruthy();
+    });
+
+    it('does not hold up other categories while a request waits',
+        async function () {
+            const executor = new Cog.Executor({maxThreads: 1, maxQueued: 4});
+            const limited = new Cog.Client({
+                transport: Cog.Transport.new_replayer(path),
+                executor,
+            });
+            limited.set_rate_limit(Cog.QuotaCategory.USER_ACCOUNT_READ, 2, 1,
+                1);
+            await limited.fetch_user_async('token1', null);
+            const start = GLib.get_monotonic_time();
+            const waiting = limited.fetch_user_async('token2', null);
+            // The only worker thread is free to send this in the meantime
+            await limited.sign_up_async('client', null, 'bob', 'password',
+                null, null, null, null, null);
+            expect(GLib.get_monotonic_time() - start).toBeLessThan(250000);
+            await waiting;
+            expect(GLib.get_monotonic_time() - start).toBeGreaterThan(250000);
+        });
+
+    it('can be removed', function () {
+        client.set_rate_limit(Cog.QuotaCategory.USER_ACCOUNT_READ, 1, 1, 0);
+        expect(fetchUserError('token1')).toBeNull();
+        client.set_rate_limit(Cog.QuotaCategory.USER_ACCOUNT_READ, 0, 0, 0);
+        expect(fetchUserError('token2')).toBeNull();
+    });
+});
+
+describe('Statistics', function () {
+    let client;
+
+    beforeEach(function () {
+        const transport = replayRecording([
+            {target: 'GetUser', body: JSON.stringify({Username: 'alice'})},
+            {
+                target: 'SignUp',
+                status: 400,
+                body: JSON.stringify({
+                    __type: 'UsernameExistsException',
+                    message: 'User already exists',
+                }),
+            },
+        ]);
+        transport.latency = 10000;  // µs
+        client = new Cog.Client({transport});
+    });
+
+    function getStatistics(operation) {
+        const stats = client.get_statistics().deepUnpack()[operation];
+        return Object.fromEntries(Object.entries(stats)
+            .map(([key, value]) => [key, value.deepUnpack()]));
+    }
+
+    it('counts requests and their latency', function () {
+        client.fetch_user('token1', null);
+        client.fetch_user('token2', null);
+        const stats = getStatistics('GetUser');
+        expect(Number(stats.requests)).toEqual(2);
+        expect(stats['in-flight']).toEqual(0);
+        expect(Number(stats.retries)).toEqual(0);
+        expect(Object.keys(stats.errors).length).toEqual(0);
+        expect(Number(stats['latency-sum'])).toBeGreaterThanOrEqual(20000);
+
+        const histogram = stats['latency-histogram'];
+        const total = histogram.reduce((sum, [, count]) => sum + Number(count),
+            0);
+        expect(total).toEqual(2);
+        histogram.forEach(([lowerBound]) =>
+            expect(Number(lowerBound)).toBeGreaterThan(8000));
+    });
+
+    it('counts errors by code', function () {
+        let code;
+        try {
+            client.sign_up('client', null, 'bob', 'password', null, null, null,
+                null, null);
+        } catch (e) {
+            ({code} = e);
+        }
+        const stats = getStatistics('SignUp');
+        expect(Number(stats.requests)).toEqual(1);
+        expect(Number(stats.errors[code])).toEqual(1);
+    });
+
+    it('keeps operations separate', function () {
+        client.fetch_user('token', null);
+        expect(Number(getStatistics('InitiateAuth').requests)).toEqual(0);
+        expect(Number(getStatistics('UpdateUserAttributes').requests))
+            .toEqual(0);
+    });
+});
+
+describe('Request metrics', function () {
+    const LATENCY = 20000;  // µs
+    const BODY = JSON.stringify({Username: 'alice'});
+    let client;
+
+    beforeEach(function () {
+        const transport = replayRecording([{target: 'GetUser', body: BODY}]);
+        transport.latency = LATENCY;
+        client = new Cog.Client({transport});
+    });
+
+    it('are reported for each request', function () {
+        const reports = [];
+        client.connect('request-completed', (self, operation, metrics) => {
+            reports.push({
+                operation,
+                attempts: metrics.attempts,
+                total: metrics.total,
+                timeToFirstByte: metrics.time_to_first_byte,
+                bytesSent: metrics.bytes_sent,
+                bytesReceived: metrics.bytes_received,
+                build: metrics.build,
+                unpack: metrics.unpack,
+            });
+        });
+        client.fetch_user('token', null);
+
+        expect(reports.length).toEqual(1);
+        const [report] = reports;
+        expect(report.operation).toEqual('GetUser');
+        expect(report.attempts).toEqual(1);
+        expect(report.total).toBeGreaterThanOrEqual(LATENCY);
+        expect(report.timeToFirstByte).toBeGreaterThanOrEqual(LATENCY);
+        expect(report.bytesSent).toBeGreaterThan(0);
+        expect(report.bytesReceived).toEqual(BODY.length);
+        expect(report.build).toBeGreaterThanOrEqual(0);
+        expect(report.build).toBeLessThan(report.total);
+        expect(report.unpack).toBeGreaterThanOrEqual(0);
+        expect(report.unpack).toBeLessThan(report.total);
+    });
+
+    // GJS cannot run the handler on one of the client's worker threads
+    it('are reported on the main context for asynchronous requests',
+        async function () {
+            const reported = new Promise(resolve => {
+                client.connect('request-completed', (self, operation, metrics) =>
+                    resolve({operation, attempts: metrics.attempts}));
+            });
+            const [user, report] = await Promise.all([
+                client.fetch_user_async('token', null),
+                reported,
+            ]);
+            expect(user.get_username()).toEqual('alice');
+            expect(report.operation).toEqual('GetUser');
+            expect(report.attempts).toEqual(1);
+        });
+
+    it('are only reported for the operation in the detail', function () {
+        const handler = jasmine.createSpy('handler');
+        client.connect('request-completed::SignUp', handler);
+        client.fetch_user('token', null);
+        expect(handler).not.toHaveBeenCalled();
+    });
+});
+
+describe('Shared backend', function () {
+    let transport;
+
+    beforeEach(function () {
+        transport = replayRecording([{
+            target: 'GetUser',
+            status: 400,
+            body: JSON.stringify({
+                __type: 'TooManyRequestsException',
+                message: 'Too many requests',
+            }),
+        }]);
+    });
+
+    function newClient(props = {}) {
+        return new Cog.Client(Object.assign({
+            transport,
+            maxAttempts: 3,
+            retryBaseDelay: 1,
+            retryBudget: 0,
+        }, props));
+    }
+
+    function getUserError(client) {
+        try {
+            client.get_user('token', null);
+        } catch (e) {
+            return e.message;
+        }
+        return null;
+    }
+
+    // Sharing the SDK client shows up as sharing its retry budget, which
+    // starts with enough retries for 5 of these requests
+    function useUpRetryBudget(client) {
+        for (let ix = 0; ix < 5; ix++)
+            expect(getUserError(client)).toMatch(/\(3 attempts\)$/);
+    }
+
+    it('is shared between clients with the same configuration', function () {
+        const first = newClient({sharedBackend: true});
+        const second = newClient({sharedBackend: true});
+        expect(first.sharedBackend).toBeTruthy();
+        useUpRetryBudget(first);
+        expect(getUserError(second)).toEqual('Too many requests');
+    });
+
+    it('is not shared between clients with different configurations',
+        function () {
+            const first = newClient({sharedBackend: true});
+            const second = newClient({sharedBackend: true, maxAttempts: 2});
+            useUpRetryBudget(first);
+            expect(getUserError(second)).toMatch(/\(2 attempts\)$/);
+        });
+
+    it('is not shared unless requested', function () {
+        const first = newClient({sharedBackend: true});
+        const second = newClient();
+        useUpRetryBudget(first);
+        expect(getUserError(second)).toMatch(/\(3 attempts\)$/);
+    });
+});
+
+describe('Anonymous client', function () {
+    it('sends requests without credentials', function () {
+        const transport = replayRecording([{
+            target: 'GetUser',
+            body: JSON.stringify({Username: 'alice', UserAttributes: []}),
+        }]);
+        transport.keepRequests = true;
+        const client = new Cog.Client({transport, anonymous: true});
+        expect(client.anonymous).toBeTruthy();
+        const [, username] = client.get_user('token', null);
+        expect(username).toEqual('alice');
+
+        const requests = readRequests(transport);
+        expect(requests.length).toEqual(1);
+        const [{target, headers}] = requests;
+        expect(target).toEqual('GetUser');
+        expect(headers['authorization']).toBeUndefined();
+        expect(headers['x-amz-date']).toBeUndefined();
+    });
+});
+
+describe('Prewarming connections', function () {
+    let transport;
+
+    beforeEach(function () {
+        transport = replayRecording([
+            {target: 'GetUser', body: JSON.stringify({Username: 'alice'})},
+        ]);
+    });
+
+    it('does not touch a replaying transport', async function () {
+        const client = new Cog.Client({transport});
+        expect(await client.prewarm_async(4, null)).toBeTruthy();
+        const [, username] = client.get_user('token', null);
+        expect(username).toEqual('alice');
+    });
+
+    it('can rewarm when the network changes', function () {
+        const client = new Cog.Client({transport});
+        expect(client.rewarmOnNetworkChange).toBeFalsy();
+        client.rewarmOnNetworkChange = true;
+        expect(client.rewarmOnNetworkChange).toBeTruthy();
+        client.rewarmOnNetworkChange = false;
+        expect(client.rewarmOnNetworkChange).toBeFalsy();
+    });
+});
+
+describe('Client secret', function () {
+    let transport;
+
+    beforeEach(function () {
+        const notAuthorized = JSON.stringify({
+            __type: 'NotAuthorizedException',
+            message: 'Unable to verify secret hash for client client',
+        });
+        // Requests without the right hash are answered with the first one of
+        // their operation
+        transport = replayRecording([{
+            target: 'SignUp',
+            status: 400,
+            body: notAuthorized,
+        }, {
+            target: 'SignUp',
+            request: JSON.stringify({
+                ClientId: 'client',
+                SecretHash: secretHash('s3cret', 'bob', 'client'),
+                Username: 'bob',
+                Password: 'password',
+            }),
+            body: JSON.stringify({UserConfirmed: true, UserSub: 'bob-sub'}),
+        }, {
+            target: 'InitiateAuth',
+            status: 400,
+            body: notAuthorized,
+        }, {
+            target: 'InitiateAuth',
+            request: JSON.stringify({
+                AuthFlow: 'USER_PASSWORD_AUTH',
+                AuthParameters: {
+                    PASSWORD: 'password',
+                    SECRET_HASH: secretHash('s3cret', 'bob', 'client'),
+                    USERNAME: 'bob',
+                },
+                ClientId: 'client',
+            }),
+            body: JSON.stringify({
+                AuthenticationResult: {AccessToken: 'token', ExpiresIn: 3600},
+            }),
+        }]);
+    });
+
+    function signUpError(client, hash) {
+        try {
+            client.sign_up('client', hash, 'bob', 'password', null, null, null,
+                null, null);
+        } catch (e) {
+            return e;
+        }
+        return null;
+    }
+
+    it('is used to compute the secret hash', function () {
+        const client = new Cog.Client({transport, clientSecret: 's3cret'});
+        const [confirmed] = client.sign_up('client', null, 'bob', 'password',
+            null, null, null, null, null);
+        expect(confirmed).toBeTruthy();
+    });
+
+    it('is used to compute the secret hash of a login', function () {
+        const client = new Cog.Client({transport, clientSecret: 's3cret'});
+        const [, authResult] = client.initiate_auth(
+            Cog.AuthFlow.USER_PASSWORD_AUTH,
+            {USERNAME: 'bob', PASSWORD: 'password'}, 'client', null, null, null,
+            null);
+        expect(authResult.access_token).toEqual('token');
+    });
+
+    it('does not replace a secret hash that was given', function () {
+        const client = new Cog.Client({transport, clientSecret: 's3cret'});
+        const error = signUpError(client, secretHash('other', 'bob', 'client'));
+        expect(error).not.toBeNull();
+        expect(error.matches(Cog.IdentityProviderError,
+            Cog.IdentityProviderError.NOT_AUTHORIZED)).toBeTruthy();
+        expect(error.message).toMatch(/secret hash/);
+    });
+});
+
+describe('Logging in', function () {
+    let client, login;
+
+    beforeEach(function () {
+        const transport = replayRecording([{
+            target: 'InitiateAuth',
+            body: JSON.stringify({
+                ChallengeName: 'SMS_MFA',
+                ChallengeParameters: {USERNAME: 'alice-id'},
+                Session: 'session1',
+            }),
+        }, {
+            target: 'RespondToAuthChallenge',
+            body: JSON.stringify({
+                ChallengeName: 'NEW_PASSWORD_REQUIRED',
+                ChallengeParameters: {USERNAME: 'alice-id'},
+                Session: 'session2',
+            }),
+        }, {
+            target: 'RespondToAuthChallenge',
+            body: JSON.stringify({
+                AuthenticationResult: {AccessToken: 'token', ExpiresIn: 3600},
+            }),
+        }]);
+        client = new Cog.Client({transport});
+        const srpClient = Cog.SrpClient.new('us-east-1_Test');
+        login = Cog.Login.new(srpClient, 'client', 'alice', 'password');
+    });
+
+    function requests(operation) {
+        const stats = client.get_statistics().deepUnpack()[operation];
+        return Number(stats.requests.deepUnpack());
+    }
+
+    it('returns challenges that need input from the user', async function () {
+        const [, authResult, challengeName, parameters] =
+            await client.log_in_async(login, null);
+        expect(authResult).toBeNull();
+        expect(challengeName).toEqual(Cog.ChallengeName.SMS_MFA);
+        expect(parameters['USERNAME']).toEqual('alice-id');
+    });
+
+    it('answers the challenges it can without the app', async function () {
+        login.set_new_password('new password');
+        await client.log_in_async(login, null);
+        const [, authResult, challengeName] = await client
+            .log_in_respond_async(login, {SMS_MFA_CODE: '123456'}, null);
+        expect(challengeName).toEqual(Cog.ChallengeName.NOT_SET);
+        expect(authResult).not.toBeNull();
+        expect(requests('InitiateAuth')).toEqual(1);
+        expect(requests('RespondToAuthChallenge')).toEqual(2);
+    });
+
+    it('leaves a new password to the app if it has none', async function () {
+        await client.log_in_async(login, null);
+        const [, authResult, challengeName] = await client
+            .log_in_respond_async(login, {SMS_MFA_CODE: '123456'}, null);
+        expect(authResult).toBeNull();
+        expect(challengeName)
+            .toEqual(Cog.ChallengeName.NEW_PASSWORD_REQUIRED);
+    });
+
+    describe('with SRP', function () {
+        const SECRET_BLOCK = 'c2VjcmV0IGJsb2Nr';
+        const SIGNATURE = /^[A-Za-z0-9+/]{43}=$/;
+        const TIMESTAMP = /^[A-Z][a-z]{2} [A-Z][a-z]{2} \d{1,2} \d\d:\d\d:\d\d UTC \d{4}$/;
+        const verifierParameters = {
+            SALT: 'a1b2c3d4e5f60718',
+            SRP_B: 'b7'.repeat(64),
+            SECRET_BLOCK,
+        };
+        const authenticated = {
+            target: 'RespondToAuthChallenge',
+            body: JSON.stringify({
+                AuthenticationResult: {AccessToken: 'token', ExpiresIn: 3600},
+            }),
+        };
+        let transport;
+
+        function logInWith(exchanges) {
+            transport = replayRecording(exchanges);
+            transport.keepRequests = true;
+            client = new Cog.Client({transport, clientSecret: 's3cret'});
+            login.set_device('device-key', 'device-group', 'device-password');
+            return client.log_in_async(login, null);
+        }
+
+        it('answers the password verifier', async function () {
+            const [, authResult, challengeName] = await logInWith([{
+                target: 'InitiateAuth',
+                body: JSON.stringify({
+                    ChallengeName: 'PASSWORD_VERIFIER',
+                    ChallengeParameters: Object.assign({
+                        USER_ID_FOR_SRP: 'alice-id',
+                    }, verifierParameters),
+                    Session: 'session1',
+                }),
+            }, authenticated]);
+            expect(challengeName).toEqual(Cog.ChallengeName.NOT_SET);
+            expect(authResult.access_token).toEqual('token');
+
+            const [initiate, respond, ...rest] = readRequests(transport);
+            expect(rest).toEqual([]);
+            expect(initiate.target).toEqual('InitiateAuth');
+            expect(initiate.body.AuthFlow).toEqual('USER_SRP_AUTH');
+            const {AuthParameters: parameters} = initiate.body;
+            expect(parameters.USERNAME).toEqual('alice');
+            expect(parameters.SRP_A).toMatch(/^[0-9a-f]+$/);
+            expect(parameters.DEVICE_KEY).toEqual('device-key');
+            expect(parameters.SECRET_HASH)
+                .toEqual(secretHash('s3cret', 'alice', 'client'));
+
+            expect(respond.target).toEqual('RespondToAuthChallenge');
+            expect(respond.body.ChallengeName).toEqual('PASSWORD_VERIFIER');
+            expect(respond.body.Session).toEqual('session1');
+            const {ChallengeResponses: responses} = respond.body;
+            expect(responses.USERNAME).toEqual('alice-id');
+            expect(responses.PASSWORD_CLAIM_SECRET_BLOCK).toEqual(SECRET_BLOCK);
+            expect(responses.PASSWORD_CLAIM_SIGNATURE).toMatch(SIGNATURE);
+            expect(responses.TIMESTAMP).toMatch(TIMESTAMP);
+            expect(responses.DEVICE_KEY).toEqual('device-key');
+            expect(responses.SECRET_HASH)
+                .toEqual(secretHash('s3cret', 'alice-id', 'client'));
+        });
+
+        it('proves a remembered device', async function () {
+            const [, authResult, challengeName] = await logInWith([{
+                target: 'InitiateAuth',
+                body: JSON.stringify({
+                    ChallengeName: 'PASSWORD_VERIFIER',
+                    ChallengeParameters: Object.assign({
+                        USER_ID_FOR_SRP: 'alice-id',
+                    }, verifierParameters),
+                    Session: 'session1',
+                }),
+            }, {
+                target: 'RespondToAuthChallenge',
+                body: JSON.stringify({
+                    ChallengeName: 'DEVICE_SRP_AUTH',
+                    ChallengeParameters: {USERNAME: 'alice-id'},
+                    Session: 'session2',
+                }),
+            }, {
+                target: 'RespondToAuthChallenge',
+                body: JSON.stringify({
+                    ChallengeName: 'DEVICE_PASSWORD_VERIFIER',
+                    ChallengeParameters: Object.assign({
+                        USERNAME: 'alice-id',
+                    }, verifierParameters),
+                    Session: 'session3',
+                }),
+            }, authenticated]);
+            expect(challengeName).toEqual(Cog.ChallengeName.NOT_SET);
+            expect(authResult.access_token).toEqual('token');
+
+            const [initiate, , srpAuth, verifier, ...rest] =
+                readRequests(transport);
+            expect(rest).toEqual([]);
+
+            expect(srpAuth.body.ChallengeName).toEqual('DEVICE_SRP_AUTH');
+            expect(srpAuth.body.Session).toEqual('session2');
+            const {ChallengeResponses: srpResponses} = srpAuth.body;
+            expect(srpResponses.USERNAME).toEqual('alice-id');
+            expect(srpResponses.SRP_A).toMatch(/^[0-9a-f]+$/);
+            // The device proves itself with a session of its own
+            expect(srpResponses.SRP_A)
+                .not.toEqual(initiate.body.AuthParameters.SRP_A);
+            expect(srpResponses.DEVICE_KEY).toEqual('device-key');
+            expect(srpResponses.SECRET_HASH)
+                .toEqual(secretHash('s3cret', 'alice-id', 'client'));
+
+            expect(verifier.body.ChallengeName)
+                .toEqual('DEVICE_PASSWORD_VERIFIER');
+            expect(verifier.body.Session).toEqual('session3');
+            const {ChallengeResponses: responses} = verifier.body;
+            expect(responses.USERNAME).toEqual('alice-id');
+            expect(responses.PASSWORD_CLAIM_SECRET_BLOCK).toEqual(SECRET_BLOCK);
+            expect(responses.PASSWORD_CLAIM_SIGNATURE).toMatch(SIGNATURE);
+            expect(responses.TIMESTAMP).toMatch(TIMESTAMP);
+            expect(responses.DEVICE_KEY).toEqual('device-key');
+            expect(responses.SECRET_HASH)
+                .toEqual(secretHash('s3cret', 'alice-id', 'client'));
+        });
+    });
 });
@@ -0,0 +1,177 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Checks that the _direct() API calls its callback on a worker thread, without
+ * the main context ever being iterated. */
+
+#include <gio/gio.h>
+#include <glib.h>
+
+#include "cog/cog.h"
+#include "test/recording.h"
+
+#define ACCESS_TOKEN "token"
+#define CLIENT_ID "testclient"
+
+typedef struct
+{
+  RecordingFixture recording;
+  GMutex lock;
+  GCond cond;
+  gboolean done;
+  GThread *callback_thread;
+  char *username;
+  char *access_token;
+  GError *error;
+} Fixture;
+
+static const RecordedExchange exchanges[] = {
+  {"GetUser",
+   "{\"Username\": \"alice\", \"UserAttributes\": "
+   "[{\"Name\": \"email\", \"Value\": \"alice@example.com\"}]}"},
+  {"InitiateAuth",
+   "{\"AuthenticationResult\": {\"AccessToken\": \"access\", "
+   "\"ExpiresIn\": 3600, \"IdToken\": \"id\", "
+   "\"RefreshToken\": \"refresh\", \"TokenType\": \"Bearer\"}}"},
+};
+
+static void
+fixture_set_up (Fixture *fixture,
+                const void *data G_GNUC_UNUSED)
+{
+  recording_fixture_set_up (&fixture->recording, exchanges,
+                            G_N_ELEMENTS (exchanges));
+  g_mutex_init (&fixture->lock);
+  g_cond_init (&fixture->cond);
+}
+
+static void
+fixture_tear_down (Fixture *fixture,
+                   const void *data G_GNUC_UNUSED)
+{
+  g_mutex_clear (&fixture->lock);
+  g_cond_clear (&fixture->cond);
+  g_clear_error (&fixture->error);
+  g_free (fixture->username);
+  g_free (fixture->access_token);
+  recording_fixture_tear_down (&fixture->recording);
+}
+
+static void
+signal_done (Fixture *fixture,
+             const GError *error)
+{
+  g_mutex_lock (&fixture->lock);
+  fixture->callback_thread = g_thread_self ();
+  if (error)
+    fixture->error = g_error_copy (error);
+  fixture->done = TRUE;
+  g_cond_signal (&fixture->cond);
+  g_mutex_unlock (&fixture->lock);
+}
+
+static void
+wait_for_done (Fixture *fixture)
+{
+  g_mutex_lock (&fixture->lock);
+  while (!fixture->done)
+    g_cond_wait (&fixture->cond, &fixture->lock);
+  g_mutex_unlock (&fixture->lock);
+
+  g_assert_false (g_main_context_pending (NULL));
+}
+
+static void
+on_user_fetched (CogClient *client G_GNUC_UNUSED,
+                 CogUser *user,
+                 const GError *error,
+                 void *data)
+{
+  Fixture *fixture = data;
+  if (user)
+    fixture->username = g_strdup (cog_user_get_username (user));
+  signal_done (fixture, error);
+}
+
+static void
+on_auth_initiated (CogClient *client G_GNUC_UNUSED,
+                   CogAuthenticationResult *auth_result,
+                   CogChallengeName challenge_name,
+                   GHashTable *challenge_parameters G_GNUC_UNUSED,
+                   const char *session G_GNUC_UNUSED,
+                   const GError *error,
+                   void *data)
+{
+  Fixture *fixture = data;
+  if (auth_result)
+    {
+      g_assert_cmpint (challenge_name, ==, COG_CHALLENGE_NAME_NOT_SET);
+      fixture->access_token = g_strdup (auth_result->access_token);
+    }
+  signal_done (fixture, error);
+}
+
+static void
+test_fetch_user (Fixture *fixture,
+                 const void *data G_GNUC_UNUSED)
+{
+  cog_client_fetch_user_direct (fixture->recording.client, ACCESS_TOKEN, NULL,
+                                on_user_fetched, fixture);
+  wait_for_done (fixture);
+
+  g_assert_no_error (fixture->error);
+  g_assert_cmpstr (fixture->username, ==, "alice");
+  g_assert_true (fixture->callback_thread != g_thread_self ());
+}
+
+static void
+test_initiate_auth (Fixture *fixture,
+                    const void *data G_GNUC_UNUSED)
+{
+  GHashTable *auth_parameters = g_hash_table_new (g_str_hash, g_str_equal);
+  g_hash_table_insert (auth_parameters, COG_PARAMETER_USERNAME, "alice");
+  g_hash_table_insert (auth_parameters, COG_PARAMETER_PASSWORD, "password");
+  cog_client_initiate_auth_direct (fixture->recording.client,
+                                   COG_AUTH_FLOW_USER_PASSWORD_AUTH,
+                                   auth_parameters, CLIENT_ID, NULL, NULL,
+                                   NULL, NULL, on_auth_initiated, fixture);
+  g_hash_table_unref (auth_parameters);
+  wait_for_done (fixture);
+
+  g_assert_no_error (fixture->error);
+  g_assert_cmpstr (fixture->access_token, ==, "access");
+  g_assert_true (fixture->callback_thread != g_thread_self ());
+}
+
+static void
+test_cancelled (Fixture *fixture,
+                const void *data G_GNUC_UNUSED)
+{
+  GCancellable *cancellable = g_cancellable_new ();
+  g_cancellable_cancel (cancellable);
+  cog_client_fetch_user_direct (fixture->recording.client, ACCESS_TOKEN,
+                                cancellable, on_user_fetched, fixture);
+  g_object_unref (cancellable);
+  wait_for_done (fixture);
+
+  g_assert_error (fixture->error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_null (fixture->username);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+  cog_init_default ();
+
+  g_test_add ("/direct/fetch-user", Fixture, NULL,
+              fixture_set_up, test_fetch_user, fixture_tear_down);
+  g_test_add ("/direct/initiate-auth", Fixture, NULL,
+              fixture_set_up, test_initiate_auth, fixture_tear_down);
+  g_test_add ("/direct/cancelled", Fixture, NULL,
+              fixture_set_up, test_cancelled, fixture_tear_down);
+
+  int retval = g_test_run ();
+  cog_shutdown ();
+  return retval;
+}
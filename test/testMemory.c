@@ -0,0 +1,73 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Checks that with pooled memory, the memory allocated through the AWS SDK is
+ * counted under its allocation tag, and given back when freed. */
+
+#include <glib.h>
+
+#include "cog/cog.h"
+
+static gboolean
+get_tag_statistics (const char *tag,
+                    guint64 *live_bytes,
+                    guint64 *n_allocations)
+{
+  GVariant *statistics = cog_get_memory_statistics ();
+  g_assert_nonnull (statistics);
+
+  GVariant *entry = g_variant_lookup_value (statistics, tag,
+                                            G_VARIANT_TYPE_VARDICT);
+  g_variant_unref (statistics);
+  if (!entry)
+    return FALSE;
+
+  g_assert_true (g_variant_lookup (entry, "live-bytes", "t", live_bytes));
+  g_assert_true (g_variant_lookup (entry, "allocations", "t", n_allocations));
+  g_variant_unref (entry);
+  return TRUE;
+}
+
+static void
+test_client_memory (void)
+{
+  guint64 live_bytes, n_allocations;
+  if (!get_tag_statistics ("libcog", &live_bytes, &n_allocations))
+    {
+      g_test_skip ("The AWS SDK was built without custom memory management");
+      return;
+    }
+
+  CogClient *client = cog_client_new ();
+
+  guint64 client_live_bytes, client_n_allocations;
+  g_assert_true (get_tag_statistics ("libcog", &client_live_bytes,
+                                     &client_n_allocations));
+  g_assert_cmpuint (client_live_bytes, >, live_bytes);
+  g_assert_cmpuint (client_n_allocations, >, n_allocations);
+
+  g_object_unref (client);
+
+  guint64 freed_live_bytes, freed_n_allocations;
+  g_assert_true (get_tag_statistics ("libcog", &freed_live_bytes,
+                                     &freed_n_allocations));
+  g_assert_cmpuint (freed_live_bytes, ==, live_bytes);
+  g_assert_cmpuint (freed_n_allocations, ==, client_n_allocations);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  CogInitOptions *init_options = cog_init_options_new ();
+  cog_init_options_set_pooled_memory (init_options, TRUE);
+  cog_init_with_options (init_options);
+  cog_init_options_unref (init_options);
+
+  g_test_add_func ("/memory/client", test_client_memory);
+
+  int retval = g_test_run ();
+  cog_shutdown ();
+  return retval;
+}
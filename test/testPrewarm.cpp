@@ -0,0 +1,221 @@
+/* Copyright 2018 Endless Mobile, Inc. */
+
+/* Checks how prewarming fans out its connections and sums up their results,
+ * with a fake network client in place of the one that would reach the
+ * service. */
+
+#include <atomic>
+
+#include <aws/core/client/CoreErrors.h>
+#include <aws/core/http/HttpClient.h>
+#include <aws/core/http/HttpRequest.h>
+#include <aws/core/http/standard/StandardHttpResponse.h>
+#include <aws/core/utils/threading/Executor.h>
+#include <gio/gio.h>
+#include <glib.h>
+
+#include "cog/cog.h"
+#include "cog/cog-prewarm-private.h"
+
+#define ENDPOINT "https://cognito-idp.cn-north-1.amazonaws.com.cn/"
+#define N_CONNECTIONS 4
+
+using Aws::Utils::RateLimits::RateLimiterInterface;
+
+/* Fails the first @n_failing requests it gets, with no response at all for
+ * the first if @respond_null, and answers the rest */
+class FakeNetworkClient : public Aws::Http::HttpClient {
+  unsigned m_n_failing;
+  bool m_respond_null;
+public:
+  mutable std::atomic<unsigned> n_requests;
+  mutable std::atomic<unsigned> n_elsewhere;  /* not sent to ENDPOINT */
+
+  FakeNetworkClient (unsigned n_failing,
+                     bool respond_null = false)
+    : m_n_failing (n_failing), m_respond_null (respond_null),
+      n_requests (0), n_elsewhere (0) {}
+
+  std::shared_ptr<Aws::Http::HttpResponse>
+  MakeRequest (const std::shared_ptr<Aws::Http::HttpRequest>& request,
+               RateLimiterInterface *read_limiter G_GNUC_UNUSED = nullptr,
+               RateLimiterInterface *write_limiter G_GNUC_UNUSED = nullptr) const override
+  {
+    unsigned ix = n_requests++;
+    if (request->GetURIString () != ENDPOINT)
+      n_elsewhere++;
+    if (ix == 0 && m_respond_null && m_n_failing > 0)
+      return nullptr;
+
+    auto response =
+      std::make_shared<Aws::Http::Standard::StandardHttpResponse> (request);
+    if (ix < m_n_failing)
+      {
+        response->SetClientErrorType (Aws::Client::CoreErrors::NETWORK_CONNECTION);
+        g_autofree char *message = g_strdup_printf ("Connection %u refused",
+                                                    ix);
+        response->SetClientErrorMessage (message);
+        return response;
+      }
+    /* Any status will do */
+    response->SetResponseCode (Aws::Http::HttpResponseCode::NOT_FOUND);
+    return response;
+  }
+};
+
+/* Runs each job as soon as it is submitted, so that prewarming is done by the
+ * time it returns */
+class InlineExecutor : public Aws::Utils::Threading::Executor {
+protected:
+  bool
+  SubmitToThread (std::function<void ()>&& job) override
+  {
+    job ();
+    return true;
+  }
+};
+
+/* Like an executor whose queue is full */
+class RefusingExecutor : public Aws::Utils::Threading::Executor {
+protected:
+  bool
+  SubmitToThread (std::function<void ()>&& job G_GNUC_UNUSED) override
+  {
+    return false;
+  }
+};
+
+typedef struct
+{
+  unsigned n_calls;
+  unsigned n_opened;
+  GError *error;
+} Result;
+
+static void
+prewarm (const std::shared_ptr<FakeNetworkClient>& network_client,
+         Aws::Utils::Threading::Executor& executor,
+         GCancellable *cancellable,
+         Result *result)
+{
+  *result = { 0, 0, NULL };
+  _cog_prewarm (network_client, ENDPOINT, executor, N_CONNECTIONS, cancellable,
+                [result] (unsigned n_opened, GError *error)
+                {
+                  result->n_calls++;
+                  result->n_opened = n_opened;
+                  result->error = error;
+                });
+  g_assert_cmpuint (result->n_calls, ==, 1);
+}
+
+static void
+test_fan_out (void)
+{
+  auto network_client = std::make_shared<FakeNetworkClient> (0);
+  InlineExecutor executor;
+  Result result;
+  prewarm (network_client, executor, NULL, &result);
+
+  g_assert_no_error (result.error);
+  g_assert_cmpuint (result.n_opened, ==, N_CONNECTIONS);
+  g_assert_cmpuint (network_client->n_requests, ==, N_CONNECTIONS);
+  g_assert_cmpuint (network_client->n_elsewhere, ==, 0);
+}
+
+static void
+test_some_failed (void)
+{
+  auto network_client = std::make_shared<FakeNetworkClient> (N_CONNECTIONS - 1,
+                                                             true);
+  InlineExecutor executor;
+  Result result;
+  prewarm (network_client, executor, NULL, &result);
+
+  g_assert_no_error (result.error);
+  g_assert_cmpuint (result.n_opened, ==, 1);
+  g_assert_cmpuint (network_client->n_requests, ==, N_CONNECTIONS);
+}
+
+static void
+test_all_failed (void)
+{
+  auto network_client = std::make_shared<FakeNetworkClient> (N_CONNECTIONS);
+  InlineExecutor executor;
+  Result result;
+  prewarm (network_client, executor, NULL, &result);
+
+  /* Only the first error is kept */
+  g_assert_error (result.error, COG_IDENTITY_PROVIDER_ERROR,
+                  COG_IDENTITY_PROVIDER_ERROR_NETWORK_CONNECTION);
+  g_assert_cmpstr (result.error->message, ==,
+                   "Could not connect to " ENDPOINT ": Connection 0 refused");
+  g_assert_cmpuint (result.n_opened, ==, 0);
+  g_assert_cmpuint (network_client->n_requests, ==, N_CONNECTIONS);
+  g_clear_error (&result.error);
+}
+
+static void
+test_no_response (void)
+{
+  auto network_client = std::make_shared<FakeNetworkClient> (N_CONNECTIONS,
+                                                             true);
+  InlineExecutor executor;
+  Result result;
+  prewarm (network_client, executor, NULL, &result);
+
+  g_assert_error (result.error, COG_IDENTITY_PROVIDER_ERROR,
+                  COG_IDENTITY_PROVIDER_ERROR_NETWORK_CONNECTION);
+  g_assert_cmpstr (result.error->message, ==,
+                   "Could not connect to " ENDPOINT ": no response");
+  g_clear_error (&result.error);
+}
+
+static void
+test_busy (void)
+{
+  auto network_client = std::make_shared<FakeNetworkClient> (0);
+  RefusingExecutor executor;
+  Result result;
+  prewarm (network_client, executor, NULL, &result);
+
+  g_assert_error (result.error, G_IO_ERROR, G_IO_ERROR_BUSY);
+  g_assert_cmpuint (result.n_opened, ==, 0);
+  g_assert_cmpuint (network_client->n_requests, ==, 0);
+  g_clear_error (&result.error);
+}
+
+static void
+test_cancelled (void)
+{
+  auto network_client = std::make_shared<FakeNetworkClient> (0);
+  InlineExecutor executor;
+  GCancellable *cancellable = g_cancellable_new ();
+  g_cancellable_cancel (cancellable);
+  Result result;
+  prewarm (network_client, executor, cancellable, &result);
+  g_object_unref (cancellable);
+
+  g_assert_error (result.error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_cmpuint (network_client->n_requests, ==, 0);
+  g_clear_error (&result.error);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+  cog_init_default ();
+
+  g_test_add_func ("/prewarm/fan-out", test_fan_out);
+  g_test_add_func ("/prewarm/some-failed", test_some_failed);
+  g_test_add_func ("/prewarm/all-failed", test_all_failed);
+  g_test_add_func ("/prewarm/no-response", test_no_response);
+  g_test_add_func ("/prewarm/busy", test_busy);
+  g_test_add_func ("/prewarm/cancelled", test_cancelled);
+
+  int retval = g_test_run ();
+  cog_shutdown ();
+  return retval;
+}
@@ -0,0 +1,116 @@
+const {Cog, GLib} = imports.gi;
+const ByteArray = imports.byteArray;
+const {readRequests, removeRecordings, replayRecording, secretHash,
+    writeRecording} = imports.test.recording;
+
+const CLIENT_ID = 'testclient';
+
+function authResponse(accessToken, expiresIn) {
+    return JSON.stringify({
+        AuthenticationResult: {
+            AccessToken: accessToken,
+            ExpiresIn: expiresIn,
+            IdToken: `id-${accessToken}`,
+            RefreshToken: 'refresh',
+            TokenType: 'Bearer',
+        },
+    });
+}
+
+describe('Session', function () {
+    let tmpdir;
+
+    beforeAll(function () {
+        Cog.init_default();
+        tmpdir = GLib.Dir.make_tmp('libcog-test-XXXXXX');
+    });
+
+    // Logs in with a client whose first InitiateAuth response has tokens that
+    // expire after initialExpiresIn seconds, and whose subsequent responses
+    // have refreshed tokens
+    function logIn(initialExpiresIn) {
+        const path = GLib.build_filenamev([tmpdir, 'session.rec']);
+        writeRecording(path, [
+            {target: 'InitiateAuth', body: authResponse('first', initialExpiresIn)},
+            {target: 'InitiateAuth', body: authResponse('refreshed', 3600)},
+        ]);
+        const client = new Cog.Client({
+            transport: Cog.Transport.new_replayer(path),
+        });
+        const [, authResult] = client.initiate_auth(
+            Cog.AuthFlow.USER_PASSWORD_AUTH,
+            {USERNAME: 'alice', PASSWORD: 'password'}, CLIENT_ID, null, null,
+            null, null);
+        return Cog.Session.new(client, CLIENT_ID, authResult);
+    }
+
+    it('returns valid tokens without refreshing', function () {
+        const session = logIn(3600);
+        expect(session.get_access_token(null)).toEqual('first');
+        expect(session.get_id_token(null)).toEqual('id-first');
+        expect(session.get_refresh_count()).toEqual(0);
+    });
+
+    it('refreshes expired tokens', function () {
+        const session = logIn(0);
+        expect(session.get_access_token(null)).toEqual('refreshed');
+        expect(session.get_id_token(null)).toEqual('id-refreshed');
+        expect(session.get_refresh_count()).toEqual(1);
+    });
+
+    it('refreshes only once for concurrent requests', async function () {
+        const session = logIn(0);
+        const tokens = await Promise.all([...Array(5)].map(() =>
+            session.get_access_token_async(null)));
+        expect(tokens).toEqual(Array(5).fill('refreshed'));
+        expect(session.get_refresh_count()).toEqual(1);
+    });
+
+    describe('with a client secret', function () {
+        const SUB = '6f1c2a8e-5b7d-4e3a-9c0f-2d4b6a8e1c3f';
+
+        afterAll(removeRecordings);
+
+        // An unsigned JSON Web Token with the given claims
+        function makeToken(claims) {
+            const payload = GLib.base64_encode(
+                ByteArray.fromString(JSON.stringify(claims)))
+                .replace(/\+/g, '-').replace(/\//g, '_').replace(/=+$/, '');
+            return `e30.${payload}.`;
+        }
+
+        it("refreshes with the secret hash of the user's sub", function () {
+            const transport = replayRecording([{
+                target: 'InitiateAuth',
+                body: JSON.stringify({
+                    AuthenticationResult: {
+                        AccessToken: 'first',
+                        ExpiresIn: 0,
+                        IdToken: makeToken({sub: SUB}),
+                        RefreshToken: 'refresh',
+                        TokenType: 'Bearer',
+                    },
+                }),
+            }, {
+                target: 'InitiateAuth',
+                body: authResponse('refreshed', 3600),
+            }]);
+            transport.keepRequests = true;
+            const client = new Cog.Client({transport, clientSecret: 's3cret'});
+            const [, authResult] = client.initiate_auth(
+                Cog.AuthFlow.USER_PASSWORD_AUTH,
+                {USERNAME: 'alice', PASSWORD: 'password'}, CLIENT_ID, null,
+                null, null, null);
+            const session = Cog.Session.new(client, CLIENT_ID, authResult);
+
+            expect(session.get_access_token(null)).toEqual('refreshed');
+            const [, refresh] = readRequests(transport);
+            expect(refresh.body.AuthFlow).toEqual('REFRESH_TOKEN_AUTH');
+            expect(refresh.body.AuthParameters).toEqual({
+                REFRESH_TOKEN: 'refresh',
+                SECRET_HASH: secretHash('s3cret', SUB, CLIENT_ID),
+                USERNAME: SUB,
+            });
+        });
+    });
+});
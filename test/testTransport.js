@@ -0,0 +1,68 @@
+const {Cog, GLib} = imports.gi;
+const {writeRecording} = imports.test.recording;
+
+const GET_USER_RESPONSE = JSON.stringify({
+    Username: 'alice',
+    UserAttributes: [{Name: 'email', Value: 'alice@example.com'}],
+});
+
+describe('Transport', function () {
+    let tmpdir;
+
+    beforeAll(function () {
+        Cog.init_default();
+        tmpdir = GLib.Dir.make_tmp('libcog-test-XXXXXX');
+    });
+
+    it('can be constructed as a recorder', function () {
+        const path = GLib.build_filenamev([tmpdir, 'recorder.rec']);
+        const transport = Cog.Transport.new_recorder(path);
+        expect(transport.mode).toEqual(Cog.TransportMode.RECORD);
+        expect(transport.get_n_exchanges()).toEqual(0);
+        void new Cog.Client({transport});
+    });
+
+    it('saves a recording that can be replayed', function () {
+        const path = GLib.build_filenamev([tmpdir, 'empty.rec']);
+        Cog.Transport.new_recorder(path).save();
+        const transport = Cog.Transport.new_replayer(path);
+        expect(transport.mode).toEqual(Cog.TransportMode.REPLAY);
+        expect(transport.get_n_exchanges()).toEqual(0);
+    });
+
+    it('fails to replay a file that is not a recording', function () {
+        const path = GLib.build_filenamev([tmpdir, 'bogus.rec']);
+        GLib.file_set_contents(path, 'bogus');
+        expect(() => Cog.Transport.new_replayer(path)).toThrow();
+        expect(() => Cog.Transport.new_replayer(`${path}.missing`)).toThrow();
+    });
+
+    it('answers requests from a recording', function () {
+        const path = GLib.build_filenamev([tmpdir, 'get-user.rec']);
+        writeRecording(path, [{
+            target: 'GetUser',
+            request: '{"AccessToken":"recorded-token"}',
+            status: 200,
+            body: GET_USER_RESPONSE,
+        }]);
+        const transport = Cog.Transport.new_replayer(path);
+        expect(transport.get_n_exchanges()).toEqual(1);
+        const client = new Cog.Client({transport});
+        const [, username, attributes] = client.get_user('other-token', null);
+        expect(username).toEqual('alice');
+        expect(attributes['email']).toEqual('alice@example.com');
+    });
+
+    it('fails requests that were not recorded', function () {
+        const path = GLib.build_filenamev([tmpdir, 'empty-replay.rec']);
+        writeRecording(path, []);
+        const client = new Cog.Client({
+            transport: Cog.Transport.new_replayer(path),
+            maxAttempts: 3,
+            retryBaseDelay: 1,
+        });
+        // Fails on the first attempt, without retrying
+        expect(() => client.get_user('token', null)).toThrowError(
+            Cog.IdentityProviderError, /^No recorded exchange for [^(]*$/);
+    });
+});
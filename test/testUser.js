@@ -0,0 +1,69 @@
+const {Cog, GLib} = imports.gi;
+const {writeRecording} = imports.test.recording;
+
+describe('User', function () {
+    let client;
+
+    beforeAll(function () {
+        Cog.init_default();
+        const tmpdir = GLib.Dir.make_tmp('libcog-test-XXXXXX');
+        const path = GLib.build_filenamev([tmpdir, 'user.rec']);
+        writeRecording(path, [{
+            target: 'GetUser',
+            body: JSON.stringify({
+                Username: 'alice',
+                UserAttributes: [
+                    {Name: 'sub', Value: '0123-4567'},
+                    {Name: 'email', Value: 'alice@example.com'},
+                    {Name: 'email_verified', Value: 'true'},
+                    {Name: 'custom:team', Value: 'blue'},
+                ],
+                UserMFASettingList: ['SOFTWARE_TOKEN_MFA'],
+            }),
+        }]);
+        client = new Cog.Client({transport: Cog.Transport.new_replayer(path)});
+    });
+
+    it('holds the username and MFA settings', function () {
+        const user = client.fetch_user('token', null);
+        expect(user.get_username()).toEqual('alice');
+        expect(user.get_preferred_mfa_setting()).toBeNull();
+        expect(user.get_mfa_settings()).toEqual(['SOFTWARE_TOKEN_MFA']);
+        expect(user.dup_mfa_options()).toEqual([]);
+    });
+
+    it('looks up attributes by name', function () {
+        const user = client.fetch_user('token', null);
+        expect(user.get_n_attributes()).toEqual(4);
+        expect(user.get_attribute('sub')).toEqual('0123-4567');
+        expect(user.get_attribute('email')).toEqual('alice@example.com');
+        expect(user.get_attribute('custom:team')).toEqual('blue');
+        expect(user.get_attribute('phone_number')).toBeNull();
+        expect(user.get_attribute('zzz')).toBeNull();
+    });
+
+    it('gives all attributes as a dictionary', function () {
+        const user = client.fetch_user('token', null);
+        expect(user.get_attributes()).toEqual({
+            sub: '0123-4567',
+            email: 'alice@example.com',
+            email_verified: 'true',
+            'custom:team': 'blue',
+        });
+    });
+
+    it('can be fetched asynchronously', async function () {
+        const user = await client.fetch_user_async('token', null);
+        expect(user.get_username()).toEqual('alice');
+    });
+
+    it('is returned from batch lookups', async function () {
+        const [item] = await client.get_user_batch_async(['token'], 0, null,
+            null);
+        const user = item.get_user_object();
+        expect(user.get_attribute('email')).toEqual('alice@example.com');
+        const [, username, attributes] = item.get_user();
+        expect(username).toEqual('alice');
+        expect(attributes['custom:team']).toEqual('blue');
+    });
+});